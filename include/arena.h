@@ -0,0 +1,82 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+static const size_t LOOP_ARENA_BYTES = 12288;
+static const size_t WEB_ARENA_BYTES = 12288;
+
+struct ArenaStats {
+  size_t capacity = 0;
+  size_t used = 0;
+  size_t highWater = 0;
+  uint32_t fallbacks = 0;
+};
+
+// Bump allocator for short-lived JSON documents and strings. The buffer is
+// allocated once; memory is reclaimed by rewinding to a mark, so transient
+// work never splits the long-lived heap. Requests that do not fit fall back
+// to malloc and are freed individually.
+//
+// Each arena must only be used from one task: `loopArena` from loop(),
+// `webArena` from AsyncTCP callbacks. The buffer and fallbacks come from
+// `parent` when given (the soak benchmark passes a model of the ESP heap).
+class ArenaAllocator : public ArduinoJson::Allocator {
+public:
+  explicit ArenaAllocator(size_t capacity, ArduinoJson::Allocator* parent = nullptr);
+  void* allocate(size_t size) override;
+  void deallocate(void* ptr) override;
+  void* reallocate(void* ptr, size_t newSize) override;
+
+  size_t mark() const;
+  void rewind(size_t mark);
+  ArenaStats stats() const;
+
+private:
+  bool owns(const void* ptr) const;
+  size_t blockSize(const void* ptr) const;
+
+  void* heapAllocate(size_t size);
+  void heapFree(void* ptr);
+
+  ArduinoJson::Allocator* parent;
+  uint8_t* buffer = nullptr;
+  size_t capacity;
+  size_t used = 0;
+  size_t lastBlock = SIZE_MAX;
+  size_t highWater = 0;
+  uint32_t fallbacks = 0;
+};
+
+// Rewinds the arena to its state at construction. Declare it before any
+// document or buffer that allocates from the arena.
+class ArenaScope {
+public:
+  explicit ArenaScope(ArenaAllocator& a) : arena(a), saved(a.mark()) {}
+  ~ArenaScope() { arena.rewind(saved); }
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+  ArenaAllocator& arena;
+  size_t saved;
+};
+
+// Growable character buffer in an arena, usable as a serializeJson() target.
+class ArenaString : public Print {
+public:
+  explicit ArenaString(ArenaAllocator& a) : arena(a) {}
+  ~ArenaString() { if (data) arena.deallocate(data); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t n) override;
+  const char* c_str() const { return data ? data : ""; }
+  size_t length() const { return len; }
+
+private:
+  ArenaAllocator& arena;
+  char* data = nullptr;
+  size_t len = 0;
+  size_t cap = 0;
+};
+
+extern ArenaAllocator loopArena;
+extern ArenaAllocator webArena;
@@ -0,0 +1,64 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+
+static const uint8_t MAX_HISTORY_HOSTS = 16;
+static const uint16_t HISTORY_HOURS = 168;        // 7 days of hourly buckets
+static const uint8_t HISTORY_TRANSITIONS = 32;
+static const uint8_t HISTORY_RTT_SLOTS = 48;      // 24 h of 30-minute RTT means
+static const uint16_t HISTORY_QUANTUM_S = 15;     // hourly buckets count 15 s units
+static const uint32_t HISTORY_SAVE_INTERVAL_MS = 3600000;
+
+// Fixed-size availability record for one static host. State is kept as
+// run-length transitions (start of each run, bit 31 set when online) plus
+// per-hour observed/online time, so uptime over a window is a sum of at most
+// HISTORY_HOURS buckets and never touches individual probe results.
+struct HostHistory {
+  uint32_t key = 0;  // hash of the host address, 0 marks a free slot
+  uint32_t lastObsS = 0;
+  bool online = false;
+  uint8_t transitionHead = 0;
+  uint8_t transitionCount = 0;
+  uint16_t hourObsS = 0;  // current hour, in seconds
+  uint16_t hourOnS = 0;
+  uint32_t transitions[HISTORY_TRANSITIONS];
+  uint8_t obs[HISTORY_HOURS];  // completed hours, in HISTORY_QUANTUM_S units
+  uint8_t on[HISTORY_HOURS];
+  uint16_t rttMs[HISTORY_RTT_SLOTS];
+  uint8_t rttCount[HISTORY_RTT_SLOTS];
+};
+
+struct Outage {
+  uint32_t startS = 0;
+  uint32_t durationS = 0;
+  bool ongoing = false;
+};
+
+// Times are seconds on a history clock that continues from the last saved
+// value after a reboot; the device has no wall clock, so time spent powered
+// off is simply not observed.
+class AvailabilityHistory {
+public:
+  explicit AvailabilityHistory(fs::FS& filesystem = LittleFS);
+  void load();
+  bool save();
+  void record(const String& host, bool online, uint16_t rttMs);
+  uint32_t now() const;
+  const HostHistory* find(const String& host) const;
+  float uptime(const HostHistory& h, uint16_t hours) const;
+  size_t outages(const HostHistory& h, uint32_t windowS, Outage* out, size_t max) const;
+  uint16_t rttAgo(const HostHistory& h, uint8_t slotsAgo) const;
+
+private:
+  static uint32_t keyFor(const String& host);
+  HostHistory& slotFor(uint32_t key);
+  void advance(uint32_t nowS);
+  void accrue(HostHistory& h, uint32_t from, uint32_t to, bool online);
+  void reset();
+
+  fs::FS& storage;
+  HostHistory hosts[MAX_HISTORY_HOSTS];
+  uint32_t baseS = 0;
+  uint32_t currentHour = 0;
+  uint32_t currentRttSlot = 0;
+};
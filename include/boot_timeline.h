@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+enum class BootPhase : uint8_t {
+  Web,          // HTTP server listening
+  Wifi,         // station link up
+  Mqtt,         // broker connected
+  FirstProbe,   // first scan probe done
+  FirstState,   // first host or subnet state published
+  Discovery,    // Home Assistant discovery sent
+  Count
+};
+
+// Milliseconds since reset at which each startup stage of this boot was
+// first reached; zero until then. Later reconnects do not move a mark.
+class BootTimeline {
+public:
+  void mark(BootPhase phase);
+  void mark(BootPhase phase, uint32_t atMs);
+  bool reached(BootPhase phase) const;
+  uint32_t at(BootPhase phase) const;
+  void writeJson(JsonObject out) const;
+
+private:
+  uint32_t atMs[static_cast<uint8_t>(BootPhase::Count)] = {};
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+
+static const size_t CAPTIVE_DNS_BUFFER_SIZE = 512;   // the classic DNS-over-UDP limit
+static const uint8_t CAPTIVE_DNS_PACKETS_PER_LOOP = 4;
+
+// Answers every A query with the portal's address so phones and laptops open
+// the configuration page. The core's DNSServer hides its socket and has to be
+// polled; this one is a plain non-blocking lwIP socket that socketFd() hands
+// to the event loop's watcher, so queries wake the loop instead of a timer.
+// buildReply() is the whole protocol path, so it can be tested without sockets.
+class CaptiveDns {
+public:
+  bool start(uint16_t port, uint32_t answerIp);
+  void stop();
+  void drain();
+  int socketFd() const;
+  uint32_t answered() const;
+
+  static size_t buildReply(const uint8_t* query, size_t len, uint32_t answerIp, uint8_t* out, size_t outLen);
+
+private:
+  int fd = -1;
+  uint32_t answerIp = 0;
+  uint32_t answers = 0;
+  uint8_t buffer[CAPTIVE_DNS_BUFFER_SIZE];
+};
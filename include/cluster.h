@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "config_store.h"
+#include "mqtt_manager.h"
+
+static const uint8_t CLUSTER_MAX_NODES = 8;
+static const uint8_t CLUSTER_VNODES = 16;      // ring points per node
+static const uint8_t CLUSTER_BLOCK_BITS = 6;   // addresses are assigned in 64-address blocks
+
+struct ClusterStats {
+  bool enabled = false;
+  bool leader = false;
+  uint32_t epoch = 0;
+  uint8_t members = 0;
+  uint32_t rebalances = 0;
+};
+
+// Coordination between several units sharing one broker. Every node keeps a
+// retained `online` on its node topic (with an `offline` will). The online node
+// with the lowest id leads: it publishes the retained member list, and every
+// node hashes address blocks and static hosts onto a ring built from that
+// list. Followers report per-subnet counts for their shard; the leader
+// publishes the totals on the usual subnet topics.
+class Cluster {
+public:
+  Cluster(Config& cfg, MqttManager& mqtt);
+  void begin();
+  void loop();
+  bool enabled() const;
+  bool isLeader() const;
+  const String& nodeId() const;
+
+  bool ownsAddress(uint32_t ip) const;
+  bool ownsHost(const String& host) const;
+  uint32_t blockEnd(uint32_t ip) const;
+
+  void reportSubnet(size_t index, uint16_t online, uint16_t found);
+  void finishSweep();
+  ClusterStats stats() const;
+
+private:
+  struct Member {
+    String id;
+    bool online = false;
+  };
+  struct ShardCounts {
+    String node;
+    std::vector<uint16_t> online;
+    std::vector<uint16_t> found;
+  };
+
+  void onConnected();
+  void onMessage(const char* topic, const uint8_t* payload, unsigned int len);
+  void setMember(const String& id, bool online);
+  bool isOnline(const String& node) const;
+  void clearCounts(const String& node);
+  void applyAssignment(const uint8_t* payload, unsigned int len);
+  void applyCounts(const String& node, const uint8_t* payload, unsigned int len);
+  void rebuildRing(const std::vector<String>& ids);
+  void publishAssignment();
+  void publishTotals(size_t index);
+  const String* electLeader() const;
+  bool ownsKey(uint32_t key) const;
+
+  Config& config;
+  MqttManager& mqtt;
+  String id;
+  String nodeTopic;
+  std::vector<Member> members;
+  std::vector<String> ringIds;
+  std::vector<std::pair<uint32_t, uint8_t>> ring;
+  std::vector<ShardCounts> shards;
+  std::vector<uint16_t> ownOnline;
+  std::vector<uint16_t> ownFound;
+  uint32_t epoch = 0;
+  uint32_t rebalances = 0;
+  bool leader = false;
+  bool assignmentDirty = false;
+};
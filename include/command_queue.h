@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+static const uint8_t COMMAND_QUEUE_DEPTH = 8;
+
+enum class CommandType : uint8_t { TriggerScan, SaveConfig, SaveTargets, Reboot, SendState };
+
+// A request from a web handler. `payload` is the JSON body of a save; it is
+// allocated by the handler and owned by whoever holds the command.
+struct Command {
+  CommandType type = CommandType::TriggerScan;
+  uint32_t clientId = 0;     // WebSocket client to answer, 0 for HTTP requests
+  String* payload = nullptr;
+  uint32_t queuedMs = 0;
+};
+
+struct CommandQueueStats {
+  uint32_t queued = 0;
+  uint32_t executed = 0;
+  uint32_t rejected = 0;     // refused with the queue full
+  uint8_t pending = 0;
+  uint32_t maxWaitMs = 0;    // longest time a command waited for the main task
+};
+
+// Hands work from the AsyncTCP task to the main task. push() never blocks: a
+// full queue refuses the command and frees its payload, so a web callback
+// returns right away. pop() runs on the main task only.
+class CommandQueue {
+public:
+  void begin();
+  bool push(CommandType type, uint32_t clientId, String* payload = nullptr);
+  bool pop(Command& out);
+  void done(const Command& cmd);
+  bool pending() const;
+  CommandQueueStats stats() const;
+
+private:
+  QueueHandle_t queue = nullptr;
+  std::atomic<uint32_t> queued{0};
+  std::atomic<uint32_t> rejected{0};
+  uint32_t executed = 0;
+  uint32_t maxWaitMs = 0;
+};
@@ -3,27 +3,41 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <vector>
+#include "target_set.h"
+#include "service_probe.h"
 
 static const uint32_t DEFAULT_SCAN_INTERVAL_MS = 300000; // 5 minutes
 static const uint16_t DEFAULT_MQTT_PORT = 1883;
 static const uint16_t PING_TIMEOUT_MS = 50;
-static const uint8_t MAX_WIFI_RETRIES = 30;
 static const size_t JSON_CAPACITY = 8192;
 static const uint32_t DEFAULT_RESOLVE_NAMES_TIMEOUT_MS = 500; // 500ms per lookup
+static const uint8_t DEFAULT_OFFLINE_GRACE_SCANS = 2;
+static const uint8_t DEFAULT_OFFLINE_EXPIRE_SCANS = 24;
+static const uint32_t MIN_TARGET_INTERVAL_MS = 1000;
+static const uint32_t MAX_SUBNET_ADDRESSES = 65536;  // a /16, swept in slices
 
 struct StaticHost {
   String ip;
   int port = 0;
+  std::vector<uint16_t> ports;
   String name;
+  uint32_t interval_ms = 0;  // 0 follows Config::scan_interval_ms
+  ServiceKind check = ServiceKind::None;  // protocol check instead of ping/connect
+  String check_arg;          // HTTP path or DNS name, with its leading '/'
 };
 
+// `cidr` holds the target expression as entered; `ranges` is its compiled,
+// merged address set with addresses claimed by earlier subnets removed.
 struct Subnet {
   String cidr;
   String name;
-  IPAddress network;
-  uint8_t prefix = 24;
   uint32_t firstHost = 0;
   uint32_t lastHost = 0;
+  std::vector<AddressRange> ranges;
+  std::vector<uint16_t> ports;
+  uint8_t methods = PROBE_ICMP;
+  uint32_t hostCount = 0;
+  uint32_t interval_ms = 0;  // 0 follows Config::scan_interval_ms
 };
 
 struct Config {
@@ -35,25 +49,48 @@ struct Config {
   String mqtt_pass;
   uint32_t scan_interval_ms = DEFAULT_SCAN_INTERVAL_MS;
   bool resolve_names = true;
+  uint8_t offline_grace_scans = DEFAULT_OFFLINE_GRACE_SCANS;   // missed sweeps before `offline`
+  uint8_t offline_expire_scans = DEFAULT_OFFLINE_EXPIRE_SCANS; // missed sweeps before topics are cleared
+  bool cluster_enabled = false;  // share targets with other nodes on the broker
+  bool passive_discovery = true; // learn hosts from mDNS/SSDP/DHCP traffic
   std::vector<Subnet> subnets;
   std::vector<StaticHost> static_hosts;
 };
 
 class ConfigStore {
 public:
-  ConfigStore();
+  explicit ConfigStore(fs::FS& filesystem = LittleFS);
   bool load();
   bool save();
+  bool saveTargets();
+  bool save(const Config& candidate);
+  bool saveTargets(const Config& candidate);
   Config& data();
   const Config& data() const;
   String renderSubnets() const;
   String renderHosts() const;
-  bool parseConfigPayload(const String& body);
-  bool parseTargetsPayload(const String& body);
+  bool parseConfigPayload(const String& body, Config& out) const;
+  bool parseTargetsPayload(const String& body, Config& out) const;
   bool parseHostLine(const String& line, StaticHost& host) const;
   bool parseSubnet(const String& cidr, Subnet& out) const;
   bool ensureFsMounted();
 
 private:
+  void compileTargets(Config& cfg) const;
+  bool adopt(const Config& candidate, bool (ConfigStore::*persist)());
+  bool readSubnet(JsonVariant v, Subnet& s) const;
+  bool readHost(JsonObject obj, StaticHost& h) const;
+  void applyTargets(JsonDocument& doc);
+  void applyOps(JsonArray ops);
+  void buildTargets(JsonDocument& doc) const;
+  void replayLog();
+  void notePersisted();
+
+  fs::FS& storage;
   Config config;
+  uint32_t generation = 0;
+  size_t logBytes = 0;
+  bool logNeedsCompaction = false;
+  std::vector<uint32_t> savedSubnets;  // entry CRCs as of the last save or log record
+  std::vector<uint32_t> savedHosts;
 };
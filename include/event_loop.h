@@ -0,0 +1,69 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Let the chip light-sleep between events while the station link is up.
+// Build with -DOVERWATCH_LIGHT_SLEEP=0 to keep the CPU clock fixed.
+#ifndef OVERWATCH_LIGHT_SLEEP
+#define OVERWATCH_LIGHT_SLEEP 1
+#endif
+
+static const uint32_t EVENT_LOOP_MAX_SLEEP_MS = 5000;   // well inside the MQTT keepalive
+static const uint32_t EVENT_LOOP_WINDOW_MS = 10000;
+static const uint8_t EVENT_LOOP_MAX_SOCKETS = 5;  // MQTT, three passive listeners, portal DNS
+
+enum EventBits : uint32_t {
+  EVENT_WIFI = 1 << 0,
+  EVENT_SOCKET = 1 << 1,
+  EVENT_WEB = 1 << 2,
+};
+
+struct EventLoopStats {
+  float idlePct = 0;          // share of the last window the loop task spent blocked
+  uint32_t wakeups = 0;
+  uint32_t timerWakeups = 0;
+  uint32_t wifiWakeups = 0;
+  uint32_t socketWakeups = 0;
+  uint32_t webWakeups = 0;
+  uint32_t busyPasses = 0;    // passes that found work pending and did not block
+  bool lightSleep = false;
+};
+
+// Lets loop() block between events instead of spinning. During a pass each
+// subsystem calls wakeIn() with how long it can go without attention; wait()
+// then sleeps on the loop task's notification until the earliest of those
+// deadlines or until post() signals an event from another task. A watcher
+// task select()s on the registered sockets, so inbound MQTT traffic ends the
+// wait too.
+class EventLoop {
+public:
+  using SocketProvider = std::function<int()>;
+
+  void begin();
+  void watchSocket(SocketProvider fd);
+  void post(uint32_t bits);
+  void wakeIn(uint32_t ms);
+  uint32_t wait();
+  void allowLightSleep(bool allowed);
+  EventLoopStats stats() const;
+
+private:
+  static void watcherTask(void* arg);
+  void watchSockets();
+  void rollWindow(uint32_t nowUs);
+
+  TaskHandle_t loopTask = nullptr;
+  TaskHandle_t watcher = nullptr;
+  SocketProvider sockets[EVENT_LOOP_MAX_SOCKETS];
+  volatile int armedFds[EVENT_LOOP_MAX_SOCKETS] = { -1, -1, -1, -1, -1 };
+  uint8_t socketCount = 0;
+  uint32_t sleepMs = 0;
+  uint32_t windowStartUs = 0;
+  uint32_t windowIdleUs = 0;
+  bool sleepAllowed = false;
+  esp_pm_lock_handle_t cpuLock = nullptr;
+  EventLoopStats counters;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+#include "config_store.h"
+
+static const size_t MAX_INVENTORY_HOSTS = MAX_SUBNET_ADDRESSES;  // the largest target
+static const size_t MAX_INVENTORY_NAMES = 64;
+static const size_t INVENTORY_NAME_LEN = 32;
+
+enum class HostState : uint8_t {
+  Marker = 0,     // ip 0: firstSweep holds the file generation, lastSweep the sweep counter
+  Online = 1,
+  Offline = 2,
+  Forgotten = 3,
+};
+
+enum class Sighting : uint8_t {
+  New,       // never seen, or expired since
+  Known,     // already online
+  Returned,  // back after being reported offline
+  Untracked, // inventory full; nothing is published for it
+};
+
+// Time is counted in sweeps rather than wall-clock seconds: the device has no
+// RTC, and sweeps survive reboots through the persisted counter. An online
+// host's lastSweep tracks the current sweep in RAM and is only written when
+// its state changes.
+struct InventoryEntry {
+  uint32_t ip = 0;
+  uint32_t firstSweep = 0;
+  uint32_t lastSweep = 0;
+  uint32_t heardMs = 0;  // last passive sighting (mDNS/SSDP/DHCP), 0 if never, RAM only
+  HostState state = HostState::Online;
+  uint8_t missed = 0;  // consecutive sweeps of its subnet without a reply, RAM only
+};
+
+struct HostName {
+  uint32_t ip = 0;
+  char name[INVENTORY_NAME_LEN] = {};
+};
+
+// On-flash record; `check` is the low half of a CRC32 over the first 14 bytes
+struct InventoryRecord {
+  uint32_t ip;
+  uint32_t firstSweep;
+  uint32_t lastSweep;
+  uint8_t state;
+  uint8_t reserved;
+  uint16_t check;
+};
+
+struct InventoryStats {
+  size_t hosts = 0;
+  uint32_t sweep = 0;
+  size_t logBytes = 0;
+  uint32_t appends = 0;
+  uint32_t compactions = 0;
+  size_t names = 0;
+  uint32_t untracked = 0;
+};
+
+// Hosts seen by subnet sweeps and static probes, persisted as a snapshot plus
+// an append-only log of fixed 16-byte records. Only state transitions and an
+// occasional sweep marker are appended, batched once per sweep. The log is
+// folded into a new snapshot when it grows past a threshold.
+class HostInventory {
+public:
+  explicit HostInventory(fs::FS& filesystem = LittleFS);
+  void load();
+  uint32_t beginSweep();
+  uint32_t sweep() const;
+  Sighting seen(uint32_t ip);
+  void markOffline(InventoryEntry& entry);
+  void markOffline(uint32_t ip);
+  void forget(size_t index);
+  void flush();
+  void heard(uint32_t ip, uint32_t nowMs);
+  bool heardWithin(uint32_t ip, uint32_t nowMs, uint32_t windowMs) const;
+  void setName(uint32_t ip, const char* name);
+  const char* name(uint32_t ip) const;
+
+  size_t lowerBound(uint32_t ip) const;
+  size_t size() const;
+  InventoryEntry& at(size_t index);
+  InventoryStats stats() const;
+
+private:
+  bool canTrack() const;
+  void apply(const InventoryRecord& r);
+  void queue(const InventoryEntry& e);
+  bool compact();
+
+  fs::FS& storage;
+  std::vector<InventoryEntry> entries;
+  std::vector<InventoryRecord> pending;
+  std::vector<HostName> names;  // hostnames learned passively, oldest first
+  uint32_t currentSweep = 0;
+  uint32_t persistedSweep = 0;
+  uint32_t generation = 0;
+  size_t logBytes = 0;
+  bool logNeedsCompaction = false;
+  uint32_t appends = 0;
+  uint32_t compactions = 0;
+  uint32_t untracked = 0;
+  bool full = false;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Set -DOVERWATCH_INSTRUMENTATION=0 to compile all timers and reporting out.
+#ifndef OVERWATCH_INSTRUMENTATION
+#define OVERWATCH_INSTRUMENTATION 1
+#endif
+
+enum class Probe : uint8_t {
+  Loop,
+  Wifi,
+  MqttConnect,
+  MqttLoop,
+  ScanStep,
+  Broadcast,
+  Count
+};
+
+#if OVERWATCH_INSTRUMENTATION
+
+static const uint8_t LATENCY_BUCKETS = 16;
+
+// Log2 histogram in microseconds: bucket 0 is < 32 us, bucket i covers
+// [2^(i+4), 2^(i+5)) and the last bucket collects everything >= ~0.5 s.
+// The window fields cover the time since the last metrics publish, the rest
+// the time since boot.
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS] = {};
+  uint32_t count = 0;
+  uint64_t totalUs = 0;
+  uint32_t maxUs = 0;
+  uint32_t windowBuckets[LATENCY_BUCKETS] = {};
+  uint32_t windowCount = 0;
+  uint32_t windowMaxUs = 0;
+
+  void record(uint32_t us);
+  uint32_t percentileUs(uint8_t pct) const;
+  uint32_t windowPercentileUs(uint8_t pct) const;
+  void resetWindow();
+};
+
+struct HeapSample {
+  uint32_t freeBytes = 0;
+  uint32_t minFreeBytes = 0;
+  uint32_t largestBlock = 0;
+  uint32_t minLargestBlock = 0;
+};
+
+class Instrumentation {
+public:
+  void record(Probe probe, uint32_t us);
+  void sampleHeap();
+  const LatencyHistogram& histogram(Probe probe) const;
+  const HeapSample& heap() const;
+  void writeJson(JsonObject out, bool withBuckets) const;
+  void resetWindow();
+
+private:
+  LatencyHistogram histograms[static_cast<uint8_t>(Probe::Count)];
+  HeapSample heapSample;
+};
+
+extern Instrumentation instrumentation;
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Probe p) : probe(p), startUs(micros()) {}
+  ~ScopedTimer() { instrumentation.record(probe, micros() - startUs); }
+
+private:
+  Probe probe;
+  uint32_t startUs;
+};
+
+#define OW_CONCAT_INNER(a, b) a##b
+#define OW_CONCAT(a, b) OW_CONCAT_INNER(a, b)
+#define INSTRUMENT_SCOPE(probe) ScopedTimer OW_CONCAT(scopedTimer_, __LINE__)(probe)
+
+#else
+
+#define INSTRUMENT_SCOPE(probe) do {} while (0)
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <memory>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+using SnapshotText = std::shared_ptr<const std::vector<char>>;
+
+// The last rendering of a document that only the main task may build, for
+// readers on other tasks. store() serializes outside the lock and swaps the
+// text in; load() hands out a reference, so a reader keeps the text it took
+// while a newer one replaces it.
+class JsonSnapshot {
+public:
+  void begin();
+  void store(JsonVariantConst doc);
+  SnapshotText load() const;
+
+private:
+  SemaphoreHandle_t lock = nullptr;
+  SnapshotText text;
+};
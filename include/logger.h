@@ -0,0 +1,119 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+
+#define OW_LOG_LEVEL_ERROR 1
+#define OW_LOG_LEVEL_WARN 2
+#define OW_LOG_LEVEL_INFO 3
+#define OW_LOG_LEVEL_DEBUG 4
+#define OW_LOG_LEVEL_TRACE 5
+
+// Calls above this level are removed at compile time. Per-probe scan logs
+// use TRACE so they cost nothing in default builds.
+#ifndef OVERWATCH_LOG_LEVEL
+#define OVERWATCH_LOG_LEVEL OW_LOG_LEVEL_INFO
+#endif
+
+enum class LogLevel : uint8_t { Error = 1, Warn, Info, Debug, Trace };
+
+static const uint8_t LOG_MAX_ARGS = 4;
+static const uint8_t LOG_TEXT_BYTES = 40;
+static const uint16_t LOG_RING_SIZE = 64;
+
+// Argument captured by value at the call site. Numbers and addresses are
+// stored raw; strings are copied into the record's small text pool.
+struct LogArg {
+  enum Kind : uint8_t { U32, I32, Ip, Str };
+  Kind kind;
+  uint32_t value = 0;
+  const char* str = nullptr;
+
+  LogArg(int v) : kind(I32), value(static_cast<uint32_t>(v)) {}
+  LogArg(long v) : kind(I32), value(static_cast<uint32_t>(v)) {}
+  LogArg(unsigned v) : kind(U32), value(v) {}
+  LogArg(unsigned long v) : kind(U32), value(static_cast<uint32_t>(v)) {}
+  LogArg(bool v) : kind(Str), str(v ? "true" : "false") {}
+  LogArg(const IPAddress& ip);
+  LogArg(const char* s) : kind(Str), str(s ? s : "") {}
+  LogArg(const String& s) : kind(Str), str(s.c_str()) {}
+};
+
+// `fmt` must be a string literal: it is kept by pointer and expanded only
+// when the drain task writes the line. Each "{}" takes the next argument.
+struct LogRecord {
+  uint32_t timestampMs;
+  const char* fmt;
+  LogLevel level;
+  uint8_t argc;
+  LogArg::Kind kinds[LOG_MAX_ARGS];
+  uint32_t values[LOG_MAX_ARGS];
+  char text[LOG_TEXT_BYTES];
+};
+
+class Logger {
+public:
+  void begin();
+  void setLevel(LogLevel level);
+  LogLevel level() const;
+  bool enabled(LogLevel level) const;
+  void write(LogLevel level, const char* fmt, std::initializer_list<LogArg> args);
+  template <typename... Args>
+  void log(LogLevel level, const char* fmt, const Args&... args) {
+    if (enabled(level)) write(level, fmt, { LogArg(args)... });
+  }
+  void setStreamSink(std::function<void(LogLevel, uint32_t, const char*)> sink);
+  void setStreamLevel(LogLevel level);
+  void drain();
+  uint32_t dropped() const;
+  uint32_t written() const;
+
+  static const char* levelName(LogLevel level);
+  static size_t format(const LogRecord& rec, char* out, size_t len);
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq{0};
+    LogRecord rec;
+  };
+  static void drainTask(void* arg);
+
+  Slot ring[LOG_RING_SIZE];
+  std::atomic<uint32_t> head{0};
+  uint32_t tail = 0;
+  std::atomic<uint32_t> droppedCount{0};
+  uint32_t writtenCount = 0;
+  std::atomic<uint8_t> runtimeLevel{static_cast<uint8_t>(OVERWATCH_LOG_LEVEL)};
+  std::atomic<uint8_t> streamLevel{static_cast<uint8_t>(LogLevel::Error)};  // widens capture for the sink only
+  std::function<void(LogLevel, uint32_t, const char*)> streamSink;
+  bool taskStarted = false;
+};
+
+extern Logger logger;
+
+#define LOG_ERROR(...) logger.log(LogLevel::Error, __VA_ARGS__)
+
+#if OVERWATCH_LOG_LEVEL >= OW_LOG_LEVEL_WARN
+#define LOG_WARN(...) logger.log(LogLevel::Warn, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if OVERWATCH_LOG_LEVEL >= OW_LOG_LEVEL_INFO
+#define LOG_INFO(...) logger.log(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if OVERWATCH_LOG_LEVEL >= OW_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logger.log(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if OVERWATCH_LOG_LEVEL >= OW_LOG_LEVEL_TRACE
+#define LOG_TRACE(...) logger.log(LogLevel::Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) do {} while (0)
+#endif
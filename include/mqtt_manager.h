@@ -2,32 +2,59 @@
 #include <Arduino.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
-#include <WiFi.h>
+#include <functional>
+#include <Client.h>
 #include "config_store.h"
+#include "instrumentation.h"
 
 class MqttManager {
 public:
-  MqttManager(Config& config);
+  MqttManager(Config& config, Client& transport);
   void ensureConnected(bool wifiConnected, bool captivePortal);
+  uint32_t wakeInMs() const;
   void loop();
   bool isConnected();
   const String& reason() const;
   PubSubClient& client();
+  uint32_t publishCount() const;
+  uint32_t firstStateMs() const;
+  void setIdentity(const String& clientId, const String& willTopic);
+  void setConnectHandler(std::function<void()> handler);
+  void setMessageHandler(std::function<void(const char*, const uint8_t*, unsigned int)> handler);
+  bool subscribe(const char* topic);
+  bool publish(const char* topic, const char* payload, bool retained);
 
   void publishAvailability(const char* payload);
   void publishDiscovery(const std::vector<Subnet>& subnets, const std::vector<StaticHost>& hosts);
   void publishOnlineCount(const Subnet& subnet, int count);
   void publishHostStatus(const StaticHost& host, bool online);
-  void publishHostStatusIp(const String& ip, bool online);
-  void publishNewHost(const String& ip);
+  void publishServiceCheck(const StaticHost& host, bool up, uint16_t latencyMs, uint16_t code);
+  void publishHostStatusIp(uint32_t ip, bool online);
+  void clearHostStatusIp(uint32_t ip);
+  void publishNewHost(uint32_t ip);
   void publishFoundCount(const Subnet& subnet, int count);
+  bool publishJson(const char* topic, const JsonDocument& doc, bool retained);
+
+  static constexpr const char* METRICS_TOPIC = "esp-overwatch/metrics";
+  static constexpr const char* SCAN_TOPIC = "esp-overwatch/scan";
+  static constexpr const char* BOOT_TOPIC = "esp-overwatch/boot";
 
 private:
-  WiFiClient wifiClient;
+  void publishLatencySensor(const StaticHost& host, const char* hostObjectId, const char* hostName);
+  void noteState(bool published);
+  void publishDeviceSensor(const char* key, const char* name, const char* stateTopic, const char* valueTemplate, const char* unit);
+
   PubSubClient mqtt;
   Config& config;
   bool lastMqttConnected = false;
+  uint32_t publishes = 0;
+  uint32_t firstStateAtMs = 0;
+  String clientId = "esp-overwatch";
+  String willTopic = AVAIL_TOPIC;
+  std::function<void()> onConnect;
   int lastMqttState = 0;
+  uint8_t connectFailures = 0;  // consecutive, sets the retry backoff
+  unsigned long retryAtMs = 0;
   String mqttReason = "init";
   static constexpr const char* AVAIL_TOPIC = "esp-overwatch/availability";
   static constexpr const char* AVAIL_ON = "online";
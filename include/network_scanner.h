@@ -1,46 +1,213 @@
 #pragma once
 #include <Arduino.h>
-#include <ESP32Ping.h>
-#include <WiFi.h>
-#include <set>
 #include "config_store.h"
 #include "mqtt_manager.h"
+#include "platform.h"
+#include "host_inventory.h"
+#include "availability_history.h"
+#include "cluster.h"
+#include "service_probe.h"
+#include "sweep_checkpoint.h"
 
-struct SubnetScanResult { String cidr; int online = 0; };
-struct HostScanResult { String ip; int port = 0; String name; bool online = false; };
+enum HostResultFlags : uint8_t {
+  HOST_ONLINE = 0x01,
+  HOST_PROBED = 0x02,
+};
+
+static const uint16_t NO_TARGET = 0xFFFF;
+static const uint32_t SWEEP_SLICE_ADDRESSES = 1024;   // larger subnets sweep one slice per job
+static const uint32_t SWEEP_CHECKPOINT_MS = 60000;    // bounds flash writes and work lost to a reset
+
+// Fixed-size records kept in arrays sized once per target set. Names, CIDRs
+// and hostnames stay in Config and are only looked up when formatting.
+struct HostScanResult {
+  uint32_t ip = 0;          // resolved address, 0 for unresolved hostnames
+  uint16_t port = 0;        // port that answered, 0 for ping
+  uint8_t flags = 0;
+  uint16_t rttMs = 0;        // service checks: latency of the check
+  uint16_t code = 0;         // service checks: protocol result code
+  uint16_t target = NO_TARGET;  // index into Config::static_hosts
+  uint32_t lastSeenMs = 0;
+
+  bool online() const { return flags & HOST_ONLINE; }
+};
+
+// Counts merge the latest result of every slice and are only set once each
+// slice has one.
+struct SubnetScanResult {
+  uint16_t subnet = NO_TARGET;  // index into Config::subnets
+  uint16_t online = 0;
+  uint16_t found = 0;
+  uint32_t completedMs = 0;
+  uint32_t durationMs = 0;  // last sweep, including waits between steps; summed over slices
+};
+
+struct SliceScanResult {
+  uint16_t online = 0;
+  uint16_t found = 0;
+  uint32_t completedMs = 0;  // 0 until the slice has run since boot
+  uint32_t durationMs = 0;
+};
+
+struct ScanHeapStats {
+  uint32_t scans = 0;
+  uint32_t freeAfterScan = 0;
+  uint32_t largestAfterScan = 0;
+  uint32_t minLargestAfterScan = 0;
+};
+
+// Cost of the last completed sweep, used to compare scanner changes against a
+// fixed (real or simulated) network.
+struct ScanRunStats {
+  uint32_t durationMs = 0;
+  uint32_t probes = 0;
+  uint32_t skipped = 0;  // addresses confirmed by passive sightings instead of a probe
+  uint32_t arpAlive = 0; // addresses found alive through ARP
+  uint32_t publishes = 0;
+  uint32_t minFreeHeap = 0;
+};
+
+// Where the current cycle stands. Rates are moving averages over 1 s samples
+// of busy time; ETA and full-sweep estimates divide address counts by them.
+struct ScanProgress {
+  bool active = false;
+  uint16_t subnet = NO_TARGET;   // subnet being swept
+  uint16_t slice = 0;
+  uint16_t slices = 0;
+  uint32_t sweepDone = 0;        // addresses handled in that slice
+  uint32_t sweepTotal = 0;
+  uint32_t cycleDone = 0;        // addresses and hosts handled this cycle
+  uint32_t remaining = 0;        // rest of the sweep plus targets already due
+  float probesPerS = 0;
+  float addressesPerS = 0;
+  uint32_t elapsedMs = 0;
+  uint32_t etaMs = 0;
+  uint32_t fullSweepMs = 0;      // estimated time to probe every target once
+};
+
+// Lateness of scheduled probes. A job that starts more than its slack after
+// its deadline counts as a miss.
+struct DeadlineStats {
+  uint32_t jobs = 0;
+  uint32_t misses = 0;
+  uint32_t lastLateMs = 0;
+  uint32_t maxLateMs = 0;
+  uint16_t queued = 0;
+  uint32_t nextDueInMs = 0;
+};
 
 class NetworkScanner {
 public:
-  explicit NetworkScanner(Config& cfg, MqttManager& mqtt);
+  NetworkScanner(Config& cfg, MqttManager& mqtt, NetworkBackend& net, HostInventory& inventory, AvailabilityHistory& history, Cluster& cluster);
   bool start();
-  void step();
+  uint16_t step(uint32_t budgetUs);
+  void resetTargets();
+  void noteAlive(uint32_t ip, const char* hostname);
   bool active() const;
   unsigned long lastCompletedMs() const;
   const std::vector<SubnetScanResult>& subnetResults() const;
   const std::vector<HostScanResult>& hostResults() const;
+  const std::vector<SliceScanResult>& sliceResults(size_t subnet) const;
+  uint16_t nextSlice(size_t subnet) const;
   int foundCount() const;
+  const ScanHeapStats& heapStats() const;
+  const ScanRunStats& runStats() const;
+  InventoryStats inventoryStats() const;
+  DeadlineStats deadlineStats() const;
+  uint32_t wakeInMs() const;
+  ScanProgress progress() const;
 
 private:
-  bool portOpen(const String& ip, int port);
-  bool pingHost(const IPAddress& ip);
+  struct ScanJob {
+    uint32_t dueMs = 0;
+    uint32_t intervalMs = 0;
+    uint16_t target = 0;  // index into Config::subnets or Config::static_hosts
+  };
+  struct LaterDue {
+    bool operator()(const ScanJob& a, const ScanJob& b) const { return (int32_t)(a.dueMs - b.dueMs) > 0; }
+  };
+  // A subnet's sweep across its slice jobs
+  struct SweepState {
+    SweepPosition position;
+    uint32_t dueMs = 0;       // deadline of the first slice; the next sweep counts from it
+    std::vector<SliceScanResult> slices;
+  };
+
+  bool probeStatic(const StaticHost& h, HostScanResult& r);
+  bool probeAddress(const Subnet& subnet, uint32_t address, uint16_t& rttMs);
+  bool arpResolved(const Subnet& subnet, uint32_t address, bool& onLink);
+  void ensureResultTables();
+  void scheduleAll(uint32_t now, bool delayFirst);
+  bool due(const std::vector<ScanJob>& queue, uint32_t now) const;
+  ScanJob popJob(std::vector<ScanJob>& queue, uint32_t now);
+  void pushJob(std::vector<ScanJob>& queue, uint16_t target, uint32_t lastDueMs, uint32_t intervalMs, uint32_t now);
+  uint32_t intervalFor(uint32_t targetIntervalMs) const;
+  void beginCycle();
+  void probeHost(size_t index);
+  void startServiceCheck(const ScanJob& job);
+  void finishServiceCheck();
+  void recordHost(size_t index, bool ok);
+  void noteProbeCost(uint32_t startUs);
+  void sampleRate(uint32_t now);
+  void publishProgress();
+  void beginSubnet(size_t index);
   void finishScan();
-  void finishSubnet();
+  void finishSlice();
+  void advanceCursor(const Subnet& subnet, uint32_t done);
+  void trackDepartures(const Subnet& subnet, uint32_t first, uint32_t last);
+  void saveCheckpoint(uint32_t now);
+  void pruneInventory();
 
   Config& config;
   MqttManager& mqtt;
+  NetworkBackend& net;
+  HostInventory& inventory;
+  AvailabilityHistory& history;
+  Cluster& cluster;
   bool scanning = false;
+  bool scheduled = false;
+  bool sweeping = false;
   bool mqttReady = false;
-  size_t hostIndex = 0;
+  std::vector<ScanJob> hostQueue;    // min-heaps on dueMs
+  std::vector<ScanJob> subnetQueue;
+  uint32_t sweepDueMs = 0;
+  uint32_t probeCostUs = 0;  // moving average of one probe iteration
+  uint32_t sweepStartMs = 0;
+  uint32_t sweepDone = 0;
+  uint32_t cycleDone = 0;
+  uint32_t rateSampleMs = 0;
+  uint32_t rateProbeBase = 0;
+  uint32_t rateAddressBase = 0;
+  float probesPerS = 0;
+  float addressesPerS = 0;
+  uint32_t lastProgressPublishMs = 0;
+  DeadlineStats deadlines;
   size_t subnetIndex = 0;
+  size_t rangeIndex = 0;
   uint32_t subnetCursor = 0;
+  uint16_t sliceIndex = 0;
+  uint32_t sliceLeft = 0;          // addresses of the slice not yet handled
+  uint32_t sliceFirstAddress = 0;  // where this run of the slice began
+  uint32_t sliceLastAddress = 0;
+  std::vector<SweepState> sweeps;  // per subnet
+  SweepCheckpoint checkpoint;
+  bool checkpointDirty = false;
+  uint32_t checkpointSavedMs = 0;
+  ServiceCheck service;
+  ScanJob serviceJob;
+  uint32_t arpBatchFirst = 0;
+  uint8_t arpBatchCount = 0;
+  uint8_t arpBatchAlive = 0;
+  bool arpBatchOnLink = false;
   int currentOnline = 0;
   int foundOnlineCount = 0;
   int foundOnlineCountSubnet = 0;
-  std::set<String> prevOnlineHosts;
-  std::set<String> currentOnlineHosts;
-  std::set<String> seenHosts;
   std::vector<SubnetScanResult> lastSubnetResults;
   std::vector<HostScanResult> lastHostResults;
+  ScanHeapStats heap;
+  ScanRunStats run;
+  uint32_t runPublishBase = 0;
+  uint32_t runMinFreeHeap = 0;
   unsigned long lastScanCompletedMs = 0;
   unsigned long lastScanStartMs = 0;
 };
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include "config_store.h"
+
+static const size_t PASSIVE_BUFFER_SIZE = 600;    // fits a full DHCP message
+static const uint8_t PASSIVE_PACKETS_PER_LOOP = 4;
+
+enum class PassiveSource : uint8_t { Mdns, Ssdp, Dhcp };
+static const uint8_t PASSIVE_SOURCES = 3;
+
+// Ports to listen on; tests move them off the privileged defaults
+struct PassivePorts {
+  uint16_t mdns = 5353;
+  uint16_t ssdp = 1900;
+  uint16_t dhcp = 67;
+};
+
+struct PassiveStats {
+  bool listening = false;
+  uint32_t mdns = 0;
+  uint32_t ssdp = 0;
+  uint32_t dhcp = 0;
+  uint32_t malformed = 0;
+  uint32_t sightings = 0;
+};
+
+// Learns live hosts from traffic the network sends anyway: mDNS and SSDP
+// multicast, and DHCP client broadcasts on the same segment. Every sighting is
+// handed to the sighting handler with the host's address and, when the packet
+// names it, its hostname. handlePacket() is the whole parsing path, so
+// captured packets can be replayed through it without sockets.
+//
+// The sockets are plain non-blocking lwIP sockets; socketFd() hands them to
+// the event loop's watcher so datagrams wake the loop instead of a poll timer.
+class PassiveListener {
+public:
+  using SightingHandler = std::function<void(uint32_t ip, const char* hostname)>;
+
+  explicit PassiveListener(Config& config, const PassivePorts& ports = PassivePorts());
+  void setSightingHandler(SightingHandler handler);
+  void loop(bool networkUp);
+  void handlePacket(PassiveSource source, uint32_t fromIp, const uint8_t* data, size_t len);
+  PassiveStats stats() const;
+  int socketFd(PassiveSource source) const;
+
+private:
+  void begin();
+  void stop();
+  void drain(PassiveSource source);
+  bool parseMdns(uint32_t fromIp, const uint8_t* data, size_t len);
+  bool parseDhcp(const uint8_t* data, size_t len);
+  void report(uint32_t ip, const char* hostname);
+
+  Config& config;
+  PassivePorts ports;
+  SightingHandler onSighting;
+  int fds[PASSIVE_SOURCES] = { -1, -1, -1 };
+  bool listening = false;
+  PassiveStats counters;
+  uint8_t buffer[PASSIVE_BUFFER_SIZE];
+};
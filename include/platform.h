@@ -0,0 +1,107 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+
+// Builds with OVERWATCH_SIM_NETWORK=1 probe a modelled LAN instead of the
+// radio so sweep time, probe rate, publish count and heap use can be compared
+// between firmware revisions on identical input.
+#ifndef OVERWATCH_SIM_NETWORK
+#define OVERWATCH_SIM_NETWORK 0
+#endif
+#ifndef OVERWATCH_SIM_SEED
+#define OVERWATCH_SIM_SEED 1
+#endif
+#ifndef OVERWATCH_SIM_DENSITY
+#define OVERWATCH_SIM_DENSITY 25
+#endif
+#ifndef OVERWATCH_SIM_LOSS
+#define OVERWATCH_SIM_LOSS 2
+#endif
+#ifndef OVERWATCH_SIM_TIME_SCALE
+#define OVERWATCH_SIM_TIME_SCALE 100
+#endif
+#ifndef OVERWATCH_SIM_ICMP_SILENT
+#define OVERWATCH_SIM_ICMP_SILENT 0
+#endif
+
+// Addresses resolved per ARP batch; stays below lwIP's 10-entry ARP table so
+// one batch's replies do not evict each other
+static const uint8_t ARP_BATCH_MAX = 8;
+
+inline uint8_t arpMask(uint8_t count) { return count >= 8 ? 0xFF : static_cast<uint8_t>((1 << count) - 1); }
+
+// Neighbour table an ARP sweep works on: lwIP's on the device, the kernel's
+// in host tests. Both take `count` (up to ARP_BATCH_MAX) consecutive
+// addresses from `first`; resolved() sets bit i for each with a complete entry.
+class ArpCache {
+public:
+  virtual ~ArpCache() {}
+  virtual bool request(uint32_t first, uint8_t count) = 0;
+  virtual uint8_t resolved(uint32_t first, uint8_t count) = 0;
+};
+
+// Requests the batch and polls `cache` until the new entries resolve or
+// `waitMs` passes. Entries cached before the request can outlive their host
+// by minutes, so those count only when `confirm` reaches the address.
+uint8_t arpSweep(ArpCache& cache, uint32_t first, uint8_t count, uint16_t waitMs, const std::function<bool(uint32_t)>& confirm);
+
+// Probe primitives the scanner depends on. The ESP32 backend
+// (esp_network.cpp) uses a raw ICMP socket and WiFiClient; SimulatedNetwork
+// stands in for a real LAN on the device and in the native environment.
+class NetworkBackend {
+public:
+  virtual ~NetworkBackend() {}
+  virtual bool ping(const IPAddress& ip, uint16_t& rttMs) = 0;
+  virtual bool connect(const IPAddress& ip, uint16_t port, uint16_t& rttMs) = 0;
+  virtual bool connect(const char* host, uint16_t port, uint16_t& rttMs) = 0;
+  // Sends ARP requests for `count` (up to ARP_BATCH_MAX) consecutive
+  // addresses from `first` and sets bit i of aliveMask for each address that
+  // resolved. Returns false when the addresses are not on the local link.
+  virtual bool arpProbe(uint32_t first, uint8_t count, uint8_t& aliveMask) = 0;
+};
+
+class EspNetworkBackend : public NetworkBackend {
+public:
+  bool ping(const IPAddress& ip, uint16_t& rttMs) override;
+  bool connect(const IPAddress& ip, uint16_t port, uint16_t& rttMs) override;
+  bool connect(const char* host, uint16_t port, uint16_t& rttMs) override;
+  bool arpProbe(uint32_t first, uint8_t count, uint8_t& aliveMask) override;
+};
+
+struct SimNetworkParams {
+  uint32_t seed = 1;
+  uint8_t hostDensityPct = 25;     // share of addresses that answer
+  uint8_t lossPct = 2;             // per-probe loss for live hosts
+  uint8_t icmpSilentPct = 0;       // share of live hosts that ignore ping but answer ARP
+  uint8_t openPortPct = 30;        // share of (host, port) pairs accepting TCP
+  uint16_t rttMinMs = 2;
+  uint16_t rttMedianMs = 8;
+  uint16_t rttMaxMs = 250;
+  uint16_t timeoutMs = 50;         // ping wait, as PING_TIMEOUT_MS on the device
+  uint16_t arpWaitMs = 40;         // cost of an ARP batch with unanswered addresses
+  uint8_t timeScalePct = 100;      // 0 runs without blocking at all
+};
+
+// Deterministic model of a LAN: liveness and port state are a hash of the
+// address and seed, RTTs follow a long-tailed distribution around the median,
+// and probes block for the modelled time so loop latency stays realistic.
+class SimulatedNetwork : public NetworkBackend {
+public:
+  explicit SimulatedNetwork(const SimNetworkParams& params);
+  bool ping(const IPAddress& ip, uint16_t& rttMs) override;
+  bool connect(const IPAddress& ip, uint16_t port, uint16_t& rttMs) override;
+  bool connect(const char* host, uint16_t port, uint16_t& rttMs) override;
+  bool arpProbe(uint32_t first, uint8_t count, uint8_t& aliveMask) override;
+  bool hostAlive(uint32_t ip) const;
+  uint32_t probes() const;
+
+private:
+  uint32_t hash(uint32_t a, uint32_t b) const;
+  uint32_t nextRandom();
+  uint16_t sampleRtt(uint32_t ip);
+  void spend(uint32_t ms);
+
+  SimNetworkParams params;
+  uint32_t probeCount = 0;
+  uint32_t rng;
+};
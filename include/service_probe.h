@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+
+static const size_t SERVICE_BUFFER_SIZE = 512;     // request, then response
+static const uint16_t SERVICE_TIMEOUT_MS = 2000;
+static const uint8_t SERVICE_POLL_MS = 5;         // loop wake interval while a check is in flight
+
+enum class ServiceKind : uint8_t { None, Http, Dns, Mqtt, Tls };
+
+enum class ProbeVerdict : uint8_t { Pending, Up, Down };
+
+// A protocol check run over a plain socket. Probes hold no state: request()
+// writes the whole request into the caller's buffer and response() judges the
+// bytes received so far, setting `code` (HTTP status, DNS rcode, CONNACK
+// return code, TLS handshake type or alert) once it decides.
+class ServiceProbe {
+public:
+  virtual ~ServiceProbe() {}
+  virtual ServiceKind kind() const = 0;
+  virtual const char* name() const = 0;   // scheme in host lines, e.g. "http"
+  virtual uint16_t defaultPort() const = 0;
+  virtual bool datagram() const { return false; }
+  virtual size_t request(const char* host, const char* arg, uint8_t* out, size_t cap) const = 0;
+  virtual ProbeVerdict response(const uint8_t* in, size_t len, uint16_t& code) const = 0;
+};
+
+// Probes are registered in a fixed table in service_probe.cpp
+const ServiceProbe* findServiceProbe(ServiceKind kind);
+const ServiceProbe* findServiceProbe(const String& name);
+
+struct ServiceResult {
+  bool up = false;
+  uint32_t ip = 0;
+  uint16_t code = 0;
+  uint16_t latencyMs = 0;   // connect start to verdict
+};
+
+// Runs one probe at a time on a non-blocking socket. start() opens the socket
+// and poll() advances connect, send and receive without waiting, so the
+// scanner keeps sweeping while a check is in flight. The buffer is part of the
+// object; nothing is allocated per check.
+class ServiceCheck {
+public:
+  ~ServiceCheck();
+  bool start(const ServiceProbe& probe, const char* host, uint16_t port, const char* arg);
+  bool poll();
+  bool busy() const;
+  void cancel();
+  const ServiceResult& result() const;
+
+private:
+  enum class Phase : uint8_t { Idle, Connecting, Sending, Receiving };
+
+  void finish(bool up, uint16_t code);
+  void closeSocket();
+
+  const ServiceProbe* probe = nullptr;
+  int fd = -1;
+  Phase phase = Phase::Idle;
+  uint32_t startMs = 0;
+  size_t requestLen = 0;
+  size_t sent = 0;
+  size_t received = 0;
+  ServiceResult res;
+  uint8_t buffer[SERVICE_BUFFER_SIZE];
+};
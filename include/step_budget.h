@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+
+// Target p99 for one pass of loop(). Override with -DOVERWATCH_LOOP_TARGET_US=...
+#ifndef OVERWATCH_LOOP_TARGET_US
+#define OVERWATCH_LOOP_TARGET_US 100000
+#endif
+
+static const uint32_t STEP_BUDGET_MIN_US = 2000;
+static const uint8_t STEP_BUDGET_WINDOW = 100;  // busy loops per adjustment
+
+struct StepBudgetStats {
+  uint32_t budgetUs = 0;
+  uint32_t targetUs = 0;
+  uint32_t windowP99Us = 0;  // second-slowest busy loop of the last full window
+  uint32_t increases = 0;
+  uint32_t decreases = 0;
+};
+
+// Time allowed to NetworkScanner::step() per loop. Only loops in which the
+// scanner probed are measured; every STEP_BUDGET_WINDOW of them the budget
+// grows additively while no loop overran the target and is cut by a quarter
+// once more than 1% did, so p99 settles just under the target. The last probe
+// admitted may wait PING_TIMEOUT_MS past the budget, so the budget stops that
+// far short of the target.
+class StepBudget {
+public:
+  explicit StepBudget(uint32_t targetUs = OVERWATCH_LOOP_TARGET_US);
+  uint32_t budgetUs() const;
+  void recordLoop(uint32_t loopUs);
+  StepBudgetStats stats() const;
+
+private:
+  uint32_t targetUs;
+  uint32_t maxBudgetUs;
+  uint32_t budget;
+  uint8_t samples = 0;
+  uint8_t over = 0;
+  uint32_t slowest = 0;
+  uint32_t secondSlowest = 0;
+  uint32_t lastP99Us = 0;
+  uint32_t increases = 0;
+  uint32_t decreases = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+
+// Where a subnet's sweep stands: the slice to run next and, while that slice
+// is part way done, the next address and the counts gathered so far.
+struct SweepPosition {
+  uint32_t key = 0;      // subnet identity, see sweepKey()
+  uint32_t cursor = 0;   // 0 at a slice boundary
+  uint16_t slice = 0;
+  uint16_t online = 0;
+  uint16_t found = 0;
+  uint16_t reserved = 0;
+};
+
+// Ties a position to a subnet's expression and compiled size, so edited
+// targets start over instead of resuming into different addresses
+uint32_t sweepKey(const String& cidr, uint32_t hostCount);
+
+// Sweep positions of sliced subnets in /sweep.bin: a magic, a count, the
+// fixed-size positions and a CRC over all of it. Written through a temporary
+// file so a reset mid-write keeps the previous checkpoint.
+class SweepCheckpoint {
+public:
+  explicit SweepCheckpoint(fs::FS& filesystem = LittleFS);
+  bool load(std::vector<SweepPosition>& out);
+  bool save(const std::vector<SweepPosition>& positions);
+  void clear();
+
+private:
+  fs::FS& storage;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+static const uint8_t MAX_TARGET_PORTS = 8;
+
+// Liveness checks a target combines; its ports add TCP connects on top
+static const uint8_t PROBE_ICMP = 0x01;
+static const uint8_t PROBE_ARP = 0x02;
+
+// Inclusive range of IPv4 addresses in host byte order.
+struct AddressRange {
+  uint32_t first = 0;
+  uint32_t last = 0;
+};
+
+// Compiled form of a target expression such as
+//   "10.0.0.0/24, 10.0.1.10-50, !10.0.0.1 :22,80"
+// Terms are CIDRs, ranges (a.b.c.d-e or a.b.c.d-a.b.c.e) or single addresses,
+// separated by commas or whitespace; a leading '!' excludes the term. An
+// optional ':' starts the port set that applies to the whole target; it may
+// also name the `arp` and `icmp` checks ("10.0.0.0/24 :arp,icmp"). Without
+// either keyword a target is pinged when it has no ports.
+struct TargetSpec {
+  std::vector<AddressRange> ranges;
+  std::vector<uint16_t> ports;
+  uint8_t methods = PROBE_ICMP;
+  uint32_t addressCount = 0;
+};
+
+uint32_t ipToInt(const IPAddress& ip);
+IPAddress intToIp(uint32_t value);
+
+bool parseTargetExpression(const String& expr, TargetSpec& out);
+bool parsePortSet(const String& text, std::vector<uint16_t>& ports);
+String renderPortSet(const std::vector<uint16_t>& ports);
+
+void normalizeRanges(std::vector<AddressRange>& ranges);
+void subtractRanges(std::vector<AddressRange>& ranges, const std::vector<AddressRange>& remove);
+uint32_t countAddresses(const std::vector<AddressRange>& ranges);
+bool rangesContain(const std::vector<AddressRange>& ranges, uint32_t address);
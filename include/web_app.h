@@ -1,34 +1,90 @@
 #pragma once
 #include <ESPAsyncWebServer.h>
+#include <atomic>
 #include <functional>
 #include "config_store.h"
 #include "network_scanner.h"
 #include "mqtt_manager.h"
+#include "wifi_manager.h"
+#include "logger.h"
+#include "arena.h"
+#include "availability_history.h"
+#include "cluster.h"
+#include "step_budget.h"
+#include "passive_listener.h"
+#include "event_loop.h"
+#include "boot_timeline.h"
+#include "ws_outbox.h"
+#include "command_queue.h"
+#include "json_snapshot.h"
 
 class WebApp {
 public:
-  WebApp(ConfigStore& store, NetworkScanner& scanner, MqttManager& mqtt);
+  WebApp(ConfigStore& store, NetworkScanner& scanner, MqttManager& mqtt, AvailabilityHistory& history);
   void begin();
+  void loop();
+  uint32_t wakeInMs() const;
   void setWifiStatusProvider(std::function<bool()> wifiUpFn, std::function<String()> wifiIpFn, std::function<bool()> captiveFn);
-  void triggerScan();
+  void setWifiStatsProvider(std::function<WifiStats()> statsFn);
+  void setClusterStatsProvider(std::function<ClusterStats()> statsFn);
+  void setStepBudgetProvider(std::function<StepBudgetStats()> statsFn);
+  void setPassiveStatsProvider(std::function<PassiveStats()> statsFn);
+  void setBootTimelineProvider(std::function<BootTimeline()> timelineFn);
+  void setEventLoopProvider(std::function<EventLoopStats()> statsFn, std::function<void()> wakeFn);
   void broadcastStatus();
   void broadcastScanResults();
+  void broadcastScanProgress();
+  void refreshSnapshots();
 
 private:
   void setupRoutes();
   void setupWebSocket();
-  void handleWsMessage(AsyncWebSocketClient* client, const String& message);
-  String buildStatusJson();
-  String buildConfigJson();
-  String buildScanResultsJson();
-  void broadcastJson(const String& type, const String& data);
+  using JsonBuilder = void (WebApp::*)(JsonObject);
+
+  void handleWsMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len);
+  bool queueCommand(CommandType type, uint32_t clientId, String* payload = nullptr);
+  void runCommand(const Command& cmd);
+  void reply(uint32_t clientId, const char* text);
+  void buildStatusJson(JsonObject out);
+  void buildConfigJson(JsonObject out);
+  void buildScanResultsJson(JsonObject out);
+  void buildScanProgressJson(JsonObject out);
+  void buildHistoryJson(JsonObject out);
+  void renderSnapshot(JsonSnapshot& snapshot, JsonBuilder build);
+  void sendSnapshot(AsyncWebServerRequest* req, const JsonSnapshot& snapshot);
+  void sendHistory(AsyncWebServerRequest* req);
+  void sendWs(uint32_t clientId, const char* type, JsonBuilder build);
+  void broadcastJson(WsChannel channel, const char* type, JsonBuilder build);
+  void streamLog(LogLevel level, uint32_t timestampMs, const char* line);
+  bool subscribeLogs(uint32_t clientId, LogLevel level);
+  void unsubscribeLogs(uint32_t clientId);
+  void updateStreamLevel();
 
   AsyncWebServer server{80};
   AsyncWebSocket ws{"/ws"};
+  WsOutbox outbox{ws};
+  CommandQueue commands;
+  JsonSnapshot statusSnapshot;
+  JsonSnapshot configSnapshot;
+  JsonSnapshot scanResultsSnapshot;
+  JsonSnapshot historySnapshot;
+  unsigned long lastCleanupMs = 0;
+  unsigned long rebootAtMs = 0;   // 0 while no reboot is scheduled
   ConfigStore& store;
   NetworkScanner& scanner;
   MqttManager& mqtt;
+  AvailabilityHistory& history;
   std::function<bool()> wifiUp;
   std::function<String()> wifiIp;
   std::function<bool()> isCaptive;
+  std::function<WifiStats()> wifiStats;
+  std::function<ClusterStats()> clusterStats;
+  std::function<StepBudgetStats()> stepBudgetStats;
+  std::function<PassiveStats()> passiveStats;
+  std::function<EventLoopStats()> eventLoopStats;
+  std::function<BootTimeline()> bootTimeline;
+  std::function<void()> wakeLoop;
+  static const uint8_t MAX_LOG_CLIENTS = 2;
+  std::atomic<uint32_t> logClients[MAX_LOG_CLIENTS] = {};
+  std::atomic<uint8_t> logLevels[MAX_LOG_CLIENTS] = {};  // per subscriber, 0 while the slot is free
 };
@@ -1,26 +1,52 @@
 #pragma once
 #include <Arduino.h>
 #include <WiFi.h>
-#include <DNSServer.h>
+#include "captive_dns.h"
 #include "config_store.h"
 
+struct WifiStats {
+  const char* state = "idle";
+  uint32_t attempts = 0;
+  uint32_t reconnects = 0;
+  uint32_t lastReconnectMs = 0;
+  uint32_t maxReconnectMs = 0;
+  uint32_t nextRetryInMs = 0;
+};
+
 class WifiManager {
 public:
-  explicit WifiManager(Config& config);
+  explicit WifiManager(Config& config, uint16_t dnsPort = 53);  // tests move DNS off port 53
   void begin();
   void loop();
-  void ensureConnected();
   bool isCaptive() const;
   bool isWifiUp() const;
   String ip() const;
+  WifiStats stats() const;
+  uint32_t wakeInMs() const;
+  int dnsSocketFd() const;
 
 private:
-  bool connectWifi();
+  enum class State { Idle, Connecting, Connected, Backoff };
+
+  void beginAttempt();
+  void onConnected();
+  void onAttemptFailed();
   void startCaptivePortal();
+  void stopCaptivePortal();
 
   Config& config;
-  DNSServer dns;
+  CaptiveDns dns;
+  uint16_t dnsPort;
+  State state = State::Idle;
   bool captive = false;
-  bool lastWifiConnected = false;
-  static constexpr uint16_t DNS_PORT = 53;
+  bool everConnected = false;
+  volatile bool linkLost = false;
+  uint32_t attempts = 0;
+  uint32_t failedAttempts = 0;
+  uint32_t reconnects = 0;
+  uint32_t lastReconnectMs = 0;
+  uint32_t maxReconnectMs = 0;
+  unsigned long attemptStartMs = 0;
+  unsigned long retryAtMs = 0;
+  unsigned long disconnectedAtMs = 0;
 };
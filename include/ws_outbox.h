@@ -0,0 +1,98 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const uint8_t WS_MAX_CLIENTS = 4;
+static const size_t WS_CLIENT_QUEUE_BYTES = 16384;   // per client, frames not yet handed to AsyncTCP
+static const uint8_t WS_CLIENT_EVENTS = 16;          // ordered frames queued per client
+static const uint8_t WS_CLIENT_INFLIGHT = 2;         // frames in AsyncTCP's own queue per client
+static const uint8_t WS_DROP_STRIKES = 3;            // overflow episodes before a client is closed
+static const uint32_t WS_STALL_MS = 30000;           // no progress with frames pending
+static const uint32_t WS_PUMP_MS = 20;
+
+// Message types where only the newest copy matters. Slots drain in this
+// order, so progress never lands after the results that end a scan.
+enum class WsChannel : uint8_t { ScanProgress, Status, ScanResults, Count };
+
+struct WsClientStats {
+  uint32_t id = 0;
+  uint32_t queuedBytes = 0;
+  uint8_t queuedFrames = 0;
+  uint8_t strikes = 0;
+  bool downgraded = false;
+};
+
+struct WsOutboxStats {
+  uint8_t clients = 0;
+  uint32_t queuedBytes = 0;
+  uint32_t maxQueuedBytes = 0;   // high water of any one client
+  uint32_t sent = 0;
+  uint32_t coalesced = 0;        // frames replaced by a newer one before sending
+  uint32_t dropped = 0;          // frames refused by the byte cap
+  uint32_t downgrades = 0;
+  uint32_t disconnects = 0;      // clients closed for overflowing or stalling
+  uint32_t rejected = 0;         // connections refused with every slot taken
+  WsClientStats perClient[WS_MAX_CLIENTS];
+};
+
+// Per-client WebSocket send queues on top of AsyncWebSocket. A message is
+// serialized once into a shared buffer that every client's queue references.
+// Each client gets one latest-value slot per WsChannel plus a small ring of
+// ordered events, together capped at WS_CLIENT_QUEUE_BYTES. pump() moves frames
+// into the library only while the client has room in flight, so a stalled
+// phone holds at most its cap. The first overflow downgrades a client to no
+// scan progress; WS_DROP_STRIKES overflows, each separated by a frame that got
+// out, or WS_STALL_MS without progress close it.
+//
+// Any task may queue; queuing only calls `wake`, when a client's queue
+// starts filling, and loop() keeps pumping while frames are pending. pump() dereferences library
+// clients, which the main task frees in cleanupClients(), so it runs on the
+// main task only.
+class WsOutbox {
+public:
+  explicit WsOutbox(AsyncWebSocket& ws);
+  void begin(std::function<void()> wake);
+  bool open(uint32_t id);
+  void close(uint32_t id);
+  void publish(WsChannel channel, const char* data, size_t len);
+  void broadcast(const char* data, size_t len);
+  void broadcast(const char* text) { broadcast(text, strlen(text)); }
+  void send(uint32_t id, const char* data, size_t len, bool lossy = false);
+  void send(uint32_t id, const char* text) { send(id, text, strlen(text)); }
+  void pump();
+  bool pending() const;
+  WsOutboxStats stats() const;
+
+private:
+  struct Client {
+    uint32_t id = 0;  // 0 marks a free slot
+    AsyncWebSocketSharedBuffer latest[static_cast<uint8_t>(WsChannel::Count)];
+    AsyncWebSocketSharedBuffer events[WS_CLIENT_EVENTS];
+    uint8_t head = 0;
+    uint8_t count = 0;
+    uint32_t bytes = 0;
+    uint8_t strikes = 0;
+    bool struck = false;   // refused since the last frame went out
+    bool downgraded = false;
+    bool closing = false;
+    uint32_t lastProgressMs = 0;
+  };
+
+  static AsyncWebSocketSharedBuffer makeBuffer(const char* data, size_t len);
+  Client* find(uint32_t id);
+  void reset(Client& c);
+  bool admit(Client& c, size_t len, size_t freed, bool lossy);
+  void refuse(Client& c, bool lossy);
+  bool pushEvent(Client& c, const AsyncWebSocketSharedBuffer& buffer, bool lossy);
+  AsyncWebSocketSharedBuffer popNext(Client& c);
+  void pumpClient(uint32_t id);
+
+  AsyncWebSocket& ws;
+  SemaphoreHandle_t lock = nullptr;
+  std::function<void()> wakePump;
+  Client clients[WS_MAX_CLIENTS];
+  WsOutboxStats counters;
+};
@@ -17,12 +17,14 @@ const mockConfig = {
   mqtt_user: 'admin',
   mqtt_pass: '********',
   scan_interval_ms: 300000,
+  offline_grace_scans: 2,
+  offline_expire_scans: 24,
   subnets: [
     { cidr: '10.11.12.0/22', name: 'Home Network' },
     { cidr: '10.11.16.0/24', name: 'Office Network' },
   ],
   static_hosts: [
-    { ip: '10.11.12.6', port: 8123, name: 'HA VM' },
+    { ip: '10.11.12.6', port: 8123, name: 'HA VM', interval_ms: 30000 },
     { ip: '10.11.99.1', name: 'OPNsense' },
   ],
 };
@@ -106,11 +108,11 @@ function simulateScan(ws: any) {
 
   ws.send(
     JSON.stringify({
-      type: 'scan_started',
+      type: 'scan_progress',
       data: {
         scanning: true,
-        currentSubnet: subnets[0].cidr,
-        completedSubnets: [],
+        current_subnet: subnets[0].cidr,
+        completed_subnets: [],
       },
     })
   );
@@ -131,11 +133,11 @@ function simulateScan(ws: any) {
     if (currentIndex < subnets.length) {
       ws.send(
         JSON.stringify({
-          type: 'scan_started',
+          type: 'scan_progress',
           data: {
             scanning: true,
-            currentSubnet: subnets[currentIndex].cidr,
-            completedSubnets,
+            current_subnet: subnets[currentIndex].cidr,
+            completed_subnets: completedSubnets,
           },
         })
       );
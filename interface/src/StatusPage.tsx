@@ -31,14 +31,27 @@ export function StatusPage({ status, scanResults, scanProgress, connected, onSca
             <div class="animate-spin h-5 w-5 border-2 border-accent border-t-transparent rounded-full"></div>
             <span class="font-bold text-accent">Scanning in progress...</span>
           </div>
-          {scanProgress.currentSubnet && (
+          {scanProgress.progress_pct !== undefined && (
+            <div class="mt-3 ml-7 h-2 rounded-full bg-border overflow-hidden">
+              <div class="h-full bg-accent" style={{ width: `${scanProgress.progress_pct}%` }}></div>
+            </div>
+          )}
+          {scanProgress.current_subnet && (
             <p class="mt-2 text-sm text-muted ml-7">
-              Current subnet: {scanProgress.currentSubnet}
+              Current subnet: {scanProgress.current_subnet}
+              {scanProgress.sweep_total ? ` (${scanProgress.sweep_done}/${scanProgress.sweep_total})` : ''}
+            </p>
+          )}
+          {scanProgress.completed_subnets.length > 0 && (
+            <p class="mt-1 text-sm text-muted ml-7">
+              Completed: {scanProgress.completed_subnets.join(', ')}
             </p>
           )}
-          {scanProgress.completedSubnets.length > 0 && (
+          {!!scanProgress.probes_per_s && (
             <p class="mt-1 text-sm text-muted ml-7">
-              Completed: {scanProgress.completedSubnets.join(', ')}
+              {scanProgress.probes_per_s.toFixed(1)} probes/s
+              {scanProgress.eta_ms ? `, about ${formatDuration(scanProgress.eta_ms)} left` : ''}
+              {scanProgress.full_sweep_ms ? `, full sweep ${formatDuration(scanProgress.full_sweep_ms)}` : ''}
             </p>
           )}
         </div>
@@ -56,6 +69,13 @@ export function StatusPage({ status, scanResults, scanProgress, connected, onSca
   );
 }
 
+function formatDuration(ms: number): string {
+  const s = Math.round(ms / 1000);
+  if (s < 60) return `${s}s`;
+  if (s < 3600) return `${Math.floor(s / 60)}m ${s % 60}s`;
+  return `${Math.floor(s / 3600)}h ${Math.floor((s % 3600) / 60)}m`;
+}
+
 function Button({
   children,
   onClick,
@@ -64,6 +64,22 @@ export function ConfigForm({ config, onChange, onSave }: Props) {
           placeholder="300000"
         />
       </Label>
+      <Label text="Offline after missed scans">
+        <Input
+          type="number"
+          value={String(config.offline_grace_scans)}
+          onChange={(v) => onChange({ offline_grace_scans: parseInt(v) || 2 })}
+          placeholder="2"
+        />
+      </Label>
+      <Label text="Forget after missed scans (0 = never)">
+        <Input
+          type="number"
+          value={String(config.offline_expire_scans)}
+          onChange={(v) => onChange({ offline_expire_scans: parseInt(v) || 0 })}
+          placeholder="24"
+        />
+      </Label>
       <div class="mt-3">
         <Button onClick={onSave}>Save & Reboot</Button>
       </div>
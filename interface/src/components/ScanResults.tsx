@@ -44,7 +44,10 @@ function SubnetsTable({ data }: { data: SubnetResult[] }) {
           <tr key={row.cidr}>
             <Td>{row.cidr}</Td>
             <Td>{row.name || ''}</Td>
-            <Td>{row.online}</Td>
+            <Td>
+              {row.online ?? '–'}
+              {row.slices ? ` (slice ${(row.next_slice ?? 0) + 1}/${row.slices})` : ''}
+            </Td>
           </tr>
         ))}
       </tbody>
@@ -1,5 +1,5 @@
 import { useState } from 'preact/hooks';
-import type { Config } from '../types';
+import type { Config, StaticHost } from '../types';
 
 interface Props {
   config: Config | null;
@@ -7,25 +7,50 @@ interface Props {
   onSave: (targets: { subnets: string[]; hosts: string[] }) => void;
 }
 
+function renderPorts(h: { port?: number; ports?: number[] }): string {
+  if (h.ports && h.ports.length) return h.ports.join(',');
+  return h.port ? String(h.port) : '';
+}
+
+function renderInterval(ms?: number): string {
+  if (!ms) return '';
+  if (ms % 3600000 === 0) return ` @${ms / 3600000}h`;
+  if (ms % 60000 === 0) return ` @${ms / 60000}m`;
+  if (ms % 1000 === 0) return ` @${ms / 1000}s`;
+  return ` @${ms}ms`;
+}
+
+// Splits an "@30s" style interval off a target line; bare numbers are seconds
+function takeInterval(text: string): { rest: string; interval_ms?: number } {
+  const match = text.match(/@(\d+)(ms|s|m|h)?/);
+  if (!match) return { rest: text };
+  const scale = { ms: 1, s: 1000, m: 60000, h: 3600000 }[match[2] || 's'] ?? 1000;
+  return { rest: text.replace(match[0], ''), interval_ms: parseInt(match[1]) * scale };
+}
+
+function renderHost(h: StaticHost): string {
+  let line = h.check ? `${h.check}://${h.ip}` : h.ip;
+  const ports = renderPorts(h);
+  if (ports) line += `:${ports}`;
+  if (h.check_arg) line += h.check_arg;
+  line += renderInterval(h.interval_ms);
+  if (h.name) line += ` # ${h.name}`;
+  return line;
+}
+
 export function TargetsForm({ config, onChange, onSave }: Props) {
   if (!config) {
     return <Card title="Targets">Loading...</Card>;
   }
   const [subnetsText, setSubnetText] = useState(() =>
     config.subnets
-      .map((s) => (s.name ? `${s.cidr} # ${s.name}` : s.cidr))
-      .join('\n')
-  );
-  const [hostsText, setHostsText] = useState(() =>
-    config.static_hosts
-      .map((h) => {
-        let line = h.ip;
-        if (h.port) line += `:${h.port}`;
-        if (h.name) line += ` # ${h.name}`;
-        return line;
+      .map((s) => {
+        const line = s.cidr + renderInterval(s.interval_ms);
+        return s.name ? `${line} # ${s.name}` : line;
       })
       .join('\n')
   );
+  const [hostsText, setHostsText] = useState(() => config.static_hosts.map(renderHost).join('\n'));
 
   const handleSubnetsChange = (text: string) => {
     const subnets = text
@@ -33,9 +58,10 @@ export function TargetsForm({ config, onChange, onSave }: Props) {
       .filter(Boolean)
       .map((line) => {
         const [cidrPart, namePart] = line.split('#');
-        const cidr = cidrPart.trim();
+        const { rest, interval_ms } = takeInterval(cidrPart);
+        const cidr = rest.trim();
         const name = namePart ? namePart.trim() : undefined;
-        return { cidr, name };
+        return { cidr, name, interval_ms };
       });
     onChange({ subnets });
     setSubnetText(text);
@@ -46,13 +72,26 @@ export function TargetsForm({ config, onChange, onSave }: Props) {
       .split('\n')
       .filter(Boolean)
       .map((line) => {
-        const [hostPart, namePart] = line.split('#');
+        const [linePart, namePart] = line.split('#');
         const name = namePart ? namePart.trim() : undefined;
+        const { rest, interval_ms } = takeInterval(linePart);
+        // "http://host:port/path" selects a service check
+        const scheme = rest.trim().match(/^(http|dns|mqtt|tls):\/\/([^/]*)(\/.*)?$/i);
+        const hostPart = scheme ? scheme[2] : rest.trim();
+        const check = scheme ? (scheme[1].toLowerCase() as StaticHost['check']) : undefined;
+        const check_arg = scheme && scheme[3] ? scheme[3] : undefined;
         const [ip, portStr] = hostPart.split(':');
+        const ports = portStr
+          ? portStr.split(',').map((p) => parseInt(p.trim())).filter((p) => !isNaN(p))
+          : [];
         return {
           ip: ip.trim(),
-          port: portStr ? parseInt(portStr.trim()) : undefined,
+          port: ports.length ? ports[0] : undefined,
+          ports: ports.length > 1 ? ports : undefined,
           name,
+          interval_ms,
+          check,
+          check_arg,
         };
       });
     onChange({ static_hosts: hosts });
@@ -61,33 +100,28 @@ export function TargetsForm({ config, onChange, onSave }: Props) {
 
   const handleSave = () => {
     const subnets = config.subnets.map((s) => {
-      let line = s.cidr;
+      let line = s.cidr + renderInterval(s.interval_ms);
       if (s.name) line += ` # ${s.name}`;
       return line;
     });
-    const hosts = config.static_hosts.map((h) => {
-      let line = h.ip;
-      if (h.port) line += `:${h.port}`;
-      if (h.name) line += ` # ${h.name}`;
-      return line;
-    });
+    const hosts = config.static_hosts.map(renderHost);
     onSave({ subnets, hosts });
   };
 
   return (
     <Card title="Targets">
-      <Label text="Subnets (one per line, CIDR)">
+      <Label text="Subnets (one per line: CIDRs, a.b.c.x-y ranges, !exclusions, optional :ports and @interval)">
         <Textarea
           value={subnetsText}
           onChange={handleSubnetsChange}
-          placeholder="10.11.12.0/22\n10.11.16.0/24 # Office Network"
+          placeholder="10.11.12.0/22\n10.11.16.0/24, !10.11.16.1 # Office Network\n10.11.20.10-50 :22,80 @1m # Servers"
         />
       </Label>
-      <Label text="Static hosts (hostname or ip[:port] per line)">
+      <Label text="Static hosts ([http|dns|mqtt|tls://]hostname or ip[:port,port...][/path] [@interval] per line)">
         <Textarea
           value={hostsText}
           onChange={handleHostsChange}
-          placeholder="10.11.12.6:8123 # HA VM\n10.11.99.1 # OPNsense\nmyserver.local:80 # My Server"
+          placeholder="10.11.12.6:8123 @30s # HA VM\n10.11.99.1 # OPNsense\nhttp://myserver.local/health # My Server"
         />
       </Label>
       <div class="mt-3">
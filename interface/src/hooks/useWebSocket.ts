@@ -14,7 +14,7 @@ export function useWebSocket() {
     status: null,
     config: null,
     scanResults: null,
-    scanProgress: { scanning: false, completedSubnets: [] },
+    scanProgress: { scanning: false, completed_subnets: [] },
     connected: false,
   });
   const wsRef = useRef<WebSocket | null>(null);
@@ -47,12 +47,12 @@ export function useWebSocket() {
               return {
                 ...s,
                 scanResults: msg.data as ScanResults,
-                scanProgress: { scanning: false, completedSubnets: [] },
+                scanProgress: { scanning: false, completed_subnets: [] },
               };
-            case 'scan_started':
+            case 'scan_progress':
               return {
                 ...s,
-                scanProgress: (msg.data as ScanProgress) || { scanning: true, completedSubnets: [] },
+                scanProgress: (msg.data as ScanProgress) || { scanning: true, completed_subnets: [] },
               };
             default:
               return s;
@@ -1,13 +1,81 @@
+export interface ClusterStats {
+  leader: boolean;
+  epoch: number;
+  members: number;
+  rebalances: number;
+}
+
+export interface DeadlineStats {
+  jobs: number;
+  misses: number;
+  last_late_ms: number;
+  max_late_ms: number;
+  queued: number;
+  next_due_in_ms: number;
+}
+
+export interface WifiStats {
+  state: 'idle' | 'portal' | 'connecting' | 'connected' | 'backoff';
+  captive: boolean;
+  attempts: number;
+  reconnects: number;
+  last_reconnect_ms: number;
+  max_reconnect_ms: number;
+  next_retry_in_ms: number;
+}
+
+export interface TimingStats {
+  count: number;
+  avg_us: number;
+  p50_us: number;
+  p99_us: number;
+  max_us: number;
+  window_count: number;
+  window_p50_us: number;
+  window_p99_us: number;
+  window_max_us: number;
+  buckets?: number[];
+}
+
+export interface PerfStats {
+  timings: Record<string, TimingStats>;
+  heap: {
+    free: number;
+    min_free: number;
+    largest_block: number;
+    min_largest_block: number;
+  };
+  log: LogStats;
+}
+
+export interface LogStats {
+  written: number;
+  dropped: number;
+}
+
 export interface Status {
   wifi_connected: boolean;
   wifi_ip: string;
   mqtt_connected: boolean;
   mqtt_reason: string;
+  wifi?: WifiStats;
+  cluster?: ClusterStats;
+  deadlines?: DeadlineStats;
+  scan?: ScanProgress;
+  passive?: PassiveStats;
+  event_loop?: EventLoopStats;
+  boot?: BootTimeline;
+  ws?: WsStats;
+  log?: LogStats;
+  commands?: CommandStats;
+  perf?: PerfStats;
+  arena?: Record<'loop' | 'web', { capacity: number; high_water: number; fallbacks: number }>;
 }
 
 export interface Subnet {
   cidr: string;
   name?: string;
+  interval_ms?: number;
 }
 
 export interface Config {
@@ -18,6 +86,10 @@ export interface Config {
   mqtt_user: string;
   mqtt_pass: string;
   scan_interval_ms: number;
+  offline_grace_scans: number;
+  offline_expire_scans: number;
+  cluster_enabled?: boolean;
+  passive_discovery?: boolean;
   subnets: Subnet[];
   static_hosts: StaticHost[];
 }
@@ -25,13 +97,30 @@ export interface Config {
 export interface StaticHost {
   ip: string;
   port?: number;
+  ports?: number[];
   name?: string;
+  interval_ms?: number;
+  check?: 'http' | 'dns' | 'mqtt' | 'tls';
+  check_arg?: string;
+}
+
+export interface SliceResult {
+  online?: number;
+  found?: number;
+  completed_ms?: number;
+  duration_ms?: number;
 }
 
 export interface SubnetResult {
   cidr: string;
   name?: string;
-  online: number;
+  online?: number;
+  found?: number;
+  duration_ms?: number;
+  interval_ms?: number;
+  slices?: number;
+  next_slice?: number;
+  slice_results?: SliceResult[];
 }
 
 export interface HostResult {
@@ -39,6 +128,95 @@ export interface HostResult {
   port?: number;
   name?: string;
   online: boolean;
+  rtt_ms?: number;
+  last_seen_ms?: number;
+  check?: string;
+  latency_ms?: number;
+  code?: number;
+}
+
+export interface ScanHeapStats {
+  scans: number;
+  free_after_scan: number;
+  largest_after_scan: number;
+  min_largest_after_scan: number;
+}
+
+export interface ScanRunStats {
+  duration_ms: number;
+  probes: number;
+  passive_skips?: number;
+  arp_alive?: number;
+  probes_per_s: number;
+  publishes: number;
+  min_free_heap: number;
+}
+
+export interface PassiveStats {
+  listening: boolean;
+  mdns: number;
+  ssdp: number;
+  dhcp: number;
+  malformed: number;
+  sightings: number;
+}
+
+export interface BootTimeline {
+  web_ms: number;
+  wifi_ms: number;
+  mqtt_ms: number;
+  first_probe_ms: number;
+  first_state_ms: number;
+  discovery_ms: number;
+}
+
+export interface WsQueue {
+  id: number;
+  bytes: number;
+  frames: number;
+  strikes: number;
+  downgraded: boolean;
+}
+
+export interface CommandStats {
+  queued: number;
+  executed: number;
+  rejected: number;
+  pending: number;
+  max_wait_ms: number;
+}
+
+export interface WsStats {
+  clients: number;
+  queued_bytes: number;
+  max_queued_bytes: number;
+  sent: number;
+  coalesced: number;
+  dropped: number;
+  downgrades: number;
+  disconnects: number;
+  rejected: number;
+  queues: WsQueue[];
+}
+
+export interface EventLoopStats {
+  idle_pct: number;
+  wakeups: number;
+  timer_wakeups: number;
+  wifi_wakeups: number;
+  socket_wakeups: number;
+  web_wakeups: number;
+  busy_passes: number;
+  light_sleep: boolean;
+}
+
+export interface InventoryStats {
+  hosts: number;
+  sweep: number;
+  log_bytes: number;
+  appends: number;
+  compactions: number;
+  untracked: number;
 }
 
 export interface ScanResults {
@@ -47,17 +225,74 @@ export interface ScanResults {
   found_count: number;
   subnets: SubnetResult[];
   hosts: HostResult[];
+  heap?: ScanHeapStats;
+  run?: ScanRunStats;
+  inventory?: InventoryStats;
 }
 
-export type WsMessageType = 'status' | 'config' | 'scan_results' | 'scan_started' | 'targets_saved' | 'config_saved';
+export interface Outage {
+  start_ago_s: number;
+  duration_s: number;
+  ongoing?: boolean;
+}
+
+export interface HostHistory {
+  ip: string;
+  name: string;
+  online: boolean;
+  last_seen_ago_s: number;
+  uptime_24h?: number;
+  uptime_7d?: number;
+  outages: Outage[];
+  rtt_ms?: number[];
+}
+
+export interface HistoryResponse {
+  now_s: number;
+  hosts: HostHistory[];
+}
+
+export type WsMessageType =
+  | 'status'
+  | 'config'
+  | 'scan_results'
+  | 'scan_progress'
+  | 'scan_started'
+  | 'targets_saved'
+  | 'targets_rejected'
+  | 'config_saved'
+  | 'config_rejected'
+  | 'rebooting'
+  | 'busy'
+  | 'log'
+  | 'log_subscribed'
+  | 'log_busy';
+
+export interface LogLine {
+  ts: number;
+  level: 'ERROR' | 'WARN' | 'INFO' | 'DEBUG' | 'TRACE';
+  msg: string;
+}
 
 export interface ScanProgress {
   scanning: boolean;
-  currentSubnet?: string;
-  completedSubnets: string[];
+  current_subnet?: string;
+  slice?: number;
+  slices?: number;
+  sweep_done?: number;
+  sweep_total?: number;
+  completed_subnets: string[];
+  done?: number;
+  remaining?: number;
+  progress_pct?: number;
+  probes_per_s?: number;
+  addresses_per_s?: number;
+  elapsed_ms?: number;
+  eta_ms?: number;
+  full_sweep_ms?: number;
 }
 
 export interface WsMessage {
   type: WsMessageType;
-  data?: Status | Config | ScanResults | ScanProgress;
+  data?: Status | Config | ScanResults | ScanProgress | LogLine;
 }
@@ -0,0 +1,112 @@
+#include "Arduino.h"
+#include "FS.h"
+#include "NativeHost.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+  std::atomic<bool> virtualClock{true};
+  std::atomic<uint64_t> virtualUs{0};
+  std::mt19937 rng(1);
+
+  uint64_t realUs()
+  {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  size_t allocatedBytes()
+  {
+#if defined(__GLIBC__)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+  }
+
+  const size_t heapBaseline = allocatedBytes();
+}
+
+namespace host {
+
+void useVirtualClock(bool on) { virtualClock = on; }
+void advance(uint32_t ms) { advanceMicros(static_cast<uint64_t>(ms) * 1000); }
+void advanceMicros(uint64_t us) { virtualUs += us; }
+
+size_t heapInUse()
+{
+  size_t used = allocatedBytes();
+  size_t flash = fs::flashBytesHeld();
+  used = used > flash ? used - flash : 0;
+  return used > heapBaseline ? used - heapBaseline : 0;
+}
+
+void resetHeapWatermark() { ESP.resetMinFreeHeap(); }
+
+}
+
+uint64_t nativeMicros64() { return virtualClock ? virtualUs.load() : realUs(); }
+unsigned long millis() { return static_cast<unsigned long>(nativeMicros64() / 1000); }
+unsigned long micros() { return static_cast<unsigned long>(nativeMicros64()); }
+
+void delay(uint32_t ms)
+{
+  if (virtualClock) host::advance(ms);
+  else std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  if (virtualClock) host::advanceMicros(us);
+  else std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {}
+
+long random(long max) { return max > 0 ? random(0, max) : 0; }
+long random(long min, long max)
+{
+  if (max <= min) return min;
+  return std::uniform_int_distribution<long>(min, max - 1)(rng);
+}
+void randomSeed(unsigned long seed) { rng.seed(seed); }
+
+void HardwareSerial::begin(unsigned long) {}
+size_t HardwareSerial::write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+size_t HardwareSerial::write(const uint8_t* buf, size_t n) { return fwrite(buf, 1, n, stdout); }
+void HardwareSerial::flush() { fflush(stdout); }
+
+uint32_t EspClass::getHeapSize() { return host::HEAP_BYTES; }
+
+uint32_t EspClass::getFreeHeap()
+{
+  size_t used = host::heapInUse();
+  uint32_t free = used < host::HEAP_BYTES ? host::HEAP_BYTES - used : 0;
+  if (free < minFree) minFree = free;
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+  getFreeHeap();
+  return minFree;
+}
+
+// The host heap does not fragment the way the device heap does
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap(); }
+uint64_t EspClass::getEfuseMac() { return efuseMac; }
+
+void EspClass::restart()
+{
+  fflush(stdout);
+  exit(0);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+// Heap figures model an ESP32-C3 heap: the bytes the process has allocated
+// since start-up are taken from NativeHost::HEAP_BYTES.
+class EspClass {
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint64_t getEfuseMac();
+  const char* getChipModel() { return "native"; }
+  void restart();
+
+  // Host only: distinct node ids for several nodes in one process
+  void setEfuseMac(uint64_t mac) { efuseMac = mac; }
+  void resetMinFreeHeap() { minFree = UINT32_MAX; }
+
+private:
+  uint64_t efuseMac = 0x0000A1B2C3D4E5F6ULL;
+  uint32_t minFree = UINT32_MAX;
+};
+
+extern EspClass ESP;
@@ -0,0 +1,161 @@
+#include "FS.h"
+#include <atomic>
+#include <cstring>
+
+namespace fs {
+
+namespace {
+  std::atomic<ptrdiff_t> flashHeld{0};
+}
+
+size_t flashBytesHeld() { return static_cast<size_t>(flashHeld.load()); }
+void noteFlashBytes(ptrdiff_t delta) { flashHeld += delta; }
+
+// Takes up to `n` bytes from the power budget; false once the device is off
+bool MemStore::spend(size_t& n)
+{
+  if (!powered) return false;
+  if (n >= budget) {
+    n = budget;
+    budget = 0;
+    powered = false;
+  } else if (budget != SIZE_MAX) {
+    budget -= n;
+  }
+  written += n;
+  return true;
+}
+
+File::File(std::shared_ptr<MemStore> s, std::shared_ptr<FileBytes> d, const std::string& p, bool r, bool w, bool a)
+  : store(std::move(s)), data(std::move(d)), filePath(p), readable(r), writable(w), append(a) {}
+
+size_t File::write(const uint8_t* buf, size_t n)
+{
+  if (!data || !writable || !store->spend(n)) return 0;
+  if (append) pos = data->size();
+  if (pos + n > data->size()) data->resize(pos + n);
+  memcpy(data->data() + pos, buf, n);
+  pos += n;
+  return n;
+}
+
+int File::available()
+{
+  if (!data || !readable || pos >= data->size()) return 0;
+  return static_cast<int>(data->size() - pos);
+}
+
+int File::read()
+{
+  uint8_t c;
+  return read(&c, 1) ? c : -1;
+}
+
+int File::peek()
+{
+  if (!available()) return -1;
+  return (*data)[pos];
+}
+
+size_t File::read(uint8_t* buf, size_t n)
+{
+  size_t left = available();
+  if (n > left) n = left;
+  if (n) memcpy(buf, data->data() + pos, n);
+  pos += n;
+  return n;
+}
+
+bool File::seek(uint32_t offset, SeekMode mode)
+{
+  if (!data) return false;
+  size_t base = mode == SeekSet ? 0 : mode == SeekCur ? pos : data->size();
+  if (base + offset > data->size()) return false;
+  pos = base + offset;
+  return true;
+}
+
+void File::close()
+{
+  data.reset();
+  store.reset();
+}
+
+const char* File::name() const
+{
+  const char* slash = strrchr(filePath.c_str(), '/');
+  return slash ? slash + 1 : filePath.c_str();
+}
+
+File FS::open(const char* path, const char* mode, bool)
+{
+  std::string p(path);
+  bool plus = strchr(mode, '+') != nullptr;
+  auto it = store->files.find(p);
+  if (mode[0] == 'r') {
+    if (it == store->files.end()) return File();
+    return File(store, it->second, p, true, plus, false);
+  }
+  // Creating or truncating is a change, so it needs power
+  if (!store->powered) return File();
+  if (mode[0] == 'w' || it == store->files.end()) {
+    auto data = std::make_shared<FileBytes>();
+    store->files[p] = data;
+    return File(store, data, p, plus, true, mode[0] == 'a');
+  }
+  return File(store, it->second, p, plus, true, true);
+}
+
+bool FS::exists(const char* path)
+{
+  return store->files.count(path) || store->dirs.count(path);
+}
+
+bool FS::remove(const char* path)
+{
+  return store->powered && store->files.erase(path) > 0;
+}
+
+bool FS::rename(const char* from, const char* to)
+{
+  auto it = store->files.find(from);
+  if (!store->powered || it == store->files.end()) return false;
+  auto data = it->second;
+  store->files.erase(it);
+  store->files[to] = data;
+  return true;
+}
+
+bool FS::mkdir(const char* path)
+{
+  if (!store->powered) return false;
+  store->dirs.insert(path);
+  return true;
+}
+
+bool FS::rmdir(const char* path)
+{
+  return store->powered && store->dirs.erase(path) > 0;
+}
+
+void FS::cutPowerAfter(size_t bytes)
+{
+  store->budget = bytes;
+  store->powered = bytes > 0;
+}
+
+void FS::restorePower()
+{
+  store->budget = SIZE_MAX;
+  store->powered = true;
+}
+
+void FS::wipe()
+{
+  store->files.clear();
+  store->dirs.clear();
+  store->written = 0;
+  restorePower();
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "Stream.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+// In-memory flash. Bytes are durable as soon as write() returns, which is
+// harsher than LittleFS (it commits on close), so recovery tested here also
+// holds on the device. cutPowerAfter() lets a test stop the device after a
+// given number of further bytes: the write in progress is cut short and
+// every later change fails until restorePower().
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// File contents sit on the host heap but are flash, not RAM, on the device.
+// Their bytes are counted here so host::heapInUse() leaves them out.
+size_t flashBytesHeld();
+void noteFlashBytes(ptrdiff_t delta);
+
+template <class T>
+struct FlashAllocator {
+  using value_type = T;
+  FlashAllocator() = default;
+  template <class U>
+  FlashAllocator(const FlashAllocator<U>&) {}
+  T* allocate(size_t n)
+  {
+    noteFlashBytes(static_cast<ptrdiff_t>(n * sizeof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t n)
+  {
+    noteFlashBytes(-static_cast<ptrdiff_t>(n * sizeof(T)));
+    ::operator delete(p);
+  }
+  template <class U>
+  bool operator==(const FlashAllocator<U>&) const { return true; }
+  template <class U>
+  bool operator!=(const FlashAllocator<U>&) const { return false; }
+};
+
+using FileBytes = std::vector<uint8_t, FlashAllocator<uint8_t>>;
+
+struct MemStore {
+  std::map<std::string, std::shared_ptr<FileBytes>> files;
+  std::set<std::string> dirs;
+  size_t written = 0;
+  size_t budget = SIZE_MAX;
+  bool powered = true;
+
+  bool spend(size_t& n);
+};
+
+class File : public Stream {
+public:
+  File() {}
+  File(std::shared_ptr<MemStore> store, std::shared_ptr<FileBytes> data, const std::string& path, bool readable, bool writable, bool append);
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t n) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override {}
+  size_t read(uint8_t* buf, size_t n);
+  size_t readBytes(char* buf, size_t n) override { return read(reinterpret_cast<uint8_t*>(buf), n); }
+  using Stream::readBytes;
+  bool seek(uint32_t pos, SeekMode mode);
+  bool seek(uint32_t pos) { return seek(pos, SeekSet); }
+  size_t position() const { return pos; }
+  size_t size() const { return data ? data->size() : 0; }
+  void close();
+  operator bool() const { return data != nullptr; }
+  const char* path() const { return filePath.c_str(); }
+  const char* name() const;
+  bool isDirectory() const { return false; }
+  using Print::write;
+
+private:
+  std::shared_ptr<MemStore> store;
+  std::shared_ptr<FileBytes> data;
+  std::string filePath;
+  size_t pos = 0;
+  bool readable = false;
+  bool writable = false;
+  bool append = false;
+};
+
+class FS {
+public:
+  FS() : store(std::make_shared<MemStore>()) {}
+  File open(const char* path, const char* mode = FILE_READ, bool create = false);
+  File open(const String& path, const char* mode = FILE_READ, bool create = false) { return open(path.c_str(), mode, create); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char* path);
+  bool rmdir(const char* path);
+
+  // Host only
+  void cutPowerAfter(size_t bytes);
+  void restorePower();
+  bool powered() const { return store->powered; }
+  size_t bytesWritten() const { return store->written; }
+  void wipe();
+
+protected:
+  std::shared_ptr<MemStore> store;
+};
+
+}
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
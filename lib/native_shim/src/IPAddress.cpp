@@ -0,0 +1,34 @@
+#include "IPAddress.h"
+#include <cstdio>
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+bool IPAddress::fromString(const char* s)
+{
+  uint8_t parsed[4];
+  int part = 0;
+  int value = -1;
+  for (const char* p = s; ; p++) {
+    if (*p >= '0' && *p <= '9') {
+      value = (value < 0 ? 0 : value * 10) + (*p - '0');
+      if (value > 255) return false;
+    } else if (*p == '.' || !*p) {
+      if (value < 0 || part > 3) return false;
+      parsed[part++] = value;
+      value = -1;
+      if (!*p) break;
+    } else {
+      return false;
+    }
+  }
+  if (part != 4) return false;
+  memcpy(octets, parsed, 4);
+  return true;
+}
+
+String IPAddress::toString() const
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+  return String(buf);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "WString.h"
+
+// IPv4 only. As in the core, the uint32_t form holds the octets in memory
+// order, i.e. network byte order.
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+  IPAddress(uint32_t address) { memcpy(octets, &address, 4); }
+  explicit IPAddress(const uint8_t* address) { memcpy(octets, address, 4); }
+
+  operator uint32_t() const { uint32_t v; memcpy(&v, octets, 4); return v; }
+  uint8_t operator[](int i) const { return octets[i]; }
+  uint8_t& operator[](int i) { return octets[i]; }
+  bool operator==(const IPAddress& o) const { return memcmp(octets, o.octets, 4) == 0; }
+  bool operator!=(const IPAddress& o) const { return !(*this == o); }
+  bool operator==(const uint8_t* address) const { return memcmp(octets, address, 4) == 0; }
+
+  bool fromString(const char* s);
+  bool fromString(const String& s) { return fromString(s.c_str()); }
+  String toString() const;
+
+private:
+  uint8_t octets[4] = {0, 0, 0, 0};
+};
+
+extern const IPAddress INADDR_NONE;
@@ -0,0 +1,23 @@
+#include "LittleFS.h"
+
+fs::LittleFSFS LittleFS;
+
+namespace fs {
+
+bool LittleFSFS::begin(bool, const char*, uint8_t, const char*) { return true; }
+
+bool LittleFSFS::format()
+{
+  if (!store->powered) return false;
+  wipe();
+  return true;
+}
+
+size_t LittleFSFS::usedBytes() const
+{
+  size_t used = 0;
+  for (const auto& f : store->files) used += f.second->size();
+  return used;
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "FS.h"
+
+namespace fs {
+
+class LittleFSFS : public FS {
+public:
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char* partitionLabel = "spiffs");
+  void end() {}
+  bool format();
+  size_t totalBytes() const { return 1536 * 1024; }
+  size_t usedBytes() const;
+};
+
+}
+
+extern fs::LittleFSFS LittleFS;
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Controls for the native environment's stand-ins, used by tests and
+// benchmarks. None of this exists on the device.
+namespace host {
+
+static const size_t HEAP_BYTES = 320 * 1024;
+
+// With the virtual clock, time only moves through delay() and advance(), so
+// simulated probe waits cost no wall time and runs are repeatable. The real
+// clock follows the host's steady clock for tests against live sockets.
+void useVirtualClock(bool on);
+void advance(uint32_t ms);
+void advanceMicros(uint64_t us);
+
+// Bytes the process has allocated beyond its start-up baseline, leaving out
+// the contents of the in-memory flash
+size_t heapInUse();
+// Starts a new heap low-water mark for ESP.getMinFreeHeap()
+void resetHeapWatermark();
+
+}
@@ -0,0 +1,27 @@
+#include "Print.h"
+#include <cstdarg>
+#include <cstdio>
+#include <vector>
+
+size_t Print::write(const uint8_t* buf, size_t n)
+{
+  size_t done = 0;
+  while (done < n && write(buf[done])) done++;
+  return done;
+}
+
+size_t Print::printf(const char* fmt, ...)
+{
+  char small[128];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if (static_cast<size_t>(len) < sizeof(small)) return write(small, len);
+  std::vector<char> big(len + 1);
+  va_start(args, fmt);
+  vsnprintf(big.data(), big.size(), fmt, args);
+  va_end(args);
+  return write(big.data(), len);
+}
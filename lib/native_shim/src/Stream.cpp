@@ -0,0 +1,26 @@
+#include "Stream.h"
+
+size_t Stream::readBytes(char* buf, size_t n)
+{
+  size_t done = 0;
+  while (done < n) {
+    int c = read();
+    if (c < 0) break;
+    buf[done++] = static_cast<char>(c);
+  }
+  return done;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+  String s;
+  for (int c = read(); c >= 0 && c != terminator; c = read()) s.concat(static_cast<char>(c));
+  return s;
+}
+
+String Stream::readString()
+{
+  String s;
+  for (int c = read(); c >= 0; c = read()) s.concat(static_cast<char>(c));
+  return s;
+}
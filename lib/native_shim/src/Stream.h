@@ -0,0 +1,20 @@
+#pragma once
+#include "Print.h"
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  // Reads never wait on the host: a stream that runs dry ends the read
+  void setTimeout(unsigned long ms) { timeoutMs = ms; }
+  unsigned long getTimeout() const { return timeoutMs; }
+  virtual size_t readBytes(char* buf, size_t n);
+  size_t readBytes(uint8_t* buf, size_t n) { return readBytes(reinterpret_cast<char*>(buf), n); }
+  String readStringUntil(char terminator);
+  String readString();
+
+protected:
+  unsigned long timeoutMs = 1000;
+};
@@ -0,0 +1,116 @@
+#include "WString.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+  std::string formatUnsigned(unsigned long long v, unsigned char base)
+  {
+    if (base < 2 || base > 36) base = 10;
+    std::string s;
+    do {
+      unsigned d = v % base;
+      s.insert(s.begin(), static_cast<char>(d < 10 ? '0' + d : 'a' + d - 10));
+      v /= base;
+    } while (v);
+    return s;
+  }
+
+  std::string formatSigned(long long v, unsigned char base)
+  {
+    if (v < 0 && base == 10) return "-" + formatUnsigned(0ULL - static_cast<unsigned long long>(v), base);
+    return formatUnsigned(static_cast<unsigned long long>(v), base);
+  }
+
+  std::string formatFloat(double v, unsigned decimals)
+  {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%.*f", static_cast<int>(decimals), v);
+    return tmp;
+  }
+}
+
+String::String(int v, unsigned char base) : buf(formatSigned(v, base)) {}
+String::String(unsigned v, unsigned char base) : buf(formatUnsigned(v, base)) {}
+String::String(long v, unsigned char base) : buf(formatSigned(v, base)) {}
+String::String(unsigned long v, unsigned char base) : buf(formatUnsigned(v, base)) {}
+String::String(long long v, unsigned char base) : buf(formatSigned(v, base)) {}
+String::String(unsigned long long v, unsigned char base) : buf(formatUnsigned(v, base)) {}
+String::String(float v, unsigned decimals) : buf(formatFloat(v, decimals)) {}
+String::String(double v, unsigned decimals) : buf(formatFloat(v, decimals)) {}
+
+bool String::equalsIgnoreCase(const String& s) const
+{
+  if (buf.size() != s.buf.size()) return false;
+  for (size_t i = 0; i < buf.size(); i++) {
+    if (tolower(static_cast<unsigned char>(buf[i])) != tolower(static_cast<unsigned char>(s.buf[i]))) return false;
+  }
+  return true;
+}
+
+bool String::endsWith(const String& s) const
+{
+  return buf.size() >= s.buf.size() && buf.compare(buf.size() - s.buf.size(), s.buf.size(), s.buf) == 0;
+}
+
+String String::substring(unsigned from, unsigned to) const
+{
+  if (from > to) std::swap(from, to);
+  if (from >= buf.size()) return String();
+  if (to > buf.size()) to = buf.size();
+  return String(buf.c_str() + from, to - from);
+}
+
+void String::trim()
+{
+  size_t first = 0;
+  while (first < buf.size() && isspace(static_cast<unsigned char>(buf[first]))) first++;
+  size_t last = buf.size();
+  while (last > first && isspace(static_cast<unsigned char>(buf[last - 1]))) last--;
+  buf = buf.substr(first, last - first);
+}
+
+void String::toLowerCase()
+{
+  for (auto& c : buf) c = tolower(static_cast<unsigned char>(c));
+}
+
+void String::toUpperCase()
+{
+  for (auto& c : buf) c = toupper(static_cast<unsigned char>(c));
+}
+
+void String::replace(char from, char to)
+{
+  for (auto& c : buf) {
+    if (c == from) c = to;
+  }
+}
+
+void String::replace(const String& from, const String& to)
+{
+  if (from.buf.empty()) return;
+  size_t p = 0;
+  while ((p = buf.find(from.buf, p)) != std::string::npos) {
+    buf.replace(p, from.buf.size(), to.buf);
+    p += to.buf.size();
+  }
+}
+
+void String::remove(unsigned index, unsigned count)
+{
+  if (index < buf.size()) buf.erase(index, count);
+}
+
+long String::toInt() const { return strtol(buf.c_str(), nullptr, 10); }
+float String::toFloat() const { return strtof(buf.c_str(), nullptr); }
+double String::toDouble() const { return strtod(buf.c_str(), nullptr); }
+
+String operator+(const String& a, const String& b) { String r(a); r.concat(b); return r; }
+String operator+(const String& a, const char* b) { String r(a); r.concat(b); return r; }
+String operator+(const char* a, const String& b) { String r(a); r.concat(b); return r; }
+String operator+(const String& a, char b) { String r(a); r.concat(b); return r; }
+String operator+(const String& a, int b) { String r(a); r.concat(b); return r; }
+String operator+(const String& a, unsigned b) { String r(a); r.concat(b); return r; }
+String operator+(const String& a, long b) { String r(a); r.concat(b); return r; }
+String operator+(const String& a, unsigned long b) { String r(a); r.concat(b); return r; }
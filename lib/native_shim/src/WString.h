@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Arduino String over std::string. Numeric constructors are explicit as in
+// the core so overloads resolve the same way on both builds.
+class String {
+public:
+  String() {}
+  String(const char* s) : buf(s ? s : "") {}
+  String(const char* s, size_t n) : buf(s ? s : "", s ? n : 0) {}
+  String(const String& s) = default;
+  String(String&& s) noexcept = default;
+  explicit String(char c) : buf(1, c) {}
+  explicit String(int v, unsigned char base = 10);
+  explicit String(unsigned v, unsigned char base = 10);
+  explicit String(long v, unsigned char base = 10);
+  explicit String(unsigned long v, unsigned char base = 10);
+  explicit String(long long v, unsigned char base = 10);
+  explicit String(unsigned long long v, unsigned char base = 10);
+  explicit String(float v, unsigned decimals = 2);
+  explicit String(double v, unsigned decimals = 2);
+
+  String& operator=(const String& s) = default;
+  String& operator=(String&& s) noexcept = default;
+  String& operator=(const char* s) { buf = s ? s : ""; return *this; }
+
+  const char* c_str() const { return buf.c_str(); }
+  unsigned length() const { return buf.size(); }
+  bool isEmpty() const { return buf.empty(); }
+  void clear() { buf.clear(); }
+  bool reserve(unsigned n) { buf.reserve(n); return true; }
+
+  bool concat(const String& s) { buf += s.buf; return true; }
+  bool concat(const char* s) { if (!s) return false; buf += s; return true; }
+  bool concat(const char* s, unsigned n) { if (!s) return false; buf.append(s, n); return true; }
+  bool concat(char c) { buf += c; return true; }
+  bool concat(int v) { return concat(String(v)); }
+  bool concat(unsigned v) { return concat(String(v)); }
+  bool concat(long v) { return concat(String(v)); }
+  bool concat(unsigned long v) { return concat(String(v)); }
+  bool concat(long long v) { return concat(String(v)); }
+  bool concat(unsigned long long v) { return concat(String(v)); }
+  bool concat(float v) { return concat(String(v)); }
+  bool concat(double v) { return concat(String(v)); }
+  template <typename T>
+  String& operator+=(const T& v) { concat(v); return *this; }
+
+  bool equals(const String& s) const { return buf == s.buf; }
+  bool equals(const char* s) const { return buf == (s ? s : ""); }
+  bool equalsIgnoreCase(const String& s) const;
+  bool startsWith(const String& s) const { return buf.compare(0, s.buf.size(), s.buf) == 0; }
+  bool endsWith(const String& s) const;
+  bool operator==(const String& s) const { return equals(s); }
+  bool operator==(const char* s) const { return equals(s); }
+  bool operator!=(const String& s) const { return !equals(s); }
+  bool operator!=(const char* s) const { return !equals(s); }
+  bool operator<(const String& s) const { return buf < s.buf; }
+  bool operator>(const String& s) const { return buf > s.buf; }
+  int compareTo(const String& s) const { return buf.compare(s.buf); }
+
+  char charAt(unsigned i) const { return i < buf.size() ? buf[i] : 0; }
+  char operator[](unsigned i) const { return charAt(i); }
+  char& operator[](unsigned i) { return buf[i]; }
+  int indexOf(char c, unsigned from = 0) const { return position(buf.find(c, from)); }
+  int indexOf(const String& s, unsigned from = 0) const { return position(buf.find(s.buf, from)); }
+  int lastIndexOf(char c) const { return position(buf.rfind(c)); }
+  int lastIndexOf(const String& s) const { return position(buf.rfind(s.buf)); }
+  String substring(unsigned from) const { return substring(from, buf.size()); }
+  String substring(unsigned from, unsigned to) const;
+
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  void replace(char from, char to);
+  void replace(const String& from, const String& to);
+  void remove(unsigned index) { remove(index, buf.size()); }
+  void remove(unsigned index, unsigned count);
+  long toInt() const;
+  float toFloat() const;
+  double toDouble() const;
+
+private:
+  static int position(size_t p) { return p == std::string::npos ? -1 : static_cast<int>(p); }
+
+  std::string buf;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const char* a, const String& b);
+String operator+(const String& a, char b);
+String operator+(const String& a, int b);
+String operator+(const String& a, unsigned b);
+String operator+(const String& a, long b);
+String operator+(const String& a, unsigned long b);
+inline bool operator==(const char* a, const String& b) { return b == a; }
+inline bool operator!=(const char* a, const String& b) { return b != a; }
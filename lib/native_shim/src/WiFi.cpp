@@ -0,0 +1,67 @@
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t m)
+{
+  currentMode = m;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char*, const char*)
+{
+  begins++;
+  linkStatus = WL_DISCONNECTED;
+  return linkStatus;
+}
+
+bool WiFiClass::disconnect(bool, bool)
+{
+  disconnects++;
+  setStatus(WL_DISCONNECTED);
+  return true;
+}
+
+bool WiFiClass::softAP(const char*, const char*)
+{
+  apUp = true;
+  return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress, IPAddress, IPAddress) { return true; }
+
+bool WiFiClass::softAPdisconnect(bool)
+{
+  apUp = false;
+  return true;
+}
+
+void WiFiClass::onEvent(EventHandler handler, arduino_event_id_t event) { handlers.push_back({ std::move(handler), event }); }
+
+// Leaving WL_CONNECTED raises the disconnect event as the core does
+void WiFiClass::setStatus(wl_status_t s)
+{
+  bool wasConnected = linkStatus == WL_CONNECTED;
+  linkStatus = s;
+  if (s == WL_CONNECTED && !wasConnected) raise(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  if (s != WL_CONNECTED && wasConnected) raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
+
+void WiFiClass::reset()
+{
+  handlers.clear();
+  currentMode = WIFI_OFF;
+  linkStatus = WL_IDLE_STATUS;
+  apUp = false;
+  stations = 0;
+  begins = 0;
+  disconnects = 0;
+}
+
+void WiFiClass::raise(arduino_event_id_t event)
+{
+  arduino_event_info_t info;
+  for (auto &s : handlers) {
+    if (s.event == event || s.event == ARDUINO_EVENT_MAX) s.handler(event, info);
+  }
+}
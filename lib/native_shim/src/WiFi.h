@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "IPAddress.h"
+
+// Station and soft-AP calls the Wi-Fi manager makes, with the link scripted by
+// the test: association never completes on its own, setStatus() decides it.
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_MAX,
+} arduino_event_id_t;
+
+typedef struct {
+} arduino_event_info_t;
+
+class WiFiClass {
+public:
+  using EventHandler = std::function<void(arduino_event_id_t, arduino_event_info_t)>;
+
+  bool mode(wifi_mode_t m);
+  wifi_mode_t getMode() const { return currentMode; }
+  wl_status_t begin(const char* ssid, const char* pass);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  wl_status_t status() const { return linkStatus; }
+  IPAddress localIP() const { return linkStatus == WL_CONNECTED ? address : IPAddress(); }
+  bool softAP(const char* ssid, const char* pass);
+  bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet);
+  bool softAPdisconnect(bool wifiOff = false);
+  uint8_t softAPgetStationNum() const { return apUp ? stations : 0; }
+  void onEvent(EventHandler handler, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+
+  // Host only: drive the link and the portal's clients, count the calls
+  void setStatus(wl_status_t s);
+  void setStations(uint8_t n) { stations = n; }
+  bool softAPUp() const { return apUp; }
+  void reset();
+  uint32_t begins = 0;
+  uint32_t disconnects = 0;
+
+private:
+  void raise(arduino_event_id_t event);
+
+  struct Subscription {
+    EventHandler handler;
+    arduino_event_id_t event;
+  };
+  std::vector<Subscription> handlers;
+  wifi_mode_t currentMode = WIFI_OFF;
+  wl_status_t linkStatus = WL_IDLE_STATUS;
+  IPAddress address{10, 0, 0, 2};
+  bool apUp = false;
+  uint8_t stations = 0;
+};
+
+extern WiFiClass WiFi;
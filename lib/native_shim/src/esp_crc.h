@@ -0,0 +1,5 @@
+#pragma once
+#include <cstdint>
+
+// Same result as the ROM routine: CRC-32 (IEEE 802.3), chainable through `crc`
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
@@ -0,0 +1,6 @@
+#pragma once
+#include <cstdint>
+
+uint64_t nativeMicros64();
+
+inline int64_t esp_timer_get_time() { return static_cast<int64_t>(nativeMicros64()); }
@@ -0,0 +1,125 @@
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct NativeTask {
+  std::thread::id id;
+};
+
+struct NativeQueue {
+  size_t length;
+  size_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex lock;
+  std::condition_variable changed;
+};
+
+struct NativeMutex {
+  std::timed_mutex lock;
+};
+
+namespace {
+  thread_local NativeTask currentTask{std::this_thread::get_id()};
+
+  template <typename Pred>
+  bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lk, TickType_t wait, Pred ready)
+  {
+    if (wait == portMAX_DELAY) {
+      cv.wait(lk, ready);
+      return true;
+    }
+    return cv.wait_for(lk, std::chrono::milliseconds(wait), ready);
+  }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char*, uint32_t, void* arg, UBaseType_t, TaskHandle_t* handle)
+{
+  std::thread t([fn, arg]() { fn(arg); });
+  if (handle) *handle = nullptr;
+  t.detach();
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  if (ticks) std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+  else std::this_thread::yield();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return &currentTask; }
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  NativeQueue* q = new NativeQueue();
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait)
+{
+  std::unique_lock<std::mutex> lk(queue->lock);
+  if (!waitFor(queue->changed, lk, wait, [queue]() { return queue->items.size() < queue->length; })) return pdFAIL;
+  const uint8_t* bytes = static_cast<const uint8_t*>(item);
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait)
+{
+  std::unique_lock<std::mutex> lk(queue->lock);
+  if (!waitFor(queue->changed, lk, wait, [queue]() { return !queue->items.empty(); })) return pdFAIL;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> lk(queue->lock);
+  queue->items.clear();
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> lk(queue->lock);
+  return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> lk(queue->lock);
+  return queue->length - queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new NativeMutex(); }
+void vSemaphoreDelete(SemaphoreHandle_t mutex) { delete mutex; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait)
+{
+  if (wait == portMAX_DELAY) {
+    mutex->lock.lock();
+    return pdPASS;
+  }
+  return mutex->lock.try_lock_for(std::chrono::milliseconds(wait)) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+  mutex->lock.unlock();
+  return pdPASS;
+}
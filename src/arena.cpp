@@ -0,0 +1,124 @@
+#include "arena.h"
+#include <cstddef>
+
+ArenaAllocator loopArena(LOOP_ARENA_BYTES);
+ArenaAllocator webArena(WEB_ARENA_BYTES);
+
+namespace {
+  const size_t ALIGN = alignof(std::max_align_t);
+  const size_t HEADER = (sizeof(size_t) + ALIGN - 1) & ~(ALIGN - 1);
+
+  size_t alignUp(size_t n) { return (n + ALIGN - 1) & ~(ALIGN - 1); }
+}
+
+ArenaAllocator::ArenaAllocator(size_t cap, ArduinoJson::Allocator* heap) : parent(heap), capacity(cap) {}
+
+void* ArenaAllocator::heapAllocate(size_t size) { return parent ? parent->allocate(size) : malloc(size); }
+
+void ArenaAllocator::heapFree(void* ptr)
+{
+  if (parent) parent->deallocate(ptr);
+  else free(ptr);
+}
+
+bool ArenaAllocator::owns(const void* ptr) const
+{
+  const uint8_t* p = static_cast<const uint8_t*>(ptr);
+  return buffer && p >= buffer && p < buffer + capacity;
+}
+
+size_t ArenaAllocator::blockSize(const void* ptr) const
+{
+  return *reinterpret_cast<const size_t*>(static_cast<const uint8_t*>(ptr) - HEADER);
+}
+
+void* ArenaAllocator::allocate(size_t size)
+{
+  // Buffer is taken on first use so it comes from the heap before it fragments
+  if (!buffer) buffer = static_cast<uint8_t*>(heapAllocate(capacity));
+  size_t need = HEADER + alignUp(size);
+  if (!buffer || used + need > capacity) {
+    fallbacks++;
+    return heapAllocate(size);
+  }
+  uint8_t* block = buffer + used;
+  *reinterpret_cast<size_t*>(block) = size;
+  lastBlock = used;
+  used += need;
+  if (used > highWater) highWater = used;
+  return block + HEADER;
+}
+
+void ArenaAllocator::deallocate(void* ptr)
+{
+  if (!ptr) return;
+  if (!owns(ptr)) {
+    heapFree(ptr);
+    return;
+  }
+  // Only the most recent block can be handed back before a rewind
+  size_t offset = static_cast<uint8_t*>(ptr) - buffer - HEADER;
+  if (offset == lastBlock) {
+    used = offset;
+    lastBlock = SIZE_MAX;
+  }
+}
+
+void* ArenaAllocator::reallocate(void* ptr, size_t newSize)
+{
+  if (!ptr) return allocate(newSize);
+  if (!owns(ptr)) return parent ? parent->reallocate(ptr, newSize) : realloc(ptr, newSize);
+
+  size_t offset = static_cast<uint8_t*>(ptr) - buffer - HEADER;
+  size_t oldSize = blockSize(ptr);
+  if (offset == lastBlock && offset + HEADER + alignUp(newSize) <= capacity) {
+    *reinterpret_cast<size_t*>(buffer + offset) = newSize;
+    used = offset + HEADER + alignUp(newSize);
+    if (used > highWater) highWater = used;
+    return ptr;
+  }
+  if (newSize <= oldSize) {
+    *reinterpret_cast<size_t*>(buffer + offset) = newSize;
+    return ptr;
+  }
+  void* moved = allocate(newSize);
+  if (!moved) return nullptr;
+  memcpy(moved, ptr, oldSize);
+  deallocate(ptr);
+  return moved;
+}
+
+size_t ArenaAllocator::mark() const { return used; }
+
+void ArenaAllocator::rewind(size_t mark)
+{
+  if (mark >= used) return;
+  used = mark;
+  lastBlock = SIZE_MAX;
+}
+
+ArenaStats ArenaAllocator::stats() const
+{
+  ArenaStats s;
+  s.capacity = capacity;
+  s.used = used;
+  s.highWater = highWater;
+  s.fallbacks = fallbacks;
+  return s;
+}
+
+size_t ArenaString::write(const uint8_t* buf, size_t n)
+{
+  if (len + n + 1 > cap) {
+    size_t want = cap ? cap * 2 : 256;
+    while (want < len + n + 1) want *= 2;
+    char* grown = static_cast<char*>(arena.reallocate(data, want));
+    if (!grown) return 0;
+    data = grown;
+    cap = want;
+  }
+  memcpy(data + len, buf, n);
+  len += n;
+  data[len] = 0;
+  return n;
+}
@@ -0,0 +1,377 @@
+#include "availability_history.h"
+#include <esp_crc.h>
+#include <esp_timer.h>
+#include "logger.h"
+
+namespace {
+  const char* HISTORY_PATH = "/history.bin";
+  const char* HISTORY_TMP_PATH = "/history.tmp";
+  const uint32_t HISTORY_MAGIC = 0x3148574F;  // "OWH1"
+  const uint32_t RTT_SLOT_S = 1800;
+  const uint32_t MAX_GAP_S = 1800;            // longer silences count as unobserved
+  const uint32_t ONLINE_BIT = 0x80000000;
+
+  // Segment encoding: varints, run-length bucket arrays and a trailing CRC32
+  class SegmentWriter {
+  public:
+    explicit SegmentWriter(File& file) : f(file) {}
+    void byte(uint8_t b) { put(&b, 1); }
+    void u32(uint32_t v) { put(reinterpret_cast<const uint8_t*>(&v), sizeof(v)); }
+    void varint(uint32_t v) {
+      while (v >= 0x80) {
+        byte(static_cast<uint8_t>(v) | 0x80);
+        v >>= 7;
+      }
+      byte(static_cast<uint8_t>(v));
+    }
+    template <typename T>
+    void runs(const T* values, size_t count) {
+      size_t i = 0;
+      while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < 255 && values[i + run] == values[i]) run++;
+        byte(static_cast<uint8_t>(run));
+        varint(values[i]);
+        i += run;
+      }
+    }
+    bool finish() {
+      uint32_t sum = crc;
+      put(reinterpret_cast<const uint8_t*>(&sum), sizeof(sum));
+      return ok;
+    }
+
+  private:
+    void put(const uint8_t* p, size_t n) {
+      crc = esp_crc32_le(crc, p, n);
+      ok = ok && f.write(p, n) == n;
+    }
+    File& f;
+    uint32_t crc = 0;
+    bool ok = true;
+  };
+
+  class SegmentReader {
+  public:
+    explicit SegmentReader(File& file) : f(file) {}
+    uint8_t byte() {
+      uint8_t b = 0;
+      get(&b, 1);
+      return b;
+    }
+    uint32_t u32() {
+      uint32_t v = 0;
+      get(reinterpret_cast<uint8_t*>(&v), sizeof(v));
+      return v;
+    }
+    uint32_t varint() {
+      uint32_t v = 0;
+      for (uint8_t shift = 0; shift < 35 && ok; shift += 7) {
+        uint8_t b = byte();
+        v |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+      }
+      ok = false;
+      return 0;
+    }
+    template <typename T>
+    void runs(T* values, size_t count) {
+      size_t i = 0;
+      while (i < count && ok) {
+        uint8_t run = byte();
+        T value = static_cast<T>(varint());
+        if (!run || i + run > count) ok = false;
+        for (uint8_t k = 0; k < run && i < count; k++) values[i++] = value;
+      }
+    }
+    bool finish() {
+      uint32_t expected = crc;
+      uint32_t stored = 0;
+      ok = ok && f.read(reinterpret_cast<uint8_t*>(&stored), sizeof(stored)) == sizeof(stored);
+      return ok && stored == expected;
+    }
+    bool ok = true;
+
+  private:
+    void get(uint8_t* p, size_t n) {
+      if (!ok || f.read(p, n) != n) {
+        ok = false;
+        return;
+      }
+      crc = esp_crc32_le(crc, p, n);
+    }
+    File& f;
+    uint32_t crc = 0;
+  };
+}
+
+AvailabilityHistory::AvailabilityHistory(fs::FS& filesystem) : storage(filesystem) { reset(); }
+
+void AvailabilityHistory::reset()
+{
+  for (auto &h : hosts) h = HostHistory();
+  baseS = 0;
+  currentHour = 0;
+  currentRttSlot = 0;
+}
+
+uint32_t AvailabilityHistory::now() const
+{
+  return baseS + static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+}
+
+uint32_t AvailabilityHistory::keyFor(const String &host)
+{
+  uint32_t key = esp_crc32_le(0, reinterpret_cast<const uint8_t*>(host.c_str()), host.length());
+  return key ? key : 1;
+}
+
+const HostHistory* AvailabilityHistory::find(const String &host) const
+{
+  uint32_t key = keyFor(host);
+  for (const auto &h : hosts) {
+    if (h.key == key) return &h;
+  }
+  return nullptr;
+}
+
+// Reuses the slot of the host observed longest ago once all slots are taken
+HostHistory& AvailabilityHistory::slotFor(uint32_t key)
+{
+  HostHistory* victim = &hosts[0];
+  for (auto &h : hosts) {
+    if (h.key == key) return h;
+    if (!h.key) {
+      victim = &h;
+      break;
+    }
+    if (victim->key && h.lastObsS < victim->lastObsS) victim = &h;
+  }
+  *victim = HostHistory();
+  victim->key = key;
+  return *victim;
+}
+
+// Closes the current hour and RTT slot for every host when the clock moves on,
+// clearing buckets for any hours skipped in between.
+void AvailabilityHistory::advance(uint32_t nowS)
+{
+  uint32_t hour = nowS / 3600;
+  if (hour != currentHour) {
+    uint32_t skipped = hour - currentHour;
+    for (auto &h : hosts) {
+      if (!h.key) continue;
+      uint16_t idx = currentHour % HISTORY_HOURS;
+      h.obs[idx] = (h.hourObsS + HISTORY_QUANTUM_S / 2) / HISTORY_QUANTUM_S;
+      h.on[idx] = (h.hourOnS + HISTORY_QUANTUM_S / 2) / HISTORY_QUANTUM_S;
+      h.hourObsS = 0;
+      h.hourOnS = 0;
+      for (uint32_t k = 1; k <= skipped && k <= HISTORY_HOURS; k++) {
+        uint16_t clear = (currentHour + k) % HISTORY_HOURS;
+        h.obs[clear] = 0;
+        h.on[clear] = 0;
+      }
+    }
+    currentHour = hour;
+  }
+
+  uint32_t slot = nowS / RTT_SLOT_S;
+  if (slot != currentRttSlot) {
+    uint32_t skipped = slot - currentRttSlot;
+    for (auto &h : hosts) {
+      if (!h.key) continue;
+      for (uint32_t k = 1; k <= skipped && k <= HISTORY_RTT_SLOTS; k++) {
+        uint8_t clear = (currentRttSlot + k) % HISTORY_RTT_SLOTS;
+        h.rttMs[clear] = 0;
+        h.rttCount[clear] = 0;
+      }
+    }
+    currentRttSlot = slot;
+  }
+}
+
+void AvailabilityHistory::accrue(HostHistory &h, uint32_t from, uint32_t to, bool online)
+{
+  if (to <= from) return;
+  if (to - from > MAX_GAP_S) from = to - MAX_GAP_S;
+  while (from < to) {
+    uint32_t hour = from / 3600;
+    uint32_t end = (hour + 1) * 3600;
+    uint32_t seg = (to < end ? to : end) - from;
+    if (hour == currentHour) {
+      h.hourObsS += seg;
+      if (online) h.hourOnS += seg;
+    } else if (currentHour - hour < HISTORY_HOURS) {
+      uint16_t idx = hour % HISTORY_HOURS;
+      uint8_t units = (seg + HISTORY_QUANTUM_S / 2) / HISTORY_QUANTUM_S;
+      h.obs[idx] = h.obs[idx] + units > 240 ? 240 : h.obs[idx] + units;
+      if (online) h.on[idx] = h.on[idx] + units > 240 ? 240 : h.on[idx] + units;
+    }
+    from += seg;
+  }
+}
+
+// The time since the previous probe is credited to the state seen then
+void AvailabilityHistory::record(const String &host, bool online, uint16_t rttMs)
+{
+  uint32_t nowS = now();
+  advance(nowS);
+  HostHistory &h = slotFor(keyFor(host));
+  bool first = !h.transitionCount;
+  if (!first) accrue(h, h.lastObsS, nowS, h.online);
+
+  if (first || h.online != online) {
+    h.transitions[h.transitionHead] = (nowS & ~ONLINE_BIT) | (online ? ONLINE_BIT : 0);
+    h.transitionHead = (h.transitionHead + 1) % HISTORY_TRANSITIONS;
+    if (h.transitionCount < HISTORY_TRANSITIONS) h.transitionCount++;
+  }
+  h.online = online;
+  h.lastObsS = nowS;
+
+  if (online) {
+    uint8_t idx = currentRttSlot % HISTORY_RTT_SLOTS;
+    if (h.rttCount[idx] < 255) h.rttCount[idx]++;
+    int32_t mean = h.rttMs[idx];
+    h.rttMs[idx] = static_cast<uint16_t>(mean + (static_cast<int32_t>(rttMs) - mean) / h.rttCount[idx]);
+  }
+}
+
+// Fraction of observed time the host was online over the last `hours`
+// (current hour included), or -1 if it was not observed at all.
+float AvailabilityHistory::uptime(const HostHistory &h, uint16_t hours) const
+{
+  uint32_t obs = h.hourObsS;
+  uint32_t on = h.hourOnS;
+  for (uint16_t k = 1; k < hours && k < HISTORY_HOURS && k <= currentHour; k++) {
+    uint16_t idx = (currentHour - k) % HISTORY_HOURS;
+    obs += h.obs[idx] * HISTORY_QUANTUM_S;
+    on += h.on[idx] * HISTORY_QUANTUM_S;
+  }
+  return obs ? static_cast<float>(on) / obs : -1.0f;
+}
+
+size_t AvailabilityHistory::outages(const HostHistory &h, uint32_t windowS, Outage *out, size_t max) const
+{
+  uint32_t nowS = now();
+  uint32_t windowStart = nowS > windowS ? nowS - windowS : 0;
+  size_t n = 0;
+  uint8_t oldest = (h.transitionHead + HISTORY_TRANSITIONS - h.transitionCount) % HISTORY_TRANSITIONS;
+  for (uint8_t i = 0; i < h.transitionCount && n < max; i++) {
+    uint32_t t = h.transitions[(oldest + i) % HISTORY_TRANSITIONS];
+    if (t & ONLINE_BIT) continue;
+    bool last = i + 1 == h.transitionCount;
+    uint32_t start = t & ~ONLINE_BIT;
+    uint32_t end = last ? h.lastObsS : h.transitions[(oldest + i + 1) % HISTORY_TRANSITIONS] & ~ONLINE_BIT;
+    if (end < windowStart) continue;
+    out[n].startS = start;
+    out[n].durationS = end - start;
+    out[n].ongoing = last;
+    n++;
+  }
+  return n;
+}
+
+uint16_t AvailabilityHistory::rttAgo(const HostHistory &h, uint8_t slotsAgo) const
+{
+  if (slotsAgo >= HISTORY_RTT_SLOTS || slotsAgo > currentRttSlot) return 0;
+  return h.rttMs[(currentRttSlot - slotsAgo) % HISTORY_RTT_SLOTS];
+}
+
+bool AvailabilityHistory::save()
+{
+  uint32_t nowS = now();
+  advance(nowS);
+  File f = storage.open(HISTORY_TMP_PATH, "w");
+  if (!f) return false;
+
+  SegmentWriter w(f);
+  uint8_t used = 0;
+  for (const auto &h : hosts) used += h.key ? 1 : 0;
+  w.u32(HISTORY_MAGIC);
+  w.varint(nowS);
+  w.varint(currentHour);
+  w.varint(currentRttSlot);
+  w.byte(used);
+  for (const auto &h : hosts) {
+    if (!h.key) continue;
+    w.u32(h.key);
+    w.varint(h.lastObsS);
+    w.byte(h.online);
+    w.varint(h.hourObsS);
+    w.varint(h.hourOnS);
+    // Transitions oldest first, delta-coded with the state in the low bit
+    w.byte(h.transitionCount);
+    uint8_t oldest = (h.transitionHead + HISTORY_TRANSITIONS - h.transitionCount) % HISTORY_TRANSITIONS;
+    uint32_t prev = 0;
+    for (uint8_t i = 0; i < h.transitionCount; i++) {
+      uint32_t t = h.transitions[(oldest + i) % HISTORY_TRANSITIONS];
+      uint32_t at = t & ~ONLINE_BIT;
+      w.varint(((at - prev) << 1) | (t & ONLINE_BIT ? 1 : 0));
+      prev = at;
+    }
+    w.runs(h.obs, HISTORY_HOURS);
+    w.runs(h.on, HISTORY_HOURS);
+    w.runs(h.rttMs, HISTORY_RTT_SLOTS);
+    w.runs(h.rttCount, HISTORY_RTT_SLOTS);
+  }
+  bool ok = w.finish();
+  [[maybe_unused]] size_t bytes = f.position();  // only logged at debug level
+  f.close();
+
+  if (!ok || !storage.rename(HISTORY_TMP_PATH, HISTORY_PATH)) {
+    storage.remove(HISTORY_TMP_PATH);
+    LOG_ERROR("History save failed");
+    return false;
+  }
+  LOG_DEBUG("History saved: {} hosts, {} bytes", used, (uint32_t)bytes);
+  return true;
+}
+
+void AvailabilityHistory::load()
+{
+  reset();
+  if (!storage.exists(HISTORY_PATH)) return;
+  File f = storage.open(HISTORY_PATH, "r");
+  if (!f) return;
+
+  SegmentReader r(f);
+  bool ok = r.u32() == HISTORY_MAGIC;
+  uint32_t savedS = r.varint();
+  currentHour = r.varint();
+  currentRttSlot = r.varint();
+  uint8_t used = r.byte();
+  ok = ok && r.ok && used <= MAX_HISTORY_HOSTS;
+  for (uint8_t s = 0; ok && s < used; s++) {
+    HostHistory &h = hosts[s];
+    h.key = r.u32();
+    h.lastObsS = r.varint();
+    h.online = r.byte();
+    h.hourObsS = r.varint();
+    h.hourOnS = r.varint();
+    h.transitionCount = r.byte();
+    if (h.transitionCount > HISTORY_TRANSITIONS) ok = false;
+    uint32_t at = 0;
+    for (uint8_t i = 0; ok && i < h.transitionCount; i++) {
+      uint32_t v = r.varint();
+      at += v >> 1;
+      h.transitions[i] = at | (v & 1 ? ONLINE_BIT : 0);
+    }
+    h.transitionHead = h.transitionCount % HISTORY_TRANSITIONS;
+    r.runs(h.obs, HISTORY_HOURS);
+    r.runs(h.on, HISTORY_HOURS);
+    r.runs(h.rttMs, HISTORY_RTT_SLOTS);
+    r.runs(h.rttCount, HISTORY_RTT_SLOTS);
+    ok = ok && r.ok;
+  }
+  ok = ok && r.finish();
+  f.close();
+
+  if (!ok) {
+    reset();
+    LOG_WARN("History segment corrupt, starting empty");
+    return;
+  }
+  // Continue the clock from the save; nothing newer than it was kept
+  baseS = savedS;
+  LOG_INFO("History loaded: {} hosts", used);
+}
@@ -0,0 +1,35 @@
+#include "boot_timeline.h"
+#include "logger.h"
+
+namespace {
+  const char* PHASE_NAMES[] = { "web_ms", "wifi_ms", "mqtt_ms", "first_probe_ms", "first_state_ms", "discovery_ms" };
+}
+
+void BootTimeline::mark(BootPhase phase)
+{
+  mark(phase, millis());
+}
+
+void BootTimeline::mark(BootPhase phase, uint32_t ms)
+{
+  uint8_t i = static_cast<uint8_t>(phase);
+  if (atMs[i]) return;
+  // Zero means "not reached", so a stage at the very first millisecond reads as 1
+  atMs[i] = ms ? ms : 1;
+  LOG_INFO("Boot {} at {} ms", PHASE_NAMES[i], atMs[i]);
+}
+
+bool BootTimeline::reached(BootPhase phase) const
+{
+  return atMs[static_cast<uint8_t>(phase)] != 0;
+}
+
+uint32_t BootTimeline::at(BootPhase phase) const
+{
+  return atMs[static_cast<uint8_t>(phase)];
+}
+
+void BootTimeline::writeJson(JsonObject out) const
+{
+  for (uint8_t i = 0; i < static_cast<uint8_t>(BootPhase::Count); i++) out[PHASE_NAMES[i]] = atMs[i];
+}
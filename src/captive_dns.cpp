@@ -0,0 +1,115 @@
+#include "captive_dns.h"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "logger.h"
+
+namespace {
+  const size_t DNS_HEADER_LEN = 12;
+  const size_t DNS_ANSWER_LEN = 16;     // name pointer, type, class, TTL, length, address
+  const uint16_t DNS_TYPE_A = 1;
+  const uint16_t DNS_TYPE_ANY = 255;
+  const uint16_t DNS_CLASS_IN = 1;
+  const uint32_t ANSWER_TTL_S = 60;
+
+  uint16_t read16(const uint8_t* p) { return static_cast<uint16_t>(p[0] << 8 | p[1]); }
+
+  void write16(uint8_t* p, uint16_t v)
+  {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+  }
+
+  void write32(uint8_t* p, uint32_t v)
+  {
+    write16(p, v >> 16);
+    write16(p + 2, v & 0xFFFF);
+  }
+}
+
+bool CaptiveDns::start(uint16_t port, uint32_t ip)
+{
+  stop();
+  answerIp = ip;
+  fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) return false;
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+    close(fd);
+    fd = -1;
+    LOG_WARN("Captive DNS: port {} unavailable", (uint32_t)port);
+    return false;
+  }
+  return true;
+}
+
+void CaptiveDns::stop()
+{
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+// A few queries per pass; the watcher wakes the loop again for the rest
+void CaptiveDns::drain()
+{
+  if (fd < 0) return;
+  uint8_t reply[CAPTIVE_DNS_BUFFER_SIZE];
+  for (uint8_t i = 0; i < CAPTIVE_DNS_PACKETS_PER_LOOP; i++) {
+    sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&from), &fromLen);
+    if (n <= 0) return;
+    size_t len = buildReply(buffer, n, answerIp, reply, sizeof(reply));
+    if (!len) continue;
+    sendto(fd, reply, len, 0, reinterpret_cast<sockaddr*>(&from), fromLen);
+    answers++;
+  }
+}
+
+int CaptiveDns::socketFd() const { return fd; }
+
+uint32_t CaptiveDns::answered() const { return answers; }
+
+// Echoes the single question; A (or ANY) in class IN gets the portal address,
+// every other type an empty answer. Responses, other opcodes and malformed
+// queries get no reply.
+size_t CaptiveDns::buildReply(const uint8_t* query, size_t len, uint32_t ip, uint8_t* out, size_t outLen)
+{
+  if (len < DNS_HEADER_LEN || (query[2] & 0x80) || (query[2] & 0x78) || read16(query + 4) != 1) return 0;
+  size_t pos = DNS_HEADER_LEN;
+  while (pos < len && query[pos]) {
+    if (query[pos] & 0xC0) return 0;  // queries carry no compressed names
+    pos += query[pos] + 1;
+  }
+  if (pos + 5 > len) return 0;
+  size_t questionEnd = pos + 5;
+  uint16_t type = read16(query + pos + 1);
+  uint16_t cls = read16(query + pos + 3);
+  bool answer = (type == DNS_TYPE_A || type == DNS_TYPE_ANY) && cls == DNS_CLASS_IN;
+  size_t total = questionEnd + (answer ? DNS_ANSWER_LEN : 0);
+  if (total > outLen) return 0;
+
+  memcpy(out, query, questionEnd);
+  out[2] = 0x84 | (query[2] & 0x01);  // response, authoritative, recursion desired as asked
+  out[3] = 0x80;                      // recursion available, no error
+  write16(out + 6, answer ? 1 : 0);
+  write16(out + 8, 0);
+  write16(out + 10, 0);
+  if (answer) {
+    uint8_t* a = out + questionEnd;
+    write16(a, 0xC000 | DNS_HEADER_LEN);
+    write16(a + 2, DNS_TYPE_A);
+    write16(a + 4, DNS_CLASS_IN);
+    write32(a + 6, ANSWER_TTL_S);
+    write16(a + 10, 4);
+    write32(a + 12, ip);
+  }
+  return total;
+}
@@ -0,0 +1,313 @@
+#include "cluster.h"
+#include <algorithm>
+#include <esp_crc.h>
+#include "arena.h"
+#include "logger.h"
+
+namespace {
+  const char* NODE_TOPIC_PREFIX = "esp-overwatch/cluster/node/";
+  const char* COUNTS_TOPIC_PREFIX = "esp-overwatch/cluster/counts/";
+  const char* ASSIGNMENT_TOPIC = "esp-overwatch/cluster/assignment";
+
+  uint32_t mix32(uint32_t h)
+  {
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+  }
+
+  uint32_t hashString(const String &s, uint32_t seed = 0)
+  {
+    return mix32(esp_crc32_le(seed, reinterpret_cast<const uint8_t*>(s.c_str()), s.length()));
+  }
+
+  bool topicSuffix(const char* topic, const char* prefix, String &out)
+  {
+    size_t n = strlen(prefix);
+    if (strncmp(topic, prefix, n) != 0) return false;
+    out = topic + n;
+    return out.length() > 0;
+  }
+}
+
+Cluster::Cluster(Config& cfg, MqttManager& mqttMgr) : config(cfg), mqtt(mqttMgr) {}
+
+bool Cluster::enabled() const { return config.cluster_enabled; }
+bool Cluster::isLeader() const { return leader; }
+const String& Cluster::nodeId() const { return id; }
+
+void Cluster::begin()
+{
+  if (!enabled()) return;
+  char buf[16];
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(buf, sizeof(buf), "ow-%06lx", (unsigned long)((mac >> 24) & 0xFFFFFF));
+  id = buf;
+  nodeTopic = String(NODE_TOPIC_PREFIX) + id;
+
+  // Each node needs its own client id and will so units do not evict each other
+  mqtt.setIdentity(String("esp-overwatch-") + id, nodeTopic);
+  mqtt.setConnectHandler([this]() { onConnected(); });
+  mqtt.setMessageHandler([this](const char* topic, const uint8_t* payload, unsigned int len) {
+    onMessage(topic, payload, len);
+  });
+
+  setMember(id, true);
+  rebuildRing(std::vector<String>{id});
+  LOG_INFO("Cluster node {}", id);
+}
+
+void Cluster::onConnected()
+{
+  mqtt.publish(nodeTopic.c_str(), "online", true);
+  String wildcard = String(NODE_TOPIC_PREFIX) + "+";
+  mqtt.subscribe(wildcard.c_str());
+  mqtt.subscribe(ASSIGNMENT_TOPIC);
+  wildcard = String(COUNTS_TOPIC_PREFIX) + "+";
+  mqtt.subscribe(wildcard.c_str());
+  if (leader) assignmentDirty = true;
+}
+
+void Cluster::onMessage(const char* topic, const uint8_t* payload, unsigned int len)
+{
+  String node;
+  if (topicSuffix(topic, NODE_TOPIC_PREFIX, node)) {
+    setMember(node, len == 6 && memcmp(payload, "online", 6) == 0);
+  } else if (strcmp(topic, ASSIGNMENT_TOPIC) == 0) {
+    applyAssignment(payload, len);
+  } else if (topicSuffix(topic, COUNTS_TOPIC_PREFIX, node) && node != id) {
+    applyCounts(node, payload, len);
+  }
+}
+
+void Cluster::setMember(const String& node, bool online)
+{
+  auto it = std::find_if(members.begin(), members.end(), [&](const Member& m) { return m.id == node; });
+  if (it == members.end()) {
+    if (!online || members.size() >= CLUSTER_MAX_NODES) return;
+    Member m;
+    m.id = node;
+    members.push_back(m);
+    it = members.end() - 1;
+  }
+  if (it->online == online) return;
+  it->online = online;
+  LOG_INFO("Cluster node {} {}", node, online ? "online" : "offline");
+  if (!online) {
+    shards.erase(std::remove_if(shards.begin(), shards.end(), [&](const ShardCounts& s) { return s.node == node; }), shards.end());
+  }
+
+  const String* elected = electLeader();
+  leader = elected && *elected == id;
+  if (leader) assignmentDirty = true;
+  // A node that dropped off keeps its last report retained; the leader clears it
+  if (!online && leader) clearCounts(node);
+}
+
+bool Cluster::isOnline(const String& node) const
+{
+  for (const auto& m : members) {
+    if (m.id == node) return m.online;
+  }
+  return false;
+}
+
+void Cluster::clearCounts(const String& node)
+{
+  String topic = String(COUNTS_TOPIC_PREFIX) + node;
+  mqtt.publish(topic.c_str(), "", true);
+}
+
+const String* Cluster::electLeader() const
+{
+  const String* best = nullptr;
+  for (const auto& m : members) {
+    if (m.online && (!best || m.id < *best)) best = &m.id;
+  }
+  return best;
+}
+
+void Cluster::loop()
+{
+  if (!enabled() || !leader || !assignmentDirty || !mqtt.isConnected()) return;
+  publishAssignment();
+  assignmentDirty = false;
+}
+
+void Cluster::publishAssignment()
+{
+  std::vector<String> ids;
+  for (const auto& m : members) {
+    if (m.online) ids.push_back(m.id);
+  }
+  std::sort(ids.begin(), ids.end());
+  epoch++;
+
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["leader"] = id;
+  doc["epoch"] = epoch;
+  JsonArray list = doc["members"].to<JsonArray>();
+  for (const auto& n : ids) list.add(n);
+  mqtt.publishJson(ASSIGNMENT_TOPIC, doc, true);
+  rebuildRing(ids);
+  LOG_INFO("Cluster assignment {}: {} nodes", epoch, (uint32_t)ids.size());
+}
+
+void Cluster::applyAssignment(const uint8_t* payload, unsigned int len)
+{
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  if (deserializeJson(doc, payload, len)) return;
+  String from = doc["leader"].as<String>();
+  uint32_t incoming = doc["epoch"] | 0;
+  // Assignments older than the one in force come from a former leader
+  if (incoming < epoch) return;
+  if (incoming > epoch) {
+    epoch = incoming;
+    // A leader that restarted counts on from the epoch it missed
+    if (leader) assignmentDirty = true;
+  }
+  // A leader ignores its own echo and any other node's view
+  if (leader || from == id) return;
+
+  std::vector<String> ids;
+  for (JsonVariant v : doc["members"].as<JsonArray>()) {
+    if (ids.size() < CLUSTER_MAX_NODES) ids.push_back(v.as<String>());
+  }
+  if (ids.empty() || ids == ringIds) return;
+  rebuildRing(ids);
+  LOG_INFO("Cluster assignment {} from {}", incoming, from);
+}
+
+void Cluster::rebuildRing(const std::vector<String>& ids)
+{
+  ring.clear();
+  ring.reserve(ids.size() * CLUSTER_VNODES);
+  for (size_t n = 0; n < ids.size(); n++) {
+    for (uint8_t v = 0; v < CLUSTER_VNODES; v++) {
+      ring.emplace_back(hashString(ids[n], v + 1), static_cast<uint8_t>(n));
+    }
+  }
+  std::sort(ring.begin(), ring.end());
+  if (ids != ringIds) rebalances++;
+  ringIds = ids;
+}
+
+bool Cluster::ownsKey(uint32_t key) const
+{
+  if (!enabled() || ring.empty()) return true;
+  uint32_t h = mix32(key);
+  auto it = std::lower_bound(ring.begin(), ring.end(), std::make_pair(h, static_cast<uint8_t>(0)));
+  if (it == ring.end()) it = ring.begin();
+  return ringIds[it->second] == id;
+}
+
+bool Cluster::ownsAddress(uint32_t ip) const
+{
+  return ownsKey(ip >> CLUSTER_BLOCK_BITS);
+}
+
+bool Cluster::ownsHost(const String& host) const
+{
+  return !enabled() || ownsKey(hashString(host));
+}
+
+uint32_t Cluster::blockEnd(uint32_t ip) const
+{
+  return ip | ((1UL << CLUSTER_BLOCK_BITS) - 1);
+}
+
+void Cluster::reportSubnet(size_t index, uint16_t online, uint16_t found)
+{
+  if (ownOnline.size() != config.subnets.size()) {
+    ownOnline.assign(config.subnets.size(), 0);
+    ownFound.assign(config.subnets.size(), 0);
+  }
+  if (index >= ownOnline.size()) return;
+  ownOnline[index] = online;
+  ownFound[index] = found;
+  if (leader) publishTotals(index);
+}
+
+// Totals combine this sweep's own shard with the latest report of every
+// other online node
+void Cluster::publishTotals(size_t index)
+{
+  uint32_t online = ownOnline[index];
+  uint32_t found = ownFound[index];
+  for (const auto& s : shards) {
+    if (index < s.online.size()) {
+      online += s.online[index];
+      found += s.found[index];
+    }
+  }
+  mqtt.publishOnlineCount(config.subnets[index], online);
+  mqtt.publishFoundCount(config.subnets[index], found);
+}
+
+void Cluster::finishSweep()
+{
+  if (!enabled() || leader || !mqtt.isConnected()) return;
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["epoch"] = epoch;
+  JsonArray subs = doc["subnets"].to<JsonArray>();
+  for (size_t i = 0; i < ownOnline.size() && i < config.subnets.size(); i++) {
+    JsonObject o = subs.add<JsonObject>();
+    o["cidr"] = config.subnets[i].cidr;
+    o["online"] = ownOnline[i];
+    o["found"] = ownFound[i];
+  }
+  String topic = String(COUNTS_TOPIC_PREFIX) + id;
+  mqtt.publishJson(topic.c_str(), doc, true);
+}
+
+// Reports are keyed by CIDR so nodes with differently ordered targets agree
+void Cluster::applyCounts(const String& node, const uint8_t* payload, unsigned int len)
+{
+  // Reports retained by nodes that are gone would count their shard twice
+  if (!len) return;
+  if (!isOnline(node)) {
+    if (leader) clearCounts(node);
+    return;
+  }
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  if (deserializeJson(doc, payload, len)) return;
+
+  auto it = std::find_if(shards.begin(), shards.end(), [&](const ShardCounts& s) { return s.node == node; });
+  if (it == shards.end()) {
+    if (shards.size() >= CLUSTER_MAX_NODES) return;
+    ShardCounts s;
+    s.node = node;
+    shards.push_back(s);
+    it = shards.end() - 1;
+  }
+  it->online.assign(config.subnets.size(), 0);
+  it->found.assign(config.subnets.size(), 0);
+  for (JsonObject o : doc["subnets"].as<JsonArray>()) {
+    const char* cidr = o["cidr"] | "";
+    for (size_t i = 0; i < config.subnets.size(); i++) {
+      if (config.subnets[i].cidr == cidr) {
+        it->online[i] = o["online"] | 0;
+        it->found[i] = o["found"] | 0;
+        break;
+      }
+    }
+  }
+}
+
+ClusterStats Cluster::stats() const
+{
+  ClusterStats s;
+  s.enabled = enabled();
+  s.leader = leader;
+  s.epoch = epoch;
+  for (const auto& m : members) s.members += m.online ? 1 : 0;
+  s.rebalances = rebalances;
+  return s;
+}
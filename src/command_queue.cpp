@@ -0,0 +1,55 @@
+#include "command_queue.h"
+#include "logger.h"
+
+void CommandQueue::begin()
+{
+  queue = xQueueCreate(COMMAND_QUEUE_DEPTH, sizeof(Command));
+  if (!queue) LOG_ERROR("Command queue allocation failed");
+}
+
+bool CommandQueue::push(CommandType type, uint32_t clientId, String* payload)
+{
+  Command cmd;
+  cmd.type = type;
+  cmd.clientId = clientId;
+  cmd.payload = payload;
+  cmd.queuedMs = millis();
+  if (!queue || xQueueSend(queue, &cmd, 0) != pdTRUE) {
+    delete payload;
+    rejected++;
+    return false;
+  }
+  queued++;
+  return true;
+}
+
+bool CommandQueue::pop(Command& out)
+{
+  if (!queue || xQueueReceive(queue, &out, 0) != pdTRUE) return false;
+  uint32_t wait = millis() - out.queuedMs;
+  if (wait > maxWaitMs) maxWaitMs = wait;
+  return true;
+}
+
+// Releases what the command carried once the main task has acted on it
+void CommandQueue::done(const Command& cmd)
+{
+  delete cmd.payload;
+  executed++;
+}
+
+bool CommandQueue::pending() const
+{
+  return queue && uxQueueMessagesWaiting(queue);
+}
+
+CommandQueueStats CommandQueue::stats() const
+{
+  CommandQueueStats s;
+  s.queued = queued;
+  s.executed = executed;
+  s.rejected = rejected;
+  s.pending = queue ? uxQueueMessagesWaiting(queue) : 0;
+  s.maxWaitMs = maxWaitMs;
+  return s;
+}
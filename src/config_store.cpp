@@ -1,53 +1,236 @@
 #include "config_store.h"
+#include <esp_crc.h>
+#include "logger.h"
 
 namespace {
   const char* CONFIG_PATH = "/config.json";
-}
+  const char* CONFIG_TMP_PATH = "/config.json.tmp";
+  const char* CONFIG_BAK_PATH = "/config.json.bak";
+  const char* CONFIG_LOG_PATH = "/config.log";
+  const char* RECORD_MAGIC = "#OW1";
+  const size_t RECORD_HEADER_MAX = 48;
+  const size_t CONFIG_LOG_COMPACT_BYTES = 4096;
+
+  // Print sink that only measures the serialized length and CRC so a record
+  // header can be written before streaming the payload itself.
+  class CrcPrint : public Print {
+  public:
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) override {
+      crc = esp_crc32_le(crc, buf, len);
+      length += len;
+      return len;
+    }
+    uint32_t crc = 0;
+    size_t length = 0;
+  };
+
+  struct RecordHeader {
+    uint32_t generation = 0;
+    size_t length = 0;
+    uint32_t crc = 0;
+    size_t payloadStart = 0;
+  };
+
+  bool writeRecord(File &f, uint32_t generation, const JsonDocument &doc)
+  {
+    CrcPrint sum;
+    serializeJson(doc, sum);
+    f.printf("%s %lu %lu %08lx\n", RECORD_MAGIC, (unsigned long)generation, (unsigned long)sum.length, (unsigned long)sum.crc);
+    size_t written = serializeJson(doc, f);
+    f.write('\n');
+    return written == sum.length;
+  }
 
-static uint32_t ipToInt(const IPAddress &ip)
-{
-  return (static_cast<uint32_t>(ip[0]) << 24) | (static_cast<uint32_t>(ip[1]) << 16) |
-         (static_cast<uint32_t>(ip[2]) << 8) | static_cast<uint32_t>(ip[3]);
-}
+  // Reads and CRC-checks the record at the current position, leaving the file
+  // positioned at the start of its payload. A torn or corrupt record fails.
+  bool readRecordHeader(File &f, RecordHeader &h)
+  {
+    char line[RECORD_HEADER_MAX];
+    size_t n = 0;
+    while (n < sizeof(line) - 1) {
+      int c = f.read();
+      if (c < 0) return false;
+      if (c == '\n') break;
+      line[n++] = static_cast<char>(c);
+    }
+    line[n] = 0;
+    if (strncmp(line, RECORD_MAGIC, strlen(RECORD_MAGIC)) != 0) return false;
+    unsigned long gen, len, crc;
+    if (sscanf(line + strlen(RECORD_MAGIC), "%lu %lu %lx", &gen, &len, &crc) != 3) return false;
+    h.generation = gen;
+    h.length = len;
+    h.crc = crc;
+    h.payloadStart = f.position();
+    if (h.payloadStart + h.length > f.size()) return false;
+
+    uint8_t buf[128];
+    uint32_t actual = 0;
+    size_t remaining = h.length;
+    while (remaining) {
+      size_t chunk = remaining < sizeof(buf) ? remaining : sizeof(buf);
+      if (f.read(buf, chunk) != chunk) return false;
+      actual = esp_crc32_le(actual, buf, chunk);
+      remaining -= chunk;
+    }
+    if (actual != h.crc) return false;
+    return f.seek(h.payloadStart);
+  }
 
-static IPAddress intToIp(uint32_t value)
-{
-  return IPAddress((value >> 24) & 0xFF, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+  // Loads a base config file. Files without a record header are plain JSON
+  // from older firmware or `uploadfs` and are treated as generation 0.
+  bool readConfigFile(fs::FS &storage, const char* path, JsonDocument &doc, uint32_t &generation)
+  {
+    if (!storage.exists(path)) return false;
+    File f = storage.open(path, "r");
+    if (!f) return false;
+    bool ok;
+    if (f.peek() == '#') {
+      RecordHeader h;
+      ok = readRecordHeader(f, h) && !deserializeJson(doc, f);
+      generation = h.generation;
+    } else {
+      ok = !deserializeJson(doc, f);
+      generation = 0;
+    }
+    f.close();
+    return ok;
+  }
+
+  // Removes an "@<n>[ms|s|m|h]" interval from a target line (bare numbers are
+  // seconds). Lines without one keep interval 0, the global scan interval.
+  bool takeInterval(String &text, uint32_t &intervalMs)
+  {
+    intervalMs = 0;
+    int at = text.indexOf('@');
+    if (at < 0) return true;
+    int end = at + 1;
+    while (end < (int)text.length() && !isspace((unsigned char)text[end]) && text[end] != '#' && text[end] != '|') end++;
+    String token = text.substring(at + 1, end);
+    text.remove(at, end - at);
+    text.trim();
+
+    char* unit = nullptr;
+    unsigned long value = strtoul(token.c_str(), &unit, 10);
+    if (unit == token.c_str()) return false;
+    uint32_t scale;
+    if (!*unit || !strcmp(unit, "s")) scale = 1000;
+    else if (!strcmp(unit, "ms")) scale = 1;
+    else if (!strcmp(unit, "m")) scale = 60000;
+    else if (!strcmp(unit, "h")) scale = 3600000;
+    else return false;
+    if (value > UINT32_MAX / scale) return false;
+    intervalMs = value * scale;
+    return intervalMs >= MIN_TARGET_INTERVAL_MS;
+  }
+
+  String renderInterval(uint32_t intervalMs)
+  {
+    if (!intervalMs) return "";
+    if (intervalMs % 3600000 == 0) return " @" + String(intervalMs / 3600000) + "h";
+    if (intervalMs % 60000 == 0) return " @" + String(intervalMs / 60000) + "m";
+    if (intervalMs % 1000 == 0) return " @" + String(intervalMs / 1000) + "s";
+    return " @" + String(intervalMs) + "ms";
+  }
+
+  uint32_t intervalField(JsonVariant v)
+  {
+    uint32_t ms = v | 0;
+    return ms && ms < MIN_TARGET_INTERVAL_MS ? MIN_TARGET_INTERVAL_MS : ms;
+  }
+
+  void writeSubnet(JsonObject o, const Subnet &s)
+  {
+    o["cidr"] = s.cidr;
+    o["name"] = s.name;
+    if (s.interval_ms) o["interval_ms"] = s.interval_ms;
+  }
+
+  void writeHost(JsonObject obj, const StaticHost &h)
+  {
+    obj["ip"] = h.ip;
+    obj["port"] = h.port;
+    if (h.ports.size() > 1) {
+      JsonArray ports = obj["ports"].to<JsonArray>();
+      for (uint16_t p : h.ports) ports.add(p);
+    }
+    obj["name"] = h.name;
+    if (h.interval_ms) obj["interval_ms"] = h.interval_ms;
+    if (h.check != ServiceKind::None) {
+      obj["check"] = findServiceProbe(h.check)->name();
+      if (h.check_arg.length()) obj["check_arg"] = h.check_arg;
+    }
+  }
+
+  // Fingerprint of a target as persisted, to find the entries an edit changed
+  template <typename T>
+  uint32_t entryCrc(const T &entry, void (*write)(JsonObject, const T &))
+  {
+    JsonDocument doc;
+    write(doc.to<JsonObject>(), entry);
+    CrcPrint sum;
+    serializeJson(doc, sum);
+    return sum.crc;
+  }
+
+  // Appends the ops turning the persisted list into the current one: entries
+  // between the unchanged head and tail are replaced pairwise, and the rest
+  // added or removed. Returns the number of ops.
+  template <typename T>
+  size_t diffTargets(JsonArray ops, const char *list, const std::vector<uint32_t> &saved, const std::vector<T> &current,
+                     void (*write)(JsonObject, const T &))
+  {
+    std::vector<uint32_t> crcs;
+    crcs.reserve(current.size());
+    for (const auto &e : current) crcs.push_back(entryCrc(e, write));
+    size_t head = 0;
+    while (head < saved.size() && head < crcs.size() && saved[head] == crcs[head]) head++;
+    size_t tail = 0;
+    while (tail < saved.size() - head && tail < crcs.size() - head &&
+           saved[saved.size() - 1 - tail] == crcs[crcs.size() - 1 - tail]) tail++;
+    size_t removed = saved.size() - head - tail;
+    size_t added = crcs.size() - head - tail;
+    size_t n = 0;
+    for (size_t i = 0; i < removed || i < added; i++, n++) {
+      JsonObject op = ops.add<JsonObject>();
+      op["op"] = i < removed && i < added ? "replace" : i < added ? "add" : "remove";
+      op["list"] = list;
+      op["at"] = head + (i < added ? i : added);
+      if (i < added) write(op["entry"].to<JsonObject>(), current[head + i]);
+    }
+    return n;
+  }
 }
 
-ConfigStore::ConfigStore() {}
+ConfigStore::ConfigStore(fs::FS& filesystem) : storage(filesystem) {}
 bool ConfigStore::ensureFsMounted() {
   static bool fsReady = false;
   if (fsReady) return true;
   fsReady = LittleFS.begin(true);
   if (fsReady) {
-    Serial.println("LittleFS mounted");
+    LOG_INFO("LittleFS mounted");
   } else {
-    Serial.println("LittleFS mount failed");
+    LOG_ERROR("LittleFS mount failed");
   }
   return fsReady;
 }
 
 bool ConfigStore::parseSubnet(const String &cidr, Subnet &out) const
 {
-  int slash = cidr.indexOf('/');
-  if (slash < 0) return false;
-  IPAddress net;
-  if (!net.fromString(cidr.substring(0, slash))) return false;
-  int prefix = cidr.substring(slash + 1).toInt();
-  if (prefix < 1 || prefix > 30) return false;
-
-  uint32_t mask = prefix == 32 ? 0xFFFFFFFF : (0xFFFFFFFF << (32 - prefix));
-  uint32_t netInt = ipToInt(net) & mask;
-  uint32_t hostCount = prefix == 32 ? 1 : ((1UL << (32 - prefix)) - 2);
-  uint32_t first = hostCount ? netInt + 1 : netInt;
-  uint32_t last = hostCount ? (netInt + hostCount) : netInt;
+  TargetSpec spec;
+  if (!parseTargetExpression(cidr, spec)) return false;
+  if (spec.addressCount > MAX_SUBNET_ADDRESSES) {
+    LOG_WARN("Subnet {} has {} addresses, more than the {} supported", cidr, spec.addressCount, MAX_SUBNET_ADDRESSES);
+    return false;
+  }
 
   out.cidr = cidr;
-  out.network = intToIp(netInt);
-  out.prefix = static_cast<uint8_t>(prefix);
-  out.firstHost = first;
-  out.lastHost = last;
+  out.firstHost = spec.ranges.front().first;
+  out.lastHost = spec.ranges.back().last;
+  out.ranges.swap(spec.ranges);
+  out.ports.swap(spec.ports);
+  out.methods = spec.methods;
+  out.hostCount = spec.addressCount;
   return true;
 }
 
@@ -61,37 +244,86 @@ bool ConfigStore::parseHostLine(const String &line, StaticHost &host) const
   if (separator < 0) separator = token.indexOf('#');  // Support both | and # separators
   String meta = separator >= 0 ? token.substring(separator + 1) : "";
   String ipPort = separator >= 0 ? token.substring(0, separator) : token;
+  if (!takeInterval(ipPort, host.interval_ms)) return false;
+
+  // "http://10.0.0.5:8080/health" selects a protocol check and its argument
+  host.check = ServiceKind::None;
+  host.check_arg = "";
+  int scheme = ipPort.indexOf("://");
+  if (scheme >= 0) {
+    const ServiceProbe* probe = findServiceProbe(ipPort.substring(0, scheme));
+    if (!probe) return false;
+    host.check = probe->kind();
+    ipPort = ipPort.substring(scheme + 3);
+    int slash = ipPort.indexOf('/');
+    if (slash >= 0) {
+      host.check_arg = ipPort.substring(slash);
+      host.check_arg.trim();
+      ipPort = ipPort.substring(0, slash);
+    }
+  }
 
   int colon = ipPort.indexOf(':');
   if (colon > 0) {
     host.ip = ipPort.substring(0, colon);
-    host.port = ipPort.substring(colon + 1).toInt();
+    if (!parsePortSet(ipPort.substring(colon + 1), host.ports)) return false;
   } else {
     host.ip = ipPort;
-    host.port = 0;
+    host.ports.clear();
   }
+  host.port = host.ports.empty() ? 0 : host.ports[0];
   host.ip.trim();
   host.name = meta;
   host.name.trim();
   return host.ip.length();
 }
 
+void ConfigStore::compileTargets(Config &cfg) const
+{
+  // Addresses already claimed by an earlier subnet are dropped from later ones
+  // so overlapping entries are probed and counted exactly once.
+  std::vector<AddressRange> claimed;
+  for (auto &s : cfg.subnets) {
+    subtractRanges(s.ranges, claimed);
+    s.hostCount = countAddresses(s.ranges);
+    if (!s.ranges.empty()) {
+      s.firstHost = s.ranges.front().first;
+      s.lastHost = s.ranges.back().last;
+    }
+    claimed.insert(claimed.end(), s.ranges.begin(), s.ranges.end());
+    normalizeRanges(claimed);
+  }
+}
+
 bool ConfigStore::load()
 {
   if (!ensureFsMounted()) return false;
-  if (!LittleFS.exists(CONFIG_PATH)) {
-    Serial.println("Config file missing, using defaults");
-    return false;
-  }
 
-  File f = LittleFS.open(CONFIG_PATH, "r");
+  // Pick the newest intact copy: a write interrupted before promotion leaves
+  // a complete temp file, one interrupted mid-write leaves the previous base.
+  const char* candidates[] = { CONFIG_PATH, CONFIG_TMP_PATH, CONFIG_BAK_PATH };
+  const char* chosen = nullptr;
   JsonDocument doc;
-  DeserializationError err = deserializeJson(doc, f);
-  f.close();
-  if (err) {
-    Serial.println("Config parse failed");
+  generation = 0;
+  for (const char* path : candidates) {
+    JsonDocument probe;
+    uint32_t gen = 0;
+    if (!readConfigFile(storage, path, probe, gen)) continue;
+    if (!chosen || gen > generation) {
+      chosen = path;
+      generation = gen;
+      doc = std::move(probe);
+    }
+  }
+  if (!chosen) {
+    if (storage.exists(CONFIG_PATH)) LOG_ERROR("Config parse failed");
+    else LOG_INFO("Config file missing, using defaults");
     return false;
   }
+  if (chosen != CONFIG_PATH) {
+    LOG_WARN("Config recovered from {}", chosen);
+  }
+
 
   config.wifi_ssid = doc["wifi"]["ssid"].as<String>();
   config.wifi_pass = doc["wifi"]["pass"].as<String>();
@@ -101,23 +333,66 @@ bool ConfigStore::load()
   config.mqtt_pass = doc["mqtt"]["pass"].as<String>();
   config.scan_interval_ms = doc["scan_interval_ms"] | DEFAULT_SCAN_INTERVAL_MS;
   config.resolve_names = doc["resolve_names"] | true;
+  config.offline_grace_scans = doc["offline_grace_scans"] | DEFAULT_OFFLINE_GRACE_SCANS;
+  config.offline_expire_scans = doc["offline_expire_scans"] | DEFAULT_OFFLINE_EXPIRE_SCANS;
+  config.cluster_enabled = doc["cluster_enabled"] | false;
+  config.passive_discovery = doc["passive_discovery"] | true;
+
+  applyTargets(doc);
+  replayLog();
+  notePersisted();
+  compileTargets(config);
+  return true;
+}
+
+bool ConfigStore::readSubnet(JsonVariant v, Subnet &s) const
+{
+  if (v.is<JsonObject>()) {
+    JsonObject obj = v.as<JsonObject>();
+    s.cidr = obj["cidr"].as<String>();
+    s.name = obj["name"].as<String>();
+    s.interval_ms = intervalField(obj["interval_ms"]);
+    s.cidr.trim();
+    return s.cidr.length() && parseSubnet(s.cidr, s);
+  }
+  String cidr = v.as<String>();
+  cidr.trim();
+  return takeInterval(cidr, s.interval_ms) && cidr.length() && parseSubnet(cidr, s);
+}
+
+bool ConfigStore::readHost(JsonObject obj, StaticHost &h) const
+{
+  h.ip = obj["ip"].as<String>();
+  h.ip.trim();
+  h.port = obj["port"] | 0;
+  JsonArray ports = obj["ports"].as<JsonArray>();
+  if (!ports.isNull()) {
+    for (JsonVariant p : ports) {
+      uint16_t port = p | 0;
+      if (port && h.ports.size() < MAX_TARGET_PORTS) h.ports.push_back(port);
+    }
+  }
+  if (h.ports.empty() && h.port) h.ports.push_back(h.port);
+  if (!h.ports.empty()) h.port = h.ports[0];
+  h.name = obj["name"].as<String>();
+  h.interval_ms = intervalField(obj["interval_ms"]);
+  const char* check = obj["check"] | "";
+  const ServiceProbe* probe = *check ? findServiceProbe(String(check)) : nullptr;
+  if (probe) {
+    h.check = probe->kind();
+    h.check_arg = obj["check_arg"] | "";
+  }
+  return h.ip.length();
+}
 
+void ConfigStore::applyTargets(JsonDocument &doc)
+{
   config.subnets.clear();
   JsonArray subs = doc["subnets"].as<JsonArray>();
   if (!subs.isNull()) {
     for (JsonVariant v : subs) {
       Subnet s;
-      if (v.is<JsonObject>()) {
-        JsonObject obj = v.as<JsonObject>();
-        s.cidr = obj["cidr"].as<String>();
-        s.name = obj["name"].as<String>();
-        s.cidr.trim();
-        if (s.cidr.length() && parseSubnet(s.cidr, s)) config.subnets.push_back(s);
-      } else {
-        String cidr = v.as<String>();
-        cidr.trim();
-        if (cidr.length() && parseSubnet(cidr, s)) config.subnets.push_back(s);
-      }
+      if (readSubnet(v, s)) config.subnets.push_back(s);
     }
   }
 
@@ -126,14 +401,96 @@ bool ConfigStore::load()
   if (!hosts.isNull()) {
     for (JsonObject obj : hosts) {
       StaticHost h;
-      h.ip = obj["ip"].as<String>();
-      h.ip.trim();
-      h.port = obj["port"] | 0;
-      h.name = obj["name"].as<String>();
-      if (h.ip.length()) config.static_hosts.push_back(h);
+      if (readHost(obj, h)) config.static_hosts.push_back(h);
     }
   }
-  return true;
+}
+
+// Replays one journal record's ops. An entry that no longer parses is
+// dropped, as load() drops it from the base file.
+void ConfigStore::applyOps(JsonArray ops)
+{
+  for (JsonObject op : ops) {
+    String kind = op["op"].as<String>();
+    size_t at = op["at"] | 0;
+    bool subnets = op["list"].as<String>() == "subnets";
+    size_t size = subnets ? config.subnets.size() : config.static_hosts.size();
+    if (kind == "remove" || kind == "replace") {
+      if (at >= size) continue;
+      if (subnets) config.subnets.erase(config.subnets.begin() + at);
+      else config.static_hosts.erase(config.static_hosts.begin() + at);
+      if (kind == "remove") continue;
+    } else if (kind != "add" || at > size) {
+      continue;
+    }
+    if (subnets) {
+      Subnet s;
+      if (readSubnet(op["entry"], s)) config.subnets.insert(config.subnets.begin() + at, s);
+    } else {
+      StaticHost h;
+      if (readHost(op["entry"], h)) config.static_hosts.insert(config.static_hosts.begin() + at, h);
+    }
+  }
+}
+
+void ConfigStore::notePersisted()
+{
+  savedSubnets.clear();
+  for (const auto &sub : config.subnets) savedSubnets.push_back(entryCrc(sub, writeSubnet));
+  savedHosts.clear();
+  for (const auto &h : config.static_hosts) savedHosts.push_back(entryCrc(h, writeHost));
+}
+
+void ConfigStore::buildTargets(JsonDocument &doc) const
+{
+  JsonArray subs = doc["subnets"].to<JsonArray>();
+  for (const auto &s : config.subnets) writeSubnet(subs.add<JsonObject>(), s);
+
+  JsonArray hosts = doc["static_hosts"].to<JsonArray>();
+  for (const auto &h : config.static_hosts) writeHost(hosts.add<JsonObject>(), h);
+}
+
+void ConfigStore::replayLog()
+{
+  logBytes = 0;
+  logNeedsCompaction = false;
+  if (!storage.exists(CONFIG_LOG_PATH)) return;
+  File f = storage.open(CONFIG_LOG_PATH, "r");
+  if (!f) return;
+
+  size_t applied = 0;
+  while (f.position() < f.size()) {
+    RecordHeader h;
+    if (!readRecordHeader(f, h)) {
+      // Torn tail from an interrupted append; later appends must not follow it
+      logNeedsCompaction = true;
+      break;
+    }
+    // Records written against an older base were folded into it already
+    if (h.generation == generation) {
+      JsonDocument doc;
+      if (deserializeJson(doc, f)) {
+        logNeedsCompaction = true;
+        break;
+      }
+      // Records from before per-target ops hold the whole target list
+      if (doc["ops"].isNull()) applyTargets(doc);
+      else applyOps(doc["ops"].as<JsonArray>());
+      applied++;
+    }
+    // A record cut before its newline is intact, but an append after it
+    // would run into its payload
+    f.seek(h.payloadStart + h.length);
+    if (f.read() != '\n') {
+      logNeedsCompaction = true;
+      break;
+    }
+    logBytes = f.position();
+  }
+  f.close();
+  if (applied) {
+    LOG_INFO("Config log replayed: {} records", applied);
+  }
 }
 
 bool ConfigStore::save()
@@ -153,74 +510,129 @@ bool ConfigStore::save()
 
   doc["scan_interval_ms"] = config.scan_interval_ms;
   doc["resolve_names"] = config.resolve_names;
+  doc["offline_grace_scans"] = config.offline_grace_scans;
+  doc["offline_expire_scans"] = config.offline_expire_scans;
+  doc["cluster_enabled"] = config.cluster_enabled;
+  doc["passive_discovery"] = config.passive_discovery;
 
-  JsonArray subs = doc["subnets"].to<JsonArray>();
-  for (const auto &s : config.subnets) {
-    JsonObject o = subs.add<JsonObject>();
-    o["cidr"] = s.cidr;
-    o["name"] = s.name;
-  }
+  buildTargets(doc);
 
-  JsonArray hosts = doc["static_hosts"].to<JsonArray>();
-  for (const auto &h : config.static_hosts) {
-    JsonObject obj = hosts.add<JsonObject>();
-    obj["ip"] = h.ip;
-    obj["port"] = h.port;
-    obj["name"] = h.name;
+  uint32_t nextGeneration = generation + 1;
+  File f = storage.open(CONFIG_TMP_PATH, "w");
+  if (!f) return false;
+  bool ok = writeRecord(f, nextGeneration, doc);
+  f.close();
+
+  // Read back before promoting so a short write never replaces a good file
+  JsonDocument verify;
+  uint32_t verifyGeneration = 0;
+  if (!ok || !readConfigFile(storage, CONFIG_TMP_PATH, verify, verifyGeneration) || verifyGeneration != nextGeneration) {
+    storage.remove(CONFIG_TMP_PATH);
+    LOG_ERROR("Config save failed");
+    return false;
   }
 
-  File f = LittleFS.open(CONFIG_PATH, "w");
-  if (!f) return false;
-  serializeJson(doc, f);
+  if (storage.exists(CONFIG_BAK_PATH)) storage.remove(CONFIG_BAK_PATH);
+  if (storage.exists(CONFIG_PATH)) storage.rename(CONFIG_PATH, CONFIG_BAK_PATH);
+  if (!storage.rename(CONFIG_TMP_PATH, CONFIG_PATH)) return false;
+  generation = nextGeneration;
+
+  // The log only holds edits against older generations now
+  if (storage.exists(CONFIG_LOG_PATH)) storage.remove(CONFIG_LOG_PATH);
+  logBytes = 0;
+  logNeedsCompaction = false;
+  notePersisted();
+  LOG_INFO("Config saved");
+  return true;
+}
+
+// Appends the targets added, removed or replaced since the last save as one
+// record, so a torn append loses the whole edit and never half of it
+bool ConfigStore::saveTargets()
+{
+  if (!ensureFsMounted()) return false;
+  if (!generation || logNeedsCompaction || logBytes >= CONFIG_LOG_COMPACT_BYTES) return save();
+
+  JsonDocument doc;
+  JsonArray ops = doc["ops"].to<JsonArray>();
+  size_t changed = diffTargets(ops, "subnets", savedSubnets, config.subnets, writeSubnet) +
+                   diffTargets(ops, "hosts", savedHosts, config.static_hosts, writeHost);
+  if (!changed) return true;
+  File f = storage.open(CONFIG_LOG_PATH, "a");
+  if (!f) return save();
+  bool ok = writeRecord(f, generation, doc);
+  logBytes = f.position();
   f.close();
-  Serial.println("Config saved");
+  if (!ok) return save();
+  notePersisted();
+  LOG_INFO("Targets saved: {} changes", changed);
   return true;
 }
 
-bool ConfigStore::parseConfigPayload(const String &body)
+// Writes `candidate` and adopts it only once it is on flash, so a failed save
+// leaves the running config as it was
+bool ConfigStore::adopt(const Config &candidate, bool (ConfigStore::*persist)())
+{
+  Config previous = std::move(config);
+  config = candidate;
+  if ((this->*persist)()) return true;
+  config = std::move(previous);
+  return false;
+}
+
+bool ConfigStore::save(const Config &candidate) { return adopt(candidate, &ConfigStore::save); }
+
+bool ConfigStore::saveTargets(const Config &candidate) { return adopt(candidate, &ConfigStore::saveTargets); }
+
+bool ConfigStore::parseConfigPayload(const String &body, Config &out) const
 {
   JsonDocument doc;
   DeserializationError err = deserializeJson(doc, body);
   if (err) return false;
 
-  config.wifi_ssid = doc["wifi_ssid"].as<String>();
-  config.wifi_pass = doc["wifi_pass"].as<String>();
-  config.mqtt_host = doc["mqtt_host"].as<String>();
-  config.mqtt_port = doc["mqtt_port"] | DEFAULT_MQTT_PORT;
-  config.mqtt_user = doc["mqtt_user"].as<String>();
-  config.mqtt_pass = doc["mqtt_pass"].as<String>();
-  config.scan_interval_ms = doc["scan_interval_ms"] | DEFAULT_SCAN_INTERVAL_MS;
-  config.resolve_names = doc["resolve_names"] | true;
-
-  config.subnets.clear();
+  out.wifi_ssid = doc["wifi_ssid"].as<String>();
+  out.wifi_pass = doc["wifi_pass"].as<String>();
+  out.mqtt_host = doc["mqtt_host"].as<String>();
+  out.mqtt_port = doc["mqtt_port"] | DEFAULT_MQTT_PORT;
+  out.mqtt_user = doc["mqtt_user"].as<String>();
+  out.mqtt_pass = doc["mqtt_pass"].as<String>();
+  out.scan_interval_ms = doc["scan_interval_ms"] | DEFAULT_SCAN_INTERVAL_MS;
+  out.resolve_names = doc["resolve_names"] | true;
+  out.offline_grace_scans = doc["offline_grace_scans"] | DEFAULT_OFFLINE_GRACE_SCANS;
+  out.offline_expire_scans = doc["offline_expire_scans"] | DEFAULT_OFFLINE_EXPIRE_SCANS;
+  out.cluster_enabled = doc["cluster_enabled"] | false;
+  out.passive_discovery = doc["passive_discovery"] | true;
+
+  out.subnets.clear();
   JsonArray subs = doc["subnets"].as<JsonArray>();
   if (!subs.isNull()) {
     for (JsonVariant v : subs) {
       Subnet s;
       String cidr = v.as<String>();
       cidr.trim();
-      if (cidr.length() && parseSubnet(cidr, s)) config.subnets.push_back(s);
+      if (takeInterval(cidr, s.interval_ms) && cidr.length() && parseSubnet(cidr, s)) out.subnets.push_back(s);
     }
   }
 
-  config.static_hosts.clear();
+  out.static_hosts.clear();
   JsonArray hosts = doc["hosts"].as<JsonArray>();
   if (!hosts.isNull()) {
     for (JsonVariant v : hosts) {
       StaticHost h;
-      if (parseHostLine(v.as<String>(), h)) config.static_hosts.push_back(h);
+      if (parseHostLine(v.as<String>(), h)) out.static_hosts.push_back(h);
     }
   }
+  compileTargets(out);
   return true;
 }
 
-bool ConfigStore::parseTargetsPayload(const String &body)
+bool ConfigStore::parseTargetsPayload(const String &body, Config &out) const
 {
   JsonDocument doc;
   DeserializationError err = deserializeJson(doc, body);
   if (err) return false;
 
-  config.subnets.clear();
+  out.subnets.clear();
   JsonArray subs = doc["subnets"].as<JsonArray>();
   if (!subs.isNull()) {
     for (JsonVariant v : subs) {
@@ -229,11 +641,13 @@ bool ConfigStore::parseTargetsPayload(const String &body)
         JsonObject obj = v.as<JsonObject>();
         s.cidr = obj["cidr"].as<String>();
         s.name = obj["name"].as<String>();
+        s.interval_ms = intervalField(obj["interval_ms"]);
         s.cidr.trim();
-        if (s.cidr.length() && parseSubnet(s.cidr, s)) config.subnets.push_back(s);
+        if (s.cidr.length() && parseSubnet(s.cidr, s)) out.subnets.push_back(s);
       } else {
         String value = v.as<String>();
         value.trim();
+        if (!takeInterval(value, s.interval_ms)) continue;
         if (value.length()) {
           int hashIndex = value.indexOf('#');
           if (hashIndex > 0) {
@@ -245,27 +659,28 @@ bool ConfigStore::parseTargetsPayload(const String &body)
             s.cidr = value;
             s.name.clear();
           }
-          if (s.cidr.length() && parseSubnet(s.cidr, s)) config.subnets.push_back(s);
+          if (s.cidr.length() && parseSubnet(s.cidr, s)) out.subnets.push_back(s);
         }
       }
     }
   }
 
-  config.static_hosts.clear();
+  out.static_hosts.clear();
   JsonArray hosts = doc["hosts"].as<JsonArray>();
   if (!hosts.isNull()) {
     for (JsonVariant v : hosts) {
       StaticHost h;
-      if (parseHostLine(v.as<String>(), h)) config.static_hosts.push_back(h);
+      if (parseHostLine(v.as<String>(), h)) out.static_hosts.push_back(h);
     }
   }
+  compileTargets(out);
   return true;
 }
 
 String ConfigStore::renderSubnets() const
 {
   String combined;
-  for (const auto &s : config.subnets) combined += s.cidr + "\n";
+  for (const auto &s : config.subnets) combined += s.cidr + renderInterval(s.interval_ms) + "\n";
   return combined;
 }
 
@@ -273,8 +688,11 @@ String ConfigStore::renderHosts() const
 {
   String combined;
   for (const auto &h : config.static_hosts) {
+    if (h.check != ServiceKind::None) combined += String(findServiceProbe(h.check)->name()) + "://";
     combined += h.ip;
-    if (h.port) combined += ":" + String(h.port);
+    if (!h.ports.empty()) combined += ":" + renderPortSet(h.ports);
+    combined += h.check_arg;
+    combined += renderInterval(h.interval_ms);
     if (h.name.length()) combined += "|" + h.name;
     combined += "\n";
   }
@@ -0,0 +1,153 @@
+#include "platform.h"
+#include <WiFi.h>
+#include <lwip/etharp.h>
+#include <lwip/icmp.h>
+#include <lwip/inet_chksum.h>
+#include <lwip/netif.h>
+#include <lwip/priv/tcpip_priv.h>
+#include <lwip/prot/ip4.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "config_store.h"
+#include "target_set.h"
+
+namespace {
+  const uint16_t ARP_REPLY_WAIT_MS = 40;
+  const uint16_t PING_ID = 0x4F57;
+  const size_t PING_REPLY_BUFFER = 64;  // IP header with options plus the echo header
+
+  uint16_t pingSeq = 0;
+
+  struct ArpCall {
+    struct tcpip_api_call_data call;  // must stay first for tcpip_api_call
+    uint32_t first;
+    uint8_t count;
+    bool send;
+    uint8_t alive;
+  };
+
+  // Runs on the lwIP thread, which owns the ARP table
+  err_t arpOnTcpip(struct tcpip_api_call_data *data)
+  {
+    ArpCall *c = reinterpret_cast<ArpCall *>(data);
+    struct netif *nif = netif_default;
+    if (!nif) return ERR_IF;
+    for (uint8_t i = 0; i < c->count; i++) {
+      ip4_addr_t addr;
+      addr.addr = lwip_htonl(c->first + i);
+      if (c->send) {
+        etharp_request(nif, &addr);
+      } else {
+        struct eth_addr *mac;
+        const ip4_addr_t *found;
+        if (etharp_find_addr(nif, &addr, &mac, &found) >= 0) c->alive |= 1 << i;
+      }
+    }
+    return ERR_OK;
+  }
+
+  class LwipArpCache : public ArpCache {
+  public:
+    bool request(uint32_t first, uint8_t count) override
+    {
+      ArpCall c = { {}, first, count, true, 0 };
+      return tcpip_api_call(arpOnTcpip, &c.call) == ERR_OK;
+    }
+
+    uint8_t resolved(uint32_t first, uint8_t count) override
+    {
+      ArpCall c = { {}, first, count, false, 0 };
+      return tcpip_api_call(arpOnTcpip, &c.call) == ERR_OK ? c.alive : 0;
+    }
+  };
+}
+
+// One echo request on a raw socket, waiting at most PING_TIMEOUT_MS for its
+// reply, so a silent address holds up the loop no longer than a connect does
+bool EspNetworkBackend::ping(const IPAddress &ip, uint16_t &rttMs)
+{
+  int fd = socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP);
+  if (fd < 0) return false;
+  sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = htonl(ipToInt(ip));
+
+  icmp_echo_hdr echo = {};
+  ICMPH_TYPE_SET(&echo, ICMP_ECHO);
+  echo.id = htons(PING_ID);
+  echo.seqno = htons(++pingSeq);
+  echo.chksum = inet_chksum(&echo, sizeof(echo));
+
+  unsigned long t0 = millis();
+  bool answered = false;
+  if (sendto(fd, &echo, sizeof(echo), 0, reinterpret_cast<sockaddr *>(&to), sizeof(to)) == sizeof(echo)) {
+    uint8_t buf[PING_REPLY_BUFFER];
+    for (;;) {
+      unsigned long elapsed = millis() - t0;
+      if (elapsed >= PING_TIMEOUT_MS) break;
+      timeval wait = { 0, static_cast<long>((PING_TIMEOUT_MS - elapsed) * 1000) };
+      fd_set readable;
+      FD_ZERO(&readable);
+      FD_SET(fd, &readable);
+      if (select(fd + 1, &readable, nullptr, nullptr, &wait) <= 0) break;
+
+      // Raw sockets see every ICMP packet, so match sender, id and sequence
+      sockaddr_in from = {};
+      socklen_t fromLen = sizeof(from);
+      int n = recvfrom(fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &fromLen);
+      if (n < static_cast<int>(IP_HLEN + sizeof(icmp_echo_hdr))) continue;
+      size_t headerLen = IPH_HL_BYTES(reinterpret_cast<const ip_hdr *>(buf));
+      if (n < static_cast<int>(headerLen + sizeof(icmp_echo_hdr))) continue;
+      const icmp_echo_hdr *reply = reinterpret_cast<const icmp_echo_hdr *>(buf + headerLen);
+      if (from.sin_addr.s_addr == to.sin_addr.s_addr && ICMPH_TYPE(reply) == ICMP_ER &&
+          reply->id == echo.id && reply->seqno == echo.seqno) {
+        answered = true;
+        break;
+      }
+    }
+  }
+  close(fd);
+  if (answered) rttMs = static_cast<uint16_t>(millis() - t0);
+  return answered;
+}
+
+bool EspNetworkBackend::connect(const IPAddress &ip, uint16_t port, uint16_t &rttMs)
+{
+  WiFiClient c;
+  unsigned long t0 = millis();
+  if (!c.connect(ip, port, PING_TIMEOUT_MS)) return false;
+  rttMs = static_cast<uint16_t>(millis() - t0);
+  return true;
+}
+
+bool EspNetworkBackend::connect(const char *host, uint16_t port, uint16_t &rttMs)
+{
+  WiFiClient c;
+  unsigned long t0 = millis();
+  if (!c.connect(host, port, PING_TIMEOUT_MS)) return false;
+  rttMs = static_cast<uint16_t>(millis() - t0);
+  return true;
+}
+
+// Requests for the whole batch go out back to back, then the ARP table is
+// polled until every address resolved or the reply window closed. Live hosts
+// cost one round trip per batch and silent ones share a single wait. lwIP
+// keeps stable entries for minutes without traffic, so addresses already
+// cached are pinged instead of trusted.
+bool EspNetworkBackend::arpProbe(uint32_t first, uint8_t count, uint8_t &aliveMask)
+{
+  aliveMask = 0;
+  uint32_t local = ipToInt(WiFi.localIP());
+  uint32_t mask = ipToInt(WiFi.subnetMask());
+  uint32_t last = first + count - 1;
+  if (!local || !count || (first & mask) != (local & mask) || (last & mask) != (local & mask)) return false;
+
+  LwipArpCache cache;
+  aliveMask = arpSweep(cache, first, count, ARP_REPLY_WAIT_MS, [this](uint32_t ip)
+                       {
+                         uint16_t rtt;
+                         return ping(intToIp(ip), rtt);
+                       });
+  return true;
+}
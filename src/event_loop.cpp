@@ -0,0 +1,145 @@
+#include "event_loop.h"
+#include <sys/select.h>
+#include "logger.h"
+
+namespace {
+  const uint32_t WATCHER_TASK_STACK = 2048;
+  const UBaseType_t WATCHER_TASK_PRIORITY = 2;   // above loop() so wakes are prompt
+  const int PM_MAX_FREQ_MHZ = 160;
+  const int PM_MIN_FREQ_MHZ = 40;                  // XTAL clock; Wi-Fi still works there
+}
+
+void EventLoop::begin()
+{
+  loopTask = xTaskGetCurrentTaskHandle();
+  sleepMs = EVENT_LOOP_MAX_SLEEP_MS;
+  windowStartUs = micros();
+#if OVERWATCH_LIGHT_SLEEP
+  // Held whenever the loop is awake so a pass never runs at the idle clock
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "loop", &cpuLock) == ESP_OK) esp_pm_lock_acquire(cpuLock);
+  else cpuLock = nullptr;
+#endif
+  if (xTaskCreate(watcherTask, "evwatch", WATCHER_TASK_STACK, this, WATCHER_TASK_PRIORITY, &watcher) != pdPASS) {
+    watcher = nullptr;
+    LOG_WARN("Socket watcher start failed, sockets are polled on timers only");
+  }
+}
+
+void EventLoop::watchSocket(SocketProvider fd)
+{
+  if (socketCount < EVENT_LOOP_MAX_SOCKETS) sockets[socketCount++] = std::move(fd);
+}
+
+void EventLoop::post(uint32_t bits)
+{
+  if (loopTask) xTaskNotify(loopTask, bits, eSetBits);
+}
+
+void EventLoop::wakeIn(uint32_t ms)
+{
+  if (ms < sleepMs) sleepMs = ms;
+}
+
+uint32_t EventLoop::wait()
+{
+  uint32_t timeoutMs = sleepMs;
+  sleepMs = EVENT_LOOP_MAX_SLEEP_MS;
+  if (!loopTask) return 0;
+
+  uint32_t bits = 0;
+  if (timeoutMs == 0) {
+    // Work is pending; only collect events that already arrived
+    xTaskNotifyWait(0, UINT32_MAX, &bits, 0);
+    counters.busyPasses++;
+  } else {
+    // Descriptors are read here, on the loop task, so the watcher never
+    // touches a client object that loop() may be closing
+    for (uint8_t i = 0; i < socketCount; i++) armedFds[i] = sockets[i]();
+    if (watcher) xTaskNotifyGive(watcher);
+    if (cpuLock) esp_pm_lock_release(cpuLock);
+    uint32_t startUs = micros();
+    bool notified = xTaskNotifyWait(0, UINT32_MAX, &bits, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+    windowIdleUs += micros() - startUs;
+    if (cpuLock) esp_pm_lock_acquire(cpuLock);
+    counters.wakeups++;
+    if (!notified) counters.timerWakeups++;
+  }
+  if (bits & EVENT_WIFI) counters.wifiWakeups++;
+  if (bits & EVENT_SOCKET) counters.socketWakeups++;
+  if (bits & EVENT_WEB) counters.webWakeups++;
+  rollWindow(micros());
+  return bits;
+}
+
+void EventLoop::rollWindow(uint32_t nowUs)
+{
+  uint32_t elapsedUs = nowUs - windowStartUs;
+  if (elapsedUs < EVENT_LOOP_WINDOW_MS * 1000UL) return;
+  // A wait that began in the previous window is counted whole in this one
+  float pct = 100.0f * windowIdleUs / elapsedUs;
+  counters.idlePct = pct > 100.0f ? 100.0f : pct;
+  windowStartUs = nowUs;
+  windowIdleUs = 0;
+}
+
+void EventLoop::watcherTask(void* arg)
+{
+  static_cast<EventLoop*>(arg)->watchSockets();
+}
+
+void EventLoop::watchSockets()
+{
+  for (;;) {
+    // Armed by wait() each time the loop blocks
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (;;) {
+      fd_set readable;
+      FD_ZERO(&readable);
+      int maxFd = -1;
+      for (uint8_t i = 0; i < EVENT_LOOP_MAX_SOCKETS; i++) {
+        int fd = armedFds[i];
+        if (fd < 0) continue;
+        FD_SET(fd, &readable);
+        if (fd > maxFd) maxFd = fd;
+      }
+      if (maxFd < 0) break;
+      // The timeout only picks up descriptors re-armed in the meantime
+      timeval tv = { 1, 0 };
+      if (select(maxFd + 1, &readable, nullptr, nullptr, &tv) != 0) {
+        // Readable or closed under us; either way the loop should look
+        xTaskNotify(loopTask, EVENT_SOCKET, eSetBits);
+        break;
+      }
+    }
+  }
+}
+
+// Light sleep needs the station link: in AP mode the radio must stay up for
+// portal clients, and while connecting there is nothing to wait for yet.
+void EventLoop::allowLightSleep(bool allowed)
+{
+#if OVERWATCH_LIGHT_SLEEP
+  if (allowed == sleepAllowed) return;
+  sleepAllowed = allowed;
+  esp_pm_config_esp32c3_t pm = {};
+  pm.max_freq_mhz = PM_MAX_FREQ_MHZ;
+  pm.min_freq_mhz = allowed ? PM_MIN_FREQ_MHZ : PM_MAX_FREQ_MHZ;
+  pm.light_sleep_enable = allowed;
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err != ESP_OK && allowed) {
+    // Cores built without tickless idle refuse light sleep but still scale the clock
+    pm.light_sleep_enable = false;
+    err = esp_pm_configure(&pm);
+  }
+  counters.lightSleep = err == ESP_OK && pm.light_sleep_enable;
+  if (err != ESP_OK) LOG_WARN("Power management unavailable ({})", (int)err);
+  else LOG_INFO("Power save {}", counters.lightSleep ? "light sleep" : allowed ? "clock scaling" : "off");
+#else
+  (void)allowed;
+#endif
+}
+
+EventLoopStats EventLoop::stats() const
+{
+  return counters;
+}
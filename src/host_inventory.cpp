@@ -0,0 +1,333 @@
+#include "host_inventory.h"
+#include <esp_crc.h>
+#include "logger.h"
+
+namespace {
+  const char* INVENTORY_PATH = "/hosts.dat";
+  const char* INVENTORY_TMP_PATH = "/hosts.tmp";
+  const char* INVENTORY_LOG_PATH = "/hosts.log";
+  const size_t INVENTORY_LOG_COMPACT_BYTES = 8192;
+  const uint32_t SWEEP_MARKER_INTERVAL = 12;  // sweeps between counter-only appends
+  const size_t IO_BATCH = 32;
+  const size_t INVENTORY_HEAP_RESERVE = 48 * 1024;  // left for the web server, TLS and MQTT
+
+  uint16_t recordCheck(const InventoryRecord &r)
+  {
+    return esp_crc32_le(0, reinterpret_cast<const uint8_t*>(&r), offsetof(InventoryRecord, check)) & 0xFFFF;
+  }
+
+  InventoryRecord makeRecord(uint32_t ip, uint32_t first, uint32_t last, HostState state)
+  {
+    InventoryRecord r = {};
+    r.ip = ip;
+    r.firstSweep = first;
+    r.lastSweep = last;
+    r.state = static_cast<uint8_t>(state);
+    r.check = recordCheck(r);
+    return r;
+  }
+
+  // Reads records until EOF or the first torn/corrupt one, which fails the
+  // read. The first record of every file is a marker carrying its generation.
+  template <typename F>
+  bool readRecords(File &f, F onRecord)
+  {
+    InventoryRecord batch[IO_BATCH];
+    while (true) {
+      size_t got = f.read(reinterpret_cast<uint8_t*>(batch), sizeof(batch));
+      size_t count = got / sizeof(InventoryRecord);
+      for (size_t i = 0; i < count; i++) {
+        if (batch[i].check != recordCheck(batch[i])) return false;
+        onRecord(batch[i]);
+      }
+      if (got % sizeof(InventoryRecord)) return false;
+      if (got < sizeof(batch)) return true;
+    }
+  }
+
+  bool writeRecords(File &f, const InventoryRecord *records, size_t count)
+  {
+    size_t bytes = count * sizeof(InventoryRecord);
+    return f.write(reinterpret_cast<const uint8_t*>(records), bytes) == bytes;
+  }
+}
+
+HostInventory::HostInventory(fs::FS& filesystem) : storage(filesystem) {}
+
+// The inventory can hold every address of the largest target, but stops
+// growing before the vector's next reallocation would eat into the reserve
+bool HostInventory::canTrack() const
+{
+  if (entries.size() >= MAX_INVENTORY_HOSTS) return false;
+  if (entries.size() < entries.capacity()) return true;
+  size_t grown = (entries.capacity() ? entries.capacity() * 2 : 1) * sizeof(InventoryEntry);
+  return ESP.getMaxAllocHeap() >= grown + INVENTORY_HEAP_RESERVE;
+}
+
+void HostInventory::apply(const InventoryRecord &r)
+{
+  HostState state = static_cast<HostState>(r.state);
+  if (state == HostState::Marker) {
+    if (r.lastSweep > persistedSweep) persistedSweep = r.lastSweep;
+    return;
+  }
+  size_t i = lowerBound(r.ip);
+  bool found = i < entries.size() && entries[i].ip == r.ip;
+  if (state == HostState::Forgotten) {
+    if (found) entries.erase(entries.begin() + i);
+    return;
+  }
+  if (!found) {
+    if (!canTrack()) return;
+    entries.insert(entries.begin() + i, InventoryEntry());
+  }
+  InventoryEntry &e = entries[i];
+  e.ip = r.ip;
+  e.firstSweep = r.firstSweep;
+  e.lastSweep = r.lastSweep;
+  e.state = state;
+}
+
+void HostInventory::load()
+{
+  entries.clear();
+  pending.clear();
+  generation = 0;
+  persistedSweep = 0;
+  logBytes = 0;
+  logNeedsCompaction = false;
+
+  if (storage.exists(INVENTORY_PATH)) {
+    File f = storage.open(INVENTORY_PATH, "r");
+    bool first = true;
+    bool ok = f && readRecords(f, [&](const InventoryRecord &r) {
+      if (first && r.state == static_cast<uint8_t>(HostState::Marker)) generation = r.firstSweep;
+      first = false;
+      apply(r);
+    });
+    if (f) f.close();
+    if (!ok) logNeedsCompaction = true;
+  }
+
+  if (storage.exists(INVENTORY_LOG_PATH)) {
+    File f = storage.open(INVENTORY_LOG_PATH, "r");
+    bool first = true;
+    bool current = false;
+    bool ok = f && readRecords(f, [&](const InventoryRecord &r) {
+      // A log left behind by an interrupted compaction belongs to an older snapshot
+      if (first) current = r.state == static_cast<uint8_t>(HostState::Marker) && r.firstSweep == generation;
+      first = false;
+      if (current) apply(r);
+    });
+    if (f) {
+      logBytes = f.size();
+      f.close();
+    }
+    if (!ok || !current) logNeedsCompaction = true;
+  }
+
+  // Hosts online at the last write were online through the last known sweep
+  currentSweep = persistedSweep;
+  for (auto &e : entries) {
+    if (e.state == HostState::Online) e.lastSweep = currentSweep;
+  }
+  LOG_INFO("Inventory loaded: {} hosts, sweep {}", (uint32_t)entries.size(), currentSweep);
+}
+
+uint32_t HostInventory::beginSweep() { return ++currentSweep; }
+
+uint32_t HostInventory::sweep() const { return currentSweep; }
+
+Sighting HostInventory::seen(uint32_t ip)
+{
+  size_t i = lowerBound(ip);
+  if (i < entries.size() && entries[i].ip == ip) {
+    InventoryEntry &e = entries[i];
+    e.lastSweep = currentSweep;
+    e.missed = 0;
+    if (e.state == HostState::Online) return Sighting::Known;
+    e.state = HostState::Online;
+    queue(e);
+    return Sighting::Returned;
+  }
+  if (!canTrack()) {
+    untracked++;
+    if (!full) LOG_WARN("Inventory full at {} hosts, new hosts are not reported", (uint32_t)entries.size());
+    full = true;
+    return Sighting::Untracked;
+  }
+  full = false;
+  InventoryEntry e;
+  e.ip = ip;
+  e.firstSweep = currentSweep;
+  e.lastSweep = currentSweep;
+  entries.insert(entries.begin() + i, e);
+  queue(e);
+  return Sighting::New;
+}
+
+void HostInventory::markOffline(InventoryEntry &entry)
+{
+  if (entry.state != HostState::Online) return;
+  entry.state = HostState::Offline;
+  queue(entry);
+}
+
+void HostInventory::markOffline(uint32_t ip)
+{
+  size_t i = lowerBound(ip);
+  if (i < entries.size() && entries[i].ip == ip) markOffline(entries[i]);
+}
+
+void HostInventory::forget(size_t index)
+{
+  if (index >= entries.size()) return;
+  uint32_t ip = entries[index].ip;
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i].ip == ip) {
+      names.erase(names.begin() + i);
+      break;
+    }
+  }
+  pending.push_back(makeRecord(entries[index].ip, 0, 0, HostState::Forgotten));
+  entries.erase(entries.begin() + index);
+}
+
+void HostInventory::heard(uint32_t ip, uint32_t nowMs)
+{
+  size_t i = lowerBound(ip);
+  if (i < entries.size() && entries[i].ip == ip) entries[i].heardMs = nowMs ? nowMs : 1;
+}
+
+bool HostInventory::heardWithin(uint32_t ip, uint32_t nowMs, uint32_t windowMs) const
+{
+  size_t i = lowerBound(ip);
+  if (i >= entries.size() || entries[i].ip != ip || !entries[i].heardMs) return false;
+  return nowMs - entries[i].heardMs < windowMs;
+}
+
+// Names are kept for a bounded set of hosts; when full the oldest is dropped
+void HostInventory::setName(uint32_t ip, const char* name)
+{
+  if (!name || !*name) return;
+  HostName *slot = nullptr;
+  for (auto &n : names) {
+    if (n.ip == ip) slot = &n;
+  }
+  if (!slot) {
+    if (names.size() >= MAX_INVENTORY_NAMES) names.erase(names.begin());
+    names.push_back(HostName());
+    slot = &names.back();
+    slot->ip = ip;
+  }
+  strncpy(slot->name, name, sizeof(slot->name) - 1);
+  slot->name[sizeof(slot->name) - 1] = 0;
+}
+
+const char* HostInventory::name(uint32_t ip) const
+{
+  for (const auto &n : names) {
+    if (n.ip == ip) return n.name;
+  }
+  return nullptr;
+}
+
+void HostInventory::queue(const InventoryEntry &e)
+{
+  pending.push_back(makeRecord(e.ip, e.firstSweep, e.lastSweep, e.state));
+}
+
+// Called once per sweep. Transitions are appended in one write behind a
+// marker; quiet sweeps only write a marker every SWEEP_MARKER_INTERVAL.
+void HostInventory::flush()
+{
+  if (pending.empty() && currentSweep - persistedSweep < SWEEP_MARKER_INTERVAL) return;
+  if (!generation || logNeedsCompaction || logBytes >= INVENTORY_LOG_COMPACT_BYTES) {
+    compact();
+    return;
+  }
+
+  File f = storage.open(INVENTORY_LOG_PATH, "a");
+  if (!f) {
+    compact();
+    return;
+  }
+  InventoryRecord marker = makeRecord(0, generation, currentSweep, HostState::Marker);
+  bool ok = writeRecords(f, &marker, 1) && writeRecords(f, pending.data(), pending.size());
+  logBytes = f.position();
+  f.close();
+  if (!ok) {
+    logNeedsCompaction = true;
+    return;
+  }
+  persistedSweep = currentSweep;
+  pending.clear();
+  appends++;
+}
+
+// Snapshot replaces the old one in a single rename; the stale log is then
+// ignored by generation even if removing it is interrupted.
+bool HostInventory::compact()
+{
+  uint32_t nextGeneration = generation + 1;
+  File f = storage.open(INVENTORY_TMP_PATH, "w");
+  if (!f) return false;
+
+  InventoryRecord batch[IO_BATCH];
+  size_t n = 0;
+  batch[n++] = makeRecord(0, nextGeneration, currentSweep, HostState::Marker);
+  bool ok = true;
+  for (const auto &e : entries) {
+    batch[n++] = makeRecord(e.ip, e.firstSweep, e.lastSweep, e.state);
+    if (n == IO_BATCH) {
+      ok = ok && writeRecords(f, batch, n);
+      n = 0;
+    }
+  }
+  ok = ok && writeRecords(f, batch, n);
+  f.close();
+
+  if (!ok || !storage.rename(INVENTORY_TMP_PATH, INVENTORY_PATH)) {
+    storage.remove(INVENTORY_TMP_PATH);
+    LOG_ERROR("Inventory compaction failed");
+    return false;
+  }
+  generation = nextGeneration;
+  if (storage.exists(INVENTORY_LOG_PATH)) storage.remove(INVENTORY_LOG_PATH);
+  logBytes = 0;
+  logNeedsCompaction = false;
+  persistedSweep = currentSweep;
+  pending.clear();
+  compactions++;
+  LOG_DEBUG("Inventory compacted: {} hosts", (uint32_t)entries.size());
+  return true;
+}
+
+size_t HostInventory::lowerBound(uint32_t ip) const
+{
+  size_t lo = 0;
+  size_t hi = entries.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (entries[mid].ip < ip) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+size_t HostInventory::size() const { return entries.size(); }
+
+InventoryEntry& HostInventory::at(size_t index) { return entries[index]; }
+
+InventoryStats HostInventory::stats() const
+{
+  InventoryStats s;
+  s.hosts = entries.size();
+  s.sweep = currentSweep;
+  s.logBytes = logBytes;
+  s.appends = appends;
+  s.compactions = compactions;
+  s.names = names.size();
+  s.untracked = untracked;
+  return s;
+}
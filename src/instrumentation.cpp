@@ -0,0 +1,122 @@
+#include "instrumentation.h"
+#include "logger.h"
+
+#if OVERWATCH_INSTRUMENTATION
+
+Instrumentation instrumentation;
+
+namespace {
+  const char* PROBE_NAMES[] = { "loop", "wifi", "mqtt_connect", "mqtt_loop", "scan_step", "broadcast" };
+  static_assert(sizeof(PROBE_NAMES) / sizeof(PROBE_NAMES[0]) == static_cast<size_t>(Probe::Count), "probe names out of sync");
+
+  uint8_t bucketFor(uint32_t us)
+  {
+    if (us < 32) return 0;
+    uint8_t log2 = 31 - __builtin_clz(us);
+    uint8_t index = log2 - 4;
+    return index >= LATENCY_BUCKETS ? LATENCY_BUCKETS - 1 : index;
+  }
+
+  uint32_t percentileOf(const uint32_t* buckets, uint32_t count, uint32_t maxUs, uint8_t pct)
+  {
+    if (!count) return 0;
+    uint32_t target = (static_cast<uint64_t>(count) * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= target) {
+        // Report the bucket's upper edge, never more than the observed max
+        uint32_t upper = i == LATENCY_BUCKETS - 1 ? maxUs : (1UL << (i + 5));
+        return upper < maxUs ? upper : maxUs;
+      }
+    }
+    return maxUs;
+  }
+}
+
+void LatencyHistogram::record(uint32_t us)
+{
+  uint8_t bucket = bucketFor(us);
+  buckets[bucket]++;
+  count++;
+  totalUs += us;
+  if (us > maxUs) maxUs = us;
+  windowBuckets[bucket]++;
+  windowCount++;
+  if (us > windowMaxUs) windowMaxUs = us;
+}
+
+uint32_t LatencyHistogram::percentileUs(uint8_t pct) const { return percentileOf(buckets, count, maxUs, pct); }
+
+uint32_t LatencyHistogram::windowPercentileUs(uint8_t pct) const
+{
+  return percentileOf(windowBuckets, windowCount, windowMaxUs, pct);
+}
+
+void LatencyHistogram::resetWindow()
+{
+  memset(windowBuckets, 0, sizeof(windowBuckets));
+  windowCount = 0;
+  windowMaxUs = 0;
+}
+
+void Instrumentation::record(Probe probe, uint32_t us)
+{
+  histograms[static_cast<uint8_t>(probe)].record(us);
+}
+
+void Instrumentation::sampleHeap()
+{
+  uint32_t freeBytes = ESP.getFreeHeap();
+  uint32_t largest = ESP.getMaxAllocHeap();
+  heapSample.freeBytes = freeBytes;
+  heapSample.largestBlock = largest;
+  heapSample.minFreeBytes = ESP.getMinFreeHeap();
+  if (!heapSample.minLargestBlock || largest < heapSample.minLargestBlock) heapSample.minLargestBlock = largest;
+}
+
+const LatencyHistogram& Instrumentation::histogram(Probe probe) const
+{
+  return histograms[static_cast<uint8_t>(probe)];
+}
+
+const HeapSample& Instrumentation::heap() const { return heapSample; }
+
+void Instrumentation::resetWindow()
+{
+  for (auto &h : histograms) h.resetWindow();
+}
+
+void Instrumentation::writeJson(JsonObject out, bool withBuckets) const
+{
+  JsonObject timings = out["timings"].to<JsonObject>();
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Probe::Count); i++) {
+    const LatencyHistogram &h = histograms[i];
+    JsonObject o = timings[PROBE_NAMES[i]].to<JsonObject>();
+    o["count"] = h.count;
+    o["avg_us"] = h.count ? static_cast<uint32_t>(h.totalUs / h.count) : 0;
+    o["p50_us"] = h.percentileUs(50);
+    o["p99_us"] = h.percentileUs(99);
+    o["max_us"] = h.maxUs;
+    o["window_count"] = h.windowCount;
+    o["window_p50_us"] = h.windowPercentileUs(50);
+    o["window_p99_us"] = h.windowPercentileUs(99);
+    o["window_max_us"] = h.windowMaxUs;
+    if (withBuckets) {
+      JsonArray b = o["buckets"].to<JsonArray>();
+      for (uint8_t k = 0; k < LATENCY_BUCKETS; k++) b.add(h.buckets[k]);
+    }
+  }
+
+  JsonObject heap = out["heap"].to<JsonObject>();
+  heap["free"] = heapSample.freeBytes;
+  heap["min_free"] = heapSample.minFreeBytes;
+  heap["largest_block"] = heapSample.largestBlock;
+  heap["min_largest_block"] = heapSample.minLargestBlock;
+
+  JsonObject log = out["log"].to<JsonObject>();
+  log["written"] = logger.written();
+  log["dropped"] = logger.dropped();
+}
+
+#endif
@@ -0,0 +1,26 @@
+#include "json_snapshot.h"
+
+void JsonSnapshot::begin()
+{
+  lock = xSemaphoreCreateMutex();
+}
+
+void JsonSnapshot::store(JsonVariantConst doc)
+{
+  size_t len = measureJson(doc);
+  auto rendered = std::make_shared<std::vector<char>>(len + 1);
+  serializeJson(doc, rendered->data(), rendered->size());
+  rendered->resize(len);
+  SnapshotText next = std::move(rendered);
+  xSemaphoreTake(lock, portMAX_DELAY);
+  text.swap(next);
+  xSemaphoreGive(lock);
+}
+
+SnapshotText JsonSnapshot::load() const
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  SnapshotText current = text;
+  xSemaphoreGive(lock);
+  return current;
+}
@@ -0,0 +1,155 @@
+#include "logger.h"
+#include "target_set.h"
+
+Logger logger;
+
+namespace {
+  const uint32_t DRAIN_PERIOD_MS = 20;
+  const uint32_t DRAIN_TASK_STACK = 4096;  // serial printf plus the stream sink
+  const UBaseType_t DRAIN_TASK_PRIORITY = 1;
+  const size_t LINE_BYTES = 192;
+}
+
+LogArg::LogArg(const IPAddress& ip) : kind(Ip), value(ipToInt(ip)) {}
+
+void Logger::begin()
+{
+  if (taskStarted) return;
+  taskStarted = xTaskCreate(drainTask, "log", DRAIN_TASK_STACK, this, DRAIN_TASK_PRIORITY, nullptr) == pdPASS;
+  if (!taskStarted) Serial.println("Log task start failed, logging synchronously");
+}
+
+void Logger::drainTask(void* arg)
+{
+  Logger* self = static_cast<Logger*>(arg);
+  for (;;) {
+    self->drain();
+    vTaskDelay(pdMS_TO_TICKS(DRAIN_PERIOD_MS));
+  }
+}
+
+void Logger::setLevel(LogLevel level) { runtimeLevel.store(static_cast<uint8_t>(level), std::memory_order_relaxed); }
+LogLevel Logger::level() const { return static_cast<LogLevel>(runtimeLevel.load(std::memory_order_relaxed)); }
+
+// Records are captured up to the serial level or the stream level, whichever
+// is more verbose; serial output stays at its own level
+bool Logger::enabled(LogLevel level) const
+{
+  uint8_t l = static_cast<uint8_t>(level);
+  return l <= runtimeLevel.load(std::memory_order_relaxed) || l <= streamLevel.load(std::memory_order_relaxed);
+}
+
+void Logger::setStreamSink(std::function<void(LogLevel, uint32_t, const char*)> sink) { streamSink = std::move(sink); }
+void Logger::setStreamLevel(LogLevel level) { streamLevel.store(static_cast<uint8_t>(level), std::memory_order_relaxed); }
+uint32_t Logger::dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+uint32_t Logger::written() const { return writtenCount; }
+
+// Producers never block: each claims a ticket and overwrites that slot, so a
+// full ring silently loses its oldest entries. The slot's sequence number acts
+// as a seqlock that lets the drain detect half-written or lapped records.
+void Logger::write(LogLevel level, const char* fmt, std::initializer_list<LogArg> args)
+{
+  uint32_t ticket = head.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = ring[ticket % LOG_RING_SIZE];
+  slot.seq.store(0, std::memory_order_release);
+
+  LogRecord &rec = slot.rec;
+  rec.timestampMs = millis();
+  rec.fmt = fmt;
+  rec.level = level;
+  rec.argc = 0;
+  size_t textUsed = 0;
+  for (const LogArg &a : args) {
+    if (rec.argc >= LOG_MAX_ARGS) break;
+    rec.kinds[rec.argc] = a.kind;
+    if (a.kind == LogArg::Str) {
+      // Store the offset of the copied string; truncated strings stay terminated
+      rec.values[rec.argc] = textUsed;
+      size_t room = textUsed < LOG_TEXT_BYTES ? LOG_TEXT_BYTES - textUsed : 0;
+      if (room) {
+        size_t n = strnlen(a.str, room - 1);
+        memcpy(rec.text + textUsed, a.str, n);
+        rec.text[textUsed + n] = 0;
+        textUsed += n + 1;
+      } else {
+        rec.values[rec.argc] = LOG_TEXT_BYTES - 1;
+        rec.text[LOG_TEXT_BYTES - 1] = 0;
+      }
+    } else {
+      rec.values[rec.argc] = a.value;
+    }
+    rec.argc++;
+  }
+
+  slot.seq.store(ticket + 1, std::memory_order_release);
+  if (!taskStarted) drain();
+}
+
+void Logger::drain()
+{
+  char line[LINE_BYTES];
+  for (;;) {
+    uint32_t h = head.load(std::memory_order_acquire);
+    if (tail == h) return;
+    if (h - tail > LOG_RING_SIZE) {
+      droppedCount.fetch_add(h - tail - LOG_RING_SIZE, std::memory_order_relaxed);
+      tail = h - LOG_RING_SIZE;
+    }
+
+    Slot &slot = ring[tail % LOG_RING_SIZE];
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != tail + 1) {
+      // Writer still filling this slot: pick it up on the next pass
+      if (seq == 0 || seq < tail + 1) return;
+      continue;
+    }
+    LogRecord rec = slot.rec;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq) continue;
+    tail++;
+
+    format(rec, line, sizeof(line));
+    if (static_cast<uint8_t>(rec.level) <= runtimeLevel.load(std::memory_order_relaxed)) {
+      Serial.printf("[%7lu] %-5s %s\n", (unsigned long)rec.timestampMs, levelName(rec.level), line);
+    }
+    if (streamSink) streamSink(rec.level, rec.timestampMs, line);
+    writtenCount++;
+  }
+}
+
+size_t Logger::format(const LogRecord& rec, char* out, size_t len)
+{
+  size_t pos = 0;
+  uint8_t arg = 0;
+  for (const char* p = rec.fmt; *p && pos + 1 < len; p++) {
+    if (p[0] == '{' && p[1] == '}' && arg < rec.argc) {
+      uint32_t v = rec.values[arg];
+      int n = 0;
+      switch (rec.kinds[arg]) {
+        case LogArg::U32: n = snprintf(out + pos, len - pos, "%lu", (unsigned long)v); break;
+        case LogArg::I32: n = snprintf(out + pos, len - pos, "%ld", (long)static_cast<int32_t>(v)); break;
+        case LogArg::Ip: n = snprintf(out + pos, len - pos, "%u.%u.%u.%u", (unsigned)(v >> 24), (unsigned)((v >> 16) & 0xFF), (unsigned)((v >> 8) & 0xFF), (unsigned)(v & 0xFF)); break;
+        case LogArg::Str: n = snprintf(out + pos, len - pos, "%s", rec.text + v); break;
+      }
+      if (n > 0) pos += static_cast<size_t>(n) < len - pos ? n : len - pos - 1;
+      arg++;
+      p++;
+    } else {
+      out[pos++] = *p;
+    }
+  }
+  out[pos] = 0;
+  return pos;
+}
+
+const char* Logger::levelName(LogLevel level)
+{
+  switch (level) {
+    case LogLevel::Error: return "ERROR";
+    case LogLevel::Warn: return "WARN";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Trace: return "TRACE";
+  }
+  return "?";
+}
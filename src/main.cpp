@@ -3,32 +3,122 @@
 #include <LittleFS.h>
 #include <functional>
 
+#include "cluster.h"
 #include "config_store.h"
+#include "event_loop.h"
+#include "instrumentation.h"
+#include "logger.h"
+#include "arena.h"
 #include "mqtt_manager.h"
+#include "availability_history.h"
+#include "boot_timeline.h"
+#include "host_inventory.h"
 #include "network_scanner.h"
+#include "passive_listener.h"
+#include "platform.h"
+#include "step_budget.h"
 #include "web_app.h"
 #include "wifi_manager.h"
 
+#if OVERWATCH_SIM_NETWORK
+SimNetworkParams simParams()
+{
+  SimNetworkParams p;
+  p.seed = OVERWATCH_SIM_SEED;
+  p.hostDensityPct = OVERWATCH_SIM_DENSITY;
+  p.lossPct = OVERWATCH_SIM_LOSS;
+  p.timeScalePct = OVERWATCH_SIM_TIME_SCALE;
+  p.icmpSilentPct = OVERWATCH_SIM_ICMP_SILENT;
+  return p;
+}
+SimulatedNetwork network(simParams());
+#else
+EspNetworkBackend network;
+#endif
+
 ConfigStore configStore;
+HostInventory inventory;
+AvailabilityHistory history;
 WifiManager wifi(configStore.data());
-MqttManager mqttManager(configStore.data());
-NetworkScanner scanner(configStore.data(), mqttManager);
-WebApp web(configStore, scanner, mqttManager);
+WiFiClient mqttTransport;
+MqttManager mqttManager(configStore.data(), mqttTransport);
+Cluster cluster(configStore.data(), mqttManager);
+NetworkScanner scanner(configStore.data(), mqttManager, network, inventory, history, cluster);
+PassiveListener passive(configStore.data());
+WebApp web(configStore, scanner, mqttManager, history);
+StepBudget scanBudget;
+EventLoop events;
+BootTimeline boot;
 
-unsigned long lastScanKickMs = 0;
 unsigned long lastStatusBroadcastMs = 0;
+unsigned long lastProgressBroadcastMs = 0;
+unsigned long lastHeapSampleMs = 0;
+unsigned long lastMetricsPublishMs = 0;
+unsigned long lastHistorySaveMs = 0;
 bool discoverySent = false;
 bool lastScanActive = false;
+bool firstScanStarted = false;
+bool bootReported = false;
+
+const uint32_t PROGRESS_BROADCAST_MS = 1000;
+const uint32_t STATUS_BROADCAST_MS = 5000;
+const uint32_t FIRST_SCAN_MQTT_GRACE_MS = 3000;
+const uint32_t DISCOVERY_DEFER_MS = 10000;
+
+uint32_t msUntil(unsigned long lastMs, uint32_t intervalMs, unsigned long now)
+{
+  unsigned long elapsed = now - lastMs;
+  return elapsed >= intervalMs ? 0 : intervalMs - elapsed;
+}
+
+// The first scan waits for the network, and briefly for the broker so its
+// results are published rather than only shown in the web UI
+bool firstScanReady(unsigned long now)
+{
+#if !OVERWATCH_SIM_NETWORK
+  if (!boot.reached(BootPhase::Wifi)) return false;
+#endif
+  return mqttManager.isConnected() || !configStore.data().mqtt_host.length() ||
+         now - boot.at(BootPhase::Wifi) >= FIRST_SCAN_MQTT_GRACE_MS;
+}
+
+// Discovery is dozens of publishes, so at boot it goes out after the first
+// state rather than ahead of it. Reconnects send it straight away.
+bool discoveryReady(unsigned long now)
+{
+  return boot.reached(BootPhase::Discovery) || boot.reached(BootPhase::FirstState) ||
+         now - boot.at(BootPhase::Mqtt) >= DISCOVERY_DEFER_MS;
+}
 
 void setup()
 {
   Serial.begin(115200);
   delay(200);
-  Serial.println("Booting ESP32 Overwatch...");
+  logger.begin();
+  events.begin();
+  LOG_INFO("Booting ESP32 Overwatch...");
 
   configStore.ensureFsMounted();
   configStore.load();
+  // Association runs in the background while the rest of the state loads
+  cluster.begin();
   wifi.begin();
+  inventory.load();
+  history.load();
+  WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t)
+               { events.post(EVENT_WIFI); });
+  events.watchSocket([]()
+                     { return mqttTransport.fd(); });
+  events.watchSocket([]()
+                     { return passive.socketFd(PassiveSource::Mdns); });
+  events.watchSocket([]()
+                     { return passive.socketFd(PassiveSource::Ssdp); });
+  events.watchSocket([]()
+                     { return passive.socketFd(PassiveSource::Dhcp); });
+  events.watchSocket([]()
+                     { return wifi.dnsSocketFd(); });
+  passive.setSightingHandler([](uint32_t ip, const char* hostname)
+                             { scanner.noteAlive(ip, hostname); });
 
   web.setWifiStatusProvider(
       []()
@@ -37,63 +127,142 @@ void setup()
       { return wifi.ip(); },
       []()
       { return wifi.isCaptive(); });
+  web.setWifiStatsProvider(
+      []()
+      { return wifi.stats(); });
+  web.setClusterStatsProvider(
+      []()
+      { return cluster.stats(); });
+  web.setStepBudgetProvider(
+      []()
+      { return scanBudget.stats(); });
+  web.setPassiveStatsProvider(
+      []()
+      { return passive.stats(); });
+  web.setEventLoopProvider(
+      []()
+      { return events.stats(); },
+      []()
+      { events.post(EVENT_WEB); });
+  web.setBootTimelineProvider(
+      []()
+      { return boot; });
   web.begin();
+  boot.mark(BootPhase::Web);
 
-  mqttManager.ensureConnected(wifi.isWifiUp(), wifi.isCaptive());
-  mqttManager.publishDiscovery(configStore.data().subnets, configStore.data().static_hosts);
+  // Wi-Fi, MQTT, the first scan and discovery come up as stages in loop()
+  LOG_INFO("Setup done");
+}
 
-  unsigned long waitStart = millis();
-  while (!mqttManager.isConnected() && millis() - waitStart < 5000)
+void loop()
+{
+  // Sleeps until an event arrives or the earliest deadline of the last pass
+  events.wait();
+  INSTRUMENT_SCOPE(Probe::Loop);
+  uint32_t loopStartUs = micros();
+  // Transient JSON and strings built during this pass are dropped at its end
+  ArenaScope loopScope(loopArena);
   {
+    INSTRUMENT_SCOPE(Probe::Wifi);
     wifi.loop();
-    mqttManager.ensureConnected(wifi.isWifiUp(), wifi.isCaptive());
-    mqttManager.loop();
-    delay(50);
   }
-
-  if (mqttManager.isConnected())
   {
-    mqttManager.publishDiscovery(configStore.data().subnets, configStore.data().static_hosts);
-    scanner.start();
+    INSTRUMENT_SCOPE(Probe::MqttConnect);
+    mqttManager.ensureConnected(wifi.isWifiUp(), wifi.isCaptive());
   }
-  else
   {
-    Serial.println("Initial scan skipped (MQTT offline)");
+    INSTRUMENT_SCOPE(Probe::MqttLoop);
+    mqttManager.loop();
   }
+  cluster.loop();
+  passive.loop(wifi.isWifiUp() && !wifi.isCaptive());
 
-  lastScanKickMs = millis();
-  Serial.println("Setup done");
-}
-
-void loop()
-{
-  wifi.loop();
-  mqttManager.ensureConnected(wifi.isWifiUp(), wifi.isCaptive());
-  mqttManager.loop();
+  unsigned long now = millis();
+  if (wifi.isWifiUp()) boot.mark(BootPhase::Wifi);
+  if (mqttManager.isConnected()) boot.mark(BootPhase::Mqtt);
 
   if (!mqttManager.isConnected()) {
     discoverySent = false;
-  } else if (!discoverySent) {
+  } else if (!discoverySent && discoveryReady(now)) {
     mqttManager.publishDiscovery(configStore.data().subnets, configStore.data().static_hosts);
     discoverySent = true;
+    boot.mark(BootPhase::Discovery);
   }
 
-  scanner.step();
+  // Static hosts are queued ahead of subnet sweeps, so they report first
+  if (!firstScanStarted && firstScanReady(now)) {
+    scanner.start();
+    firstScanStarted = true;
+  }
 
-  unsigned long now = millis();
+  uint16_t probes;
+  {
+    INSTRUMENT_SCOPE(Probe::ScanStep);
+    probes = scanner.step(scanBudget.budgetUs());
+  }
+  if (probes) boot.mark(BootPhase::FirstProbe);
+  if (mqttManager.firstStateMs()) boot.mark(BootPhase::FirstState, mqttManager.firstStateMs());
+  if (!bootReported && boot.reached(BootPhase::FirstState) && discoverySent) {
+    JsonDocument timeline(&loopArena);
+    boot.writeJson(timeline.to<JsonObject>());
+    bootReported = mqttManager.publishJson(MqttManager::BOOT_TOPIC, timeline, true);
+  }
+
+  now = millis();
 
-  if (lastScanActive && !scanner.active()) {
-    web.broadcastScanResults();
+  {
+    INSTRUMENT_SCOPE(Probe::Broadcast);
+    if (lastScanActive && !scanner.active()) {
+      web.broadcastScanResults();
+    } else if (scanner.active() && (!lastScanActive || now - lastProgressBroadcastMs >= PROGRESS_BROADCAST_MS)) {
+      web.broadcastScanProgress();
+      lastProgressBroadcastMs = now;
+    }
+    if (now - lastStatusBroadcastMs >= STATUS_BROADCAST_MS) {
+      web.broadcastStatus();
+      web.refreshSnapshots();
+      lastStatusBroadcastMs = now;
+    }
+    web.loop();
   }
   lastScanActive = scanner.active();
 
-  if (now - lastStatusBroadcastMs >= 5000) {
-    web.broadcastStatus();
-    lastStatusBroadcastMs = now;
+#if OVERWATCH_INSTRUMENTATION
+  // Sampled on passes that run anyway; waking just to sample would keep the
+  // loop from idling
+  bool metricsDue = now - lastMetricsPublishMs >= 60000 && mqttManager.isConnected();
+  if (metricsDue || now - lastHeapSampleMs >= 1000) {
+    instrumentation.sampleHeap();
+    lastHeapSampleMs = now;
+  }
+  if (metricsDue) {
+    JsonDocument metrics(&loopArena);
+    instrumentation.writeJson(metrics.to<JsonObject>(), false);
+    mqttManager.publishJson(MqttManager::METRICS_TOPIC, metrics, false);
+    instrumentation.resetWindow();
+    lastMetricsPublishMs = now;
   }
+#endif
 
-  if (!scanner.active() && (now - lastScanKickMs >= configStore.data().scan_interval_ms)) {
-    scanner.start();
-    lastScanKickMs = now;
+  if (now - lastHistorySaveMs >= HISTORY_SAVE_INTERVAL_MS) {
+    history.save();
+    lastHistorySaveMs = now;
   }
+
+  // Idle passes say nothing about the budget, so only probing loops tune it
+  if (probes) scanBudget.recordLoop(micros() - loopStartUs);
+
+  events.allowLightSleep(wifi.isWifiUp() && !wifi.isCaptive());
+  events.wakeIn(scanner.wakeInMs());
+  events.wakeIn(wifi.wakeInMs());
+  events.wakeIn(web.wakeInMs());
+  events.wakeIn(mqttManager.wakeInMs());
+  if (mqttManager.isConnected() && !discoverySent) events.wakeIn(msUntil(boot.at(BootPhase::Mqtt), DISCOVERY_DEFER_MS, now));
+  if (!firstScanStarted && boot.reached(BootPhase::Wifi)) events.wakeIn(msUntil(boot.at(BootPhase::Wifi), FIRST_SCAN_MQTT_GRACE_MS, now));
+  if (scanner.active()) events.wakeIn(msUntil(lastProgressBroadcastMs, PROGRESS_BROADCAST_MS, now));
+  events.wakeIn(msUntil(lastStatusBroadcastMs, STATUS_BROADCAST_MS, now));
+  events.wakeIn(msUntil(lastHistorySaveMs, HISTORY_SAVE_INTERVAL_MS, now));
+#if OVERWATCH_INSTRUMENTATION
+  if (mqttManager.isConnected()) events.wakeIn(msUntil(lastMetricsPublishMs, 60000, now));
+#endif
 }
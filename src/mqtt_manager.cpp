@@ -1,6 +1,91 @@
 #include "mqtt_manager.h"
+#include <esp_crc.h>
+#include "logger.h"
+#include "arena.h"
 
-MqttManager::MqttManager(Config& cfg) : mqtt(wifiClient), config(cfg) {}
+namespace {
+  const size_t SUBNET_SLUG_LEN = 24;
+  const size_t SUBNET_KEY_LEN = SUBNET_SLUG_LEN + 10;  // slug, '-', 8 hex digits
+  const size_t SUBNET_TOPIC_LEN = 96;
+  const size_t PUBLISH_CHUNK_BYTES = 128;
+  const uint32_t CONNECT_RETRY_MIN_MS = 1000;
+  const uint32_t CONNECT_RETRY_MAX_MS = 60000;
+
+  // serializeJson() writes mostly one byte at a time, and PubSubClient hands
+  // each write straight to the socket; this gathers them into chunks
+  class ChunkedWriter : public Print {
+  public:
+    explicit ChunkedWriter(Print& target) : out(target) {}
+
+    size_t write(uint8_t c) override
+    {
+      if (used == sizeof(chunk) && !finish()) return 0;
+      chunk[used++] = c;
+      return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t len) override
+    {
+      for (size_t i = 0; i < len; i++) {
+        if (!write(data[i])) return i;
+      }
+      return len;
+    }
+
+    bool finish()
+    {
+      if (used && out.write(chunk, used) != used) failed = true;
+      used = 0;
+      return !failed;
+    }
+
+  private:
+    Print& out;
+    uint8_t chunk[PUBLISH_CHUNK_BYTES];
+    size_t used = 0;
+    bool failed = false;
+  };
+
+  bool isPlainCidr(const String& expr)
+  {
+    if (expr.length() > SUBNET_SLUG_LEN || expr.indexOf('/') < 0 || expr.indexOf('/') != expr.lastIndexOf('/')) return false;
+    for (size_t i = 0; i < expr.length(); i++) {
+      char c = expr[i];
+      if (!isdigit(static_cast<unsigned char>(c)) && c != '.' && c != '/') return false;
+    }
+    return true;
+  }
+
+  // Subnet topics are keyed by the target expression. A plain CIDR is used as
+  // written; any other expression can be long and hold spaces, '+' or '#', so
+  // it becomes a slug of its start plus a CRC of the whole expression.
+  void subnetKey(const Subnet& subnet, char* out, size_t len)
+  {
+    const String& expr = subnet.cidr;
+    if (isPlainCidr(expr)) {
+      snprintf(out, len, "%s", expr.c_str());
+      return;
+    }
+    char slug[SUBNET_SLUG_LEN + 1];
+    size_t n = 0;
+    for (size_t i = 0; i < expr.length() && n < SUBNET_SLUG_LEN; i++) {
+      char c = expr[i];
+      slug[n++] = isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' ? c : '_';
+    }
+    slug[n] = 0;
+    uint32_t crc = esp_crc32_le(0, reinterpret_cast<const uint8_t*>(expr.c_str()), expr.length());
+    snprintf(out, len, "%s-%08x", slug, (unsigned)crc);
+  }
+
+  void subnetTopic(const Subnet& subnet, const char* leaf, char* out, size_t len)
+  {
+    char key[SUBNET_KEY_LEN + 1];
+    subnetKey(subnet, key, sizeof(key));
+    snprintf(out, len, "esp-overwatch/network/%s/%s", key, leaf);
+  }
+}
+
+MqttManager::MqttManager(Config& cfg, Client& transport) : mqtt(transport), config(cfg) {}
 
 void MqttManager::loop() { mqtt.loop(); }
 
@@ -10,77 +95,131 @@ const String& MqttManager::reason() const { return mqttReason; }
 
 PubSubClient& MqttManager::client() { return mqtt; }
 
+uint32_t MqttManager::publishCount() const { return publishes; }
+uint32_t MqttManager::firstStateMs() const { return firstStateAtMs; }
+
+// Cluster nodes connect with their own id and put the will on their node topic
+void MqttManager::setIdentity(const String& id, const String& will)
+{
+  clientId = id;
+  willTopic = will;
+}
+
+void MqttManager::setConnectHandler(std::function<void()> handler) { onConnect = std::move(handler); }
+
+void MqttManager::setMessageHandler(std::function<void(const char*, const uint8_t*, unsigned int)> handler)
+{
+  mqtt.setCallback([handler](char* topic, uint8_t* payload, unsigned int len) { handler(topic, payload, len); });
+}
+
+bool MqttManager::subscribe(const char* topic) { return mqtt.subscribe(topic); }
+
+bool MqttManager::publish(const char* topic, const char* payload, bool retained)
+{
+  if (!mqtt.publish(topic, payload, retained)) return false;
+  publishes++;
+  return true;
+}
+
+// Time to the first published state is the startup metric that matters to
+// Home Assistant, so the state publishers below record it
+void MqttManager::noteState(bool published)
+{
+  if (published && !firstStateAtMs) firstStateAtMs = millis();
+}
+
 void MqttManager::ensureConnected(bool wifiConnected, bool captivePortal)
 {
+  // A fresh link gets an immediate attempt rather than an old backoff
+  if (captivePortal || !config.mqtt_host.length() || !wifiConnected) connectFailures = 0;
   if (captivePortal) { mqttReason = "captive_portal"; return; }
   if (!config.mqtt_host.length()) { mqttReason = "no_host"; return; }
   if (!wifiConnected) { mqttReason = "wifi_offline"; return; }
   if (mqtt.connected()) {
-    if (!lastMqttConnected) Serial.println("MQTT connected");
+    if (!lastMqttConnected) LOG_INFO("MQTT connected");
     lastMqttConnected = true;
     mqttReason = "connected";
     return;
   }
+  if (connectFailures && static_cast<long>(millis() - retryAtMs) < 0) return;
 
   mqtt.setServer(config.mqtt_host.c_str(), config.mqtt_port);
   bool ok;
   if (config.mqtt_user.length()) {
     ok = mqtt.connect(
-      "esp-overwatch",
+      clientId.c_str(),
       config.mqtt_user.c_str(),
       config.mqtt_pass.c_str(),
-      AVAIL_TOPIC,
+      willTopic.c_str(),
       0,
       true,
       AVAIL_OFF
     );
   } else {
-    ok = mqtt.connect("esp-overwatch", AVAIL_TOPIC, 0, true, AVAIL_OFF);
+    ok = mqtt.connect(clientId.c_str(), willTopic.c_str(), 0, true, AVAIL_OFF);
   }
 
   if (ok) {
-    Serial.println("MQTT connected");
+    LOG_INFO("MQTT connected");
+    connectFailures = 0;
     lastMqttConnected = true;
     mqttReason = "connected";
     publishAvailability(AVAIL_ON);
+    if (onConnect) onConnect();
   } else {
     int state = mqtt.state();
     if (!lastMqttConnected || state != lastMqttState) {
-      Serial.print("MQTT connect failed, state ");
-      Serial.println(state);
+      LOG_WARN("MQTT connect failed, state {}", state);
     }
     lastMqttConnected = false;
     lastMqttState = state;
     mqttReason = String("connect_failed_") + state;
+    // Each attempt blocks the loop until the broker answers or times out
+    connectFailures++;
+    uint32_t shift = connectFailures > 6 ? 6 : connectFailures - 1;
+    uint32_t backoff = CONNECT_RETRY_MIN_MS << shift;
+    retryAtMs = millis() + (backoff < CONNECT_RETRY_MAX_MS ? backoff : CONNECT_RETRY_MAX_MS);
   }
 }
 
+// Only a pending retry needs a timer: a dropped connection wakes the loop
+// through its socket, and link changes through Wi-Fi events
+uint32_t MqttManager::wakeInMs() const
+{
+  if (!connectFailures) return UINT32_MAX;
+  long remaining = static_cast<long>(retryAtMs - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
 void MqttManager::publishAvailability(const char* payload)
 {
-  mqtt.publish(AVAIL_TOPIC, payload, true);
+  publish(AVAIL_TOPIC, payload, true);
 }
 
 void MqttManager::publishDiscovery(const std::vector<Subnet>& subnets, const std::vector<StaticHost>& hosts)
 {
   if (!mqtt.connected()) {
-    Serial.println("Discovery skipped (MQTT not connected)");
+    LOG_INFO("Discovery skipped (MQTT not connected)");
     return;
   }
-  Serial.println("Publishing Home Assistant discovery");
+  LOG_INFO("Publishing Home Assistant discovery");
   for (const auto &s : subnets)
   {
+    char key[SUBNET_KEY_LEN + 1];
+    subnetKey(s, key, sizeof(key));
     char objectId[64];
-    snprintf(objectId, sizeof(objectId), "overwatch_subnet_%s", s.cidr.c_str());
+    snprintf(objectId, sizeof(objectId), "overwatch_subnet_%s", key);
     for (char* p = objectId; *p; ++p) {
-      if (*p == '/' || *p == '.') *p = '_';
+      if (!isalnum(static_cast<unsigned char>(*p))) *p = '_';
     }
     char topic[128];
     snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/config", objectId);
-    char name[64];
-    snprintf(name, sizeof(name), "Network %s online", s.cidr.c_str());
-    char statTopic[64];
-    snprintf(statTopic, sizeof(statTopic), "esp-overwatch/network/%s/online_count", s.cidr.c_str());
-    JsonDocument doc;
+    char name[96];
+    snprintf(name, sizeof(name), "Network %s online", s.name.length() ? s.name.c_str() : s.cidr.c_str());
+    char statTopic[SUBNET_TOPIC_LEN];
+    subnetTopic(s, "online_count", statTopic, sizeof(statTopic));
+    ArenaScope scope(loopArena);
+    JsonDocument doc(&loopArena);
     doc["name"] = name;
     doc["uniq_id"] = objectId;
     doc["stat_t"] = statTopic;
@@ -95,12 +234,9 @@ void MqttManager::publishDiscovery(const std::vector<Subnet>& subnets, const std
     dev["name"] = "ESP32 Overwatch";
     dev["mdl"] = "XIAO ESP32C3";
     dev["mf"] = "Seeed";
-    String payload;
-    serializeJson(doc, payload);
-    bool ok = mqtt.publish(topic, payload.c_str(), true);
-    if (!ok) Serial.print("Failed to publish discovery message:");
-    else Serial.print("Discovery subnet published: ");
-    Serial.print(topic); Serial.print(" -> "); Serial.println(payload);
+    bool ok = publishJson(topic, doc, true);
+    if (!ok) LOG_WARN("Failed to publish discovery message: {}", topic);
+    else LOG_DEBUG("Discovery subnet published: {}", topic);
   }
 
   for (const auto &h : hosts)
@@ -120,7 +256,8 @@ void MqttManager::publishDiscovery(const std::vector<Subnet>& subnets, const std
     }
     char statTopic[64];
     snprintf(statTopic, sizeof(statTopic), "esp-overwatch/host/%s/status", h.ip.c_str());
-    JsonDocument doc;
+    ArenaScope scope(loopArena);
+    JsonDocument doc(&loopArena);
     doc["name"] = name;
     doc["uniq_id"] = objectId;
     doc["stat_t"] = statTopic;
@@ -135,41 +272,168 @@ void MqttManager::publishDiscovery(const std::vector<Subnet>& subnets, const std
     dev["name"] = "ESP32 Overwatch";
     dev["mdl"] = "XIAO ESP32C3";
     dev["mf"] = "Seeed";
-    String payload;
-    serializeJson(doc, payload);
-    bool ok = mqtt.publish(topic, payload.c_str(), true);
-    if (!ok) Serial.print("Failed to publish discovery message: ");
-    else Serial.print("Discovery host published: ");
-    Serial.print(topic); Serial.print(" -> "); Serial.println(payload);
+    bool ok = publishJson(topic, doc, true);
+    if (!ok) LOG_WARN("Failed to publish discovery message: {}", topic);
+    else LOG_DEBUG("Discovery host published: {}", topic);
+    if (h.check != ServiceKind::None) publishLatencySensor(h, objectId, name);
+  }
+
+  publishDeviceSensor("scan_progress", "Scan progress", SCAN_TOPIC, "{{ value_json.progress_pct }}", "%");
+  publishDeviceSensor("scan_rate", "Scan rate", SCAN_TOPIC, "{{ value_json.probes_per_s }}", "probes/s");
+  publishDeviceSensor("scan_eta", "Scan time remaining", SCAN_TOPIC, "{{ (value_json.eta_ms / 1000) | round(0) }}", "s");
+  publishDeviceSensor("scan_full_sweep", "Full sweep time", SCAN_TOPIC, "{{ (value_json.full_sweep_ms / 1000) | round(0) }}", "s");
+  publishDeviceSensor("boot_first_state", "Boot to first state", BOOT_TOPIC, "{{ (value_json.first_state_ms / 1000) | round(1) }}", "s");
+
+#if OVERWATCH_INSTRUMENTATION
+  publishDeviceSensor("loop_p99", "Loop latency p99", METRICS_TOPIC, "{{ value_json.timings.loop.window_p99_us }}", "us");
+  publishDeviceSensor("loop_max", "Loop latency max", METRICS_TOPIC, "{{ value_json.timings.loop.window_max_us }}", "us");
+  publishDeviceSensor("heap_free", "Free heap", METRICS_TOPIC, "{{ value_json.heap.free }}", "B");
+  publishDeviceSensor("heap_largest", "Largest free block", METRICS_TOPIC, "{{ value_json.heap.largest_block }}", "B");
+#endif
+}
+
+// Latency of a host's protocol check; unknown while the check fails
+void MqttManager::publishLatencySensor(const StaticHost& host, const char* hostObjectId, const char* hostName)
+{
+  char objectId[80];
+  snprintf(objectId, sizeof(objectId), "%s_latency", hostObjectId);
+  char topic[128];
+  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/config", objectId);
+  char name[80];
+  snprintf(name, sizeof(name), "%s %s latency", hostName, findServiceProbe(host.check)->name());
+  char statTopic[96];
+  snprintf(statTopic, sizeof(statTopic), "esp-overwatch/host/%s/check", host.ip.c_str());
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["name"] = name;
+  doc["uniq_id"] = objectId;
+  doc["stat_t"] = statTopic;
+  doc["val_tpl"] = "{{ value_json.latency_ms if value_json.up else None }}";
+  doc["unit_of_meas"] = "ms";
+  doc["dev_cla"] = "duration";
+  doc["state_class"] = "measurement";
+  doc["avty_t"] = AVAIL_TOPIC;
+  doc["pl_avail"] = AVAIL_ON;
+  doc["pl_not_avail"] = AVAIL_OFF;
+  JsonObject dev = doc["dev"].to<JsonObject>();
+  JsonArray ids = dev["ids"].to<JsonArray>();
+  ids.add("esp-overwatch");
+  dev["name"] = "ESP32 Overwatch";
+  dev["mdl"] = "XIAO ESP32C3";
+  dev["mf"] = "Seeed";
+  if (!publishJson(topic, doc, true)) {
+    LOG_WARN("Failed to publish discovery message: {}", topic);
   }
 }
 
+void MqttManager::publishDeviceSensor(const char* key, const char* name, const char* stateTopic, const char* valueTemplate, const char* unit)
+{
+  char objectId[64];
+  snprintf(objectId, sizeof(objectId), "overwatch_%s", key);
+  char topic[128];
+  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/config", objectId);
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["name"] = name;
+  doc["uniq_id"] = objectId;
+  doc["stat_t"] = stateTopic;
+  doc["val_tpl"] = valueTemplate;
+  doc["unit_of_meas"] = unit;
+  doc["state_class"] = "measurement";
+  doc["ent_cat"] = "diagnostic";
+  doc["avty_t"] = AVAIL_TOPIC;
+  doc["pl_avail"] = AVAIL_ON;
+  doc["pl_not_avail"] = AVAIL_OFF;
+  JsonObject dev = doc["dev"].to<JsonObject>();
+  JsonArray ids = dev["ids"].to<JsonArray>();
+  ids.add("esp-overwatch");
+  dev["name"] = "ESP32 Overwatch";
+  dev["mdl"] = "XIAO ESP32C3";
+  dev["mf"] = "Seeed";
+  if (!publishJson(topic, doc, true)) {
+    LOG_WARN("Failed to publish discovery message: {}", topic);
+  }
+}
+
+// Streams the document so payloads larger than MQTT_MAX_PACKET_SIZE still fit
+bool MqttManager::publishJson(const char* topic, const JsonDocument& doc, bool retained)
+{
+  if (!mqtt.connected()) return false;
+  size_t len = measureJson(doc);
+  if (!mqtt.beginPublish(topic, len, retained)) return false;
+  ChunkedWriter writer(mqtt);
+  bool written = serializeJson(doc, writer) == len && writer.finish();
+  if (!mqtt.endPublish() || !written) return false;
+  publishes++;
+  return true;
+}
+
+static void formatIp(uint32_t ip, char* out, size_t len)
+{
+  snprintf(out, len, "%u.%u.%u.%u", (unsigned)(ip >> 24), (unsigned)((ip >> 16) & 0xFF), (unsigned)((ip >> 8) & 0xFF), (unsigned)(ip & 0xFF));
+}
+
 void MqttManager::publishOnlineCount(const Subnet &subnet, int count)
 {
-  String topic = "esp-overwatch/network/" + subnet.cidr + "/online_count";
-  mqtt.publish(topic.c_str(), String(count).c_str(), true);
+  char topic[SUBNET_TOPIC_LEN];
+  subnetTopic(subnet, "online_count", topic, sizeof(topic));
+  char payload[12];
+  snprintf(payload, sizeof(payload), "%d", count);
+  noteState(publish(topic, payload, true));
 }
 
 void MqttManager::publishHostStatus(const StaticHost &host, bool online)
 {
-  String topic = "esp-overwatch/host/" + host.ip + "/status";
-  mqtt.publish(topic.c_str(), online ? "online" : "offline", true);
+  char topic[128];
+  snprintf(topic, sizeof(topic), "esp-overwatch/host/%s/status", host.ip.c_str());
+  noteState(publish(topic, online ? "online" : "offline", true));
+}
+
+void MqttManager::publishServiceCheck(const StaticHost &host, bool up, uint16_t latencyMs, uint16_t code)
+{
+  char topic[128];
+  snprintf(topic, sizeof(topic), "esp-overwatch/host/%s/check", host.ip.c_str());
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["up"] = up;
+  doc["latency_ms"] = latencyMs;
+  doc["code"] = code;
+  noteState(publishJson(topic, doc, true));
+}
+
+void MqttManager::publishHostStatusIp(uint32_t ip, bool online)
+{
+  char addr[16];
+  formatIp(ip, addr, sizeof(addr));
+  char topic[64];
+  snprintf(topic, sizeof(topic), "esp-overwatch/host/%s/status", addr);
+  noteState(publish(topic, online ? "online" : "offline", true));
 }
 
-void MqttManager::publishHostStatusIp(const String &ip, bool online)
+// An empty retained payload removes the stored status from the broker
+void MqttManager::clearHostStatusIp(uint32_t ip)
 {
-  String topic = "esp-overwatch/host/" + ip + "/status";
-  mqtt.publish(topic.c_str(), online ? "online" : "offline", true);
+  char addr[16];
+  formatIp(ip, addr, sizeof(addr));
+  char topic[64];
+  snprintf(topic, sizeof(topic), "esp-overwatch/host/%s/status", addr);
+  publish(topic, "", true);
 }
 
-void MqttManager::publishNewHost(const String &ip)
+void MqttManager::publishNewHost(uint32_t ip)
 {
-  String topic = "esp-overwatch/host/" + ip + "/discovered";
-  mqtt.publish(topic.c_str(), "1", false);
+  char addr[16];
+  formatIp(ip, addr, sizeof(addr));
+  char topic[64];
+  snprintf(topic, sizeof(topic), "esp-overwatch/host/%s/discovered", addr);
+  publish(topic, "1", false);
 }
 
 void MqttManager::publishFoundCount(const Subnet& subnet, int count)
 {
-  String topic = "esp-overwatch/network/" + subnet.cidr + "/found_count";
-  mqtt.publish(topic.c_str(), String(count).c_str(), false);
+  char topic[SUBNET_TOPIC_LEN];
+  subnetTopic(subnet, "found_count", topic, sizeof(topic));
+  char payload[12];
+  snprintf(payload, sizeof(payload), "%d", count);
+  publish(topic, payload, false);
 }
@@ -1,138 +1,728 @@
 #include "network_scanner.h"
+#include <algorithm>
+#include "arena.h"
+#include "logger.h"
 
 namespace {
-  const uint8_t SCAN_STEP_BUDGET = 3;
+  const uint32_t DEADLINE_SLACK_MIN_MS = 1000;
+  const uint32_t RATE_SAMPLE_MS = 1000;
+  const float RATE_WEIGHT = 0.25f;
+  const uint32_t PROGRESS_PUBLISH_MS = 10000;
+
+  // Slices number a subnet's addresses in order across its sorted ranges
+  uint16_t sliceCount(const Subnet &subnet)
+  {
+    uint32_t n = (subnet.hostCount + SWEEP_SLICE_ADDRESSES - 1) / SWEEP_SLICE_ADDRESSES;
+    return n ? n : 1;
+  }
+
+  uint32_t sliceSize(const Subnet &subnet, uint16_t slice)
+  {
+    uint32_t first = slice * SWEEP_SLICE_ADDRESSES;
+    if (first >= subnet.hostCount) return 0;
+    uint32_t left = subnet.hostCount - first;
+    return left < SWEEP_SLICE_ADDRESSES ? left : SWEEP_SLICE_ADDRESSES;
+  }
+
+  bool addressAt(const Subnet &subnet, uint32_t ordinal, size_t &range, uint32_t &address)
+  {
+    for (range = 0; range < subnet.ranges.size(); range++) {
+      uint32_t n = subnet.ranges[range].last - subnet.ranges[range].first + 1;
+      if (ordinal < n) {
+        address = subnet.ranges[range].first + ordinal;
+        return true;
+      }
+      ordinal -= n;
+    }
+    return false;
+  }
+
+  bool ordinalOf(const Subnet &subnet, uint32_t address, size_t &range, uint32_t &ordinal)
+  {
+    ordinal = 0;
+    for (range = 0; range < subnet.ranges.size(); range++) {
+      const AddressRange &r = subnet.ranges[range];
+      if (address >= r.first && address <= r.last) {
+        ordinal += address - r.first;
+        return true;
+      }
+      ordinal += r.last - r.first + 1;
+    }
+    return false;
+  }
 }
 
-NetworkScanner::NetworkScanner(Config& cfg, MqttManager& mqttMgr)
-  : config(cfg), mqtt(mqttMgr) {}
+NetworkScanner::NetworkScanner(Config& cfg, MqttManager& mqttMgr, NetworkBackend& backend, HostInventory& hosts, AvailabilityHistory& hist, Cluster& shard)
+  : config(cfg), mqtt(mqttMgr), net(backend), inventory(hosts), history(hist), cluster(shard) {}
 
-bool NetworkScanner::pingHost(const IPAddress &ip)
+bool NetworkScanner::probeStatic(const StaticHost &h, HostScanResult &r)
 {
-  return Ping.ping(ip, 1);
+  IPAddress parsed;
+  bool numeric = parsed.fromString(h.ip);
+  r.ip = numeric ? ipToInt(parsed) : 0;
+  r.port = 0;
+  if (h.ports.empty()) {
+    run.probes++;
+    return numeric && net.ping(parsed, r.rttMs);
+  }
+
+  for (uint16_t port : h.ports) {
+    run.probes++;
+    bool open = numeric ? net.connect(parsed, port, r.rttMs) : net.connect(h.ip.c_str(), port, r.rttMs);
+    if (open) {
+      r.port = port;
+      return true;
+    }
+  }
+  return false;
 }
 
-bool NetworkScanner::portOpen(const String &ip, int port)
+// ARP goes first when enabled; ping and ports only run for addresses it did
+// not resolve. An ARP-only subnet that is not on-link falls back to ping.
+bool NetworkScanner::probeAddress(const Subnet &subnet, uint32_t address, uint16_t &rttMs)
 {
-  WiFiClient c;
-  return c.connect(ip.c_str(), port, PING_TIMEOUT_MS);
+  bool icmp = subnet.methods & PROBE_ICMP;
+  if (subnet.methods & PROBE_ARP) {
+    bool onLink = true;
+    if (arpResolved(subnet, address, onLink)) {
+      run.arpAlive++;
+      rttMs = 0;
+      return true;
+    }
+    if (!onLink && subnet.ports.empty()) icmp = true;
+  }
+
+  IPAddress ip = intToIp(address);
+  if (icmp) {
+    run.probes++;
+    if (net.ping(ip, rttMs)) return true;
+  }
+  for (uint16_t port : subnet.ports) {
+    run.probes++;
+    if (net.connect(ip, port, rttMs)) return true;
+  }
+  return false;
 }
 
-bool NetworkScanner::start()
+// Resolves up to ARP_BATCH_MAX addresses from the cursor at once, within the
+// current range, slice and cluster block, and answers later addresses of the
+// batch from the stored mask.
+bool NetworkScanner::arpResolved(const Subnet &subnet, uint32_t address, bool &onLink)
 {
-  if (scanning) return false;
+  if (address < arpBatchFirst || address - arpBatchFirst >= arpBatchCount) {
+    uint32_t last = subnet.ranges[rangeIndex].last;
+    uint32_t blockLast = cluster.blockEnd(address);
+    if (blockLast < last) last = blockLast;
+    if (sliceLastAddress < last) last = sliceLastAddress;
+    uint32_t count = last - address + 1;
+    arpBatchFirst = address;
+    arpBatchCount = count > ARP_BATCH_MAX ? ARP_BATCH_MAX : static_cast<uint8_t>(count);
+    arpBatchOnLink = net.arpProbe(address, arpBatchCount, arpBatchAlive);
+    if (arpBatchOnLink) run.probes += arpBatchCount;
+    else arpBatchAlive = 0;
+    if (!arpBatchOnLink && address == subnet.firstHost) LOG_WARN("Subnet {} is not on-link, ARP checks fall back to ping", subnet.cidr);
+  }
+  onLink = arpBatchOnLink;
+  return arpBatchAlive & (1 << (address - arpBatchFirst));
+}
+
+// Result tables are allocated once per target set and reused by every scan
+void NetworkScanner::ensureResultTables()
+{
+  if (lastHostResults.size() != config.static_hosts.size()) {
+    std::vector<HostScanResult> hosts(config.static_hosts.size());
+    for (size_t i = 0; i < hosts.size(); i++) hosts[i].target = i;
+    lastHostResults.swap(hosts);
+  }
+  if (lastSubnetResults.size() != config.subnets.size()) {
+    std::vector<SubnetScanResult> subnets(config.subnets.size());
+    for (size_t i = 0; i < subnets.size(); i++) subnets[i].subnet = i;
+    lastSubnetResults.swap(subnets);
+  }
+  if (sweeps.size() != config.subnets.size()) {
+    // Subnets whose expression and size are unchanged resume where they were
+    std::vector<SweepPosition> saved;
+    checkpoint.load(saved);
+    std::vector<SweepState> states(config.subnets.size());
+    for (size_t i = 0; i < states.size(); i++) {
+      const Subnet &subnet = config.subnets[i];
+      SweepPosition &pos = states[i].position;
+      pos.key = sweepKey(subnet.cidr, subnet.hostCount);
+      for (const auto &p : saved) {
+        if (p.key == pos.key && p.slice < sliceCount(subnet)) pos = p;
+      }
+      states[i].slices.resize(sliceCount(subnet));
+    }
+    sweeps.swap(states);
+  }
+}
+
+void NetworkScanner::resetTargets()
+{
+  service.cancel();
+  scanning = false;
+  sweeping = false;
+  pruneInventory();
+  // Slice boundaries reached so far carry over to subnets that are kept
+  if (checkpointDirty) saveCheckpoint(millis());
   lastHostResults.clear();
   lastSubnetResults.clear();
-  prevOnlineHosts = currentOnlineHosts;
-  currentOnlineHosts.clear();
-  foundOnlineCount = 0;
+  sweeps.clear();
+  ensureResultTables();
+  // New targets are probed right away unless nothing could be published
+  scheduleAll(millis(), !mqtt.isConnected());
+}
+
+uint32_t NetworkScanner::intervalFor(uint32_t targetIntervalMs) const
+{
+  uint32_t ms = targetIntervalMs ? targetIntervalMs : config.scan_interval_ms;
+  return ms < MIN_TARGET_INTERVAL_MS ? MIN_TARGET_INTERVAL_MS : ms;
+}
+
+// Every target owns exactly one job; both queues are rebuilt whenever the
+// target lists are replaced since jobs refer to targets by index.
+void NetworkScanner::scheduleAll(uint32_t now, bool delayFirst)
+{
+  hostQueue.clear();
+  subnetQueue.clear();
+  ScanJob job;
+  for (size_t i = 0; i < config.static_hosts.size(); i++) {
+    job.target = i;
+    job.intervalMs = intervalFor(config.static_hosts[i].interval_ms);
+    job.dueMs = delayFirst ? now + job.intervalMs : now;
+    hostQueue.push_back(job);
+  }
+  for (size_t i = 0; i < config.subnets.size(); i++) {
+    job.target = i;
+    job.intervalMs = intervalFor(config.subnets[i].interval_ms);
+    job.dueMs = delayFirst ? now + job.intervalMs : now;
+    subnetQueue.push_back(job);
+  }
+  std::make_heap(hostQueue.begin(), hostQueue.end(), LaterDue());
+  std::make_heap(subnetQueue.begin(), subnetQueue.end(), LaterDue());
+  scheduled = true;
+}
+
+bool NetworkScanner::due(const std::vector<ScanJob> &queue, uint32_t now) const
+{
+  return !queue.empty() && (int32_t)(now - queue.front().dueMs) >= 0;
+}
+
+NetworkScanner::ScanJob NetworkScanner::popJob(std::vector<ScanJob> &queue, uint32_t now)
+{
+  std::pop_heap(queue.begin(), queue.end(), LaterDue());
+  ScanJob job = queue.back();
+  queue.pop_back();
+
+  uint32_t late = now - job.dueMs;
+  uint32_t slack = job.intervalMs / 10;
+  if (slack < DEADLINE_SLACK_MIN_MS) slack = DEADLINE_SLACK_MIN_MS;
+  deadlines.jobs++;
+  deadlines.lastLateMs = late;
+  if (late > deadlines.maxLateMs) deadlines.maxLateMs = late;
+  if (late > slack) deadlines.misses++;
+  return job;
+}
+
+// Deadlines advance by whole intervals so they do not drift with probe time;
+// a target that fell a full interval behind restarts from now instead of
+// running back to back to catch up.
+void NetworkScanner::pushJob(std::vector<ScanJob> &queue, uint16_t target, uint32_t lastDueMs, uint32_t intervalMs, uint32_t now)
+{
+  ScanJob job;
+  job.target = target;
+  job.intervalMs = intervalMs;
+  job.dueMs = lastDueMs + intervalMs;
+  if ((int32_t)(now - job.dueMs) >= 0) job.dueMs = now + intervalMs;
+  queue.push_back(job);
+  std::push_heap(queue.begin(), queue.end(), LaterDue());
+}
+
+// Starts the subnet's next slice. A slice cut short by a restart continues
+// from its checkpointed cursor with the counts it had reached.
+void NetworkScanner::beginSubnet(size_t index)
+{
+  const Subnet &subnet = config.subnets[index];
+  SweepState &s = sweeps[index];
+  subnetIndex = index;
+  sliceIndex = s.position.slice;
+  sliceLeft = sliceSize(subnet, sliceIndex);
+  arpBatchCount = 0;
   foundOnlineCountSubnet = 0;
-  scanning = true;
-  mqttReady = mqtt.isConnected();
-  hostIndex = 0;
-  subnetIndex = 0;
-  subnetCursor = config.subnets.empty() ? 0 : config.subnets[0].firstHost;
   currentOnline = 0;
-  lastScanStartMs = millis();
-  Serial.println("Scan started");
+  uint32_t ordinal = sliceIndex * SWEEP_SLICE_ADDRESSES;
+  uint32_t resume = 0;
+  if (s.position.cursor && ordinalOf(subnet, s.position.cursor, rangeIndex, resume) &&
+      resume >= ordinal && resume - ordinal < sliceLeft) {
+    sliceLeft -= resume - ordinal;
+    ordinal = resume;
+    currentOnline = s.position.online;
+    foundOnlineCountSubnet = s.position.found;
+  }
+  if (sliceLeft && addressAt(subnet, ordinal, rangeIndex, subnetCursor)) {
+    size_t lastRange = 0;
+    addressAt(subnet, ordinal + sliceLeft - 1, lastRange, sliceLastAddress);
+    sliceFirstAddress = subnetCursor;
+  } else {
+    // Nothing left to probe; step() finishes the slice right away
+    rangeIndex = subnet.ranges.size();
+    sliceLeft = 0;
+    sliceFirstAddress = 1;
+    sliceLastAddress = 0;
+  }
+  if (!sliceIndex || !s.dueMs) s.dueMs = sweepDueMs;
+  sweepStartMs = millis();
+  sweepDone = 0;
+  sweeping = true;
+  mqttReady = mqtt.isConnected();
+  inventory.beginSweep();
+}
+
+// Makes every target due now. A cycle already in progress is left alone.
+bool NetworkScanner::start()
+{
+  if (scanning) return false;
+  ensureResultTables();
+  scheduleAll(millis(), false);
   return true;
 }
 
+// A cycle runs from the first due job until the queues go idle again
+void NetworkScanner::beginCycle()
+{
+  scanning = true;
+  foundOnlineCount = 0;
+  lastScanStartMs = millis();
+  run.probes = 0;
+  run.skipped = 0;
+  run.arpAlive = 0;
+  runPublishBase = mqtt.publishCount();
+  runMinFreeHeap = ESP.getFreeHeap();
+  cycleDone = 0;
+  rateSampleMs = lastScanStartMs;
+  rateProbeBase = 0;
+  rateAddressBase = 0;
+  LOG_INFO("Scan started");
+}
+
 void NetworkScanner::finishScan()
 {
   scanning = false;
-  prevOnlineHosts = currentOnlineHosts;
   lastScanCompletedMs = millis();
-  Serial.println("Scan complete");
+  run.durationMs = lastScanCompletedMs - lastScanStartMs;
+  run.publishes = mqtt.publishCount() - runPublishBase;
+  run.minFreeHeap = runMinFreeHeap;
+
+  heap.scans++;
+  heap.freeAfterScan = ESP.getFreeHeap();
+  heap.largestAfterScan = ESP.getMaxAllocHeap();
+  if (!heap.minLargestAfterScan || heap.largestAfterScan < heap.minLargestAfterScan) {
+    heap.minLargestAfterScan = heap.largestAfterScan;
+  }
+  inventory.flush();
+  // Cycles that reported `scanning` also report going idle
+  if ((int32_t)(lastProgressPublishMs - lastScanStartMs) >= 0) publishProgress();
+  LOG_INFO("Scan complete: {} probes in {} ms, {} publishes", run.probes, run.durationMs, run.publishes);
+}
+
+// Runs once per slice over the addresses it covered, so the per-probe path
+// only records sightings. Known hosts not seen in this sweep of their subnet
+// count a missed sweep; subnets on different intervals therefore age their
+// hosts independently. `offline` is published once when the count reaches the
+// grace limit and the retained status is cleared when it reaches the expiry
+// limit.
+void NetworkScanner::trackDepartures(const Subnet &subnet, uint32_t first, uint32_t last)
+{
+  uint32_t grace = config.offline_grace_scans ? config.offline_grace_scans : 1;
+  uint32_t expire = config.offline_expire_scans;
+  if (expire && expire < grace) expire = grace;
+  uint32_t sweep = inventory.sweep();
+
+  for (const auto &range : subnet.ranges) {
+    if (range.last < first || range.first > last) continue;
+    uint32_t end = range.last < last ? range.last : last;
+    size_t i = inventory.lowerBound(range.first > first ? range.first : first);
+    while (i < inventory.size() && inventory.at(i).ip <= end) {
+      InventoryEntry &e = inventory.at(i);
+      // Another node probes this block; keep the entry idle instead of aging it
+      if (e.lastSweep == sweep || !cluster.ownsAddress(e.ip)) {
+        e.missed = 0;
+        i++;
+        continue;
+      }
+      if (e.missed < UINT8_MAX) e.missed++;
+      uint32_t missed = e.missed;
+      if (missed >= grace && e.state == HostState::Online) {
+        LOG_INFO("Host {} offline", intToIp(e.ip));
+        inventory.markOffline(e);
+        if (mqttReady) mqtt.publishHostStatusIp(e.ip, false);
+      }
+      if (expire && missed >= expire) {
+        if (mqttReady) mqtt.clearHostStatusIp(e.ip);
+        inventory.forget(i);
+        continue;
+      }
+      i++;
+    }
+  }
+}
+
+// Drops hosts no longer covered by any target so they cannot linger forever
+void NetworkScanner::pruneInventory()
+{
+  size_t i = 0;
+  while (i < inventory.size()) {
+    uint32_t ip = inventory.at(i).ip;
+    bool covered = false;
+    for (const auto &subnet : config.subnets) {
+      if (rangesContain(subnet.ranges, ip)) {
+        covered = true;
+        break;
+      }
+    }
+    for (size_t h = 0; !covered && h < config.static_hosts.size(); h++) {
+      IPAddress parsed;
+      covered = parsed.fromString(config.static_hosts[h].ip) && ipToInt(parsed) == ip;
+    }
+    if (covered) i++;
+    else inventory.forget(i);
+  }
+  inventory.flush();
 }
 
-void NetworkScanner::finishSubnet()
+// Subnet counts are the sum of each slice's latest result and are published
+// after every slice once all slices have one, so a restart mid-sweep does not
+// report a partial subnet. Slice jobs are spread evenly over the interval; the
+// next sweep is due one interval after the first slice was.
+void NetworkScanner::finishSlice()
 {
   const Subnet &subnet = config.subnets[subnetIndex];
-  SubnetScanResult r;
-  r.cidr = subnet.cidr;
-  r.online = currentOnline;
-  lastSubnetResults.push_back(r);
-  if (mqttReady) mqtt.publishOnlineCount(subnet, currentOnline);
-  if (mqttReady) mqtt.publishFoundCount(subnet, foundOnlineCountSubnet);
-  subnetIndex++;
-  if (subnetIndex < config.subnets.size()) {
-    subnetCursor = config.subnets[subnetIndex].firstHost;
-    foundOnlineCountSubnet = 0;
-    currentOnline = 0;
+  SweepState &s = sweeps[subnetIndex];
+  uint32_t now = millis();
+  SliceScanResult &slice = s.slices[sliceIndex];
+  slice.online = currentOnline;
+  slice.found = foundOnlineCountSubnet;
+  slice.completedMs = now;
+  slice.durationMs = now - sweepStartMs;
+  trackDepartures(subnet, sliceFirstAddress, sliceLastAddress);
+
+  uint32_t online = 0;
+  uint32_t found = 0;
+  uint32_t durationMs = 0;
+  bool covered = true;
+  for (const auto &r : s.slices) {
+    online += r.online;
+    found += r.found;
+    durationMs += r.durationMs;
+    if (!r.completedMs) covered = false;
+  }
+  if (covered) {
+    SubnetScanResult &r = lastSubnetResults[subnetIndex];
+    r.online = online;
+    r.found = found;
+    r.completedMs = now;
+    r.durationMs = durationMs;
+    if (cluster.enabled()) {
+      if (mqttReady) cluster.reportSubnet(subnetIndex, online, found);
+    } else if (mqttReady) {
+      mqtt.publishOnlineCount(subnet, online);
+      mqtt.publishFoundCount(subnet, found);
+    }
+  }
+
+  sweeping = false;
+  uint16_t slices = s.slices.size();
+  uint32_t intervalMs = intervalFor(subnet.interval_ms);
+  bool lastSlice = sliceIndex + 1 >= slices;
+  s.position.slice = lastSlice ? 0 : sliceIndex + 1;
+  s.position.cursor = 0;
+  s.position.online = 0;
+  s.position.found = 0;
+  if (lastSlice) pushJob(subnetQueue, subnetIndex, s.dueMs, intervalMs, now);
+  else pushJob(subnetQueue, subnetIndex, sweepDueMs, intervalMs / slices, now);
+  if (slices > 1) checkpointDirty = true;
+  inventory.flush();
+  if (covered) cluster.finishSweep();
+}
+
+void NetworkScanner::saveCheckpoint(uint32_t now)
+{
+  std::vector<SweepPosition> positions;
+  for (const auto &s : sweeps) {
+    if (s.slices.size() > 1) positions.push_back(s.position);
+  }
+  checkpoint.save(positions);
+  checkpointDirty = false;
+  checkpointSavedMs = now;
+}
+
+// Passive sightings (mDNS, SSDP, DHCP) of addresses inside a subnet target.
+// They count as replies for the inventory and MQTT but not for subnet
+// online counts, which stay per sweep.
+void NetworkScanner::noteAlive(uint32_t ip, const char* hostname)
+{
+  bool covered = false;
+  for (const auto &subnet : config.subnets) {
+    if (rangesContain(subnet.ranges, ip)) {
+      covered = true;
+      break;
+    }
+  }
+  if (!covered || !cluster.ownsAddress(ip)) return;
+
+  Sighting seen = inventory.seen(ip);
+  inventory.heard(ip, millis());
+  if (hostname) inventory.setName(ip, hostname);
+  if (seen == Sighting::Known || seen == Sighting::Untracked) return;
+  if (seen == Sighting::New) foundOnlineCount++;
+  LOG_DEBUG("Host {} heard passively{}{}", intToIp(ip), hostname ? " as " : "", hostname ? hostname : "");
+  if (mqtt.isConnected()) {
+    if (seen == Sighting::New) mqtt.publishNewHost(ip);
+    mqtt.publishHostStatusIp(ip, true);
+  }
+}
+
+void NetworkScanner::probeHost(size_t index)
+{
+  const auto &h = config.static_hosts[index];
+  if (!cluster.ownsHost(h.ip)) return;
+  bool ok = probeStatic(h, lastHostResults[index]);
+  LOG_TRACE("scan host {} {} {}", h.ip, h.port ? "tcp" : "ping", ok ? "online" : "offline");
+  recordHost(index, ok);
+}
+
+// A protocol check runs across several steps; its job goes back into the
+// queue when the check finishes.
+void NetworkScanner::startServiceCheck(const ScanJob &job)
+{
+  const auto &h = config.static_hosts[job.target];
+  serviceJob = job;
+  if (!cluster.ownsHost(h.ip)) {
+    pushJob(hostQueue, job.target, job.dueMs, intervalFor(h.interval_ms), millis());
+    return;
+  }
+  const ServiceProbe *probe = findServiceProbe(h.check);
+  run.probes++;
+  if (!service.start(*probe, h.ip.c_str(), h.port ? h.port : probe->defaultPort(), h.check_arg.c_str())) {
+    finishServiceCheck();
+  }
+}
+
+void NetworkScanner::finishServiceCheck()
+{
+  const auto &h = config.static_hosts[serviceJob.target];
+  HostScanResult &r = lastHostResults[serviceJob.target];
+  const ServiceProbe *probe = findServiceProbe(h.check);
+  const ServiceResult &res = service.result();
+  IPAddress parsed;
+  r.ip = parsed.fromString(h.ip) ? res.ip : 0;
+  r.port = h.port ? h.port : probe->defaultPort();
+  r.rttMs = res.latencyMs;
+  r.code = res.code;
+  LOG_TRACE("scan host {} {} {} code {}", h.ip, probe->name(), res.up ? "online" : "offline", res.code);
+  recordHost(serviceJob.target, res.up);
+  if (mqttReady) mqtt.publishServiceCheck(h, res.up, res.latencyMs, res.code);
+  pushJob(hostQueue, serviceJob.target, serviceJob.dueMs, intervalFor(h.interval_ms), millis());
+}
+
+void NetworkScanner::recordHost(size_t index, bool ok)
+{
+  const auto &h = config.static_hosts[index];
+  HostScanResult &r = lastHostResults[index];
+  mqttReady = mqtt.isConnected();
+  bool wasOnline = r.online();
+  r.flags = HOST_PROBED | (ok ? HOST_ONLINE : 0);
+  history.record(h.ip, ok, r.rttMs);
+  if (ok) {
+    r.lastSeenMs = millis();
+    // The inventory remembers numeric hosts across reboots
+    Sighting seen = r.ip ? inventory.seen(r.ip) : Sighting::New;
+    if (!wasOnline && (seen == Sighting::New || seen == Sighting::Returned)) foundOnlineCount++;
+    if (mqttReady) {
+      mqtt.publishHostStatus(h, true);
+    }
   } else {
-    finishScan();
+    if (r.ip) inventory.markOffline(r.ip);
+    if (mqttReady) mqtt.publishHostStatus(h, false);
   }
 }
 
-void NetworkScanner::step()
+void NetworkScanner::noteProbeCost(uint32_t startUs)
 {
-  if (!scanning) return;
-  uint8_t budget = SCAN_STEP_BUDGET;
-  while (budget-- && scanning) {
+  uint32_t us = micros() - startUs;
+  probeCostUs = probeCostUs ? probeCostUs - probeCostUs / 8 + us / 8 : us;
+}
+
+// Due static hosts go first since each is a single probe; one subnet sweep at
+// a time runs between them, and a subnet that falls due meanwhile waits in
+// its queue (and is reported late if it waits past its slack).
+//
+// Probes are admitted while the average probe cost still fits in `budgetUs`;
+// the first one always runs so the scan progresses on any budget. Returns the
+// number of probes run.
+uint16_t NetworkScanner::step(uint32_t budgetUs)
+{
+  // Until start() runs, the first probes wait one interval
+  if (!scheduled) {
+    ensureResultTables();
+    scheduleAll(millis(), true);
+  }
+  uint32_t startUs = micros();
+  uint16_t probes = 0;
+  while (!probes || micros() - startUs + probeCostUs <= budgetUs) {
+    uint32_t iterationStartUs = micros();
+    uint32_t now = millis();
+    if (service.busy() && service.poll()) finishServiceCheck();
+    // Further protocol checks wait while one is in flight
+    bool hostDue = due(hostQueue, now) &&
+                   !(service.busy() && config.static_hosts[hostQueue.front().target].check != ServiceKind::None);
+    if (!hostDue && !sweeping && !due(subnetQueue, now)) {
+      if (scanning && !service.busy()) finishScan();
+      break;
+    }
+    if (!scanning) beginCycle();
+
     // Keep MQTT alive during potentially slow scan work to avoid availability flaps
     mqtt.loop();
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < runMinFreeHeap) runMinFreeHeap = freeHeap;
 
-    if (hostIndex < config.static_hosts.size()) {
-      const auto &h = config.static_hosts[hostIndex];
-      bool ok = false;
-      if (h.port) ok = portOpen(h.ip, h.port);
-      else {
-        IPAddress parsed; if (parsed.fromString(h.ip)) ok = pingHost(parsed);
+    if (hostDue) {
+      ScanJob job = popJob(hostQueue, now);
+      if (config.static_hosts[job.target].check != ServiceKind::None) {
+        startServiceCheck(job);
+      } else {
+        probeHost(job.target);
+        pushJob(hostQueue, job.target, job.dueMs, intervalFor(config.static_hosts[job.target].interval_ms), millis());
       }
-      Serial.print("scan host "); Serial.print(h.ip);
-      if (h.port) { Serial.print(":"); Serial.print(h.port); Serial.print(" tcp "); }
-      else { Serial.print(" ping "); }
-      Serial.println(ok ? "online" : "offline");
-      HostScanResult hr;
-      hr.ip = h.ip;
-      hr.port = h.port;
-      hr.name = h.name;
-      hr.online = ok;
-      lastHostResults.push_back(hr);
-      if (ok) {
-        currentOnlineHosts.insert(h.ip);
-        bool newSincePrev = prevOnlineHosts.find(h.ip) == prevOnlineHosts.end();
-        if (newSincePrev) foundOnlineCount++;
-        if (mqttReady) {
-          mqtt.publishHostStatus(h, true);
-        }
-      } else if (mqttReady) {
-        mqtt.publishHostStatus(h, false);
-      }
-      hostIndex++;
+      noteProbeCost(iterationStartUs);
+      probes++;
+      cycleDone++;
       continue;
     }
 
-    if (subnetIndex >= config.subnets.size()) {
-      finishScan();
-      break;
+    if (!sweeping) {
+      ScanJob job = popJob(subnetQueue, now);
+      sweepDueMs = job.dueMs;
+      beginSubnet(job.target);
     }
 
     const Subnet &subnet = config.subnets[subnetIndex];
-    IPAddress target = IPAddress((subnetCursor >> 24) & 0xFF, (subnetCursor >> 16) & 0xFF, (subnetCursor >> 8) & 0xFF, subnetCursor & 0xFF);
-    bool ok = pingHost(target);
+    if (rangeIndex >= subnet.ranges.size()) {
+      finishSlice();
+      continue;
+    }
+    if (!cluster.ownsAddress(subnetCursor)) {
+      uint32_t end = cluster.blockEnd(subnetCursor);
+      if (end > subnet.ranges[rangeIndex].last) end = subnet.ranges[rangeIndex].last;
+      if (end > sliceLastAddress) end = sliceLastAddress;
+      sweepDone += end - subnetCursor + 1;
+      cycleDone += end - subnetCursor + 1;
+      advanceCursor(subnet, end);
+      continue;
+    }
+    uint16_t rttMs = 0;
+    // A ping target heard passively within its interval needs no probe; port
+    // targets are still probed since a sighting says nothing about the port
+    bool heard = subnet.ports.empty() && inventory.heardWithin(subnetCursor, millis(), intervalFor(subnet.interval_ms));
+    bool ok = heard || probeAddress(subnet, subnetCursor, rttMs);
+    if (heard) run.skipped++;
     if (ok) {
       currentOnline++;
-      String ipStr = target.toString();
-      currentOnlineHosts.insert(ipStr);
-      bool newSincePrev = prevOnlineHosts.find(ipStr) == prevOnlineHosts.end();
+      // A host returning within the expiry window is known, not newly found.
+      // One the inventory has no room for could never be reported offline,
+      // so it is counted but not published.
+      Sighting seen = inventory.seen(subnetCursor);
+      bool newSincePrev = seen == Sighting::New;
       if (newSincePrev) {
         foundOnlineCount++;
         foundOnlineCountSubnet++;
       }
-      if (mqttReady) {
-        if (newSincePrev) mqtt.publishNewHost(ipStr);
-        mqtt.publishHostStatusIp(ipStr, true);
+      if (mqttReady && seen != Sighting::Untracked) {
+        if (newSincePrev) mqtt.publishNewHost(subnetCursor);
+        mqtt.publishHostStatusIp(subnetCursor, true);
       }
     }
-    Serial.print("scan subnet "); Serial.print(subnet.cidr); Serial.print(" host "); Serial.print(target); Serial.print(" ping "); Serial.println(ok ? "online" : "offline");
+    LOG_TRACE("scan subnet {} host {} {} {}", subnet.cidr, intToIp(subnetCursor), subnet.ports.empty() ? (subnet.methods & PROBE_ARP ? "arp" : "ping") : "tcp", ok ? "online" : "offline");
+    if (!heard) noteProbeCost(iterationStartUs);
+    probes++;
+    sweepDone++;
+    cycleDone++;
+    advanceCursor(subnet, subnetCursor);
+  }
+  if (scanning) {
+    uint32_t now = millis();
+    sampleRate(now);
+    if (now - lastProgressPublishMs >= PROGRESS_PUBLISH_MS) publishProgress();
+  }
+  if (sweeping && sweeps[subnetIndex].slices.size() > 1) {
+    SweepPosition &pos = sweeps[subnetIndex].position;
+    pos.cursor = subnetCursor;
+    pos.online = currentOnline;
+    pos.found = foundOnlineCountSubnet;
+    checkpointDirty = true;
+  }
+  if (checkpointDirty && millis() - checkpointSavedMs >= SWEEP_CHECKPOINT_MS) saveCheckpoint(millis());
+  return probes;
+}
 
-    if (subnetCursor >= subnet.lastHost) {
-      finishSubnet();
-    } else {
-      subnetCursor++;
-    }
+void NetworkScanner::sampleRate(uint32_t now)
+{
+  uint32_t elapsed = now - rateSampleMs;
+  if (elapsed < RATE_SAMPLE_MS) return;
+  float probes = (run.probes - rateProbeBase) * 1000.0f / elapsed;
+  float addresses = (cycleDone - rateAddressBase) * 1000.0f / elapsed;
+  probesPerS = probesPerS > 0 ? probesPerS + (probes - probesPerS) * RATE_WEIGHT : probes;
+  addressesPerS = addressesPerS > 0 ? addressesPerS + (addresses - addressesPerS) * RATE_WEIGHT : addresses;
+  rateSampleMs = now;
+  rateProbeBase = run.probes;
+  rateAddressBase = cycleDone;
+}
+
+// Scan telemetry for Home Assistant, at most every PROGRESS_PUBLISH_MS while
+// a cycle runs so short host-only cycles do not flood the broker
+void NetworkScanner::publishProgress()
+{
+  lastProgressPublishMs = millis();
+  if (!mqtt.isConnected()) return;
+  ScanProgress p = progress();
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["state"] = p.active ? "scanning" : "idle";
+  uint32_t total = p.cycleDone + p.remaining;
+  doc["progress_pct"] = total ? (uint32_t)((uint64_t)p.cycleDone * 100 / total) : 100;
+  doc["done"] = p.cycleDone;
+  doc["remaining"] = p.remaining;
+  doc["probes_per_s"] = roundf(p.probesPerS * 10) / 10;
+  doc["addresses_per_s"] = roundf(p.addressesPerS * 10) / 10;
+  doc["elapsed_ms"] = p.elapsedMs;
+  doc["eta_ms"] = p.etaMs;
+  doc["full_sweep_ms"] = p.fullSweepMs;
+  if (p.subnet != NO_TARGET) doc["subnet"] = config.subnets[p.subnet].cidr;
+  JsonArray subs = doc["subnets"].to<JsonArray>();
+  for (const auto &r : lastSubnetResults) {
+    if (r.subnet >= config.subnets.size() || !r.completedMs) continue;
+    JsonObject o = subs.add<JsonObject>();
+    o["cidr"] = config.subnets[r.subnet].cidr;
+    o["duration_ms"] = r.durationMs;
+    o["interval_ms"] = intervalFor(config.subnets[r.subnet].interval_ms);
+  }
+  mqtt.publishJson(MqttManager::SCAN_TOPIC, doc, false);
+}
+
+// Moves past `done`, the last address handled in the current range
+void NetworkScanner::advanceCursor(const Subnet &subnet, uint32_t done)
+{
+  uint32_t handled = done - subnetCursor + 1;
+  sliceLeft = handled < sliceLeft ? sliceLeft - handled : 0;
+  if (!sliceLeft) {
+    finishSlice();
+  } else if (done < subnet.ranges[rangeIndex].last) {
+    subnetCursor = done + 1;
+  } else if (++rangeIndex < subnet.ranges.size()) {
+    subnetCursor = subnet.ranges[rangeIndex].first;
+  } else {
+    finishSlice();
   }
 }
 
@@ -140,4 +730,94 @@ bool NetworkScanner::active() const { return scanning; }
 unsigned long NetworkScanner::lastCompletedMs() const { return lastScanCompletedMs; }
 const std::vector<SubnetScanResult>& NetworkScanner::subnetResults() const { return lastSubnetResults; }
 const std::vector<HostScanResult>& NetworkScanner::hostResults() const { return lastHostResults; }
+
+const std::vector<SliceScanResult>& NetworkScanner::sliceResults(size_t subnet) const
+{
+  static const std::vector<SliceScanResult> none;
+  return subnet < sweeps.size() ? sweeps[subnet].slices : none;
+}
+
+// The slice running now, or the one the subnet's job runs next
+uint16_t NetworkScanner::nextSlice(size_t subnet) const
+{
+  return subnet < sweeps.size() ? sweeps[subnet].position.slice : 0;
+}
+
 int NetworkScanner::foundCount() const { return foundOnlineCount; }
+const ScanHeapStats& NetworkScanner::heapStats() const { return heap; }
+const ScanRunStats& NetworkScanner::runStats() const { return run; }
+InventoryStats NetworkScanner::inventoryStats() const { return inventory.stats(); }
+
+// How long loop() may block before step() has work: zero mid-sweep, the
+// poll interval while a protocol check is in flight, else the next due job
+uint32_t NetworkScanner::wakeInMs() const
+{
+  if (!scheduled || sweeping) return 0;
+  uint32_t wait = UINT32_MAX;
+  if (service.busy()) wait = SERVICE_POLL_MS;
+  else if (scanning) return 0;  // finishScan() is still to run
+  uint32_t now = millis();
+  for (const auto *queue : { &hostQueue, &subnetQueue }) {
+    if (queue->empty()) continue;
+    // A due protocol check is held back until the one in flight finishes
+    if (queue == &hostQueue && service.busy() && config.static_hosts[queue->front().target].check != ServiceKind::None) continue;
+    int32_t in = (int32_t)(queue->front().dueMs - now);
+    uint32_t w = in > 0 ? in : 0;
+    if (w < wait) wait = w;
+  }
+  return wait;
+}
+
+ScanProgress NetworkScanner::progress() const
+{
+  ScanProgress p;
+  uint32_t now = millis();
+  p.active = scanning;
+  p.cycleDone = cycleDone;
+  p.probesPerS = probesPerS;
+  p.addressesPerS = addressesPerS;
+  if (sweeping) {
+    p.subnet = subnetIndex;
+    p.slice = sliceIndex;
+    p.slices = sweeps[subnetIndex].slices.size();
+    p.sweepDone = sweepDone;
+    p.sweepTotal = sweepDone + sliceLeft;
+    p.remaining = sliceLeft;
+  }
+  for (const auto &job : subnetQueue) {
+    if ((int32_t)(now - job.dueMs) >= 0 && job.target < sweeps.size()) {
+      p.remaining += sliceSize(config.subnets[job.target], sweeps[job.target].position.slice);
+    }
+  }
+  for (const auto &job : hostQueue) {
+    if ((int32_t)(now - job.dueMs) >= 0) p.remaining++;
+  }
+  if (scanning) p.elapsedMs = now - lastScanStartMs;
+
+  // Subnets that completed use their measured duration, the rest the rate
+  float rate = addressesPerS;
+  if (rate > 0) p.etaMs = p.remaining * 1000.0f / rate;
+  float full = rate > 0 ? config.static_hosts.size() * 1000.0f / rate : 0;
+  for (size_t i = 0; i < config.subnets.size(); i++) {
+    if (i < lastSubnetResults.size() && lastSubnetResults[i].durationMs) full += lastSubnetResults[i].durationMs;
+    else if (rate > 0) full += config.subnets[i].hostCount * 1000.0f / rate;
+  }
+  p.fullSweepMs = full;
+  return p;
+}
+
+DeadlineStats NetworkScanner::deadlineStats() const
+{
+  DeadlineStats s = deadlines;
+  s.queued = hostQueue.size() + subnetQueue.size();
+  uint32_t now = millis();
+  bool any = false;
+  for (const auto *queue : { &hostQueue, &subnetQueue }) {
+    if (queue->empty()) continue;
+    int32_t in = (int32_t)(queue->front().dueMs - now);
+    uint32_t wait = in > 0 ? in : 0;
+    if (!any || wait < s.nextDueInMs) s.nextDueInMs = wait;
+    any = true;
+  }
+  return s;
+}
@@ -0,0 +1,265 @@
+#include "passive_listener.h"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "logger.h"
+
+namespace {
+  const uint32_t MDNS_GROUP = 0xE00000FB;  // 224.0.0.251
+  const uint32_t SSDP_GROUP = 0xEFFFFFFA;  // 239.255.255.250
+  const uint16_t DNS_TYPE_A = 1;
+  const uint8_t DNS_MAX_JUMPS = 16;
+  const size_t DNS_HEADER_LEN = 12;
+  const size_t DHCP_OPTIONS_OFFSET = 240;
+  const uint32_t DHCP_MAGIC = 0x63825363;
+  const uint8_t DHCP_OPT_HOSTNAME = 12;
+  const uint8_t DHCP_OPT_REQUESTED_IP = 50;
+  const uint8_t DHCP_OPT_MESSAGE_TYPE = 53;
+  const uint8_t DHCP_REQUEST = 3;
+  const uint8_t DHCP_ACK = 5;
+  const uint8_t DHCP_INFORM = 8;
+  const size_t NAME_BUFFER_LEN = 64;
+
+  uint16_t be16(const uint8_t* p) { return (uint16_t(p[0]) << 8) | p[1]; }
+  uint32_t be32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+
+  // Reads a possibly compressed DNS name at `pos` into dotted form and leaves
+  // `pos` after the name as stored in place. Fails on loops or overruns.
+  bool readName(const uint8_t* msg, size_t len, size_t &pos, char* out, size_t outLen)
+  {
+    size_t cursor = pos;
+    size_t written = 0;
+    bool jumped = false;
+    uint8_t jumps = 0;
+    if (outLen) out[0] = 0;
+    while (true) {
+      if (cursor >= len) return false;
+      uint8_t label = msg[cursor];
+      if (label == 0) {
+        if (!jumped) pos = cursor + 1;
+        return true;
+      }
+      if ((label & 0xC0) == 0xC0) {
+        if (cursor + 1 >= len || ++jumps > DNS_MAX_JUMPS) return false;
+        if (!jumped) pos = cursor + 2;
+        jumped = true;
+        cursor = ((label & 0x3F) << 8) | msg[cursor + 1];
+        continue;
+      }
+      if (label & 0xC0) return false;
+      if (cursor + 1 + label > len) return false;
+      if (written && written + 1 < outLen) out[written++] = '.';
+      for (uint8_t i = 1; i <= label && written + 1 < outLen; i++) out[written++] = static_cast<char>(msg[cursor + i]);
+      if (outLen) out[written] = 0;
+      cursor += 1 + label;
+    }
+  }
+
+  // "printer.local" -> "printer"
+  void stripLocal(char* name)
+  {
+    size_t n = strlen(name);
+    if (n > 6 && strcasecmp(name + n - 6, ".local") == 0) name[n - 6] = 0;
+  }
+
+  bool linkLocalOrUnset(uint32_t ip)
+  {
+    return ip == 0 || ip == 0xFFFFFFFF || (ip >> 16) == 0xA9FE || (ip >> 28) == 0xE;
+  }
+
+  // Non-blocking UDP socket on `port` of every interface, joined to `group`
+  // when given. Shares the port with other listeners such as the mDNS responder.
+  int openSocket(uint16_t port, uint32_t group)
+  {
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) return -1;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // lwIP only hands broadcasts to sockets that ask for them
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+      close(fd);
+      return -1;
+    }
+    if (group) {
+      ip_mreq mreq = {};
+      mreq.imr_multiaddr.s_addr = htonl(group);
+      mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+      // Without the group only unicast replies arrive; keep the socket anyway
+      if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) LOG_WARN("Passive discovery: joining multicast on port {} failed", port);
+    }
+    return fd;
+  }
+}
+
+PassiveListener::PassiveListener(Config& cfg, const PassivePorts& p) : config(cfg), ports(p) {}
+
+void PassiveListener::setSightingHandler(SightingHandler handler) { onSighting = std::move(handler); }
+
+void PassiveListener::loop(bool networkUp)
+{
+  bool wanted = networkUp && config.passive_discovery;
+  if (wanted && !listening) begin();
+  else if (!wanted && listening) stop();
+  if (!listening) return;
+  drain(PassiveSource::Mdns);
+  drain(PassiveSource::Ssdp);
+  drain(PassiveSource::Dhcp);
+}
+
+void PassiveListener::begin()
+{
+  fds[static_cast<uint8_t>(PassiveSource::Mdns)] = openSocket(ports.mdns, MDNS_GROUP);
+  fds[static_cast<uint8_t>(PassiveSource::Ssdp)] = openSocket(ports.ssdp, SSDP_GROUP);
+  // DHCP clients broadcast to the server port before they have an address
+  fds[static_cast<uint8_t>(PassiveSource::Dhcp)] = openSocket(ports.dhcp, 0);
+  listening = true;
+  bool ok = true;
+  for (int fd : fds) ok = ok && fd >= 0;
+  if (!ok) LOG_WARN("Passive discovery: some sockets failed to open");
+  else LOG_INFO("Passive discovery listening");
+}
+
+void PassiveListener::stop()
+{
+  for (int &fd : fds) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  listening = false;
+}
+
+// A bounded number of datagrams per loop keeps a chatty network from
+// starving the scanner; the rest wait in the socket buffer and keep the
+// event loop's watcher waking it.
+void PassiveListener::drain(PassiveSource source)
+{
+  int fd = fds[static_cast<uint8_t>(source)];
+  if (fd < 0) return;
+  for (uint8_t i = 0; i < PASSIVE_PACKETS_PER_LOOP; i++) {
+    sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    int len = recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&from), &fromLen);
+    if (len < 0) return;
+    if (len > 0) handlePacket(source, ntohl(from.sin_addr.s_addr), buffer, len);
+  }
+}
+
+void PassiveListener::handlePacket(PassiveSource source, uint32_t fromIp, const uint8_t* data, size_t len)
+{
+  bool ok = false;
+  switch (source) {
+    case PassiveSource::Mdns:
+      counters.mdns++;
+      ok = parseMdns(fromIp, data, len);
+      break;
+    case PassiveSource::Ssdp:
+      // NOTIFY, M-SEARCH and search responses all come from a live sender
+      counters.ssdp++;
+      ok = len >= 8;
+      if (ok) report(fromIp, nullptr);
+      break;
+    case PassiveSource::Dhcp:
+      counters.dhcp++;
+      ok = parseDhcp(data, len);
+      break;
+  }
+  if (!ok) counters.malformed++;
+}
+
+// Any mDNS packet proves its sender is up; A records in answers also carry
+// the hostname the responder claims for an address.
+bool PassiveListener::parseMdns(uint32_t fromIp, const uint8_t* data, size_t len)
+{
+  if (len < DNS_HEADER_LEN) return false;
+  uint16_t questions = be16(data + 4);
+  uint16_t records = be16(data + 6) + be16(data + 8) + be16(data + 10);
+  size_t pos = DNS_HEADER_LEN;
+  char name[NAME_BUFFER_LEN];
+  for (uint16_t i = 0; i < questions; i++) {
+    if (!readName(data, len, pos, name, sizeof(name)) || pos + 4 > len) return false;
+    pos += 4;
+  }
+
+  bool namedSender = false;
+  for (uint16_t i = 0; i < records; i++) {
+    if (!readName(data, len, pos, name, sizeof(name)) || pos + 10 > len) return false;
+    uint16_t type = be16(data + pos);
+    uint16_t rdLength = be16(data + pos + 8);
+    pos += 10;
+    if (pos + rdLength > len) return false;
+    if (type == DNS_TYPE_A && rdLength == 4) {
+      uint32_t ip = be32(data + pos);
+      stripLocal(name);
+      report(ip, name);
+      if (ip == fromIp) namedSender = true;
+    }
+    pos += rdLength;
+  }
+  if (!namedSender) report(fromIp, nullptr);
+  return true;
+}
+
+// Client REQUEST/INFORM broadcasts and broadcast ACKs name the address the
+// client is about to use, plus its hostname option when sent.
+bool PassiveListener::parseDhcp(const uint8_t* data, size_t len)
+{
+  if (len < DHCP_OPTIONS_OFFSET || be32(data + 236) != DHCP_MAGIC) return false;
+  uint8_t op = data[0];
+  uint32_t ciaddr = be32(data + 12);
+  uint32_t yiaddr = be32(data + 16);
+  uint8_t type = 0;
+  uint32_t requested = 0;
+  char hostname[NAME_BUFFER_LEN] = {};
+
+  size_t pos = DHCP_OPTIONS_OFFSET;
+  while (pos < len) {
+    uint8_t code = data[pos++];
+    if (code == 0) continue;
+    if (code == 255) break;
+    if (pos >= len) return false;
+    uint8_t optLen = data[pos++];
+    if (pos + optLen > len) return false;
+    if (code == DHCP_OPT_MESSAGE_TYPE && optLen == 1) type = data[pos];
+    else if (code == DHCP_OPT_REQUESTED_IP && optLen == 4) requested = be32(data + pos);
+    else if (code == DHCP_OPT_HOSTNAME) {
+      size_t n = optLen < sizeof(hostname) - 1 ? optLen : sizeof(hostname) - 1;
+      memcpy(hostname, data + pos, n);
+      hostname[n] = 0;
+    }
+    pos += optLen;
+  }
+
+  uint32_t ip = 0;
+  if (op == 2 && type == DHCP_ACK) ip = yiaddr;
+  else if (op == 1 && type == DHCP_REQUEST) ip = requested ? requested : ciaddr;
+  else if (op == 1 && type == DHCP_INFORM) ip = ciaddr;
+  if (ip) report(ip, hostname);
+  return true;
+}
+
+void PassiveListener::report(uint32_t ip, const char* hostname)
+{
+  if (linkLocalOrUnset(ip)) return;
+  counters.sightings++;
+  LOG_TRACE("passive sighting {} {}", intToIp(ip), hostname ? hostname : "");
+  if (onSighting) onSighting(ip, hostname && *hostname ? hostname : nullptr);
+}
+
+PassiveStats PassiveListener::stats() const
+{
+  PassiveStats s = counters;
+  s.listening = listening;
+  return s;
+}
+
+int PassiveListener::socketFd(PassiveSource source) const
+{
+  return fds[static_cast<uint8_t>(source)];
+}
@@ -0,0 +1,128 @@
+#include "platform.h"
+#include <math.h>
+#include "config_store.h"
+#include "target_set.h"
+
+namespace {
+  const uint8_t ARP_POLL_MS = 4;
+}
+
+uint8_t arpSweep(ArpCache &cache, uint32_t first, uint8_t count, uint16_t waitMs, const std::function<bool(uint32_t)> &confirm)
+{
+  if (count > ARP_BATCH_MAX) count = ARP_BATCH_MAX;
+  uint8_t all = arpMask(count);
+  uint8_t cached = cache.resolved(first, count);
+  uint8_t fresh = 0;
+  if (cached != all && cache.request(first, count)) {
+    unsigned long t0 = millis();
+    do {
+      delay(ARP_POLL_MS);
+      fresh = cache.resolved(first, count) & ~cached;
+    } while ((fresh | cached) != all && millis() - t0 < waitMs);
+  }
+  uint8_t alive = fresh;
+  for (uint8_t i = 0; i < count; i++) {
+    if ((cached & (1 << i)) && confirm(first + i)) alive |= 1 << i;
+  }
+  return alive;
+}
+
+SimulatedNetwork::SimulatedNetwork(const SimNetworkParams &p) : params(p), rng(p.seed ? p.seed : 1) {}
+
+uint32_t SimulatedNetwork::hash(uint32_t a, uint32_t b) const
+{
+  uint32_t h = a * 0x9E3779B1u ^ (b + params.seed) * 0x85EBCA77u;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 12;
+  return h;
+}
+
+bool SimulatedNetwork::hostAlive(uint32_t ip) const
+{
+  return hash(ip, 0) % 100 < params.hostDensityPct;
+}
+
+// xorshift keeps per-probe loss and jitter cheap and reproducible for a given seed
+uint32_t SimulatedNetwork::nextRandom()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+uint16_t SimulatedNetwork::sampleRtt(uint32_t ip)
+{
+  float u = ((nextRandom() ^ hash(ip, 1)) & 0xFFFF) / 65536.0f;
+  float spread = params.rttMedianMs > params.rttMinMs ? params.rttMedianMs - params.rttMinMs : 1;
+  float rtt = params.rttMinMs + spread * -logf(1.0f - u) / 0.6931f;
+  return rtt > params.rttMaxMs ? params.rttMaxMs : static_cast<uint16_t>(rtt);
+}
+
+void SimulatedNetwork::spend(uint32_t ms)
+{
+  uint32_t scaled = ms * params.timeScalePct / 100;
+  if (scaled) delay(scaled);
+}
+
+bool SimulatedNetwork::ping(const IPAddress &ip, uint16_t &rttMs)
+{
+  probeCount++;
+  uint32_t addr = ipToInt(ip);
+  bool lost = nextRandom() % 100 < params.lossPct;
+  bool silent = hash(addr, 2) % 100 < params.icmpSilentPct;
+  uint16_t rtt = sampleRtt(addr);
+  // A reply slower than the wait is as good as lost
+  if (!hostAlive(addr) || lost || silent || rtt > params.timeoutMs) {
+    spend(params.timeoutMs);
+    return false;
+  }
+  rttMs = rtt;
+  spend(rttMs);
+  return true;
+}
+
+bool SimulatedNetwork::connect(const IPAddress &ip, uint16_t port, uint16_t &rttMs)
+{
+  probeCount++;
+  uint32_t addr = ipToInt(ip);
+  if (!hostAlive(addr)) {
+    spend(PING_TIMEOUT_MS);
+    return false;
+  }
+  rttMs = sampleRtt(addr);
+  spend(rttMs);
+  return hash(addr, port) % 100 < params.openPortPct;
+}
+
+bool SimulatedNetwork::connect(const char *host, uint16_t port, uint16_t &rttMs)
+{
+  IPAddress ip;
+  if (!ip.fromString(host)) {
+    probeCount++;
+    return false;
+  }
+  return connect(ip, port, rttMs);
+}
+
+// The modelled segment is entirely on-link and ARP is answered by every live
+// host, including those that ignore ping
+bool SimulatedNetwork::arpProbe(uint32_t first, uint8_t count, uint8_t &aliveMask)
+{
+  aliveMask = 0;
+  uint16_t slowest = 0;
+  if (count > ARP_BATCH_MAX) count = ARP_BATCH_MAX;
+  for (uint8_t i = 0; i < count; i++) {
+    probeCount++;
+    uint32_t addr = first + i;
+    if (!hostAlive(addr) || nextRandom() % 100 < params.lossPct) continue;
+    aliveMask |= 1 << i;
+    uint16_t rtt = sampleRtt(addr);
+    if (rtt > slowest) slowest = rtt;
+  }
+  spend(aliveMask == arpMask(count) ? slowest : params.arpWaitMs);
+  return true;
+}
+
+uint32_t SimulatedNetwork::probes() const { return probeCount; }
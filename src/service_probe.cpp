@@ -0,0 +1,381 @@
+#include "service_probe.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "logger.h"
+#include "target_set.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+  const uint16_t DNS_QUERY_ID = 0x4F57;
+  const char* DNS_DEFAULT_NAME = "example.com";
+  const char* MQTT_CLIENT_ID = "ow-probe";
+
+  uint16_t be16(const uint8_t* p) { return (uint16_t(p[0]) << 8) | p[1]; }
+
+  // Bounds-checked appender over a caller's buffer; `ok` drops on overflow
+  struct Writer {
+    uint8_t* out;
+    size_t cap;
+    size_t len = 0;
+    bool ok = true;
+
+    Writer(uint8_t* buf, size_t n) : out(buf), cap(n) {}
+    void u8(uint8_t v)
+    {
+      if (len < cap) out[len++] = v;
+      else ok = false;
+    }
+    void u16(uint16_t v) { u8(v >> 8); u8(v & 0xFF); }
+    void bytes(const void* data, size_t n)
+    {
+      for (size_t i = 0; i < n; i++) u8(static_cast<const uint8_t*>(data)[i]);
+    }
+    // Backfills a big-endian length of `width` bytes at `at`
+    void lengthAt(size_t at, uint8_t width)
+    {
+      size_t n = len - at - width;
+      for (uint8_t i = 0; ok && i < width; i++) out[at + i] = (n >> (8 * (width - 1 - i))) & 0xFF;
+    }
+    size_t done() const { return ok ? len : 0; }
+  };
+
+  class HttpProbe : public ServiceProbe {
+  public:
+    ServiceKind kind() const override { return ServiceKind::Http; }
+    const char* name() const override { return "http"; }
+    uint16_t defaultPort() const override { return 80; }
+
+    size_t request(const char* host, const char* arg, uint8_t* out, size_t cap) const override
+    {
+      int n = snprintf(reinterpret_cast<char*>(out), cap,
+                       "GET %s HTTP/1.0\r\nHost: %s\r\nUser-Agent: esp-overwatch\r\nConnection: close\r\n\r\n",
+                       *arg ? arg : "/", host);
+      return n > 0 && static_cast<size_t>(n) < cap ? n : 0;
+    }
+
+    // "HTTP/1.1 204 ..." is enough; 2xx and 3xx count as up
+    ProbeVerdict response(const uint8_t* in, size_t len, uint16_t& code) const override
+    {
+      if (len < 12) return ProbeVerdict::Pending;
+      if (memcmp(in, "HTTP/", 5) != 0 || in[8] != ' ') return ProbeVerdict::Down;
+      code = 0;
+      for (size_t i = 9; i < 12; i++) {
+        if (in[i] < '0' || in[i] > '9') return ProbeVerdict::Down;
+        code = code * 10 + (in[i] - '0');
+      }
+      return code >= 200 && code < 400 ? ProbeVerdict::Up : ProbeVerdict::Down;
+    }
+  };
+
+  class DnsProbe : public ServiceProbe {
+  public:
+    ServiceKind kind() const override { return ServiceKind::Dns; }
+    const char* name() const override { return "dns"; }
+    uint16_t defaultPort() const override { return 53; }
+    bool datagram() const override { return true; }
+
+    // One recursive A query for the name in `arg` ("/router.lan")
+    size_t request(const char*, const char* arg, uint8_t* out, size_t cap) const override
+    {
+      if (*arg == '/') arg++;
+      const char* qname = *arg ? arg : DNS_DEFAULT_NAME;
+      Writer w(out, cap);
+      w.u16(DNS_QUERY_ID);
+      w.u16(0x0100);
+      w.u16(1);
+      w.u16(0);
+      w.u16(0);
+      w.u16(0);
+      while (*qname) {
+        const char* dot = strchr(qname, '.');
+        size_t n = dot ? static_cast<size_t>(dot - qname) : strlen(qname);
+        if (!n || n > 63) return 0;
+        w.u8(n);
+        w.bytes(qname, n);
+        qname += n + (dot ? 1 : 0);
+      }
+      w.u8(0);
+      w.u16(1);
+      w.u16(1);
+      return w.done();
+    }
+
+    // Up when the server answers the query with at least one record
+    ProbeVerdict response(const uint8_t* in, size_t len, uint16_t& code) const override
+    {
+      if (len < 12) return ProbeVerdict::Pending;
+      if (be16(in) != DNS_QUERY_ID || !(in[2] & 0x80)) return ProbeVerdict::Down;
+      code = in[3] & 0x0F;
+      return code == 0 && be16(in + 6) ? ProbeVerdict::Up : ProbeVerdict::Down;
+    }
+  };
+
+  class MqttProbe : public ServiceProbe {
+  public:
+    ServiceKind kind() const override { return ServiceKind::Mqtt; }
+    const char* name() const override { return "mqtt"; }
+    uint16_t defaultPort() const override { return 1883; }
+
+    // MQTT 3.1.1 CONNECT with a clean session and no credentials
+    size_t request(const char*, const char*, uint8_t* out, size_t cap) const override
+    {
+      Writer w(out, cap);
+      w.u8(0x10);
+      w.u8(0);
+      w.u16(4);
+      w.bytes("MQTT", 4);
+      w.u8(4);
+      w.u8(0x02);
+      w.u16(30);
+      w.u16(strlen(MQTT_CLIENT_ID));
+      w.bytes(MQTT_CLIENT_ID, strlen(MQTT_CLIENT_ID));
+      w.lengthAt(1, 1);
+      return w.done();
+    }
+
+    // A broker that refuses the anonymous login (4, 5) is still serving
+    ProbeVerdict response(const uint8_t* in, size_t len, uint16_t& code) const override
+    {
+      if (len < 4) return ProbeVerdict::Pending;
+      if (in[0] != 0x20 || in[1] != 0x02) return ProbeVerdict::Down;
+      code = in[3];
+      return code == 0 || code == 4 || code == 5 ? ProbeVerdict::Up : ProbeVerdict::Down;
+    }
+  };
+
+  class TlsProbe : public ServiceProbe {
+  public:
+    ServiceKind kind() const override { return ServiceKind::Tls; }
+    const char* name() const override { return "tls"; }
+    uint16_t defaultPort() const override { return 443; }
+
+    // A ClientHello offering TLS 1.2 and 1.3. The TLS 1.3 key share is left
+    // empty, so such servers answer with a HelloRetryRequest, which is also a
+    // ServerHello. No keys are computed: the check times the server's first
+    // handshake flight, not certificate validation.
+    size_t request(const char* host, const char*, uint8_t* out, size_t cap) const override
+    {
+      static const uint8_t suites[] = {0x13, 0x01, 0x13, 0x02, 0x13, 0x03, 0xC0, 0x2B, 0xC0, 0x2F, 0xC0, 0x2C,
+                                       0xC0, 0x30, 0xCC, 0xA9, 0xCC, 0xA8, 0x00, 0x9C, 0x00, 0x2F};
+      static const uint8_t fixedExtensions[] = {
+        0x00, 0x0A, 0x00, 0x08, 0x00, 0x06, 0x00, 0x1D, 0x00, 0x17, 0x00, 0x18,   // supported_groups
+        0x00, 0x0B, 0x00, 0x02, 0x01, 0x00,                                       // ec_point_formats
+        0x00, 0x0D, 0x00, 0x12, 0x00, 0x10, 0x04, 0x03, 0x08, 0x04, 0x04, 0x01,   // signature_algorithms
+        0x05, 0x03, 0x08, 0x05, 0x05, 0x01, 0x08, 0x06, 0x06, 0x01,
+        0x00, 0x2B, 0x00, 0x05, 0x04, 0x03, 0x04, 0x03, 0x03,                     // supported_versions
+        0x00, 0x33, 0x00, 0x02, 0x00, 0x00,                                       // key_share, empty
+      };
+      Writer w(out, cap);
+      w.u8(0x16);
+      w.u16(0x0301);
+      size_t recordLen = w.len;
+      w.u16(0);
+      w.u8(0x01);
+      size_t helloLen = w.len;
+      w.u8(0);
+      w.u16(0);
+      w.u16(0x0303);
+      // Only timing is measured, so the client random need not be strong
+      uint32_t seed = micros() ^ 0x9E3779B9;
+      for (uint8_t i = 0; i < 32; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        w.u8(seed & 0xFF);
+      }
+      w.u8(0);
+      w.u16(sizeof(suites));
+      w.bytes(suites, sizeof(suites));
+      w.u8(1);
+      w.u8(0);
+      size_t extLen = w.len;
+      w.u16(0);
+      IPAddress numeric;
+      size_t hostLen = strlen(host);
+      if (hostLen && !numeric.fromString(host)) {
+        w.u16(0x0000);
+        w.u16(hostLen + 5);
+        w.u16(hostLen + 3);
+        w.u8(0);
+        w.u16(hostLen);
+        w.bytes(host, hostLen);
+      }
+      w.bytes(fixedExtensions, sizeof(fixedExtensions));
+      w.lengthAt(extLen, 2);
+      w.lengthAt(helloLen, 3);
+      w.lengthAt(recordLen, 2);
+      return w.done();
+    }
+
+    ProbeVerdict response(const uint8_t* in, size_t len, uint16_t& code) const override
+    {
+      if (len < 6) return ProbeVerdict::Pending;
+      if (in[0] == 0x16) {
+        code = in[5];
+        return code == 0x02 ? ProbeVerdict::Up : ProbeVerdict::Down;
+      }
+      if (in[0] == 0x15) {
+        if (len < 7) return ProbeVerdict::Pending;
+        code = in[6];
+      }
+      return ProbeVerdict::Down;
+    }
+  };
+
+  const HttpProbe httpProbe;
+  const DnsProbe dnsProbe;
+  const MqttProbe mqttProbe;
+  const TlsProbe tlsProbe;
+  const ServiceProbe* const SERVICE_PROBES[] = {&httpProbe, &dnsProbe, &mqttProbe, &tlsProbe};
+
+  bool resolve(const char* host, uint32_t &ip)
+  {
+    IPAddress parsed;
+    if (parsed.fromString(host)) {
+      ip = ipToInt(parsed);
+      return true;
+    }
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    struct addrinfo* found = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &found) != 0 || !found) return false;
+    ip = ntohl(reinterpret_cast<struct sockaddr_in*>(found->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(found);
+    return true;
+  }
+}
+
+const ServiceProbe* findServiceProbe(ServiceKind kind)
+{
+  for (const ServiceProbe* p : SERVICE_PROBES) {
+    if (p->kind() == kind) return p;
+  }
+  return nullptr;
+}
+
+const ServiceProbe* findServiceProbe(const String& name)
+{
+  for (const ServiceProbe* p : SERVICE_PROBES) {
+    if (name.equalsIgnoreCase(p->name())) return p;
+  }
+  return nullptr;
+}
+
+ServiceCheck::~ServiceCheck() { closeSocket(); }
+
+bool ServiceCheck::busy() const { return phase != Phase::Idle; }
+
+const ServiceResult& ServiceCheck::result() const { return res; }
+
+void ServiceCheck::cancel()
+{
+  closeSocket();
+  phase = Phase::Idle;
+}
+
+void ServiceCheck::closeSocket()
+{
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+// Resolving a hostname blocks like any other DNS lookup; everything after
+// it is non-blocking. Returns false, with a down result, when the check
+// could not even start.
+bool ServiceCheck::start(const ServiceProbe& p, const char* host, uint16_t port, const char* arg)
+{
+  cancel();
+  probe = &p;
+  res = ServiceResult();
+  startMs = millis();
+  sent = 0;
+  received = 0;
+  requestLen = p.request(host, arg, buffer, sizeof(buffer));
+  if (!requestLen || !resolve(host, res.ip)) return false;
+
+  fd = socket(AF_INET, p.datagram() ? SOCK_DGRAM : SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(res.ip);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    closeSocket();
+    return false;
+  }
+  phase = Phase::Connecting;
+  return true;
+}
+
+// Advances the check as far as the socket allows without waiting. Returns
+// true once the result is final.
+bool ServiceCheck::poll()
+{
+  if (phase == Phase::Idle) return true;
+  if (millis() - startMs >= SERVICE_TIMEOUT_MS) {
+    finish(false, 0);
+    return true;
+  }
+
+  if (phase == Phase::Connecting) {
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(fd, &writable);
+    struct timeval now = {0, 0};
+    if (select(fd + 1, nullptr, &writable, nullptr, &now) <= 0) return false;
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+    if (err) {
+      finish(false, 0);
+      return true;
+    }
+    phase = Phase::Sending;
+  }
+
+  if (phase == Phase::Sending) {
+    ssize_t n = send(fd, buffer + sent, requestLen - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      finish(false, 0);
+      return true;
+    }
+    if (n > 0) sent += n;
+    if (sent < requestLen) return false;
+    phase = Phase::Receiving;
+  }
+
+  // The request is no longer needed, so the response reuses the buffer
+  while (received < sizeof(buffer)) {
+    ssize_t n = recv(fd, buffer + received, sizeof(buffer) - received, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+    uint16_t code = 0;
+    ProbeVerdict verdict = n > 0 ? probe->response(buffer, received + n, code) : ProbeVerdict::Down;
+    if (n > 0) received += n;
+    if (verdict != ProbeVerdict::Pending) {
+      finish(verdict == ProbeVerdict::Up, code);
+      return true;
+    }
+  }
+  finish(false, 0);
+  return true;
+}
+
+void ServiceCheck::finish(bool up, uint16_t code)
+{
+  closeSocket();
+  phase = Phase::Idle;
+  res.up = up;
+  res.code = code;
+  uint32_t elapsed = millis() - startMs;
+  res.latencyMs = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+  LOG_TRACE("service {} {} in {} ms, code {}", probe->name(), up ? "up" : "down", elapsed, code);
+}
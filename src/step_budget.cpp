@@ -0,0 +1,57 @@
+#include "step_budget.h"
+#include "config_store.h"
+#include "logger.h"
+
+namespace {
+  const uint32_t PROBE_WAIT_US = PING_TIMEOUT_MS * 1000UL;
+  // A probe cannot be split across loops, and every step runs at least one
+  static_assert(PROBE_WAIT_US < OVERWATCH_LOOP_TARGET_US, "PING_TIMEOUT_MS must fit under the loop target");
+}
+
+StepBudget::StepBudget(uint32_t target)
+  : targetUs(target),
+    maxBudgetUs(target > PROBE_WAIT_US + STEP_BUDGET_MIN_US ? target - PROBE_WAIT_US : STEP_BUDGET_MIN_US),
+    budget(target / 2 < maxBudgetUs ? target / 2 : maxBudgetUs)
+{
+}
+
+uint32_t StepBudget::budgetUs() const { return budget; }
+
+void StepBudget::recordLoop(uint32_t loopUs)
+{
+  if (loopUs > targetUs) over++;
+  if (loopUs > slowest) {
+    secondSlowest = slowest;
+    slowest = loopUs;
+  } else if (loopUs > secondSlowest) {
+    secondSlowest = loopUs;
+  }
+  if (++samples < STEP_BUDGET_WINDOW) return;
+
+  if (over > STEP_BUDGET_WINDOW / 100) {
+    uint32_t cut = budget - budget / 4;
+    budget = cut < STEP_BUDGET_MIN_US ? STEP_BUDGET_MIN_US : cut;
+    decreases++;
+  } else if (!over && budget < maxBudgetUs) {
+    uint32_t grown = budget + targetUs / 16;
+    budget = grown > maxBudgetUs ? maxBudgetUs : grown;
+    increases++;
+  }
+  LOG_DEBUG("Step budget {} us (p99 {} us, {} over)", budget, secondSlowest, over);
+  lastP99Us = secondSlowest;
+  samples = 0;
+  over = 0;
+  slowest = 0;
+  secondSlowest = 0;
+}
+
+StepBudgetStats StepBudget::stats() const
+{
+  StepBudgetStats s;
+  s.budgetUs = budget;
+  s.targetUs = targetUs;
+  s.windowP99Us = lastP99Us;
+  s.increases = increases;
+  s.decreases = decreases;
+  return s;
+}
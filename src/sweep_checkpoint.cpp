@@ -0,0 +1,75 @@
+#include "sweep_checkpoint.h"
+#include <esp_crc.h>
+#include "logger.h"
+
+namespace {
+  const char* CHECKPOINT_PATH = "/sweep.bin";
+  const char* CHECKPOINT_TMP_PATH = "/sweep.tmp";
+  const uint32_t CHECKPOINT_MAGIC = 0x3153574F;  // "OWS1"
+  const uint16_t CHECKPOINT_MAX_ENTRIES = 64;
+}
+
+uint32_t sweepKey(const String& cidr, uint32_t hostCount)
+{
+  return esp_crc32_le(hostCount, reinterpret_cast<const uint8_t*>(cidr.c_str()), cidr.length());
+}
+
+SweepCheckpoint::SweepCheckpoint(fs::FS& filesystem) : storage(filesystem) {}
+
+bool SweepCheckpoint::load(std::vector<SweepPosition>& out)
+{
+  out.clear();
+  if (!storage.exists(CHECKPOINT_PATH)) return false;
+  File f = storage.open(CHECKPOINT_PATH, "r");
+  if (!f) return false;
+  uint32_t magic = 0;
+  uint16_t count = 0;
+  bool ok = f.read(reinterpret_cast<uint8_t*>(&magic), sizeof(magic)) == sizeof(magic) &&
+            f.read(reinterpret_cast<uint8_t*>(&count), sizeof(count)) == sizeof(count) &&
+            magic == CHECKPOINT_MAGIC && count <= CHECKPOINT_MAX_ENTRIES;
+  if (ok) {
+    out.resize(count);
+    size_t bytes = count * sizeof(SweepPosition);
+    uint32_t stored = 0;
+    ok = f.read(reinterpret_cast<uint8_t*>(out.data()), bytes) == bytes &&
+         f.read(reinterpret_cast<uint8_t*>(&stored), sizeof(stored)) == sizeof(stored);
+    uint32_t crc = esp_crc32_le(0, reinterpret_cast<const uint8_t*>(&magic), sizeof(magic));
+    crc = esp_crc32_le(crc, reinterpret_cast<const uint8_t*>(&count), sizeof(count));
+    crc = esp_crc32_le(crc, reinterpret_cast<const uint8_t*>(out.data()), bytes);
+    ok = ok && crc == stored;
+  }
+  f.close();
+  if (!ok) {
+    out.clear();
+    LOG_WARN("Sweep checkpoint unreadable, sweeps start over");
+  }
+  return ok;
+}
+
+bool SweepCheckpoint::save(const std::vector<SweepPosition>& positions)
+{
+  uint16_t count = positions.size() > CHECKPOINT_MAX_ENTRIES ? CHECKPOINT_MAX_ENTRIES : positions.size();
+  size_t bytes = count * sizeof(SweepPosition);
+  uint32_t crc = esp_crc32_le(0, reinterpret_cast<const uint8_t*>(&CHECKPOINT_MAGIC), sizeof(CHECKPOINT_MAGIC));
+  crc = esp_crc32_le(crc, reinterpret_cast<const uint8_t*>(&count), sizeof(count));
+  crc = esp_crc32_le(crc, reinterpret_cast<const uint8_t*>(positions.data()), bytes);
+
+  File f = storage.open(CHECKPOINT_TMP_PATH, "w");
+  if (!f) return false;
+  bool ok = f.write(reinterpret_cast<const uint8_t*>(&CHECKPOINT_MAGIC), sizeof(CHECKPOINT_MAGIC)) == sizeof(CHECKPOINT_MAGIC) &&
+            f.write(reinterpret_cast<const uint8_t*>(&count), sizeof(count)) == sizeof(count) &&
+            f.write(reinterpret_cast<const uint8_t*>(positions.data()), bytes) == bytes &&
+            f.write(reinterpret_cast<const uint8_t*>(&crc), sizeof(crc)) == sizeof(crc);
+  f.close();
+  if (!ok || !storage.rename(CHECKPOINT_TMP_PATH, CHECKPOINT_PATH)) {
+    storage.remove(CHECKPOINT_TMP_PATH);
+    LOG_ERROR("Sweep checkpoint save failed");
+    return false;
+  }
+  return true;
+}
+
+void SweepCheckpoint::clear()
+{
+  storage.remove(CHECKPOINT_PATH);
+}
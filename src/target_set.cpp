@@ -0,0 +1,235 @@
+#include "target_set.h"
+#include <algorithm>
+
+uint32_t ipToInt(const IPAddress &ip)
+{
+  return (static_cast<uint32_t>(ip[0]) << 24) | (static_cast<uint32_t>(ip[1]) << 16) |
+         (static_cast<uint32_t>(ip[2]) << 8) | static_cast<uint32_t>(ip[3]);
+}
+
+IPAddress intToIp(uint32_t value)
+{
+  return IPAddress((value >> 24) & 0xFF, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+}
+
+static bool parseAddress(const String &text, uint32_t &out)
+{
+  IPAddress ip;
+  if (!ip.fromString(text)) return false;
+  out = ipToInt(ip);
+  return true;
+}
+
+static bool parseTerm(const String &term, AddressRange &out)
+{
+  int slash = term.indexOf('/');
+  if (slash >= 0) {
+    uint32_t net;
+    if (!parseAddress(term.substring(0, slash), net)) return false;
+    int prefix = term.substring(slash + 1).toInt();
+    if (prefix < 1 || prefix > 32) return false;
+    uint32_t mask = prefix == 32 ? 0xFFFFFFFF : (0xFFFFFFFF << (32 - prefix));
+    uint32_t first = net & mask;
+    uint32_t last = first | ~mask;
+    // Skip network and broadcast addresses except for point-to-point sized blocks
+    if (prefix <= 30) { first++; last--; }
+    out.first = first;
+    out.last = last;
+    return true;
+  }
+
+  int dash = term.indexOf('-');
+  if (dash >= 0) {
+    uint32_t first;
+    if (!parseAddress(term.substring(0, dash), first)) return false;
+    String upper = term.substring(dash + 1);
+    uint32_t last;
+    if (upper.indexOf('.') >= 0) {
+      if (!parseAddress(upper, last)) return false;
+    } else {
+      long octet = upper.toInt();
+      if (!upper.length() || octet < 0 || octet > 255) return false;
+      last = (first & 0xFFFFFF00) | static_cast<uint32_t>(octet);
+    }
+    if (last < first) return false;
+    out.first = first;
+    out.last = last;
+    return true;
+  }
+
+  uint32_t single;
+  if (!parseAddress(term, single)) return false;
+  out.first = single;
+  out.last = single;
+  return true;
+}
+
+bool parsePortSet(const String &text, std::vector<uint16_t> &ports)
+{
+  ports.clear();
+  int start = 0;
+  int len = text.length();
+  while (start < len) {
+    int comma = text.indexOf(',', start);
+    if (comma < 0) comma = len;
+    String item = text.substring(start, comma);
+    item.trim();
+    start = comma + 1;
+    if (!item.length()) continue;
+
+    int dash = item.indexOf('-');
+    long lo = dash >= 0 ? item.substring(0, dash).toInt() : item.toInt();
+    long hi = dash >= 0 ? item.substring(dash + 1).toInt() : lo;
+    if (lo < 1 || hi > 65535 || hi < lo) return false;
+    for (long p = lo; p <= hi; p++) {
+      if (ports.size() >= MAX_TARGET_PORTS) return false;
+      if (std::find(ports.begin(), ports.end(), static_cast<uint16_t>(p)) == ports.end()) {
+        ports.push_back(static_cast<uint16_t>(p));
+      }
+    }
+  }
+  return true;
+}
+
+String renderPortSet(const std::vector<uint16_t> &ports)
+{
+  String out;
+  for (size_t i = 0; i < ports.size(); i++) {
+    if (i) out += ",";
+    out += String(ports[i]);
+  }
+  return out;
+}
+
+// Splits the check keywords out of a target's port set
+static bool parseProbeSet(const String &text, std::vector<uint16_t> &ports, uint8_t &methods)
+{
+  methods = 0;
+  String portText;
+  int start = 0;
+  int len = text.length();
+  while (start < len) {
+    int comma = text.indexOf(',', start);
+    if (comma < 0) comma = len;
+    String item = text.substring(start, comma);
+    item.trim();
+    start = comma + 1;
+    if (item.equalsIgnoreCase("arp")) methods |= PROBE_ARP;
+    else if (item.equalsIgnoreCase("icmp") || item.equalsIgnoreCase("ping")) methods |= PROBE_ICMP;
+    else if (item.length()) {
+      if (portText.length()) portText += ",";
+      portText += item;
+    }
+  }
+  if (!parsePortSet(portText, ports)) return false;
+  if (!methods && ports.empty()) methods = PROBE_ICMP;
+  return true;
+}
+
+bool parseTargetExpression(const String &expr, TargetSpec &out)
+{
+  out.ranges.clear();
+  out.ports.clear();
+  out.methods = PROBE_ICMP;
+  out.addressCount = 0;
+
+  String addresses = expr;
+  int colon = expr.indexOf(':');
+  if (colon >= 0) {
+    addresses = expr.substring(0, colon);
+    if (!parseProbeSet(expr.substring(colon + 1), out.ports, out.methods)) return false;
+  }
+
+  std::vector<AddressRange> excluded;
+  int start = 0;
+  int len = addresses.length();
+  while (start < len) {
+    int end = start;
+    while (end < len && addresses[end] != ',' && addresses[end] != ' ' && addresses[end] != '\t') end++;
+    String term = addresses.substring(start, end);
+    start = end + 1;
+    if (!term.length()) continue;
+
+    bool exclude = term[0] == '!';
+    if (exclude) term = term.substring(1);
+    AddressRange r;
+    if (!parseTerm(term, r)) return false;
+    if (exclude) excluded.push_back(r);
+    else out.ranges.push_back(r);
+  }
+  if (out.ranges.empty()) return false;
+
+  normalizeRanges(out.ranges);
+  normalizeRanges(excluded);
+  subtractRanges(out.ranges, excluded);
+  out.addressCount = countAddresses(out.ranges);
+  return true;
+}
+
+void normalizeRanges(std::vector<AddressRange> &ranges)
+{
+  if (ranges.size() < 2) return;
+  std::sort(ranges.begin(), ranges.end(), [](const AddressRange &a, const AddressRange &b) {
+    return a.first < b.first;
+  });
+  size_t out = 0;
+  for (size_t i = 1; i < ranges.size(); i++) {
+    AddressRange &cur = ranges[out];
+    const AddressRange &next = ranges[i];
+    // Merge overlapping and directly adjacent ranges
+    if (cur.last == 0xFFFFFFFF || next.first <= cur.last + 1) {
+      if (next.last > cur.last) cur.last = next.last;
+    } else {
+      ranges[++out] = next;
+    }
+  }
+  ranges.resize(out + 1);
+}
+
+void subtractRanges(std::vector<AddressRange> &ranges, const std::vector<AddressRange> &remove)
+{
+  if (ranges.empty() || remove.empty()) return;
+  std::vector<AddressRange> result;
+  result.reserve(ranges.size() + remove.size());
+  size_t j = 0;
+  for (const auto &r : ranges) {
+    uint64_t cursor = r.first;
+    while (j < remove.size() && remove[j].last < r.first) j++;
+    size_t k = j;
+    while (k < remove.size() && remove[k].first <= r.last && cursor <= r.last) {
+      if (remove[k].first > cursor) {
+        AddressRange piece;
+        piece.first = static_cast<uint32_t>(cursor);
+        piece.last = remove[k].first - 1;
+        result.push_back(piece);
+      }
+      cursor = static_cast<uint64_t>(remove[k].last) + 1;
+      if (remove[k].last > r.last) break;
+      k++;
+    }
+    if (cursor <= r.last) {
+      AddressRange piece;
+      piece.first = static_cast<uint32_t>(cursor);
+      piece.last = r.last;
+      result.push_back(piece);
+    }
+  }
+  ranges.swap(result);
+}
+
+uint32_t countAddresses(const std::vector<AddressRange> &ranges)
+{
+  uint64_t total = 0;
+  for (const auto &r : ranges) total += static_cast<uint64_t>(r.last) - r.first + 1;
+  return total > 0xFFFFFFFF ? 0xFFFFFFFF : static_cast<uint32_t>(total);
+}
+
+bool rangesContain(const std::vector<AddressRange> &ranges, uint32_t address)
+{
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), address, [](uint32_t value, const AddressRange &r) {
+    return value < r.first;
+  });
+  if (it == ranges.begin()) return false;
+  --it;
+  return address <= it->last;
+}
@@ -1,9 +1,16 @@
 #include "web_app.h"
+#include <algorithm>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include "instrumentation.h"
 
-WebApp::WebApp(ConfigStore& st, NetworkScanner& sc, MqttManager& mq)
-  : store(st), scanner(sc), mqtt(mq) {}
+namespace {
+  const uint32_t REBOOT_DELAY_MS = 500;   // lets the reply reach the client first
+  const size_t LOG_FRAME_BYTES = 512;     // a 191-byte line with some escaping
+}
+
+WebApp::WebApp(ConfigStore& st, NetworkScanner& sc, MqttManager& mq, AvailabilityHistory& hist)
+  : store(st), scanner(sc), mqtt(mq), history(hist) {}
 
 void WebApp::setWifiStatusProvider(std::function<bool()> wifiUpFn, std::function<String()> wifiIpFn, std::function<bool()> captiveFn) {
   wifiUp = std::move(wifiUpFn);
@@ -11,7 +18,39 @@ void WebApp::setWifiStatusProvider(std::function<bool()> wifiUpFn, std::function
   isCaptive = std::move(captiveFn);
 }
 
+void WebApp::setWifiStatsProvider(std::function<WifiStats()> statsFn) {
+  wifiStats = std::move(statsFn);
+}
+
+void WebApp::setClusterStatsProvider(std::function<ClusterStats()> statsFn) {
+  clusterStats = std::move(statsFn);
+}
+
+void WebApp::setStepBudgetProvider(std::function<StepBudgetStats()> statsFn) {
+  stepBudgetStats = std::move(statsFn);
+}
+
+void WebApp::setPassiveStatsProvider(std::function<PassiveStats()> statsFn) {
+  passiveStats = std::move(statsFn);
+}
+
+void WebApp::setBootTimelineProvider(std::function<BootTimeline()> timelineFn) {
+  bootTimeline = std::move(timelineFn);
+}
+
+void WebApp::setEventLoopProvider(std::function<EventLoopStats()> statsFn, std::function<void()> wakeFn) {
+  eventLoopStats = std::move(statsFn);
+  wakeLoop = std::move(wakeFn);
+}
+
 void WebApp::begin() {
+  // Frames queued from any task are sent by loop()
+  outbox.begin([this]() { if (wakeLoop) wakeLoop(); });
+  commands.begin();
+  for (JsonSnapshot* snapshot : { &statusSnapshot, &configSnapshot, &scanResultsSnapshot, &historySnapshot }) snapshot->begin();
+  renderSnapshot(configSnapshot, &WebApp::buildConfigJson);
+  refreshSnapshots();
+  logger.setStreamSink([this](LogLevel level, uint32_t ts, const char* line) { streamLog(level, ts, line); });
   setupWebSocket();
   setupRoutes();
   server.begin();
@@ -20,56 +59,128 @@ void WebApp::begin() {
 void WebApp::setupWebSocket() {
   ws.onEvent([this](AsyncWebSocket* s, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
     if (type == WS_EVT_CONNECT) {
-      client->text("{\"type\":\"connected\"}");
+      if (!outbox.open(client->id())) {
+        client->close(1013, "busy");
+        return;
+      }
+      outbox.send(client->id(), "{\"type\":\"connected\"}");
+    } else if (type == WS_EVT_DISCONNECT) {
+      outbox.close(client->id());
+      unsubscribeLogs(client->id());
     } else if (type == WS_EVT_DATA) {
       AwsFrameInfo* info = (AwsFrameInfo*)arg;
       if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
-        String msg;
-        msg.reserve(len + 1);
-        for (size_t i = 0; i < len; i++) {
-          msg += (char)data[i];
-        }
-        handleWsMessage(client, msg);
+        handleWsMessage(client, data, len);
+        // Replies and commands wait for loop(), which may be blocked waiting for events
+        if (wakeLoop) wakeLoop();
       }
     }
   });
   server.addHandler(&ws);
 }
 
-void WebApp::handleWsMessage(AsyncWebSocketClient* client, const String& message) {
-  JsonDocument doc;
-  if (deserializeJson(doc, message)) return;
+// Runs in the AsyncTCP task, which must not read scanner or config state.
+// Everything but the log subscription is queued for the main task, which
+// replies when it is done.
+void WebApp::handleWsMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len) {
+  // Everything allocated while handling this message is released on return
+  ArenaScope scope(webArena);
+  JsonDocument doc(&webArena);
+  if (deserializeJson(doc, data, len)) return;
 
   const char* type = doc["type"];
   if (!type) return;
 
   if (strcmp(type, "get_all") == 0) {
-    client->text("{\"type\":\"status\",\"data\":" + buildStatusJson() + "}");
-    client->text("{\"type\":\"config\",\"data\":" + buildConfigJson() + "}");
-    client->text("{\"type\":\"scan_results\",\"data\":" + buildScanResultsJson() + "}");
+    queueCommand(CommandType::SendState, client->id());
   } else if (strcmp(type, "trigger_scan") == 0) {
-    triggerScan();
-    ws.textAll("{\"type\":\"scan_started\"}");
+    queueCommand(CommandType::TriggerScan, client->id());
   } else if (strcmp(type, "save_config") == 0) {
     JsonObject data = doc["data"];
     if (data) {
-      String payload;
-      serializeJson(data, payload);
-      if (store.parseConfigPayload(payload) && store.save()) {
-        ws.textAll("{\"type\":\"config_saved\"}");
-        delay(500);
-        ESP.restart();
+      String* payload = new String();
+      serializeJson(data, *payload);
+      queueCommand(CommandType::SaveConfig, client->id(), payload);
+    }
+  } else if (strcmp(type, "reboot") == 0) {
+    queueCommand(CommandType::Reboot, client->id());
+  } else if (strcmp(type, "log_subscribe") == 0) {
+    LogLevel level = logger.level();
+    const char* name = doc["level"];
+    if (name) {
+      static const char* names[] = { "error", "warn", "info", "debug", "trace" };
+      for (uint8_t i = 0; i < 5; i++) {
+        if (strcmp(name, names[i]) == 0) level = static_cast<LogLevel>(i + 1);
       }
     }
+    outbox.send(client->id(), subscribeLogs(client->id(), level) ? "{\"type\":\"log_subscribed\"}" : "{\"type\":\"log_busy\"}");
+  } else if (strcmp(type, "log_unsubscribe") == 0) {
+    unsubscribeLogs(client->id());
   } else if (strcmp(type, "save_targets") == 0) {
     JsonObject data = doc["data"];
     if (data) {
-      String payload;
-      serializeJson(data, payload);
-      if (store.parseTargetsPayload(payload) && store.save()) {
-        ws.textAll("{\"type\":\"targets_saved\"}");
+      String* payload = new String();
+      serializeJson(data, *payload);
+      queueCommand(CommandType::SaveTargets, client->id(), payload);
+    }
+  }
+}
+
+bool WebApp::queueCommand(CommandType type, uint32_t clientId, String* payload) {
+  if (commands.push(type, clientId, payload)) return true;
+  reply(clientId, "{\"type\":\"busy\"}");
+  return false;
+}
+
+void WebApp::reply(uint32_t clientId, const char* text) {
+  if (clientId) outbox.send(clientId, text);
+}
+
+// Runs on the main task. Successful saves are broadcast since every open UI
+// shows the result; failures only go to the client that asked.
+void WebApp::runCommand(const Command& cmd) {
+  switch (cmd.type) {
+    case CommandType::TriggerScan:
+      scanner.start();
+      outbox.broadcast("{\"type\":\"scan_started\"}");
+      break;
+    // Both saves parse into a copy that replaces the running config only once
+    // it is on flash. Result records index into the target lists, so they are
+    // dropped whenever the lists are replaced.
+    case CommandType::SaveConfig: {
+      Config candidate = store.data();
+      if (cmd.payload && store.parseConfigPayload(*cmd.payload, candidate) && store.save(candidate)) {
+        scanner.resetTargets();
+        renderSnapshot(configSnapshot, &WebApp::buildConfigJson);
+        refreshSnapshots();
+        outbox.broadcast("{\"type\":\"config_saved\"}");
+        if (!rebootAtMs) rebootAtMs = millis() + REBOOT_DELAY_MS;
+      } else {
+        reply(cmd.clientId, "{\"type\":\"config_rejected\"}");
+      }
+      break;
+    }
+    case CommandType::SaveTargets: {
+      Config candidate = store.data();
+      if (cmd.payload && store.parseTargetsPayload(*cmd.payload, candidate) && store.saveTargets(candidate)) {
+        scanner.resetTargets();
+        renderSnapshot(configSnapshot, &WebApp::buildConfigJson);
+        refreshSnapshots();
+        outbox.broadcast("{\"type\":\"targets_saved\"}");
+      } else {
+        reply(cmd.clientId, "{\"type\":\"targets_rejected\"}");
       }
+      break;
     }
+    case CommandType::Reboot:
+      outbox.broadcast("{\"type\":\"rebooting\"}");
+      if (!rebootAtMs) rebootAtMs = millis() + REBOOT_DELAY_MS;
+      break;
+    case CommandType::SendState:
+      sendWs(cmd.clientId, "status", &WebApp::buildStatusJson);
+      sendWs(cmd.clientId, "config", &WebApp::buildConfigJson);
+      sendWs(cmd.clientId, "scan_results", &WebApp::buildScanResultsJson);
+      break;
   }
 }
 
@@ -98,12 +209,14 @@ void WebApp::setupRoutes() {
     req->send(200, "text/html", "<html><body>Success</body></html>");
   });
 
+  // GET handlers run on the AsyncTCP task and serve what the main task last
+  // rendered; see refreshSnapshots()
   server.on("/config", HTTP_GET, [this](AsyncWebServerRequest* req) {
-    req->send(200, "application/json", buildConfigJson());
+    sendSnapshot(req, configSnapshot);
   });
 
   server.on("/status", HTTP_GET, [this](AsyncWebServerRequest* req) {
-    req->send(200, "application/json", buildStatusJson());
+    sendSnapshot(req, statusSnapshot);
   });
 
   server.on("/settings", HTTP_GET, [this](AsyncWebServerRequest* req) {
@@ -131,33 +244,46 @@ void WebApp::setupRoutes() {
   });
 
   server.on("/scan_results", HTTP_GET, [this](AsyncWebServerRequest* req) {
-    req->send(200, "application/json", buildScanResultsJson());
+    sendSnapshot(req, scanResultsSnapshot);
+  });
+
+  server.on("/history", HTTP_GET, [this](AsyncWebServerRequest* req) {
+    sendHistory(req);
   });
 
   server.on("/scan", HTTP_GET, [this](AsyncWebServerRequest* req) {
-    triggerScan();
-    req->send(202, "text/plain", "Scan started");
+    if (commands.push(CommandType::TriggerScan, 0)) {
+      if (wakeLoop) wakeLoop();
+      req->send(202, "text/plain", "Scan started");
+    } else {
+      req->send(503, "text/plain", "Busy");
+    }
   });
 
+  // The body is handed to the main task as is; the outcome is broadcast as
+  // `config_saved` or the config is left unchanged
   server.on("/save", HTTP_POST, [](AsyncWebServerRequest* req) {
     req->send(400, "text/plain", "Use WebSocket");
   }, NULL, [this](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
     if (index == 0) {
+      if (total > JSON_CAPACITY) {
+        req->send(413, "text/plain", "Config too large");
+        return;
+      }
       req->_tempObject = new String();
+      static_cast<String*>(req->_tempObject)->reserve(total);
     }
     String* body = (String*)req->_tempObject;
-    for (size_t i = 0; i < len; i++) {
-      *body += (char)data[i];
-    }
+    if (!body) return;
+    body->concat(reinterpret_cast<const char*>(data), len);
     if (index + len == total) {
-      if (store.parseConfigPayload(*body) && store.save()) {
-        req->send(200, "text/plain", "Saved, rebooting");
-        delete body;
-        delay(500);
-        ESP.restart();
+      // The request frees _tempObject with free(); the queue owns the body now
+      req->_tempObject = nullptr;
+      if (commands.push(CommandType::SaveConfig, 0, body)) {
+        if (wakeLoop) wakeLoop();
+        req->send(202, "text/plain", "Saving, rebooting");
       } else {
-        req->send(400, "text/plain", "Invalid config");
-        delete body;
+        req->send(503, "text/plain", "Busy");
       }
     }
   });
@@ -171,21 +297,122 @@ void WebApp::setupRoutes() {
   });
 }
 
-String WebApp::buildStatusJson() {
-  JsonDocument doc;
+void WebApp::buildStatusJson(JsonObject doc) {
   bool wifi_ok = wifiUp ? wifiUp() : false;
   doc["wifi_connected"] = wifi_ok;
   doc["wifi_ip"] = wifi_ok && wifiIp ? wifiIp() : "";
   bool mqtt_ok = mqtt.isConnected() && wifi_ok;
   doc["mqtt_connected"] = mqtt_ok;
   doc["mqtt_reason"] = mqtt.reason();
-  String out;
-  serializeJson(doc, out);
-  return out;
+  if (wifiStats) {
+    WifiStats ws = wifiStats();
+    JsonObject w = doc["wifi"].to<JsonObject>();
+    w["state"] = ws.state;
+    w["captive"] = isCaptive ? isCaptive() : false;
+    w["attempts"] = ws.attempts;
+    w["reconnects"] = ws.reconnects;
+    w["last_reconnect_ms"] = ws.lastReconnectMs;
+    w["max_reconnect_ms"] = ws.maxReconnectMs;
+    w["next_retry_in_ms"] = ws.nextRetryInMs;
+  }
+  if (clusterStats) {
+    ClusterStats cs = clusterStats();
+    if (cs.enabled) {
+      JsonObject c = doc["cluster"].to<JsonObject>();
+      c["leader"] = cs.leader;
+      c["epoch"] = cs.epoch;
+      c["members"] = cs.members;
+      c["rebalances"] = cs.rebalances;
+    }
+  }
+  buildScanProgressJson(doc["scan"].to<JsonObject>());
+  DeadlineStats dl = scanner.deadlineStats();
+  JsonObject d = doc["deadlines"].to<JsonObject>();
+  d["jobs"] = dl.jobs;
+  d["misses"] = dl.misses;
+  d["last_late_ms"] = dl.lastLateMs;
+  d["max_late_ms"] = dl.maxLateMs;
+  d["queued"] = dl.queued;
+  d["next_due_in_ms"] = dl.nextDueInMs;
+  if (stepBudgetStats) {
+    StepBudgetStats sb = stepBudgetStats();
+    JsonObject b = doc["step_budget"].to<JsonObject>();
+    b["budget_us"] = sb.budgetUs;
+    b["target_p99_us"] = sb.targetUs;
+    b["window_p99_us"] = sb.windowP99Us;
+    b["increases"] = sb.increases;
+    b["decreases"] = sb.decreases;
+  }
+  if (passiveStats) {
+    PassiveStats ps = passiveStats();
+    JsonObject p = doc["passive"].to<JsonObject>();
+    p["listening"] = ps.listening;
+    p["mdns"] = ps.mdns;
+    p["ssdp"] = ps.ssdp;
+    p["dhcp"] = ps.dhcp;
+    p["malformed"] = ps.malformed;
+    p["sightings"] = ps.sightings;
+  }
+  if (eventLoopStats) {
+    EventLoopStats el = eventLoopStats();
+    JsonObject e = doc["event_loop"].to<JsonObject>();
+    e["idle_pct"] = el.idlePct;
+    e["wakeups"] = el.wakeups;
+    e["timer_wakeups"] = el.timerWakeups;
+    e["wifi_wakeups"] = el.wifiWakeups;
+    e["socket_wakeups"] = el.socketWakeups;
+    e["web_wakeups"] = el.webWakeups;
+    e["busy_passes"] = el.busyPasses;
+    e["light_sleep"] = el.lightSleep;
+  }
+  if (bootTimeline) bootTimeline().writeJson(doc["boot"].to<JsonObject>());
+  WsOutboxStats wsStats = outbox.stats();
+  JsonObject w = doc["ws"].to<JsonObject>();
+  w["clients"] = wsStats.clients;
+  w["queued_bytes"] = wsStats.queuedBytes;
+  w["max_queued_bytes"] = wsStats.maxQueuedBytes;
+  w["sent"] = wsStats.sent;
+  w["coalesced"] = wsStats.coalesced;
+  w["dropped"] = wsStats.dropped;
+  w["downgrades"] = wsStats.downgrades;
+  w["disconnects"] = wsStats.disconnects;
+  w["rejected"] = wsStats.rejected;
+  JsonArray queues = w["queues"].to<JsonArray>();
+  for (uint8_t i = 0; i < wsStats.clients; i++) {
+    const WsClientStats &cs = wsStats.perClient[i];
+    JsonObject q = queues.add<JsonObject>();
+    q["id"] = cs.id;
+    q["bytes"] = cs.queuedBytes;
+    q["frames"] = cs.queuedFrames;
+    q["strikes"] = cs.strikes;
+    q["downgraded"] = cs.downgraded;
+  }
+  JsonObject l = doc["log"].to<JsonObject>();
+  l["written"] = logger.written();
+  l["dropped"] = logger.dropped();
+  CommandQueueStats cmd = commands.stats();
+  JsonObject c = doc["commands"].to<JsonObject>();
+  c["queued"] = cmd.queued;
+  c["executed"] = cmd.executed;
+  c["rejected"] = cmd.rejected;
+  c["pending"] = cmd.pending;
+  c["max_wait_ms"] = cmd.maxWaitMs;
+#if OVERWATCH_INSTRUMENTATION
+  instrumentation.writeJson(doc["perf"].to<JsonObject>(), true);
+#endif
+  JsonObject arenas = doc["arena"].to<JsonObject>();
+  ArenaAllocator* pools[] = { &loopArena, &webArena };
+  const char* names[] = { "loop", "web" };
+  for (uint8_t i = 0; i < 2; i++) {
+    ArenaStats st = pools[i]->stats();
+    JsonObject a = arenas[names[i]].to<JsonObject>();
+    a["capacity"] = st.capacity;
+    a["high_water"] = st.highWater;
+    a["fallbacks"] = st.fallbacks;
+  }
 }
 
-String WebApp::buildConfigJson() {
-  JsonDocument doc;
+void WebApp::buildConfigJson(JsonObject doc) {
   const Config& cfg = store.data();
   doc["wifi_ssid"] = cfg.wifi_ssid;
   doc["wifi_pass"] = cfg.wifi_pass;
@@ -194,12 +421,17 @@ String WebApp::buildConfigJson() {
   doc["mqtt_user"] = cfg.mqtt_user;
   doc["mqtt_pass"] = cfg.mqtt_pass;
   doc["scan_interval_ms"] = cfg.scan_interval_ms;
+  doc["offline_grace_scans"] = cfg.offline_grace_scans;
+  doc["offline_expire_scans"] = cfg.offline_expire_scans;
+  doc["cluster_enabled"] = cfg.cluster_enabled;
+  doc["passive_discovery"] = cfg.passive_discovery;
 
   JsonArray subs = doc["subnets"].to<JsonArray>();
   for (const auto& s : cfg.subnets) {
     JsonObject o = subs.add<JsonObject>();
     o["cidr"] = s.cidr;
     o["name"] = s.name;
+    if (s.interval_ms) o["interval_ms"] = s.interval_ms;
   }
 
   JsonArray hosts = doc["static_hosts"].to<JsonArray>();
@@ -207,53 +439,353 @@ String WebApp::buildConfigJson() {
     JsonObject o = hosts.add<JsonObject>();
     o["ip"] = h.ip;
     o["port"] = h.port;
+    if (h.ports.size() > 1) {
+      JsonArray ports = o["ports"].to<JsonArray>();
+      for (uint16_t p : h.ports) ports.add(p);
+    }
     o["name"] = h.name;
+    if (h.interval_ms) o["interval_ms"] = h.interval_ms;
+    if (h.check != ServiceKind::None) {
+      o["check"] = findServiceProbe(h.check)->name();
+      if (h.check_arg.length()) o["check_arg"] = h.check_arg;
+    }
   }
-
-  String out;
-  serializeJson(doc, out);
-  return out;
 }
 
-String WebApp::buildScanResultsJson() {
-  JsonDocument doc;
+void WebApp::buildScanResultsJson(JsonObject doc) {
   doc["last_scan_ms"] = scanner.lastCompletedMs();
   doc["device_now_ms"] = millis();
   doc["found_count"] = scanner.foundCount();
 
+  const Config& cfg = store.data();
   JsonArray subs = doc["subnets"].to<JsonArray>();
   for (const auto& s : scanner.subnetResults()) {
+    if (s.subnet >= cfg.subnets.size()) continue;
+    // Sliced subnets are listed from their first slice; counts follow once all have run
+    const std::vector<SliceScanResult>& slices = scanner.sliceResults(s.subnet);
+    bool sliced = slices.size() > 1;
+    bool anySlice = std::any_of(slices.begin(), slices.end(), [](const SliceScanResult& r) { return r.completedMs; });
+    if (!s.completedMs && !(sliced && anySlice)) continue;
+    const Subnet& subnet = cfg.subnets[s.subnet];
     JsonObject o = subs.add<JsonObject>();
-    o["cidr"] = s.cidr;
-    o["online"] = s.online;
+    o["cidr"] = subnet.cidr;
+    if (subnet.name.length()) o["name"] = subnet.name;
+    if (s.completedMs) {
+      o["online"] = s.online;
+      o["found"] = s.found;
+      o["duration_ms"] = s.durationMs;
+    }
+    o["interval_ms"] = subnet.interval_ms ? subnet.interval_ms : cfg.scan_interval_ms;
+    if (!sliced) continue;
+    o["slices"] = slices.size();
+    o["next_slice"] = scanner.nextSlice(s.subnet);
+    JsonArray list = o["slice_results"].to<JsonArray>();
+    for (const auto& r : slices) {
+      JsonObject e = list.add<JsonObject>();
+      if (!r.completedMs) continue;
+      e["online"] = r.online;
+      e["found"] = r.found;
+      e["completed_ms"] = r.completedMs;
+      e["duration_ms"] = r.durationMs;
+    }
   }
 
   JsonArray hosts = doc["hosts"].to<JsonArray>();
   for (const auto& h : scanner.hostResults()) {
+    if (h.target >= cfg.static_hosts.size() || !(h.flags & HOST_PROBED)) continue;
+    const StaticHost& host = cfg.static_hosts[h.target];
     JsonObject o = hosts.add<JsonObject>();
-    o["ip"] = h.ip;
-    o["port"] = h.port;
-    o["name"] = h.name;
-    o["online"] = h.online;
+    o["ip"] = host.ip;
+    o["port"] = h.port ? h.port : host.port;
+    o["name"] = host.name;
+    o["online"] = h.online();
+    if (h.online()) o["rtt_ms"] = h.rttMs;
+    if (h.lastSeenMs) o["last_seen_ms"] = h.lastSeenMs;
+    if (host.check != ServiceKind::None) {
+      o["check"] = findServiceProbe(host.check)->name();
+      o["latency_ms"] = h.rttMs;
+      o["code"] = h.code;
+    }
+  }
+
+  const ScanHeapStats& heap = scanner.heapStats();
+  JsonObject heapObj = doc["heap"].to<JsonObject>();
+  heapObj["scans"] = heap.scans;
+  heapObj["free_after_scan"] = heap.freeAfterScan;
+  heapObj["largest_after_scan"] = heap.largestAfterScan;
+  heapObj["min_largest_after_scan"] = heap.minLargestAfterScan;
+
+  const ScanRunStats& run = scanner.runStats();
+  if (run.durationMs) {
+    JsonObject runObj = doc["run"].to<JsonObject>();
+    runObj["duration_ms"] = run.durationMs;
+    runObj["probes"] = run.probes;
+    runObj["passive_skips"] = run.skipped;
+    runObj["arp_alive"] = run.arpAlive;
+    runObj["probes_per_s"] = run.probes * 1000.0f / run.durationMs;
+    runObj["publishes"] = run.publishes;
+    runObj["min_free_heap"] = run.minFreeHeap;
+  }
+
+  InventoryStats inv = scanner.inventoryStats();
+  JsonObject invObj = doc["inventory"].to<JsonObject>();
+  invObj["hosts"] = inv.hosts;
+  invObj["sweep"] = inv.sweep;
+  invObj["log_bytes"] = inv.logBytes;
+  invObj["appends"] = inv.appends;
+  invObj["compactions"] = inv.compactions;
+  invObj["untracked"] = inv.untracked;
+}
+
+// Subnets completed in the running cycle are those finished after it began
+void WebApp::buildScanProgressJson(JsonObject doc) {
+  const Config& cfg = store.data();
+  ScanProgress p = scanner.progress();
+  doc["scanning"] = p.active;
+  if (p.subnet < cfg.subnets.size()) {
+    doc["current_subnet"] = cfg.subnets[p.subnet].cidr;
+    if (p.slices > 1) {
+      doc["slice"] = p.slice;
+      doc["slices"] = p.slices;
+    }
+    doc["sweep_done"] = p.sweepDone;
+    doc["sweep_total"] = p.sweepTotal;
+  }
+  JsonArray done = doc["completed_subnets"].to<JsonArray>();
+  if (p.active) {
+    uint32_t since = millis() - p.elapsedMs;
+    for (const auto& s : scanner.subnetResults()) {
+      if (s.subnet < cfg.subnets.size() && s.completedMs && (int32_t)(s.completedMs - since) >= 0) {
+        done.add(cfg.subnets[s.subnet].cidr);
+      }
+    }
+  }
+  uint32_t total = p.cycleDone + p.remaining;
+  doc["done"] = p.cycleDone;
+  doc["remaining"] = p.remaining;
+  doc["progress_pct"] = total ? (uint32_t)((uint64_t)p.cycleDone * 100 / total) : 100;
+  doc["probes_per_s"] = p.probesPerS;
+  doc["addresses_per_s"] = p.addressesPerS;
+  doc["elapsed_ms"] = p.elapsedMs;
+  doc["eta_ms"] = p.etaMs;
+  doc["full_sweep_ms"] = p.fullSweepMs;
+}
+
+// Every host with its RTT series; sendHistory() trims it per request
+void WebApp::buildHistoryJson(JsonObject doc) {
+  uint32_t now = history.now();
+  doc["now_s"] = now;
+  JsonArray hosts = doc["hosts"].to<JsonArray>();
+  for (const auto& host : store.data().static_hosts) {
+    const HostHistory* h = history.find(host.ip);
+    if (!h) continue;
+    JsonObject o = hosts.add<JsonObject>();
+    o["ip"] = host.ip;
+    o["name"] = host.name;
+    o["online"] = h->online;
+    o["last_seen_ago_s"] = now - h->lastObsS;
+    float day = history.uptime(*h, 24);
+    float week = history.uptime(*h, HISTORY_HOURS);
+    if (day >= 0) o["uptime_24h"] = day * 100;
+    if (week >= 0) o["uptime_7d"] = week * 100;
+
+    Outage outages[HISTORY_TRANSITIONS / 2];
+    size_t n = history.outages(*h, HISTORY_HOURS * 3600UL, outages, HISTORY_TRANSITIONS / 2);
+    JsonArray list = o["outages"].to<JsonArray>();
+    for (size_t i = 0; i < n; i++) {
+      JsonObject e = list.add<JsonObject>();
+      e["start_ago_s"] = now - outages[i].startS;
+      e["duration_s"] = outages[i].durationS;
+      if (outages[i].ongoing) e["ongoing"] = true;
+    }
+
+    JsonArray rtt = o["rtt_ms"].to<JsonArray>();
+    for (uint8_t k = 0; k < HISTORY_RTT_SLOTS; k++) rtt.add(history.rttAgo(*h, k));
   }
+}
+
+// Runs on the main task, on the status broadcast cadence and after saves.
+// The config only changes through commands, so it is rendered there.
+void WebApp::refreshSnapshots() {
+  renderSnapshot(statusSnapshot, &WebApp::buildStatusJson);
+  renderSnapshot(scanResultsSnapshot, &WebApp::buildScanResultsJson);
+  renderSnapshot(historySnapshot, &WebApp::buildHistoryJson);
+}
 
-  String out;
+void WebApp::renderSnapshot(JsonSnapshot& snapshot, JsonBuilder build) {
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  (this->*build)(doc.to<JsonObject>());
+  snapshot.store(doc);
+}
+
+// The response holds a reference to the snapshot text and copies from it as
+// AsyncTCP asks for more, so a refresh meanwhile does not disturb it
+void WebApp::sendSnapshot(AsyncWebServerRequest* req, const JsonSnapshot& snapshot) {
+  SnapshotText text = snapshot.load();
+  if (!text) {
+    req->send(503, "text/plain", "Starting");
+    return;
+  }
+  req->send(req->beginResponse("application/json", text->size(), [text](uint8_t* out, size_t maxLen, size_t index) -> size_t {
+    size_t n = std::min(maxLen, text->size() - index);
+    memcpy(out, text->data() + index, n);
+    return n;
+  }));
+}
+
+// Uptime and outages per static host; `?ip=` limits it to one host and keeps
+// its 24 h RTT series. Works on a parsed copy of the snapshot.
+void WebApp::sendHistory(AsyncWebServerRequest* req) {
+  String ip = req->hasParam("ip") ? req->getParam("ip")->value() : String();
+  SnapshotText text = historySnapshot.load();
+  ArenaScope scope(webArena);
+  JsonDocument doc(&webArena);
+  if (!text || deserializeJson(doc, text->data(), text->size())) {
+    req->send(503, "text/plain", "Starting");
+    return;
+  }
+  JsonArray hosts = doc["hosts"];
+  for (size_t i = hosts.size(); i-- > 0;) {
+    JsonObject h = hosts[i];
+    if (!ip.length()) h.remove("rtt_ms");
+    else if (ip != h["ip"].as<const char*>()) hosts.remove(i);
+  }
+  AsyncResponseStream* response = req->beginResponseStream("application/json");
+  serializeJson(doc, *response);
+  req->send(response);
+}
+
+// Runs on the main task, answering `get_all`
+void WebApp::sendWs(uint32_t clientId, const char* type, JsonBuilder build) {
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["type"] = type;
+  (this->*build)(doc["data"].to<JsonObject>());
+  ArenaString out(loopArena);
+  serializeJson(doc, out);
+  outbox.send(clientId, out.c_str(), out.length());
+}
+
+// Broadcasts run on the loop task and therefore use the loop arena
+void WebApp::broadcastJson(WsChannel channel, const char* type, JsonBuilder build) {
+  ArenaScope scope(loopArena);
+  JsonDocument doc(&loopArena);
+  doc["type"] = type;
+  (this->*build)(doc["data"].to<JsonObject>());
+  ArenaString out(loopArena);
   serializeJson(doc, out);
-  return out;
+  outbox.publish(channel, out.c_str(), out.length());
 }
 
-void WebApp::broadcastJson(const String& type, const String& data) {
-  ws.textAll("{\"type\":\"" + type + "\",\"data\":" + data + "}");
+// A subscriber's level only filters its own stream; the serial level is
+// left alone and the logger captures up to the most verbose subscriber
+bool WebApp::subscribeLogs(uint32_t clientId, LogLevel level) {
+  bool ok = false;
+  for (uint8_t i = 0; i < MAX_LOG_CLIENTS && !ok; i++) {
+    if (logClients[i].load() == clientId) {
+      logLevels[i].store(static_cast<uint8_t>(level));
+      ok = true;
+    }
+  }
+  for (uint8_t i = 0; i < MAX_LOG_CLIENTS && !ok; i++) {
+    uint32_t expected = 0;
+    if (logClients[i].compare_exchange_strong(expected, clientId)) {
+      logLevels[i].store(static_cast<uint8_t>(level));
+      ok = true;
+    }
+  }
+  updateStreamLevel();
+  return ok;
+}
+
+void WebApp::unsubscribeLogs(uint32_t clientId) {
+  for (uint8_t i = 0; i < MAX_LOG_CLIENTS; i++) {
+    uint32_t expected = clientId;
+    if (logClients[i].compare_exchange_strong(expected, 0)) logLevels[i].store(0);
+  }
+  updateStreamLevel();
+}
+
+void WebApp::updateStreamLevel() {
+  uint8_t widest = static_cast<uint8_t>(LogLevel::Error);
+  for (auto &l : logLevels) widest = std::max(widest, l.load());
+  logger.setStreamLevel(static_cast<LogLevel>(widest));
+}
+
+// Runs on the log drain task. The frame is built in a fixed buffer to keep
+// that task's stack and the heap out of it.
+void WebApp::streamLog(LogLevel level, uint32_t timestampMs, const char* line) {
+  uint32_t ids[MAX_LOG_CLIENTS];
+  bool any = false;
+  for (uint8_t i = 0; i < MAX_LOG_CLIENTS; i++) {
+    ids[i] = logClients[i].load();
+    if (static_cast<uint8_t>(level) > logLevels[i].load()) ids[i] = 0;
+    any = any || ids[i];
+  }
+  if (!any) return;
+
+  char out[LOG_FRAME_BYTES];
+  size_t pos = snprintf(out, sizeof(out), "{\"type\":\"log\",\"data\":{\"ts\":%lu,\"level\":\"%s\",\"msg\":\"",
+                        (unsigned long)timestampMs, Logger::levelName(level));
+  // Escapes take up to 6 bytes; the closing `"}}` needs 3 more
+  for (const char* p = line; *p && pos + 10 < sizeof(out); p++) {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      out[pos++] = '\\';
+      out[pos++] = c;
+    } else if (c < 0x20) {
+      pos += snprintf(out + pos, sizeof(out) - pos, "\\u%04x", c);
+    } else {
+      out[pos++] = c;
+    }
+  }
+  memcpy(out + pos, "\"}}", 3);
+  pos += 3;
+  for (uint32_t id : ids) {
+    if (id) outbox.send(id, out, pos, true);
+  }
 }
 
 void WebApp::broadcastStatus() {
-  broadcastJson("status", buildStatusJson());
+  broadcastJson(WsChannel::Status, "status", &WebApp::buildStatusJson);
 }
 
 void WebApp::broadcastScanResults() {
-  broadcastJson("scan_results", buildScanResultsJson());
+  broadcastJson(WsChannel::ScanResults, "scan_results", &WebApp::buildScanResultsJson);
+  renderSnapshot(scanResultsSnapshot, &WebApp::buildScanResultsJson);
+}
+
+void WebApp::broadcastScanProgress() {
+  broadcastJson(WsChannel::ScanProgress, "scan_progress", &WebApp::buildScanProgressJson);
 }
 
-void WebApp::triggerScan() {
-  scanner.start();
+// Runs commands queued by web handlers, then hands queued frames to clients
+// with room in flight. AsyncWebSocket only frees disconnected clients when
+// asked, so that happens here too. A scheduled reboot waits for the replies.
+void WebApp::loop() {
+  Command cmd;
+  while (commands.pop(cmd)) {
+    runCommand(cmd);
+    commands.done(cmd);
+  }
+  outbox.pump();
+  unsigned long now = millis();
+  if (rebootAtMs && (int32_t)(now - rebootAtMs) >= 0) ESP.restart();
+  if (now - lastCleanupMs >= 1000) {
+    ws.cleanupClients(WS_MAX_CLIENTS);
+    lastCleanupMs = now;
+  }
 }
+
+uint32_t WebApp::wakeInMs() const {
+  if (commands.pending()) return 0;
+  uint32_t wait = outbox.pending() ? WS_PUMP_MS : UINT32_MAX;
+  if (rebootAtMs) {
+    int32_t in = (int32_t)(rebootAtMs - millis());
+    uint32_t reboot = in > 0 ? in : 0;
+    if (reboot < wait) wait = reboot;
+  }
+  return wait;
+}
+
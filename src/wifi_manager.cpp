@@ -1,62 +1,165 @@
 #include "wifi_manager.h"
+#include "logger.h"
+#include "target_set.h"
 
-constexpr uint16_t WifiManager::DNS_PORT;
+namespace {
+  const uint32_t CONNECT_TIMEOUT_MS = 15000;
+  const uint32_t RETRY_BACKOFF_MIN_MS = 5000;
+  const uint32_t RETRY_BACKOFF_MAX_MS = 300000;
+  const uint8_t PORTAL_AFTER_FAILURES = 1;
+  const uint32_t PORTAL_HOLD_MAX_MS = 600000;  // a phone left associated must not stall retries
+}
 
-WifiManager::WifiManager(Config& cfg) : config(cfg) {}
+WifiManager::WifiManager(Config& cfg, uint16_t port) : config(cfg), dnsPort(port) {}
 
 void WifiManager::begin()
 {
-  ensureConnected();
+  WiFi.onEvent([this](arduino_event_id_t, arduino_event_info_t) { linkLost = true; },
+               ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  disconnectedAtMs = millis();
+  if (!config.wifi_ssid.length()) {
+    LOG_INFO("No WiFi credentials, starting captive portal");
+    startCaptivePortal();
+    return;
+  }
+  WiFi.mode(WIFI_STA);
+  beginAttempt();
 }
 
-bool WifiManager::connectWifi()
+void WifiManager::beginAttempt()
 {
-  if (!config.wifi_ssid.length()) return false;
-  WiFi.mode(WIFI_STA);
+  attempts++;
+  attemptStartMs = millis();
+  linkLost = false;
+  state = State::Connecting;
+  WiFi.disconnect();
   WiFi.begin(config.wifi_ssid.c_str(), config.wifi_pass.c_str());
-  for (uint8_t i = 0; i < MAX_WIFI_RETRIES; i++) {
-    if (WiFi.status() == WL_CONNECTED) return true;
-    delay(500);
-  }
-  return WiFi.status() == WL_CONNECTED;
+}
+
+void WifiManager::onConnected()
+{
+  unsigned long now = millis();
+  lastReconnectMs = now - disconnectedAtMs;
+  if (lastReconnectMs > maxReconnectMs) maxReconnectMs = lastReconnectMs;
+  if (everConnected) reconnects++;
+  everConnected = true;
+  failedAttempts = 0;
+  linkLost = false;
+  state = State::Connected;
+  LOG_INFO("WiFi connected: {} after {} ms", WiFi.localIP(), lastReconnectMs);
+  if (captive) stopCaptivePortal();
+}
+
+void WifiManager::onAttemptFailed()
+{
+  failedAttempts++;
+  uint32_t shift = failedAttempts > 6 ? 6 : failedAttempts - 1;
+  uint32_t backoff = RETRY_BACKOFF_MIN_MS << shift;
+  if (backoff > RETRY_BACKOFF_MAX_MS) backoff = RETRY_BACKOFF_MAX_MS;
+  retryAtMs = millis() + backoff;
+  state = State::Backoff;
+  LOG_WARN("WiFi connect failed, retry in {} ms", backoff);
+  if (!captive && failedAttempts >= PORTAL_AFTER_FAILURES) startCaptivePortal();
 }
 
 void WifiManager::startCaptivePortal()
 {
   captive = true;
-  WiFi.mode(WIFI_AP);
+  // Keep the STA interface up so background retries can run alongside the portal
+  WiFi.mode(config.wifi_ssid.length() ? WIFI_AP_STA : WIFI_AP);
   WiFi.softAP("ESP32NetMon", "esp32config");
   IPAddress apIP(192, 168, 4, 1);
   IPAddress net(255, 255, 255, 0);
   WiFi.softAPConfig(apIP, apIP, net);
-  dns.start(DNS_PORT, "*", apIP);
-  Serial.println("Captive portal at http://192.168.4.1");
+  dns.start(dnsPort, ipToInt(apIP));
+  LOG_INFO("Captive portal at http://192.168.4.1");
 }
 
-void WifiManager::ensureConnected()
+void WifiManager::stopCaptivePortal()
 {
-  if (WiFi.status() == WL_CONNECTED) {
-    if (!lastWifiConnected) {
-      Serial.print("WiFi connected: ");
-      Serial.println(WiFi.localIP());
+  dns.stop();
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  captive = false;
+  LOG_INFO("Captive portal stopped");
+}
+
+void WifiManager::loop()
+{
+  if (captive) dns.drain();
+  unsigned long now = millis();
+
+  switch (state) {
+    case State::Idle:
+      break;
+    case State::Connecting:
+      if (WiFi.status() == WL_CONNECTED) onConnected();
+      else if (now - attemptStartMs >= CONNECT_TIMEOUT_MS) onAttemptFailed();
+      break;
+    case State::Connected:
+      if (linkLost || WiFi.status() != WL_CONNECTED) {
+        LOG_WARN("WiFi link lost");
+        disconnectedAtMs = now;
+        beginAttempt();
+      }
+      break;
+    case State::Backoff: {
+      // The core may re-associate on its own between attempts; keep that link
+      if (WiFi.status() == WL_CONNECTED) {
+        onConnected();
+        break;
+      }
+      long overdue = static_cast<long>(now - retryAtMs);
+      if (overdue < 0) break;
+      // Channel hopping during a retry would drop a phone using the portal
+      if (captive && overdue < static_cast<long>(PORTAL_HOLD_MAX_MS) && WiFi.softAPgetStationNum() > 0) break;
+      beginAttempt();
+      break;
     }
-    lastWifiConnected = true;
-    return;
   }
-  lastWifiConnected = false;
-  if (captive) return;
-  if (!connectWifi()) {
-    Serial.println("WiFi connect failed, starting captive portal");
-    startCaptivePortal();
+}
+
+WifiStats WifiManager::stats() const
+{
+  WifiStats s;
+  switch (state) {
+    case State::Idle: s.state = captive ? "portal" : "idle"; break;
+    case State::Connecting: s.state = "connecting"; break;
+    case State::Connected: s.state = "connected"; break;
+    case State::Backoff: s.state = "backoff"; break;
   }
+  s.attempts = attempts;
+  s.reconnects = reconnects;
+  s.lastReconnectMs = lastReconnectMs;
+  s.maxReconnectMs = maxReconnectMs;
+  if (state == State::Backoff) {
+    long remaining = static_cast<long>(retryAtMs - millis());
+    s.nextRetryInMs = remaining > 0 ? remaining : 0;
+  }
+  return s;
 }
 
-void WifiManager::loop()
+// Link changes and portal clients leaving arrive as Wi-Fi events and portal
+// DNS queries through the socket watcher, so only timeouts need a timer
+uint32_t WifiManager::wakeInMs() const
 {
-  if (captive) dns.processNextRequest();
-  ensureConnected();
+  unsigned long now = millis();
+  long remaining;
+  switch (state) {
+    case State::Connecting:
+      remaining = static_cast<long>(attemptStartMs + CONNECT_TIMEOUT_MS - now);
+      break;
+    case State::Backoff:
+      remaining = static_cast<long>(retryAtMs - now);
+      if (remaining <= 0 && captive && WiFi.softAPgetStationNum() > 0) remaining += PORTAL_HOLD_MAX_MS;
+      break;
+    default:
+      return UINT32_MAX;
+  }
+  return remaining > 0 ? remaining : 0;
 }
 
 bool WifiManager::isCaptive() const { return captive; }
-bool WifiManager::isWifiUp() const { return WiFi.status() == WL_CONNECTED && !captive; }
+int WifiManager::dnsSocketFd() const { return dns.socketFd(); }
+bool WifiManager::isWifiUp() const { return state == State::Connected && WiFi.status() == WL_CONNECTED; }
 String WifiManager::ip() const { return isWifiUp() ? WiFi.localIP().toString() : ""; }
@@ -0,0 +1,272 @@
+#include "ws_outbox.h"
+#include "logger.h"
+
+namespace {
+  struct Guard {
+    explicit Guard(SemaphoreHandle_t m) : mutex(m) { if (mutex) xSemaphoreTake(mutex, portMAX_DELAY); }
+    ~Guard() { if (mutex) xSemaphoreGive(mutex); }
+    SemaphoreHandle_t mutex;
+  };
+
+  const uint8_t SCAN_PROGRESS = static_cast<uint8_t>(WsChannel::ScanProgress);
+  const uint8_t SCAN_RESULTS = static_cast<uint8_t>(WsChannel::ScanResults);
+}
+
+WsOutbox::WsOutbox(AsyncWebSocket& socket) : ws(socket) {}
+
+void WsOutbox::begin(std::function<void()> wake)
+{
+  lock = xSemaphoreCreateMutex();
+  wakePump = std::move(wake);
+}
+
+AsyncWebSocketSharedBuffer WsOutbox::makeBuffer(const char* data, size_t len)
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  return std::make_shared<std::vector<uint8_t>>(bytes, bytes + len);
+}
+
+WsOutbox::Client* WsOutbox::find(uint32_t id)
+{
+  if (!id) return nullptr;
+  for (auto &c : clients) {
+    if (c.id == id) return &c;
+  }
+  return nullptr;
+}
+
+void WsOutbox::reset(Client& c)
+{
+  c = Client();
+}
+
+bool WsOutbox::open(uint32_t id)
+{
+  Guard g(lock);
+  if (find(id)) return true;
+  for (auto &c : clients) {
+    if (c.id) continue;
+    reset(c);
+    c.id = id;
+    return true;
+  }
+  counters.rejected++;
+  return false;
+}
+
+void WsOutbox::close(uint32_t id)
+{
+  Guard g(lock);
+  Client* c = find(id);
+  if (c) reset(*c);
+}
+
+// An empty queue always takes one frame, however large, so a big result set
+// cannot lock a client out
+bool WsOutbox::admit(Client& c, size_t len, size_t freed, bool lossy)
+{
+  uint32_t after = c.bytes - freed;
+  if (!after || after + len <= WS_CLIENT_QUEUE_BYTES) return true;
+  refuse(c, lossy);
+  return false;
+}
+
+// Lossy frames (log lines) are dropped quietly; anything else counts
+// against the client
+void WsOutbox::refuse(Client& c, bool lossy)
+{
+  counters.dropped++;
+  if (lossy || c.struck) return;
+  c.struck = true;
+  c.strikes++;
+  if (!c.downgraded) {
+    c.downgraded = true;
+    counters.downgrades++;
+    LOG_WARN("WebSocket client {} is slow, scan progress paused", c.id);
+  }
+  if (c.strikes >= WS_DROP_STRIKES) c.closing = true;
+}
+
+void WsOutbox::publish(WsChannel channel, const char* data, size_t len)
+{
+  if (!len) return;
+  AsyncWebSocketSharedBuffer buffer = makeBuffer(data, len);
+  uint8_t slot = static_cast<uint8_t>(channel);
+  bool started = false;
+  {
+    Guard g(lock);
+    uint32_t now = millis();
+    for (auto &c : clients) {
+      if (!c.id || c.closing || (slot == SCAN_PROGRESS && c.downgraded)) continue;
+      size_t freed = c.latest[slot] ? c.latest[slot]->size() : 0;
+      // Results end a scan, so progress still waiting is stale too
+      bool dropProgress = slot == SCAN_RESULTS && c.latest[SCAN_PROGRESS];
+      if (dropProgress) freed += c.latest[SCAN_PROGRESS]->size();
+      if (!admit(c, len, freed, false)) continue;
+      if (c.latest[slot]) counters.coalesced++;
+      if (dropProgress) {
+        c.latest[SCAN_PROGRESS].reset();
+        counters.coalesced++;
+      }
+      if (!c.bytes) {
+        c.lastProgressMs = now;
+        started = true;
+      }
+      c.bytes = c.bytes - freed + len;
+      c.latest[slot] = buffer;
+      if (c.bytes > counters.maxQueuedBytes) counters.maxQueuedBytes = c.bytes;
+    }
+  }
+  if (started && wakePump) wakePump();
+}
+
+// Returns true when the frame was queued for a client with nothing pending,
+// the only case where the main task needs waking
+bool WsOutbox::pushEvent(Client& c, const AsyncWebSocketSharedBuffer& buffer, bool lossy)
+{
+  if (c.closing) return false;
+  if (c.count >= WS_CLIENT_EVENTS) {
+    refuse(c, lossy);
+    return false;
+  }
+  if (!admit(c, buffer->size(), 0, lossy)) return false;
+  bool started = !c.bytes;
+  if (started) c.lastProgressMs = millis();
+  c.events[(c.head + c.count) % WS_CLIENT_EVENTS] = buffer;
+  c.count++;
+  c.bytes += buffer->size();
+  if (c.bytes > counters.maxQueuedBytes) counters.maxQueuedBytes = c.bytes;
+  return started;
+}
+
+void WsOutbox::broadcast(const char* data, size_t len)
+{
+  if (!len) return;
+  AsyncWebSocketSharedBuffer buffer = makeBuffer(data, len);
+  bool started = false;
+  {
+    Guard g(lock);
+    for (auto &c : clients) {
+      if (c.id && pushEvent(c, buffer, false)) started = true;
+    }
+  }
+  if (started && wakePump) wakePump();
+}
+
+void WsOutbox::send(uint32_t id, const char* data, size_t len, bool lossy)
+{
+  if (!len) return;
+  AsyncWebSocketSharedBuffer buffer = makeBuffer(data, len);
+  bool started;
+  {
+    Guard g(lock);
+    Client* c = find(id);
+    if (!c) return;
+    started = pushEvent(*c, buffer, lossy);
+  }
+  if (started && wakePump) wakePump();
+}
+
+// Ordered events go first, then the newest copy of each channel
+AsyncWebSocketSharedBuffer WsOutbox::popNext(Client& c)
+{
+  AsyncWebSocketSharedBuffer next;
+  if (c.count) {
+    next = std::move(c.events[c.head]);
+    c.head = (c.head + 1) % WS_CLIENT_EVENTS;
+    c.count--;
+  } else {
+    for (auto &slot : c.latest) {
+      if (!slot) continue;
+      next = std::move(slot);
+      slot.reset();
+      break;
+    }
+  }
+  if (next) c.bytes -= next->size();
+  return next;
+}
+
+void WsOutbox::pump()
+{
+  uint32_t ids[WS_MAX_CLIENTS];
+  uint8_t n = 0;
+  {
+    Guard g(lock);
+    for (auto &c : clients) {
+      if (c.id && (c.bytes || c.closing)) ids[n++] = c.id;
+    }
+  }
+  for (uint8_t i = 0; i < n; i++) pumpClient(ids[i]);
+}
+
+// Library calls stay outside the lock: AsyncWebSocket runs our event
+// handler, which takes the lock, while holding its own
+void WsOutbox::pumpClient(uint32_t id)
+{
+  AsyncWebSocketClient* client = ws.client(id);
+  if (!client) {
+    close(id);
+    return;
+  }
+  if (client->status() != WS_CONNECTED) return;
+  size_t inFlight = client->queueLen();
+
+  AsyncWebSocketSharedBuffer batch[WS_CLIENT_INFLIGHT];
+  uint8_t n = 0;
+  bool drop = false;
+  {
+    Guard g(lock);
+    Client* c = find(id);
+    if (!c) return;
+    uint32_t now = millis();
+    while (!c->closing && inFlight + n < WS_CLIENT_INFLIGHT) {
+      batch[n] = popNext(*c);
+      if (!batch[n]) break;
+      n++;
+    }
+    if (n) {
+      c->lastProgressMs = now;
+      c->struck = false;
+    } else if (c->bytes && now - c->lastProgressMs >= WS_STALL_MS) c->closing = true;
+    counters.sent += n;
+    if (c->closing) {
+      drop = true;
+      counters.disconnects++;
+      reset(*c);
+    }
+  }
+  if (drop) {
+    LOG_WARN("WebSocket client {} closed: not keeping up", id);
+    client->close();
+    return;
+  }
+  for (uint8_t i = 0; i < n; i++) client->text(batch[i]);
+}
+
+bool WsOutbox::pending() const
+{
+  Guard g(lock);
+  for (const auto &c : clients) {
+    if (c.id && (c.bytes || c.closing)) return true;
+  }
+  return false;
+}
+
+WsOutboxStats WsOutbox::stats() const
+{
+  Guard g(lock);
+  WsOutboxStats s = counters;
+  for (const auto &c : clients) {
+    if (!c.id) continue;
+    WsClientStats &cs = s.perClient[s.clients++];
+    cs.id = c.id;
+    cs.queuedBytes = c.bytes;
+    cs.queuedFrames = c.count;
+    for (const auto &slot : c.latest) cs.queuedFrames += slot ? 1 : 0;
+    cs.strikes = c.strikes;
+    cs.downgraded = c.downgraded;
+    s.queuedBytes += c.bytes;
+  }
+  return s;
+}
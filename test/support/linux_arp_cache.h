@@ -0,0 +1,67 @@
+#pragma once
+// The Linux kernel's neighbour table as an ArpCache, so ARP sweeps can run
+// against a real link in host tests. Requests are empty UDP datagrams to the
+// discard port, which make the kernel resolve the address; resolved() reads
+// complete entries from /proc/net/arp, the table `ip neigh` shows.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include "platform.h"
+
+class LinuxArpCache : public ArpCache {
+public:
+  bool request(uint32_t first, uint8_t count) override
+  {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return false;
+    bool sent = true;
+    for (uint8_t i = 0; i < count; i++) {
+      sockaddr_in to = {};
+      to.sin_family = AF_INET;
+      to.sin_port = htons(9);
+      to.sin_addr.s_addr = htonl(first + i);
+      sent = sendto(fd, "", 0, MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&to), sizeof(to)) == 0 && sent;
+    }
+    close(fd);
+    return sent;
+  }
+
+  uint8_t resolved(uint32_t first, uint8_t count) override
+  {
+    uint8_t mask = 0;
+    FILE* f = fopen("/proc/net/arp", "r");
+    if (!f) return 0;
+    char line[256];
+    fgets(line, sizeof(line), f);  // header
+    while (fgets(line, sizeof(line), f)) {
+      char ip[32];
+      unsigned flags = 0;
+      if (sscanf(line, "%31s %*s %x", ip, &flags) != 2) continue;
+      in_addr addr;
+      if (!inet_aton(ip, &addr)) continue;
+      uint32_t a = ntohl(addr.s_addr);
+      // ATF_COM: the entry has a hardware address
+      if (a >= first && a - first < count && (flags & 0x2)) mask |= 1 << (a - first);
+    }
+    fclose(f);
+    return mask;
+  }
+
+  // The IPv4 default gateway, or 0 without one
+  static uint32_t defaultGateway()
+  {
+    FILE* f = fopen("/proc/net/route", "r");
+    if (!f) return 0;
+    char line[256];
+    uint32_t gateway = 0;
+    fgets(line, sizeof(line), f);
+    while (!gateway && fgets(line, sizeof(line), f)) {
+      unsigned dest = 0, gw = 0;
+      if (sscanf(line, "%*s %x %x", &dest, &gw) == 2 && dest == 0 && gw) gateway = ntohl(gw);
+    }
+    fclose(f);
+    return gateway;
+  }
+};
@@ -0,0 +1,323 @@
+#pragma once
+#include <Arduino.h>
+#include <Client.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// MQTT 3.1.1 broker for native tests, reached through in-memory links rather
+// than sockets. Packets are handled as soon as a client writes them, so a
+// publish is queued at every subscriber before publish() returns; each
+// subscriber sees it on its next loop(). QoS 0 only. Retained messages,
+// wills and client id takeover behave as on a real broker.
+class StandInBroker;
+
+class BrokerLink : public Client {
+public:
+  explicit BrokerLink(StandInBroker& b) : broker(b) {}
+  ~BrokerLink() override;
+
+  int connect(IPAddress, uint16_t) override { return open(); }
+  int connect(const char*, uint16_t) override { return open(); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t n) override;
+  int available() override { return socketOpen ? static_cast<int>(inbox.size()) : 0; }
+  int read() override;
+  int read(uint8_t* buf, size_t n) override;
+  int peek() override { return inbox.empty() ? -1 : inbox.front(); }
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override { return socketOpen; }
+  operator bool() override { return socketOpen; }
+  using Print::write;
+
+  // Drops the connection without DISCONNECT, as a node losing power does
+  void cut();
+
+private:
+  friend class StandInBroker;
+  int open();
+
+  StandInBroker& broker;
+  bool socketOpen = false;
+  bool session = false;
+  std::string clientId;
+  std::string willTopic;
+  std::string willPayload;
+  bool willRetain = false;
+  std::vector<std::string> filters;
+  std::vector<uint8_t> pending;  // bytes of a packet not yet complete
+  std::deque<uint8_t> inbox;     // bytes for the client to read
+};
+
+class StandInBroker {
+public:
+  struct Message {
+    std::string from;
+    std::string topic;
+    std::string payload;
+    bool retained;
+  };
+
+  bool up = true;                           // connects fail while false
+  std::map<std::string, std::string> retained;
+  std::vector<Message> log;                 // every publish, wills included
+  bool record = true;                       // keep the log and retained messages;
+                                            // off for benchmarks that measure heap
+
+  size_t published(const std::string& topic) const
+  {
+    size_t n = 0;
+    for (const auto& m : log) n += m.topic == topic;
+    return n;
+  }
+
+  const std::string* retainedAt(const std::string& topic) const
+  {
+    auto it = retained.find(topic);
+    return it == retained.end() ? nullptr : &it->second;
+  }
+
+  static bool matches(const std::string& filter, const std::string& topic)
+  {
+    size_t f = 0, t = 0;
+    while (f < filter.size()) {
+      if (filter[f] == '#') return true;
+      if (filter[f] == '+') {
+        while (t < topic.size() && topic[t] != '/') t++;
+        f++;
+        continue;
+      }
+      if (t >= topic.size() || filter[f] != topic[t]) return false;
+      f++;
+      t++;
+    }
+    return t == topic.size();
+  }
+
+private:
+  friend class BrokerLink;
+
+  void attach(BrokerLink* link) { links.push_back(link); }
+  void detach(BrokerLink* link)
+  {
+    for (size_t i = 0; i < links.size(); i++) {
+      if (links[i] == link) links.erase(links.begin() + i);
+    }
+  }
+
+  void closeSession(BrokerLink& link, bool graceful)
+  {
+    if (!link.session) return;
+    link.session = false;
+    link.filters.clear();
+    if (!graceful && !link.willTopic.empty()) route(link.clientId, link.willTopic, link.willPayload, link.willRetain);
+  }
+
+  void route(const std::string& from, const std::string& topic, const std::string& payload, bool retain)
+  {
+    if (record) {
+      log.push_back({from, topic, payload, retain});
+      if (retain && payload.empty()) retained.erase(topic);
+      else if (retain) retained[topic] = payload;
+    }
+    for (BrokerLink* l : links) {
+      if (!l->session) continue;
+      for (const auto& f : l->filters) {
+        if (matches(f, topic)) {
+          deliver(*l, topic, payload, false);
+          break;
+        }
+      }
+    }
+  }
+
+  static void putLength(std::deque<uint8_t>& out, size_t n)
+  {
+    do {
+      uint8_t b = n % 128;
+      n /= 128;
+      out.push_back(n ? b | 0x80 : b);
+    } while (n);
+  }
+
+  static void deliver(BrokerLink& l, const std::string& topic, const std::string& payload, bool retain)
+  {
+    l.inbox.push_back(0x30 | (retain ? 1 : 0));
+    putLength(l.inbox, 2 + topic.size() + payload.size());
+    l.inbox.push_back(topic.size() >> 8);
+    l.inbox.push_back(topic.size() & 0xFF);
+    l.inbox.insert(l.inbox.end(), topic.begin(), topic.end());
+    l.inbox.insert(l.inbox.end(), payload.begin(), payload.end());
+  }
+
+  static std::string readString(const uint8_t*& p, const uint8_t* end)
+  {
+    if (end - p < 2) {
+      p = end;
+      return std::string();
+    }
+    size_t n = (p[0] << 8) | p[1];
+    p += 2;
+    if (static_cast<size_t>(end - p) < n) n = end - p;
+    std::string s(reinterpret_cast<const char*>(p), n);
+    p += n;
+    return s;
+  }
+
+  // Handles every complete packet buffered on the link
+  void receive(BrokerLink& l)
+  {
+    for (;;) {
+      std::vector<uint8_t>& in = l.pending;
+      size_t len = 0, shift = 0, pos = 1;
+      bool complete = false;
+      while (pos < in.size() && pos <= 4) {
+        len |= static_cast<size_t>(in[pos] & 0x7F) << shift;
+        shift += 7;
+        if (!(in[pos++] & 0x80)) {
+          complete = true;
+          break;
+        }
+      }
+      if (!complete || in.size() < pos + len) return;
+      std::vector<uint8_t> packet(in.begin(), in.begin() + pos + len);
+      in.erase(in.begin(), in.begin() + pos + len);
+      handle(l, packet[0], packet.data() + pos, packet.data() + pos + len);
+      if (!l.socketOpen) return;
+    }
+  }
+
+  void handle(BrokerLink& l, uint8_t header, const uint8_t* p, const uint8_t* end)
+  {
+    switch (header >> 4) {
+      case 1: {  // CONNECT
+        readString(p, end);  // protocol name
+        if (end - p < 4) return;
+        uint8_t flags = p[1];
+        p += 4;
+        l.clientId = readString(p, end);
+        l.willTopic.clear();
+        l.willPayload.clear();
+        if (flags & 0x04) {
+          l.willTopic = readString(p, end);
+          l.willPayload = readString(p, end);
+          l.willRetain = flags & 0x20;
+        }
+        for (BrokerLink* other : links) {
+          if (other != &l && other->session && other->clientId == l.clientId) {
+            closeSession(*other, true);
+            other->socketOpen = false;
+          }
+        }
+        l.session = true;
+        l.inbox.insert(l.inbox.end(), {0x20, 0x02, 0x00, 0x00});
+        break;
+      }
+      case 3: {  // PUBLISH
+        std::string topic = readString(p, end);
+        if ((header >> 1) & 0x03) p += 2;  // packet id
+        std::string payload(reinterpret_cast<const char*>(p), end - p);
+        route(l.clientId, topic, payload, header & 0x01);
+        break;
+      }
+      case 8: {  // SUBSCRIBE
+        uint8_t id[2] = {p[0], p[1]};
+        p += 2;
+        std::vector<std::string> added;
+        while (p < end) {
+          std::string filter = readString(p, end);
+          p++;  // requested QoS
+          l.filters.push_back(filter);
+          added.push_back(filter);
+        }
+        l.inbox.push_back(0x90);
+        putLength(l.inbox, 2 + added.size());
+        l.inbox.push_back(id[0]);
+        l.inbox.push_back(id[1]);
+        for (size_t i = 0; i < added.size(); i++) l.inbox.push_back(0x00);
+        for (const auto& f : added) {
+          for (const auto& r : retained) {
+            if (matches(f, r.first)) deliver(l, r.first, r.second, true);
+          }
+        }
+        break;
+      }
+      case 10: {  // UNSUBSCRIBE
+        uint8_t id[2] = {p[0], p[1]};
+        p += 2;
+        while (p < end) {
+          std::string filter = readString(p, end);
+          for (size_t i = 0; i < l.filters.size(); i++) {
+            if (l.filters[i] == filter) l.filters.erase(l.filters.begin() + i);
+          }
+        }
+        l.inbox.insert(l.inbox.end(), {0xB0, 0x02, id[0], id[1]});
+        break;
+      }
+      case 12:  // PINGREQ
+        l.inbox.insert(l.inbox.end(), {0xD0, 0x00});
+        break;
+      case 14:  // DISCONNECT
+        closeSession(l, true);
+        l.socketOpen = false;
+        break;
+    }
+  }
+
+  std::vector<BrokerLink*> links;
+};
+
+inline BrokerLink::~BrokerLink()
+{
+  cut();
+  broker.detach(this);
+}
+
+inline int BrokerLink::open()
+{
+  if (!broker.up) return 0;
+  broker.closeSession(*this, false);
+  broker.detach(this);
+  broker.attach(this);
+  socketOpen = true;
+  pending.clear();
+  inbox.clear();
+  return 1;
+}
+
+inline size_t BrokerLink::write(const uint8_t* buf, size_t n)
+{
+  if (!socketOpen) return 0;
+  pending.insert(pending.end(), buf, buf + n);
+  broker.receive(*this);
+  return n;
+}
+
+inline int BrokerLink::read()
+{
+  if (!available()) return -1;
+  uint8_t c = inbox.front();
+  inbox.pop_front();
+  return c;
+}
+
+inline int BrokerLink::read(uint8_t* buf, size_t n)
+{
+  size_t k = 0;
+  while (k < n && available()) buf[k++] = read();
+  return static_cast<int>(k);
+}
+
+inline void BrokerLink::stop()
+{
+  broker.closeSession(*this, false);
+  socketOpen = false;
+  inbox.clear();
+}
+
+inline void BrokerLink::cut()
+{
+  stop();
+}
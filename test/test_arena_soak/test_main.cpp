@@ -0,0 +1,228 @@
+// Long-run soak of transient JSON against a model of the ESP heap. The same
+// workload runs twice, building its documents on the heap and then in an
+// arena, while long-lived host records are allocated and freed in between.
+// The largest free block and the free bytes outside it, after each
+// iteration, show how far the heap fragments. Run `pio test -e native -f test_arena_soak -v` for the table.
+#include <Arduino.h>
+#include <unity.h>
+#include <map>
+#include <vector>
+#include "arena.h"
+
+namespace {
+  const size_t HEAP_BYTES = 160 * 1024;  // free heap of a connected C3
+  const size_t HEAP_ALIGN = 8;
+  const size_t SOAK_ARENA_BYTES = 32 * 1024;  // room for the largest document here
+  const uint32_t ITERATIONS = 20000;
+  const size_t LIVE_RECORDS = 400;
+
+  size_t alignUp(size_t n) { return (n + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1); }
+
+  // First-fit allocator over a fixed region with coalescing free blocks, as
+  // the ESP-IDF heap does. Fails instead of growing.
+  class SimHeap : public ArduinoJson::Allocator {
+  public:
+    SimHeap() : region(HEAP_BYTES) { freeBlocks[0] = HEAP_BYTES; }
+
+    void* allocate(size_t size) override
+    {
+      size_t need = alignUp(size ? size : 1);
+      for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+        if (it->second < need) continue;
+        size_t offset = it->first;
+        size_t left = it->second - need;
+        freeBlocks.erase(it);
+        if (left) freeBlocks[offset + need] = left;
+        used[offset] = need;
+        return region.data() + offset;
+      }
+      failures++;
+      return nullptr;
+    }
+
+    void deallocate(void* ptr) override
+    {
+      if (!ptr) return;
+      size_t offset = static_cast<uint8_t*>(ptr) - region.data();
+      auto u = used.find(offset);
+      TEST_ASSERT_TRUE(u != used.end());
+      size_t size = u->second;
+      used.erase(u);
+      auto next = freeBlocks.lower_bound(offset);
+      if (next != freeBlocks.end() && next->first == offset + size) {
+        size += next->second;
+        next = freeBlocks.erase(next);
+      }
+      if (next != freeBlocks.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+          prev->second += size;
+          return;
+        }
+      }
+      freeBlocks[offset] = size;
+    }
+
+    void* reallocate(void* ptr, size_t newSize) override
+    {
+      if (!ptr) return allocate(newSize);
+      size_t oldSize = used[static_cast<uint8_t*>(ptr) - region.data()];
+      if (alignUp(newSize) <= oldSize) return ptr;
+      void* moved = allocate(newSize);
+      if (!moved) return nullptr;
+      memcpy(moved, ptr, oldSize);
+      deallocate(ptr);
+      return moved;
+    }
+
+    size_t largestFree() const
+    {
+      size_t largest = 0;
+      for (const auto& b : freeBlocks) largest = b.second > largest ? b.second : largest;
+      return largest;
+    }
+
+    size_t freeBytes() const
+    {
+      size_t total = 0;
+      for (const auto& b : freeBlocks) total += b.second;
+      return total;
+    }
+
+    uint32_t failures = 0;
+
+  private:
+    std::vector<uint8_t> region;
+    std::map<size_t, size_t> freeBlocks;  // offset -> size
+    std::map<size_t, size_t> used;
+  };
+
+  // Growable output buffer on the heap, as String grows when serializing
+  class HeapText : public Print {
+  public:
+    explicit HeapText(SimHeap& h) : heap(h) {}
+    ~HeapText() { heap.deallocate(data); }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t n) override
+    {
+      if (len + n + 1 > cap) {
+        size_t want = cap ? cap * 2 : 64;
+        while (want < len + n + 1) want *= 2;
+        char* grown = static_cast<char*>(heap.reallocate(data, want));
+        if (!grown) return 0;
+        data = grown;
+        cap = want;
+      }
+      memcpy(data + len, buf, n);
+      len += n;
+      return n;
+    }
+
+  private:
+    SimHeap& heap;
+    char* data = nullptr;
+    size_t len = 0;
+    size_t cap = 0;
+  };
+
+  // Fragmented bytes are free bytes outside the largest block
+  struct SoakResult {
+    size_t minLargest = SIZE_MAX;
+    size_t maxFragmented = 0;
+    size_t finalLargest = 0;
+    size_t finalFree = 0;
+    uint32_t failures = 0;
+    size_t arenaHighWater = 0;
+    uint32_t arenaFallbacks = 0;
+  };
+
+  // One loop iteration's transient work: a scan results document for a
+  // varying number of hosts, serialized for a WebSocket client. `midway` runs
+  // while the document is half built, as other tasks allocate meanwhile.
+  template <typename F>
+  void buildResults(ArduinoJson::Allocator* alloc, Print& out, uint32_t hosts, uint32_t seed, F midway)
+  {
+    JsonDocument doc(alloc);
+    doc["type"] = "scan_results";
+    JsonArray list = doc["hosts"].to<JsonArray>();
+    for (uint32_t i = 0; i < hosts; i++) {
+      JsonObject h = list.add<JsonObject>();
+      h["ip"] = "10.0." + String((seed + i) % 250) + "." + String(i % 250);
+      h["name"] = "host-" + String(seed * 7 + i);
+      h["online"] = (seed + i) % 3 != 0;
+      h["rtt_ms"] = (seed * 13 + i) % 200;
+      if (i == hosts / 2) midway();
+    }
+    serializeJson(doc, out);
+  }
+
+  SoakResult soak(bool useArena)
+  {
+    SimHeap heap;
+    ArenaAllocator arena(SOAK_ARENA_BYTES, &heap);
+    std::vector<void*> live(LIVE_RECORDS, nullptr);
+    uint32_t rng = 12345;
+    SoakResult r;
+
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+      rng = rng * 1103515245u + 12345u;
+      uint32_t hosts = 10 + (rng >> 8) % 40;
+      // A host record (hostname, inventory entry) replaced in the meantime
+      auto replaceRecord = [&]() {
+        size_t slot = (rng >> 4) % LIVE_RECORDS;
+        heap.deallocate(live[slot]);
+        live[slot] = heap.allocate(16 + (rng >> 12) % 72);
+      };
+      if (useArena) {
+        ArenaScope scope(arena);
+        ArenaString out(arena);
+        buildResults(&arena, out, hosts, i, replaceRecord);
+      } else {
+        HeapText out(heap);
+        buildResults(&heap, out, hosts, i, replaceRecord);
+      }
+
+      size_t largest = heap.largestFree();
+      size_t fragmented = heap.freeBytes() - largest;
+      if (largest < r.minLargest) r.minLargest = largest;
+      if (fragmented > r.maxFragmented) r.maxFragmented = fragmented;
+    }
+    r.finalLargest = heap.largestFree();
+    r.finalFree = heap.freeBytes();
+    r.failures = heap.failures;
+    for (void* p : live) heap.deallocate(p);
+    r.arenaHighWater = arena.stats().highWater;
+    r.arenaFallbacks = arena.stats().fallbacks;
+    return r;
+  }
+
+  void report(const char* label, const SoakResult& r)
+  {
+    printf("%-6s largest block %7u B min %7u B final, fragmented %6u B max, %7u B free, %u failed allocations, arena peak %u B, %u fallbacks\n",
+           label, (unsigned)r.minLargest, (unsigned)r.finalLargest, (unsigned)r.maxFragmented, (unsigned)r.finalFree,
+           r.failures, (unsigned)r.arenaHighWater, r.arenaFallbacks);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// The arena costs its buffer up front but leaves less of the remaining heap
+// in pieces than documents built on the heap do
+void test_arena_limits_fragmentation()
+{
+  SoakResult heap = soak(false);
+  SoakResult arena = soak(true);
+  report("heap", heap);
+  report("arena", arena);
+  TEST_ASSERT_EQUAL_UINT32(0, arena.failures);
+  TEST_ASSERT_LESS_THAN(heap.maxFragmented, arena.maxFragmented);
+  TEST_ASSERT_GREATER_THAN(HEAP_BYTES - SOAK_ARENA_BYTES - HEAP_BYTES / 4, arena.minLargest);
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_arena_limits_fragmentation);
+  return UNITY_END();
+}
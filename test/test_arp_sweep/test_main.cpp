@@ -0,0 +1,147 @@
+// ARP sweeps: fresh replies count, entries cached before the request only
+// when the host still answers. Runs against a scripted table and, where the
+// host has a default gateway, the kernel's own.
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <unity.h>
+#include <set>
+#include <vector>
+#include "platform.h"
+#include "../support/linux_arp_cache.h"
+
+namespace {
+  const uint32_t FIRST = 0x0A000010;  // 10.0.0.16
+  const uint16_t WAIT_MS = 40;
+
+  // Live hosts reply `replyMs` after a request; stale entries stay resolved
+  // with nobody behind them, as lwIP keeps them for minutes
+  class ScriptedArpCache : public ArpCache {
+  public:
+    std::set<uint32_t> live;
+    std::set<uint32_t> cached;
+    uint32_t replyMs = 8;
+    uint32_t requests = 0;
+
+    bool request(uint32_t, uint8_t) override
+    {
+      requests++;
+      requestedAt = millis();
+      return true;
+    }
+
+    uint8_t resolved(uint32_t first, uint8_t count) override
+    {
+      uint8_t mask = 0;
+      bool replied = requests && millis() - requestedAt >= replyMs;
+      for (uint8_t i = 0; i < count; i++) {
+        uint32_t ip = first + i;
+        if (cached.count(ip) || (replied && live.count(ip))) mask |= 1 << i;
+      }
+      return mask;
+    }
+
+  private:
+    unsigned long requestedAt = 0;
+  };
+
+  struct Confirmer {
+    const std::set<uint32_t>* answers;
+    std::vector<uint32_t> asked;
+
+    std::function<bool(uint32_t)> fn()
+    {
+      return [this](uint32_t ip)
+      {
+        asked.push_back(ip);
+        return answers->count(ip) > 0;
+      };
+    }
+  };
+}
+
+void setUp() { host::useVirtualClock(true); }
+void tearDown() { host::useVirtualClock(true); }
+
+void test_stale_entry_is_not_alive()
+{
+  ScriptedArpCache cache;
+  cache.live = { FIRST, FIRST + 3, FIRST + 5 };
+  cache.cached = { FIRST + 2, FIRST + 3 };  // +2 left the network
+  Confirmer confirm{ &cache.live };
+
+  uint8_t alive = arpSweep(cache, FIRST, 8, WAIT_MS, confirm.fn());
+
+  TEST_ASSERT_EQUAL_UINT8(0x29, alive);  // +0, +3, +5
+  TEST_ASSERT_EQUAL(2, confirm.asked.size());
+  TEST_ASSERT_EQUAL_UINT32(FIRST + 2, confirm.asked[0]);
+  TEST_ASSERT_EQUAL_UINT32(FIRST + 3, confirm.asked[1]);
+}
+
+// The wait ends as soon as every uncached address resolved
+void test_live_batch_costs_one_round_trip()
+{
+  ScriptedArpCache cache;
+  for (uint8_t i = 0; i < 8; i++) cache.live.insert(FIRST + i);
+  Confirmer confirm{ &cache.live };
+  unsigned long t0 = millis();
+
+  TEST_ASSERT_EQUAL_UINT8(0xFF, arpSweep(cache, FIRST, 8, WAIT_MS, confirm.fn()));
+  TEST_ASSERT_LESS_THAN(WAIT_MS, millis() - t0);
+  TEST_ASSERT_EQUAL(0, confirm.asked.size());
+}
+
+void test_silent_batch_waits_once()
+{
+  ScriptedArpCache cache;
+  Confirmer confirm{ &cache.live };
+  unsigned long t0 = millis();
+
+  TEST_ASSERT_EQUAL_UINT8(0, arpSweep(cache, FIRST, 8, WAIT_MS, confirm.fn()));
+  TEST_ASSERT_GREATER_OR_EQUAL(WAIT_MS, millis() - t0);
+  TEST_ASSERT_LESS_THAN(WAIT_MS * 2, millis() - t0);
+  TEST_ASSERT_EQUAL(1, cache.requests);
+}
+
+// With every address cached nothing is requested; confirmation decides
+void test_fully_cached_batch_sends_nothing()
+{
+  ScriptedArpCache cache;
+  cache.cached = { FIRST, FIRST + 1 };
+  cache.live = { FIRST + 1 };
+  Confirmer confirm{ &cache.live };
+
+  TEST_ASSERT_EQUAL_UINT8(0x02, arpSweep(cache, FIRST, 2, WAIT_MS, confirm.fn()));
+  TEST_ASSERT_EQUAL(0, cache.requests);
+}
+
+// The gateway resolves on the first sweep; on the second its entry predates
+// the request, so a failed confirmation drops it
+void test_kernel_neighbour_table()
+{
+  uint32_t gateway = LinuxArpCache::defaultGateway();
+  if (!gateway) TEST_IGNORE_MESSAGE("no IPv4 default gateway");
+  host::useVirtualClock(false);
+  LinuxArpCache cache;
+  std::set<uint32_t> reachable = { gateway };
+  Confirmer confirm{ &reachable };
+
+  TEST_ASSERT_EQUAL_UINT8(0x01, arpSweep(cache, gateway, 1, 1000, confirm.fn()));
+  TEST_ASSERT_EQUAL_UINT8(0x01, cache.resolved(gateway, 1));
+
+  std::set<uint32_t> gone;
+  Confirmer refuse{ &gone };
+  TEST_ASSERT_EQUAL_UINT8(0, arpSweep(cache, gateway, 1, 1000, refuse.fn()));
+  TEST_ASSERT_EQUAL(1, refuse.asked.size());
+  TEST_ASSERT_EQUAL_UINT32(gateway, refuse.asked[0]);
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_stale_entry_is_not_alive);
+  RUN_TEST(test_live_batch_costs_one_round_trip);
+  RUN_TEST(test_silent_batch_waits_once);
+  RUN_TEST(test_fully_cached_batch_sends_nothing);
+  RUN_TEST(test_kernel_neighbour_table);
+  return UNITY_END();
+}
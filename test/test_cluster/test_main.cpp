@@ -0,0 +1,191 @@
+// Several cluster nodes on one stand-in broker: election, the assignment
+// epoch, and subnet totals as nodes leave and come back.
+#include <Arduino.h>
+#include <unity.h>
+#include <memory>
+#include "cluster.h"
+#include "config_store.h"
+#include "mqtt_manager.h"
+#include "../support/stand_in_broker.h"
+
+namespace {
+  const char* ASSIGNMENT_TOPIC = "esp-overwatch/cluster/assignment";
+  const char* COUNTS_TOPIC_PREFIX = "esp-overwatch/cluster/counts/";
+  const uint32_t FIRST_BLOCK = 0x0A000000;  // 10.0.0.0
+  const uint32_t BLOCKS = 1024;             // a /16 in cluster blocks
+
+  // Node ids come from bits 24-47 of the efuse MAC
+  const uint64_t MAC_A = 0x111111ULL << 24;
+  const uint64_t MAC_B = 0x222222ULL << 24;
+  const uint64_t MAC_C = 0x333333ULL << 24;
+
+  struct Node {
+    Config config;
+    BrokerLink link;
+    MqttManager mqtt;
+    Cluster cluster;
+
+    Node(StandInBroker& broker, uint64_t mac) : link(broker), mqtt(config, link), cluster(config, mqtt)
+    {
+      ConfigStore parser;
+      Subnet subnet;
+      TEST_ASSERT_TRUE(parser.parseSubnet("10.0.0.0/24", subnet));
+      config.subnets.push_back(subnet);
+      config.mqtt_host = "broker";
+      config.cluster_enabled = true;
+      ESP.setEfuseMac(mac);
+      cluster.begin();
+      mqtt.ensureConnected(true, false);
+    }
+
+    void step()
+    {
+      mqtt.loop();
+      cluster.loop();
+    }
+  };
+
+  // A client outside the cluster, for stale or foreign messages
+  struct Outsider {
+    BrokerLink link;
+    PubSubClient client;
+
+    explicit Outsider(StandInBroker& broker) : link(broker), client(link)
+    {
+      client.setServer("broker", 1883);
+      TEST_ASSERT_TRUE(client.connect("outsider"));
+    }
+  };
+
+  void settle(std::initializer_list<Node*> nodes)
+  {
+    for (int round = 0; round < 6; round++) {
+      for (Node* n : nodes) {
+        if (n) n->step();
+      }
+    }
+  }
+
+  // Every block is owned by exactly one of the nodes
+  void assertPartition(std::initializer_list<Node*> nodes)
+  {
+    for (uint32_t b = 0; b < BLOCKS; b++) {
+      uint32_t ip = FIRST_BLOCK + (b << CLUSTER_BLOCK_BITS);
+      int owners = 0;
+      for (Node* n : nodes) owners += n->cluster.ownsAddress(ip);
+      TEST_ASSERT_EQUAL_INT(1, owners);
+    }
+  }
+
+  String onlineTotal(StandInBroker& broker)
+  {
+    const std::string* v = broker.retainedAt("esp-overwatch/network/10.0.0.0/24/online_count");
+    return v ? String(v->c_str()) : String();
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_lowest_id_leads_and_shards_partition_the_range()
+{
+  StandInBroker broker;
+  Node c(broker, MAC_C), a(broker, MAC_A), b(broker, MAC_B);
+  settle({&a, &b, &c});
+
+  TEST_ASSERT_TRUE(a.cluster.isLeader());
+  TEST_ASSERT_FALSE(b.cluster.isLeader());
+  TEST_ASSERT_FALSE(c.cluster.isLeader());
+  TEST_ASSERT_EQUAL(3, b.cluster.stats().members);
+  TEST_ASSERT_EQUAL(a.cluster.stats().epoch, c.cluster.stats().epoch);
+  assertPartition({&a, &b, &c});
+}
+
+void test_assignment_with_older_epoch_is_ignored()
+{
+  StandInBroker broker;
+  Node a(broker, MAC_A);
+  settle({&a});
+  Node b(broker, MAC_B), c(broker, MAC_C);
+  settle({&a, &b, &c});
+  uint32_t epoch = b.cluster.stats().epoch;
+  TEST_ASSERT_GREATER_THAN(1, epoch);
+
+  // A former leader's view, giving every block to B
+  Outsider stale(broker);
+  stale.client.publish(ASSIGNMENT_TOPIC, "{\"leader\":\"ow-000001\",\"epoch\":1,\"members\":[\"ow-222222\"]}", false);
+  settle({&a, &b, &c});
+
+  TEST_ASSERT_EQUAL_UINT32(epoch, b.cluster.stats().epoch);
+  TEST_ASSERT_EQUAL_UINT32(epoch, c.cluster.stats().epoch);
+  assertPartition({&a, &b, &c});
+}
+
+// The leader loses power and boots with epoch 0; its next assignment must
+// still outrank the one published while it was away
+void test_restarted_leader_resumes_with_a_newer_epoch()
+{
+  StandInBroker broker;
+  std::unique_ptr<Node> a(new Node(broker, MAC_A));
+  Node b(broker, MAC_B), c(broker, MAC_C);
+  settle({a.get(), &b, &c});
+
+  a.reset();
+  settle({&b, &c});
+  TEST_ASSERT_TRUE(b.cluster.isLeader());
+  TEST_ASSERT_EQUAL(2, c.cluster.stats().members);
+  assertPartition({&b, &c});
+  uint32_t interim = b.cluster.stats().epoch;
+
+  a.reset(new Node(broker, MAC_A));
+  settle({a.get(), &b, &c});
+  TEST_ASSERT_TRUE(a->cluster.isLeader());
+  TEST_ASSERT_FALSE(b.cluster.isLeader());
+  TEST_ASSERT_GREATER_THAN(interim, a->cluster.stats().epoch);
+  TEST_ASSERT_EQUAL_UINT32(a->cluster.stats().epoch, c.cluster.stats().epoch);
+  assertPartition({a.get(), &b, &c});
+}
+
+void test_totals_drop_departed_and_foreign_reports()
+{
+  StandInBroker broker;
+  Node a(broker, MAC_A), b(broker, MAC_B);
+  std::unique_ptr<Node> c(new Node(broker, MAC_C));
+  settle({&a, &b, c.get()});
+
+  c->cluster.reportSubnet(0, 5, 2);
+  c->cluster.finishSweep();
+  b.cluster.reportSubnet(0, 3, 0);
+  b.cluster.finishSweep();
+  settle({&a, &b, c.get()});
+  a.cluster.reportSubnet(0, 1, 0);
+  TEST_ASSERT_EQUAL_STRING("9", onlineTotal(broker).c_str());
+
+  // C's report stays retained after it drops off until the leader clears it
+  std::string countsC = std::string(COUNTS_TOPIC_PREFIX) + "ow-333333";
+  TEST_ASSERT_NOT_NULL(broker.retainedAt(countsC));
+  c.reset();
+  settle({&a, &b});
+  TEST_ASSERT_NULL(broker.retainedAt(countsC));
+  a.cluster.reportSubnet(0, 1, 0);
+  TEST_ASSERT_EQUAL_STRING("4", onlineTotal(broker).c_str());
+
+  // Nor does a report from a node that never joined count
+  Outsider foreign(broker);
+  std::string countsX = std::string(COUNTS_TOPIC_PREFIX) + "ow-999999";
+  foreign.client.publish(countsX.c_str(), "{\"epoch\":1,\"subnets\":[{\"cidr\":\"10.0.0.0/24\",\"online\":50,\"found\":0}]}", true);
+  settle({&a, &b});
+  a.cluster.reportSubnet(0, 1, 0);
+  TEST_ASSERT_EQUAL_STRING("4", onlineTotal(broker).c_str());
+  TEST_ASSERT_NULL(broker.retainedAt(countsX));
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_lowest_id_leads_and_shards_partition_the_range);
+  RUN_TEST(test_assignment_with_older_epoch_is_ignored);
+  RUN_TEST(test_restarted_leader_resumes_with_a_newer_epoch);
+  RUN_TEST(test_totals_drop_departed_and_foreign_reports);
+  return UNITY_END();
+}
@@ -0,0 +1,195 @@
+// Config persistence: the targets journal and recovery from a power cut at
+// every byte of a save.
+#include <Arduino.h>
+#include <unity.h>
+#include "config_store.h"
+
+namespace {
+  const char* LOG_PATH = "/config.log";
+
+  String targetsOf(const ConfigStore& store) { return store.renderSubnets() + "--\n" + store.renderHosts(); }
+
+  String targetsOnFlash()
+  {
+    ConfigStore reloaded;
+    reloaded.load();
+    return targetsOf(reloaded);
+  }
+
+  size_t logSize()
+  {
+    if (!LittleFS.exists(LOG_PATH)) return 0;
+    File f = LittleFS.open(LOG_PATH, "r");
+    size_t n = f.size();
+    f.close();
+    return n;
+  }
+
+  void addSubnet(ConfigStore& store, const char* cidr, const char* name = "")
+  {
+    Subnet s;
+    TEST_ASSERT_TRUE(store.parseSubnet(cidr, s));
+    s.name = name;
+    store.data().subnets.push_back(s);
+  }
+
+  void addHost(ConfigStore& store, const char* line)
+  {
+    StaticHost h;
+    TEST_ASSERT_TRUE(store.parseHostLine(line, h));
+    store.data().static_hosts.push_back(h);
+  }
+
+  // A saved base with a few targets, and one journal record on top of it
+  void seed(ConfigStore& store)
+  {
+    LittleFS.wipe();
+    store.data().mqtt_host = "broker";
+    addSubnet(store, "10.0.0.0/24", "lan");
+    addSubnet(store, "10.0.1.0/24", "iot");
+    addHost(store, "10.0.0.5:22|nas");
+    addHost(store, "http://10.0.0.6:8080/health @30s|web");
+    TEST_ASSERT_TRUE(store.save());
+    addHost(store, "10.0.0.7|printer");
+    TEST_ASSERT_TRUE(store.saveTargets());
+  }
+
+  // Cuts power after each byte offset of `edit`'s save in turn. After every
+  // cut the flash must load as exactly the state before or after the edit,
+  // and the next save must go through.
+  void cutAtEveryByte(void (*edit)(ConfigStore&), bool full)
+  {
+    ConfigStore probe;
+    seed(probe);
+    String before = targetsOf(probe);
+    edit(probe);
+    String after = targetsOf(probe);
+    size_t start = LittleFS.bytesWritten();
+    TEST_ASSERT_TRUE(full ? probe.save() : probe.saveTargets());
+    size_t total = LittleFS.bytesWritten() - start;
+    TEST_ASSERT_GREATER_THAN(0, total);
+
+    for (size_t cut = 0; cut <= total; cut++) {
+      ConfigStore store;
+      seed(store);
+      edit(store);
+      LittleFS.cutPowerAfter(cut);
+      full ? store.save() : store.saveTargets();
+      LittleFS.restorePower();
+
+      ConfigStore rebooted;
+      TEST_ASSERT_TRUE(rebooted.load());
+      String loaded = targetsOf(rebooted);
+      if (loaded != before && loaded != after) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "torn state after a cut at byte %u of %u", (unsigned)cut, (unsigned)total);
+        TEST_FAIL_MESSAGE(msg);
+      }
+      TEST_ASSERT_EQUAL_STRING("broker", rebooted.data().mqtt_host.c_str());
+
+      addSubnet(rebooted, "10.9.0.0/30");
+      TEST_ASSERT_TRUE(rebooted.saveTargets());
+      TEST_ASSERT_EQUAL_STRING(targetsOf(rebooted).c_str(), targetsOnFlash().c_str());
+    }
+  }
+
+  void replaceSubnet(ConfigStore& store) { store.data().subnets[1].name = "cameras"; }
+  void removeHost(ConfigStore& store) { store.data().static_hosts.erase(store.data().static_hosts.begin()); }
+  void addTargets(ConfigStore& store)
+  {
+    addSubnet(store, "192.168.5.0/28", "lab");
+    addHost(store, "dns://10.0.0.53/example.com|resolver");
+  }
+}
+
+void setUp() { LittleFS.begin(true); }
+void tearDown() { LittleFS.restorePower(); }
+
+// Editing one target of many appends that target, not the whole list
+void test_edit_logs_only_the_changed_target()
+{
+  ConfigStore store;
+  seed(store);
+  for (int i = 0; i < 40; i++) addHost(store, ("10.0.2." + String(i + 1) + "|host-" + String(i)).c_str());
+  TEST_ASSERT_TRUE(store.save());
+  TEST_ASSERT_EQUAL(0, logSize());
+
+  store.data().static_hosts[20].name = "renamed";
+  TEST_ASSERT_TRUE(store.saveTargets());
+  size_t oneEdit = logSize();
+  TEST_ASSERT_GREATER_THAN(0, oneEdit);
+  TEST_ASSERT_LESS_THAN(160, oneEdit);
+  TEST_ASSERT_EQUAL_STRING(targetsOf(store).c_str(), targetsOnFlash().c_str());
+
+  // Saving without changes writes nothing
+  TEST_ASSERT_TRUE(store.saveTargets());
+  TEST_ASSERT_EQUAL(oneEdit, logSize());
+}
+
+// Adds, removes and replaces anywhere in either list replay to the same targets
+void test_journal_replays_adds_removes_and_replaces()
+{
+  ConfigStore store;
+  seed(store);
+  Config& c = store.data();
+
+  c.subnets.erase(c.subnets.begin());
+  TEST_ASSERT_TRUE(store.saveTargets());
+  TEST_ASSERT_EQUAL_STRING(targetsOf(store).c_str(), targetsOnFlash().c_str());
+
+  addSubnet(store, "172.16.0.0/29", "dmz");
+  c.subnets.insert(c.subnets.begin(), c.subnets.back());
+  c.subnets.pop_back();
+  TEST_ASSERT_TRUE(store.saveTargets());
+  TEST_ASSERT_EQUAL_STRING(targetsOf(store).c_str(), targetsOnFlash().c_str());
+
+  c.static_hosts.erase(c.static_hosts.begin() + 1);
+  c.static_hosts[0].interval_ms = 60000;
+  addHost(store, "10.0.0.8:80,443|gateway");
+  TEST_ASSERT_TRUE(store.saveTargets());
+  TEST_ASSERT_EQUAL_STRING(targetsOf(store).c_str(), targetsOnFlash().c_str());
+
+  c.static_hosts.clear();
+  TEST_ASSERT_TRUE(store.saveTargets());
+  TEST_ASSERT_EQUAL_STRING(targetsOf(store).c_str(), targetsOnFlash().c_str());
+}
+
+// A candidate that does not reach flash never replaces the running config
+void test_failed_save_keeps_the_running_config()
+{
+  ConfigStore store;
+  seed(store);
+  String before = targetsOf(store);
+
+  Config candidate = store.data();
+  TEST_ASSERT_TRUE(store.parseTargetsPayload("{\"subnets\":[\"172.16.0.0/29#dmz\"],\"hosts\":[]}", candidate));
+  TEST_ASSERT_EQUAL(1, candidate.subnets.size());
+  LittleFS.cutPowerAfter(0);
+  TEST_ASSERT_FALSE(store.saveTargets(candidate));
+  TEST_ASSERT_FALSE(store.save(candidate));
+  LittleFS.restorePower();
+  TEST_ASSERT_EQUAL_STRING(before.c_str(), targetsOf(store).c_str());
+  TEST_ASSERT_EQUAL_STRING(before.c_str(), targetsOnFlash().c_str());
+
+  TEST_ASSERT_TRUE(store.saveTargets(candidate));
+  TEST_ASSERT_EQUAL_STRING("172.16.0.0/29\n--\n", targetsOf(store).c_str());
+  TEST_ASSERT_EQUAL_STRING(targetsOf(store).c_str(), targetsOnFlash().c_str());
+}
+
+void test_cut_during_replace() { cutAtEveryByte(replaceSubnet, false); }
+void test_cut_during_remove() { cutAtEveryByte(removeHost, false); }
+void test_cut_during_add() { cutAtEveryByte(addTargets, false); }
+void test_cut_during_full_save() { cutAtEveryByte(addTargets, true); }
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_edit_logs_only_the_changed_target);
+  RUN_TEST(test_journal_replays_adds_removes_and_replaces);
+  RUN_TEST(test_failed_save_keeps_the_running_config);
+  RUN_TEST(test_cut_during_replace);
+  RUN_TEST(test_cut_during_remove);
+  RUN_TEST(test_cut_during_add);
+  RUN_TEST(test_cut_during_full_save);
+  return UNITY_END();
+}
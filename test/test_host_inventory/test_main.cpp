@@ -0,0 +1,54 @@
+// Host inventory limits: once it can grow no further, unknown hosts are
+// untracked on every sweep rather than reported as new each time.
+#include <Arduino.h>
+#include <unity.h>
+#include "host_inventory.h"
+
+namespace {
+  const uint32_t FIRST_IP = 0x0A000000;  // 10.0.0.0
+
+  // Adds hosts until the inventory refuses one, returning how many it took
+  size_t fill(HostInventory& inventory)
+  {
+    inventory.beginSweep();
+    for (uint32_t i = 0; i < MAX_INVENTORY_HOSTS; i++) {
+      Sighting s = inventory.seen(FIRST_IP + i);
+      if (s == Sighting::Untracked) return i;
+      TEST_ASSERT_EQUAL(Sighting::New, s);
+    }
+    return MAX_INVENTORY_HOSTS;
+  }
+}
+
+void setUp() { LittleFS.wipe(); }
+void tearDown() {}
+
+void test_full_inventory_leaves_new_hosts_untracked()
+{
+  HostInventory inventory;
+  inventory.load();
+  size_t held = fill(inventory);
+  TEST_ASSERT_GREATER_THAN(1024, held);
+  TEST_ASSERT_EQUAL(held, inventory.size());
+
+  uint32_t outsider = held < MAX_INVENTORY_HOSTS ? FIRST_IP + held + 100 : FIRST_IP - 1;
+  uint32_t before = inventory.stats().untracked;
+  for (int sweep = 0; sweep < 3; sweep++) {
+    inventory.beginSweep();
+    TEST_ASSERT_EQUAL(Sighting::Untracked, inventory.seen(outsider));
+    TEST_ASSERT_EQUAL(Sighting::Known, inventory.seen(FIRST_IP));
+  }
+  TEST_ASSERT_EQUAL_UINT32(before + 3, inventory.stats().untracked);
+
+  // Forgetting a host makes room again
+  inventory.forget(0);
+  TEST_ASSERT_EQUAL(Sighting::New, inventory.seen(outsider));
+  TEST_ASSERT_EQUAL(Sighting::Known, inventory.seen(outsider));
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_full_inventory_leaves_new_hosts_untracked);
+  return UNITY_END();
+}
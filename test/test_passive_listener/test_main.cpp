@@ -0,0 +1,190 @@
+// Passive discovery over real sockets: captured mDNS, SSDP and DHCP packets
+// are replayed from a UDP stand-in on loopback to a listener on high ports.
+#include <Arduino.h>
+#include <unity.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "config_store.h"
+#include "passive_listener.h"
+
+namespace {
+  const uint32_t LOOPBACK = 0x7F000001;
+  const uint32_t PRINTER = 0x0A000005;  // 10.0.0.5
+  const uint32_t CAMERA = 0x0A00002A;   // 10.0.0.42
+
+  PassivePorts testPorts()
+  {
+    PassivePorts p;
+    p.mdns = 45353;
+    p.ssdp = 41900;
+    p.dhcp = 40067;
+    return p;
+  }
+
+  // Response announcing printer.local at 10.0.0.5
+  const uint8_t MDNS_ANNOUNCE[] = {
+    0x00, 0x00, 0x84, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    7, 'p', 'r', 'i', 'n', 't', 'e', 'r', 5, 'l', 'o', 'c', 'a', 'l', 0,
+    0x00, 0x01, 0x80, 0x01, 0x00, 0x00, 0x00, 0x78, 0x00, 0x04, 10, 0, 0, 5,
+  };
+
+  const char SSDP_NOTIFY[] =
+    "NOTIFY * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nNT: upnp:rootdevice\r\nNTS: ssdp:alive\r\n\r\n";
+
+  // Client REQUEST for 10.0.0.42 with hostname "cam1"
+  std::vector<uint8_t> dhcpRequest()
+  {
+    std::vector<uint8_t> p(240, 0);
+    p[0] = 1;
+    p[1] = 1;
+    p[2] = 6;
+    p[236] = 0x63; p[237] = 0x82; p[238] = 0x53; p[239] = 0x63;
+    const uint8_t options[] = { 53, 1, 3, 50, 4, 10, 0, 0, 42, 12, 4, 'c', 'a', 'm', '1', 255 };
+    p.insert(p.end(), options, options + sizeof(options));
+    return p;
+  }
+
+  struct Sighting {
+    uint32_t ip;
+    std::string name;
+  };
+
+  // The sending side, as another host on the segment would be
+  class UdpStandIn {
+  public:
+    UdpStandIn() { fd = socket(AF_INET, SOCK_DGRAM, 0); }
+    ~UdpStandIn() { close(fd); }
+
+    void send(uint16_t port, const void* data, size_t len)
+    {
+      sockaddr_in to = {};
+      to.sin_family = AF_INET;
+      to.sin_port = htons(port);
+      to.sin_addr.s_addr = htonl(LOOPBACK);
+      TEST_ASSERT_EQUAL_INT((int)len, (int)sendto(fd, data, len, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to)));
+    }
+
+  private:
+    int fd;
+  };
+
+  struct Rig {
+    Config config;
+    PassiveListener listener;
+    std::vector<Sighting> seen;
+
+    Rig() : listener(config, testPorts())
+    {
+      config.passive_discovery = true;
+      listener.setSightingHandler([this](uint32_t ip, const char* name)
+                                  { seen.push_back({ ip, name ? name : "" }); });
+    }
+
+    // Loopback delivers at once, but give the kernel a few passes
+    void pump(size_t wantPackets)
+    {
+      for (int i = 0; i < 50; i++) {
+        listener.loop(true);
+        PassiveStats s = listener.stats();
+        if (s.mdns + s.ssdp + s.dhcp >= wantPackets) return;
+        usleep(1000);
+      }
+    }
+
+    bool saw(uint32_t ip, const char* name) const
+    {
+      for (const auto& s : seen) {
+        if (s.ip == ip && s.name == name) return true;
+      }
+      return false;
+    }
+  };
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_replayed_packets_become_sightings()
+{
+  Rig rig;
+  rig.listener.loop(true);
+  TEST_ASSERT_TRUE(rig.listener.stats().listening);
+  for (PassiveSource s : { PassiveSource::Mdns, PassiveSource::Ssdp, PassiveSource::Dhcp }) TEST_ASSERT_TRUE(rig.listener.socketFd(s) >= 0);
+
+  UdpStandIn peer;
+  PassivePorts ports = testPorts();
+  peer.send(ports.mdns, MDNS_ANNOUNCE, sizeof(MDNS_ANNOUNCE));
+  peer.send(ports.ssdp, SSDP_NOTIFY, strlen(SSDP_NOTIFY));
+  std::vector<uint8_t> dhcp = dhcpRequest();
+  peer.send(ports.dhcp, dhcp.data(), dhcp.size());
+  rig.pump(3);
+
+  PassiveStats s = rig.listener.stats();
+  TEST_ASSERT_EQUAL_UINT32(1, s.mdns);
+  TEST_ASSERT_EQUAL_UINT32(1, s.ssdp);
+  TEST_ASSERT_EQUAL_UINT32(1, s.dhcp);
+  TEST_ASSERT_EQUAL_UINT32(0, s.malformed);
+  TEST_ASSERT_TRUE(rig.saw(PRINTER, "printer"));
+  TEST_ASSERT_TRUE(rig.saw(CAMERA, "cam1"));
+  // Neither the mDNS answer nor the NOTIFY names the sender itself
+  TEST_ASSERT_TRUE(rig.saw(LOOPBACK, ""));
+}
+
+// A burst is read a few datagrams per loop; the rest stay queued and keep
+// the socket readable for the event loop
+void test_burst_is_drained_across_loops()
+{
+  Rig rig;
+  rig.listener.loop(true);
+  UdpStandIn peer;
+  const uint32_t burst = PASSIVE_PACKETS_PER_LOOP + 2;
+  for (uint32_t i = 0; i < burst; i++) peer.send(testPorts().ssdp, SSDP_NOTIFY, strlen(SSDP_NOTIFY));
+  usleep(10000);
+
+  rig.listener.loop(true);
+  TEST_ASSERT_EQUAL_UINT32(PASSIVE_PACKETS_PER_LOOP, rig.listener.stats().ssdp);
+  rig.pump(burst);
+  TEST_ASSERT_EQUAL_UINT32(burst, rig.listener.stats().ssdp);
+}
+
+void test_truncated_packets_count_as_malformed()
+{
+  Rig rig;
+  rig.listener.loop(true);
+  UdpStandIn peer;
+  peer.send(testPorts().mdns, MDNS_ANNOUNCE, sizeof(MDNS_ANNOUNCE) - 3);
+  std::vector<uint8_t> dhcp = dhcpRequest();
+  peer.send(testPorts().dhcp, dhcp.data(), 200);
+  rig.pump(2);
+
+  TEST_ASSERT_EQUAL_UINT32(2, rig.listener.stats().malformed);
+  TEST_ASSERT_FALSE(rig.saw(PRINTER, "printer"));
+  TEST_ASSERT_FALSE(rig.saw(CAMERA, "cam1"));
+}
+
+void test_sockets_close_when_the_network_drops()
+{
+  Rig rig;
+  rig.listener.loop(true);
+  rig.listener.loop(false);
+  TEST_ASSERT_FALSE(rig.listener.stats().listening);
+  for (PassiveSource s : { PassiveSource::Mdns, PassiveSource::Ssdp, PassiveSource::Dhcp }) TEST_ASSERT_EQUAL_INT(-1, rig.listener.socketFd(s));
+
+  // The ports are free again for the next start
+  rig.listener.loop(true);
+  TEST_ASSERT_TRUE(rig.listener.socketFd(PassiveSource::Dhcp) >= 0);
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_replayed_packets_become_sightings);
+  RUN_TEST(test_burst_is_drained_across_loops);
+  RUN_TEST(test_truncated_packets_count_as_malformed);
+  RUN_TEST(test_sockets_close_when_the_network_drops);
+  return UNITY_END();
+}
@@ -0,0 +1,140 @@
+// Scan benchmarks on the simulated network: one full sweep of a /24 up to a
+// /16 with the default scanner settings. Run `pio test -e native -f
+// test_scan_bench -v` and compare the table across revisions; the times are
+// modelled network time, so they are identical from run to run.
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <unity.h>
+#include "availability_history.h"
+#include "cluster.h"
+#include "config_store.h"
+#include "host_inventory.h"
+#include "mqtt_manager.h"
+#include "network_scanner.h"
+#include "platform.h"
+#include "../support/stand_in_broker.h"
+
+namespace {
+  const uint32_t STEP_BUDGET_US = 20000;
+  const uint32_t MAX_STEPS = 2000000;
+
+  struct BenchResult {
+    uint32_t addresses = 0;
+    uint32_t online = 0;
+    uint32_t alive = 0;
+    uint32_t sweepMs = 0;
+    uint32_t probes = 0;
+    uint32_t publishes = 0;
+    uint32_t untracked = 0;  // online, but past what the inventory could hold
+    uint32_t peakHeap = 0;
+  };
+
+  SimNetworkParams benchParams(uint8_t lossPct)
+  {
+    SimNetworkParams p;
+    p.seed = 1;
+    p.hostDensityPct = 25;
+    p.lossPct = lossPct;
+    return p;
+  }
+
+  BenchResult sweepOnce(const char* cidr, const SimNetworkParams& params)
+  {
+    LittleFS.wipe();
+    host::useVirtualClock(true);
+    StandInBroker broker;
+    broker.record = false;
+    BrokerLink link(broker);
+    ConfigStore store;
+    Config& config = store.data();
+    config.mqtt_host = "broker";
+    Subnet subnet;
+    TEST_ASSERT_TRUE(store.parseSubnet(cidr, subnet));
+    config.subnets.push_back(subnet);
+
+    SimulatedNetwork net(params);
+    MqttManager mqtt(config, link);
+    HostInventory inventory;
+    AvailabilityHistory history;
+    Cluster cluster(config, mqtt);
+    NetworkScanner scanner(config, mqtt, net, inventory, history, cluster);
+    mqtt.ensureConnected(true, false);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+
+    BenchResult r;
+    r.addresses = subnet.hostCount;
+    for (const auto& range : subnet.ranges) {
+      for (uint32_t a = range.first; a <= range.last; a++) r.alive += net.hostAlive(a);
+    }
+    uint32_t probesBefore = net.probes();
+    uint32_t publishesBefore = mqtt.publishCount();
+    host::resetHeapWatermark();
+    size_t heapBefore = host::heapInUse();
+
+    scanner.start();
+    uint32_t steps = 0;
+    while (!scanner.subnetResults()[0].completedMs && steps++ < MAX_STEPS) {
+      if (!scanner.step(STEP_BUDGET_US)) host::advance(scanner.wakeInMs() ? scanner.wakeInMs() : 1);
+      mqtt.loop();
+    }
+    TEST_ASSERT_LESS_THAN_UINT32(MAX_STEPS, steps);
+
+    const SubnetScanResult& done = scanner.subnetResults()[0];
+    r.online = done.online;
+    r.sweepMs = done.durationMs;
+    r.probes = net.probes() - probesBefore;
+    r.publishes = mqtt.publishCount() - publishesBefore;
+    r.untracked = inventory.stats().untracked;
+    size_t peak = host::HEAP_BYTES - ESP.getMinFreeHeap();
+    r.peakHeap = peak > heapBefore ? peak - heapBefore : 0;
+    return r;
+  }
+
+  void report(const char* cidr, const BenchResult& r)
+  {
+    float rate = r.sweepMs ? r.probes * 1000.0f / r.sweepMs : 0;
+    printf("%-16s %6u addr %6u online %9u ms %8u probes %8.1f probes/s %6u publishes %6u untracked %7u B heap\n",
+           cidr, r.addresses, r.online, r.sweepMs, r.probes, rate, r.publishes, r.untracked, r.peakHeap);
+  }
+
+  void bench(const char* cidr)
+  {
+    BenchResult r = sweepOnce(cidr, benchParams(2));
+    report(cidr, r);
+    TEST_ASSERT_TRUE(r.online <= r.alive);
+    TEST_ASSERT_TRUE(r.probes >= r.addresses);
+    TEST_ASSERT_TRUE(r.publishes + r.untracked >= r.online);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Without loss, and with every reply inside the ping wait, each live address
+// is found, once, in a single sweep
+void test_lossless_sweep_finds_every_host()
+{
+  SimNetworkParams params = benchParams(0);
+  params.rttMaxMs = params.timeoutMs;
+  BenchResult r = sweepOnce("10.1.0.0/22", params);
+  TEST_ASSERT_EQUAL_UINT32(r.alive, r.online);
+  TEST_ASSERT_EQUAL_UINT32(r.addresses, r.probes);
+}
+
+void test_bench_24() { bench("10.0.0.0/24"); }
+void test_bench_22() { bench("10.0.0.0/22"); }
+void test_bench_20() { bench("10.0.0.0/20"); }
+void test_bench_18() { bench("10.0.0.0/18"); }
+void test_bench_16() { bench("10.0.0.0/16"); }
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_lossless_sweep_finds_every_host);
+  RUN_TEST(test_bench_24);
+  RUN_TEST(test_bench_22);
+  RUN_TEST(test_bench_20);
+  RUN_TEST(test_bench_18);
+  RUN_TEST(test_bench_16);
+  return UNITY_END();
+}
@@ -0,0 +1,121 @@
+// Long run of the scanner on the simulated network: 1,000 back-to-back scans
+// of a /24 and two static hosts, with loss so hosts come and go. After a
+// warm-up the scan records are updated in place, so free heap and the largest
+// block should not drift. Run `pio test -e native -f test_scan_soak -v` for
+// the table. The host heap does not fragment like the device heap (its
+// largest block is the free heap), so this catches growth and leaks; the
+// device's own figures are under "heap" in /scan_results.
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <unity.h>
+#include <algorithm>
+#include "availability_history.h"
+#include "cluster.h"
+#include "config_store.h"
+#include "host_inventory.h"
+#include "mqtt_manager.h"
+#include "network_scanner.h"
+#include "platform.h"
+#include "../support/stand_in_broker.h"
+
+namespace {
+  const uint32_t SOAK_SCANS = 1000;
+  const uint32_t WARM_UP_SCANS = 100;
+  const uint32_t REPORT_EVERY = 100;
+  const uint32_t STEP_BUDGET_US = 20000;
+  const uint32_t MAX_STEPS_PER_SCAN = 200000;
+  // glibc keeps some freed blocks cached per thread and counts them as in
+  // use, which moves the figures by a few hundred bytes over a run
+  const uint32_t MAX_DRIFT_BYTES = 2048;
+
+  // Low points of free heap and the largest block over a run of scans
+  struct HeapLow {
+    uint32_t free = UINT32_MAX;
+    uint32_t largest = UINT32_MAX;
+
+    void note(const ScanHeapStats& s)
+    {
+      free = std::min(free, s.freeAfterScan);
+      largest = std::min(largest, s.largestAfterScan);
+    }
+  };
+
+  StaticHost staticHost(const char* ip, const char* name)
+  {
+    StaticHost h;
+    h.ip = ip;
+    h.name = name;
+    return h;
+  }
+}
+
+void setUp()
+{
+  LittleFS.wipe();
+  host::useVirtualClock(true);
+}
+
+void tearDown() {}
+
+void test_thousand_scans_leave_the_heap_where_it_was()
+{
+  StandInBroker broker;
+  broker.record = false;
+  BrokerLink link(broker);
+  ConfigStore store;
+  Config& config = store.data();
+  config.mqtt_host = "broker";
+  Subnet subnet;
+  TEST_ASSERT_TRUE(store.parseSubnet("10.0.0.0/24", subnet));
+  config.subnets.push_back(subnet);
+  config.static_hosts.push_back(staticHost("10.0.1.10", "nas"));
+  config.static_hosts.push_back(staticHost("10.0.1.11", "printer"));
+
+  SimNetworkParams params;
+  params.seed = 1;
+  params.hostDensityPct = 25;
+  params.lossPct = 5;
+  SimulatedNetwork net(params);
+  MqttManager mqtt(config, link);
+  HostInventory inventory;
+  inventory.load();
+  AvailabilityHistory history;
+  Cluster cluster(config, mqtt);
+  NetworkScanner scanner(config, mqtt, net, inventory, history, cluster);
+  mqtt.ensureConnected(true, false);
+  TEST_ASSERT_TRUE(mqtt.isConnected());
+
+  // Scans settle in after the warm-up but still swing by a few hundred
+  // bytes as journals compact, so the low points of the two halves are
+  // compared rather than two single scans
+  HeapLow firstHalf, secondHalf;
+  printf("%6s %10s %10s %10s\n", "scan", "free", "largest", "flash");
+  for (uint32_t scan = 1; scan <= SOAK_SCANS; scan++) {
+    TEST_ASSERT_TRUE(scanner.start());
+    uint32_t steps = 0;
+    while (scanner.heapStats().scans < scan && steps++ < MAX_STEPS_PER_SCAN) {
+      if (!scanner.step(STEP_BUDGET_US)) host::advance(scanner.wakeInMs() ? scanner.wakeInMs() : 1);
+      mqtt.loop();
+    }
+    TEST_ASSERT_LESS_THAN_UINT32(MAX_STEPS_PER_SCAN, steps);
+
+    const ScanHeapStats& heap = scanner.heapStats();
+    if (scan > WARM_UP_SCANS) (scan <= (SOAK_SCANS + WARM_UP_SCANS) / 2 ? firstHalf : secondHalf).note(heap);
+    if (scan % REPORT_EVERY == 0) {
+      printf("%6u %10u %10u %10u\n", scan, heap.freeAfterScan, heap.largestAfterScan, (uint32_t)LittleFS.usedBytes());
+    }
+  }
+
+  printf("low points, first half: %u B free, %u B largest; second half: %u B free, %u B largest\n", firstHalf.free,
+         firstHalf.largest, secondHalf.free, secondHalf.largest);
+  TEST_ASSERT_EQUAL_UINT32(SOAK_SCANS, scanner.heapStats().scans);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(firstHalf.free, secondHalf.free + MAX_DRIFT_BYTES);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(firstHalf.largest, secondHalf.largest + MAX_DRIFT_BYTES);
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_thousand_scans_leave_the_heap_where_it_was);
+  return UNITY_END();
+}
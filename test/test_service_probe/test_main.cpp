@@ -0,0 +1,271 @@
+// Service checks against stand-in HTTP, DNS, MQTT and TLS servers on
+// loopback, on the real clock: each server checks the request it gets and
+// answers with a scripted response.
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <unity.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "service_probe.h"
+
+namespace {
+  const int SERVER_POLL_MS = 20;
+
+  // Serves on an ephemeral loopback port until destroyed. `reply` sees the
+  // request received so far and returns the response, or "" while the
+  // request is incomplete; a server with no reply accepts and stays silent.
+  class StandInServer {
+  public:
+    using Reply = std::function<std::string(const std::string& request)>;
+
+    StandInServer(bool datagram, Reply r) : reply(std::move(r))
+    {
+      fd = socket(AF_INET, datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      TEST_ASSERT_EQUAL_INT(0, bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+      socklen_t len = sizeof(addr);
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+      port = ntohs(addr.sin_port);
+      if (!datagram) listen(fd, 1);
+      worker = std::thread([this, datagram]() { datagram ? serveDatagrams() : serveStreams(); });
+    }
+
+    ~StandInServer()
+    {
+      stopping = true;
+      worker.join();
+      close(fd);
+    }
+
+    std::string request()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return received;
+    }
+
+    uint16_t port = 0;
+
+  private:
+    bool readable(int s)
+    {
+      pollfd p = { s, POLLIN, 0 };
+      return poll(&p, 1, SERVER_POLL_MS) > 0;
+    }
+
+    void serveStreams()
+    {
+      while (!stopping) {
+        if (!readable(fd)) continue;
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0) continue;
+        std::string req;
+        std::string resp;
+        while (!stopping && resp.empty()) {
+          if (!readable(client)) continue;
+          char buf[512];
+          ssize_t n = recv(client, buf, sizeof(buf), 0);
+          if (n <= 0) break;
+          req.append(buf, n);
+          record(req);
+          if (reply) resp = reply(req);
+        }
+        if (!resp.empty()) send(client, resp.data(), resp.size(), MSG_NOSIGNAL);
+        close(client);
+      }
+    }
+
+    void serveDatagrams()
+    {
+      while (!stopping) {
+        if (!readable(fd)) continue;
+        char buf[512];
+        sockaddr_in from = {};
+        socklen_t fromLen = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr*>(&from), &fromLen);
+        if (n <= 0) continue;
+        std::string req(buf, n);
+        record(req);
+        std::string resp = reply ? reply(req) : std::string();
+        if (!resp.empty()) sendto(fd, resp.data(), resp.size(), 0, reinterpret_cast<sockaddr*>(&from), fromLen);
+      }
+    }
+
+    void record(const std::string& req)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      received = req;
+    }
+
+    int fd = -1;
+    Reply reply;
+    std::thread worker;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::string received;
+  };
+
+  ServiceResult runCheck(ServiceKind kind, uint16_t port, const char* arg = "")
+  {
+    ServiceCheck check;
+    TEST_ASSERT_TRUE(check.start(*findServiceProbe(kind), "127.0.0.1", port, arg));
+    while (!check.poll()) delay(1);
+    TEST_ASSERT_FALSE(check.busy());
+    return check.result();
+  }
+
+  std::string bytes(std::initializer_list<uint8_t> b) { return std::string(b.begin(), b.end()); }
+
+  StandInServer::Reply httpStatus(const char* statusLine)
+  {
+    std::string resp = std::string(statusLine) + "\r\nContent-Length: 0\r\n\r\n";
+    return [resp](const std::string& req) { return req.find("\r\n\r\n") == std::string::npos ? std::string() : resp; };
+  }
+
+  // Echoes the query's id and question with one A record, or an rcode alone
+  StandInServer::Reply dnsAnswer(uint8_t rcode)
+  {
+    return [rcode](const std::string& req)
+    {
+      if (req.size() < 12) return std::string();
+      std::string resp = req;
+      resp[2] = static_cast<char>(0x81);
+      resp[3] = static_cast<char>(0x80 | rcode);
+      resp[7] = rcode ? 0 : 1;
+      if (!rcode) resp += bytes({ 0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0, 60, 0, 4, 10, 0, 0, 1 });
+      return resp;
+    };
+  }
+
+  StandInServer::Reply connack(uint8_t returnCode)
+  {
+    return [returnCode](const std::string& req)
+    {
+      if (req.size() < 2 || req.size() < static_cast<size_t>(2 + static_cast<uint8_t>(req[1]))) return std::string();
+      return bytes({ 0x20, 0x02, 0x00, returnCode });
+    };
+  }
+
+  // Answers a complete ClientHello record with `resp`
+  StandInServer::Reply tlsFlight(std::string resp)
+  {
+    return [resp](const std::string& req)
+    {
+      if (req.size() < 5) return std::string();
+      size_t record = 5 + ((static_cast<uint8_t>(req[3]) << 8) | static_cast<uint8_t>(req[4]));
+      return req.size() < record ? std::string() : resp;
+    };
+  }
+}
+
+void setUp() { host::useVirtualClock(false); }
+void tearDown() { host::useVirtualClock(true); }
+
+void test_http_status_decides()
+{
+  StandInServer ok(false, httpStatus("HTTP/1.1 204 No Content"));
+  ServiceResult r = runCheck(ServiceKind::Http, ok.port, "/health");
+  TEST_ASSERT_TRUE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(204, r.code);
+  TEST_ASSERT_EQUAL_UINT32(0x7F000001, r.ip);
+  std::string req = ok.request();
+  TEST_ASSERT_EQUAL(0, req.find("GET /health HTTP/1.0\r\n"));
+  TEST_ASSERT_TRUE(req.find("\r\nHost: 127.0.0.1\r\n") != std::string::npos);
+
+  StandInServer failing(false, httpStatus("HTTP/1.1 503 Service Unavailable"));
+  r = runCheck(ServiceKind::Http, failing.port);
+  TEST_ASSERT_FALSE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(503, r.code);
+  TEST_ASSERT_EQUAL(0, failing.request().find("GET / HTTP/1.0\r\n"));
+}
+
+void test_dns_answer_decides()
+{
+  StandInServer resolver(true, dnsAnswer(0));
+  ServiceResult r = runCheck(ServiceKind::Dns, resolver.port, "/router.lan");
+  TEST_ASSERT_TRUE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(0, r.code);
+  std::string req = resolver.request();
+  TEST_ASSERT_EQUAL_size_t(12 + 12 + 4, req.size());
+  TEST_ASSERT_EQUAL(12, req.find(bytes({ 6, 'r', 'o', 'u', 't', 'e', 'r', 3, 'l', 'a', 'n', 0 })));
+
+  StandInServer nxdomain(true, dnsAnswer(3));
+  r = runCheck(ServiceKind::Dns, nxdomain.port, "/missing.lan");
+  TEST_ASSERT_FALSE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(3, r.code);
+}
+
+// A broker refusing the anonymous login still serves MQTT
+void test_mqtt_connack_decides()
+{
+  StandInServer refusing(false, connack(5));
+  ServiceResult r = runCheck(ServiceKind::Mqtt, refusing.port);
+  TEST_ASSERT_TRUE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(5, r.code);
+  std::string req = refusing.request();
+  TEST_ASSERT_EQUAL_UINT8(0x10, static_cast<uint8_t>(req[0]));
+  TEST_ASSERT_EQUAL(4, req.find("MQTT"));
+
+  StandInServer unavailable(false, connack(3));
+  r = runCheck(ServiceKind::Mqtt, unavailable.port);
+  TEST_ASSERT_FALSE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(3, r.code);
+}
+
+void test_tls_hello_or_alert_decides()
+{
+  StandInServer hello(false, tlsFlight(bytes({ 0x16, 0x03, 0x03, 0x00, 0x04, 0x02, 0x00, 0x00, 0x00 })));
+  ServiceResult r = runCheck(ServiceKind::Tls, hello.port);
+  TEST_ASSERT_TRUE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(0x02, r.code);
+  std::string req = hello.request();
+  TEST_ASSERT_EQUAL_UINT8(0x16, static_cast<uint8_t>(req[0]));
+  TEST_ASSERT_EQUAL_UINT8(0x01, static_cast<uint8_t>(req[5]));
+
+  // handshake_failure
+  StandInServer alert(false, tlsFlight(bytes({ 0x15, 0x03, 0x03, 0x00, 0x02, 0x02, 0x28 })));
+  r = runCheck(ServiceKind::Tls, alert.port);
+  TEST_ASSERT_FALSE(r.up);
+  TEST_ASSERT_EQUAL_UINT16(0x28, r.code);
+}
+
+void test_refused_connection_is_down_at_once()
+{
+  uint16_t port;
+  {
+    StandInServer gone(false, nullptr);
+    port = gone.port;
+  }
+  ServiceResult r = runCheck(ServiceKind::Http, port);
+  TEST_ASSERT_FALSE(r.up);
+  TEST_ASSERT_LESS_THAN(SERVICE_TIMEOUT_MS / 2, r.latencyMs);
+}
+
+void test_silent_server_times_out()
+{
+  StandInServer silent(false, nullptr);
+  ServiceResult r = runCheck(ServiceKind::Mqtt, silent.port);
+  TEST_ASSERT_FALSE(r.up);
+  TEST_ASSERT_GREATER_OR_EQUAL(SERVICE_TIMEOUT_MS, r.latencyMs);
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_http_status_decides);
+  RUN_TEST(test_dns_answer_decides);
+  RUN_TEST(test_mqtt_connack_decides);
+  RUN_TEST(test_tls_hello_or_alert_decides);
+  RUN_TEST(test_refused_connection_is_down_at_once);
+  RUN_TEST(test_silent_server_times_out);
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+// Loop latency under the step budget: the scanner sweeps a /22 of the
+// simulated network whose probes block for their modelled time, as the device
+// backend does, and each loop pass goes into the loop histogram. With probes
+// capped at PING_TIMEOUT_MS the budget holds p99 under the target; a probe
+// that blocks past the target cannot be paced, whatever the budget.
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <unity.h>
+#include "availability_history.h"
+#include "cluster.h"
+#include "config_store.h"
+#include "host_inventory.h"
+#include "instrumentation.h"
+#include "mqtt_manager.h"
+#include "network_scanner.h"
+#include "platform.h"
+#include "step_budget.h"
+#include "../support/stand_in_broker.h"
+
+namespace {
+  const uint32_t BUSY_LOOPS = 2000;  // 20 budget windows
+  const uint32_t MAX_PASSES = 200000;
+  const uint16_t OLD_PING_WAIT_MS = 1000;  // a one-second ping, as ESP32Ping waited
+
+  SimNetworkParams lossyLan()
+  {
+    SimNetworkParams p;
+    p.seed = 1;
+    p.hostDensityPct = 25;
+    p.lossPct = 5;
+    return p;
+  }
+
+  // Runs loop passes until BUSY_LOOPS of them probed, feeding the budget and
+  // the loop histogram as main.cpp does
+  StepBudgetStats runLoops(const SimNetworkParams& params)
+  {
+    StandInBroker broker;
+    broker.record = false;
+    BrokerLink link(broker);
+    ConfigStore store;
+    Config& config = store.data();
+    config.mqtt_host = "broker";
+    Subnet subnet;
+    TEST_ASSERT_TRUE(store.parseSubnet("10.0.0.0/22", subnet));
+    config.subnets.push_back(subnet);
+
+    SimulatedNetwork net(params);
+    MqttManager mqtt(config, link);
+    HostInventory inventory;
+    AvailabilityHistory history;
+    Cluster cluster(config, mqtt);
+    NetworkScanner scanner(config, mqtt, net, inventory, history, cluster);
+    mqtt.ensureConnected(true, false);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+
+    StepBudget budget;
+    scanner.start();
+    uint32_t busy = 0;
+    for (uint32_t pass = 0; pass < MAX_PASSES && busy < BUSY_LOOPS; pass++) {
+      uint32_t loopStartUs = micros();
+      uint16_t probes = scanner.step(budget.budgetUs());
+      mqtt.loop();
+      uint32_t loopUs = micros() - loopStartUs;
+      instrumentation.record(Probe::Loop, loopUs);
+      if (probes) {
+        budget.recordLoop(loopUs);
+        busy++;
+      } else {
+        host::advance(scanner.wakeInMs() ? scanner.wakeInMs() : 1);
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT32(BUSY_LOOPS, busy);
+    return budget.stats();
+  }
+
+  const LatencyHistogram& loops() { return instrumentation.histogram(Probe::Loop); }
+}
+
+void setUp()
+{
+  LittleFS.wipe();
+  host::useVirtualClock(true);
+  instrumentation = Instrumentation();
+}
+
+void tearDown() {}
+
+void test_capped_probes_keep_loop_p99_under_target()
+{
+  StepBudgetStats stats = runLoops(lossyLan());
+  uint32_t p99 = loops().percentileUs(99);
+  printf("capped probes: p99 %u us, max %u us, budget %u us, %u cuts\n", p99, loops().maxUs, stats.budgetUs,
+         stats.decreases);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(OVERWATCH_LOOP_TARGET_US, p99);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(OVERWATCH_LOOP_TARGET_US, loops().maxUs);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(OVERWATCH_LOOP_TARGET_US, stats.windowP99Us);
+}
+
+// The first probe of a step always runs, so a wait longer than the target
+// sets the loop's p99 on its own
+void test_probe_blocking_past_target_cannot_be_paced()
+{
+  SimNetworkParams params = lossyLan();
+  params.timeoutMs = OLD_PING_WAIT_MS;
+  StepBudgetStats stats = runLoops(params);
+  uint32_t p99 = loops().percentileUs(99);
+  printf("1 s probes: p99 %u us, budget %u us\n", p99, stats.budgetUs);
+  TEST_ASSERT_GREATER_THAN_UINT32(OVERWATCH_LOOP_TARGET_US, p99);
+  TEST_ASSERT_EQUAL_UINT32(STEP_BUDGET_MIN_US, stats.budgetUs);
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_capped_probes_keep_loop_p99_under_target);
+  RUN_TEST(test_probe_blocking_past_target_cannot_be_paced);
+  return UNITY_END();
+}
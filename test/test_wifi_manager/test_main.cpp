@@ -0,0 +1,183 @@
+// Wi-Fi manager against the scripted station in the native shim: retries,
+// links that come up on their own, the portal hold and portal DNS answered
+// over loopback.
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "captive_dns.h"
+#include "wifi_manager.h"
+
+namespace {
+  const uint16_t TEST_DNS_PORT = 40053;
+  const uint32_t CONNECT_TIMEOUT_MS = 15000;
+  const uint32_t FIRST_BACKOFF_MS = 5000;
+  const uint32_t PORTAL_HOLD_MAX_MS = 600000;
+  const uint32_t PORTAL_IP = 0xC0A80401;  // 192.168.4.1
+
+  Config homeNetwork()
+  {
+    Config config;
+    config.wifi_ssid = "home";
+    config.wifi_pass = "secret";
+    return config;
+  }
+
+  // The first attempt times out, which also opens the portal
+  void failFirstAttempt(WifiManager& wifi)
+  {
+    wifi.begin();
+    host::advance(CONNECT_TIMEOUT_MS);
+    wifi.loop();
+    TEST_ASSERT_EQUAL_STRING("backoff", wifi.stats().state);
+    TEST_ASSERT_TRUE(wifi.isCaptive());
+  }
+
+  std::vector<uint8_t> query(uint16_t type, uint8_t flags = 0x01)
+  {
+    std::vector<uint8_t> q = { 0x12, 0x34, flags, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    const char* labels[] = { "connectivitycheck", "gstatic", "com" };
+    for (const char* l : labels) {
+      q.push_back(strlen(l));
+      q.insert(q.end(), l, l + strlen(l));
+    }
+    q.push_back(0);
+    q.push_back(type >> 8);
+    q.push_back(type & 0xFF);
+    q.push_back(0x00);
+    q.push_back(0x01);
+    return q;
+  }
+
+  // A phone on the portal: sends a query, then the portal's loop runs
+  std::vector<uint8_t> askPortal(WifiManager& wifi, const std::vector<uint8_t>& q)
+  {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_port = htons(TEST_DNS_PORT);
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(fd, q.data(), q.size(), 0, reinterpret_cast<sockaddr*>(&to), sizeof(to));
+    wifi.loop();
+    std::vector<uint8_t> reply(CAPTIVE_DNS_BUFFER_SIZE);
+    pollfd p = { fd, POLLIN, 0 };
+    ssize_t n = poll(&p, 1, 1000) > 0 ? recv(fd, reply.data(), reply.size(), 0) : 0;
+    close(fd);
+    reply.resize(n > 0 ? n : 0);
+    return reply;
+  }
+
+  uint32_t answerAddress(const std::vector<uint8_t>& reply)
+  {
+    const uint8_t* a = reply.data() + reply.size() - 4;
+    return static_cast<uint32_t>(a[0]) << 24 | a[1] << 16 | a[2] << 8 | a[3];
+  }
+}
+
+void setUp()
+{
+  WiFi.reset();
+  host::useVirtualClock(true);
+}
+
+void tearDown() {}
+
+// The core re-associates on its own during the backoff; that link is taken
+// as is rather than dropped by the retry that was still due
+void test_link_that_comes_up_during_backoff_is_kept()
+{
+  Config config = homeNetwork();
+  WifiManager wifi(config, TEST_DNS_PORT);
+  failFirstAttempt(wifi);
+  uint32_t begins = WiFi.begins;
+  uint32_t disconnects = WiFi.disconnects;
+
+  host::advance(1000);
+  WiFi.setStatus(WL_CONNECTED);
+  wifi.loop();
+  TEST_ASSERT_TRUE(wifi.isWifiUp());
+  TEST_ASSERT_FALSE(wifi.isCaptive());
+  TEST_ASSERT_FALSE(WiFi.softAPUp());
+
+  host::advance(FIRST_BACKOFF_MS * 2);
+  wifi.loop();
+  TEST_ASSERT_TRUE(wifi.isWifiUp());
+  TEST_ASSERT_EQUAL_UINT32(begins, WiFi.begins);
+  TEST_ASSERT_EQUAL_UINT32(disconnects, WiFi.disconnects);
+}
+
+// A client on the portal holds a due retry, without a timer spinning, but
+// only for so long
+void test_portal_client_holds_the_retry_for_a_bounded_time()
+{
+  Config config = homeNetwork();
+  WifiManager wifi(config, TEST_DNS_PORT);
+  failFirstAttempt(wifi);
+  WiFi.setStations(1);
+  uint32_t begins = WiFi.begins;
+
+  host::advance(FIRST_BACKOFF_MS);
+  wifi.loop();
+  TEST_ASSERT_EQUAL_UINT32(begins, WiFi.begins);
+  TEST_ASSERT_EQUAL_UINT32(PORTAL_HOLD_MAX_MS, wifi.wakeInMs());
+
+  host::advance(PORTAL_HOLD_MAX_MS);
+  wifi.loop();
+  TEST_ASSERT_EQUAL_UINT32(begins + 1, WiFi.begins);
+  TEST_ASSERT_EQUAL_STRING("connecting", wifi.stats().state);
+}
+
+// Portal DNS is served from a watched socket: the loop needs no poll timer,
+// and every name resolves to the portal
+void test_portal_answers_dns_without_a_poll_timer()
+{
+  Config config = homeNetwork();
+  WifiManager wifi(config, TEST_DNS_PORT);
+  failFirstAttempt(wifi);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, wifi.dnsSocketFd());
+  TEST_ASSERT_EQUAL_UINT32(FIRST_BACKOFF_MS, wifi.wakeInMs());
+
+  std::vector<uint8_t> q = query(1);
+  std::vector<uint8_t> reply = askPortal(wifi, q);
+  TEST_ASSERT_EQUAL(q.size() + 16, reply.size());
+  TEST_ASSERT_EQUAL_HEX8(0x85, reply[2]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, reply[3]);
+  TEST_ASSERT_EQUAL_HEX8(1, reply[7]);
+  TEST_ASSERT_EQUAL_HEX32(PORTAL_IP, answerAddress(reply));
+
+  WiFi.setStatus(WL_CONNECTED);
+  wifi.loop();
+  TEST_ASSERT_EQUAL(-1, wifi.dnsSocketFd());
+}
+
+void test_only_plain_queries_get_answers()
+{
+  uint8_t out[CAPTIVE_DNS_BUFFER_SIZE];
+  std::vector<uint8_t> aaaa = query(28);
+  TEST_ASSERT_EQUAL(aaaa.size(), CaptiveDns::buildReply(aaaa.data(), aaaa.size(), PORTAL_IP, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0, out[7]);
+
+  std::vector<uint8_t> response = query(1, 0x81);
+  TEST_ASSERT_EQUAL(0, CaptiveDns::buildReply(response.data(), response.size(), PORTAL_IP, out, sizeof(out)));
+  std::vector<uint8_t> truncated = query(1);
+  truncated.resize(truncated.size() - 3);
+  TEST_ASSERT_EQUAL(0, CaptiveDns::buildReply(truncated.data(), truncated.size(), PORTAL_IP, out, sizeof(out)));
+  std::vector<uint8_t> a = query(1);
+  TEST_ASSERT_EQUAL(0, CaptiveDns::buildReply(a.data(), a.size(), PORTAL_IP, out, a.size() + 8));
+}
+
+int main(int, char**)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_link_that_comes_up_during_backoff_is_kept);
+  RUN_TEST(test_portal_client_holds_the_retry_for_a_bounded_time);
+  RUN_TEST(test_portal_answers_dns_without_a_poll_timer);
+  RUN_TEST(test_only_plain_queries_get_answers);
+  return UNITY_END();
+}